@@ -0,0 +1,315 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <new>
+
+#include "qoob++.h"
+
+namespace qoob {
+
+namespace {
+
+class error_category : public std::error_category
+{
+public:
+  const char *name () const noexcept override { return "qoob"; }
+  std::string message (int e) const override
+  {
+    return qoob_error_to_string (static_cast<qoob_error_t> (e));
+  }
+};
+
+void
+callback (qoob_sync_callback_t type, int r, int t, void *user_data)
+{
+  auto *f = static_cast<progress_function *> (user_data);
+
+  if (*f)
+    (*f) (type, r, t);
+}
+
+} /* namespace */
+
+const std::error_category &
+category () noexcept
+{
+  static const error_category c;
+  return c;
+}
+
+/* qoob_t does not move as callbacks get pointer to progress */
+struct device::state
+{
+  qoob_t qoob;
+  progress_function progress;
+};
+
+void
+device::state_delete::operator() (state *s) const noexcept
+{
+  qoob_sync_deinit (&s->qoob);
+  delete s;
+}
+
+device::device (std::unique_ptr<state, state_delete> s) noexcept
+  : state_ (std::move (s))
+{
+}
+
+std::vector<std::pair<std::string, std::string>>
+device::find_all (std::error_code &ec)
+{
+  std::vector<std::pair<std::string, std::string>> found;
+  auto s = create (ec, 0);
+
+  if (ec)
+    return found;
+
+  qoob_device_t devices[QOOB_DISCOVER_MAX];
+  int count = 0;
+
+  qoob_discover_all (&s->qoob, devices, QOOB_DISCOVER_MAX, &count);
+  for (int i = 0; i < count; i++) {
+    found.emplace_back (devices[i].bus, devices[i].device);
+  }
+
+  return found;
+}
+
+std::unique_ptr<device::state, device::state_delete>
+device::create (std::error_code &ec, int lock_timeout)
+{
+  std::unique_ptr<state, state_delete> s;
+  auto *raw = new (std::nothrow) state ();
+
+  if (raw == nullptr) {
+    ec = QOOB_ERROR_NO_MEMORY;
+    return s;
+  }
+  if (qoob_sync_init (&raw->qoob) != 0) {
+    delete raw;
+    ec = QOOB_ERROR_NOT_FOUND;
+    return s;
+  }
+  s.reset (raw);
+
+  qoob_sync_lock_timeout_set (&s->qoob, lock_timeout);
+  qoob_sync_set_callback (&s->qoob, callback, &s->progress);
+  ec.clear ();
+
+  return s;
+}
+
+device
+device::open (std::error_code &ec, int lock_timeout)
+{
+  auto s = create (ec, lock_timeout);
+
+  if (ec)
+    return device ();
+
+  ec = qoob_sync_usb_find (&s->qoob);
+  if (!ec)
+    ec = qoob_sync_usb_list (&s->qoob, nullptr);
+  if (ec)
+    return device ();
+
+  return device (std::move (s));
+}
+
+device
+device::open (const std::string &bus,
+              const std::string &dev,
+              std::error_code &ec,
+              int lock_timeout)
+{
+  auto s = create (ec, lock_timeout);
+
+  if (ec)
+    return device ();
+
+  ec = qoob_sync_usb_find_device (&s->qoob, bus.c_str (), dev.c_str ());
+  if (!ec)
+    ec = qoob_sync_usb_list (&s->qoob, nullptr);
+  if (ec)
+    return device ();
+
+  return device (std::move (s));
+}
+
+std::error_code
+device::list () noexcept
+{
+  if (!state_)
+    return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
+
+  return qoob_sync_usb_list (&state_->qoob, nullptr);
+}
+
+slot_table
+device::slots () const noexcept
+{
+  static const qoob_slot_t none[QOOB_PRO_SLOTS] = {};
+
+  return slot_table (state_ ? qoob_sync_slots_get (&state_->qoob) : none);
+}
+
+std::error_code
+device::read (int slot, std::byte *data, std::size_t size) noexcept
+{
+  if (!state_)
+    return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
+
+  return qoob_sync_usb_read_buffer (&state_->qoob,
+                                    reinterpret_cast<char *> (data),
+                                    size,
+                                    static_cast<short int> (slot));
+}
+
+std::error_code
+device::write (int slot,
+               const std::byte *data,
+               std::size_t size,
+               binary_type_t type,
+               const std::string &name) noexcept
+{
+  if (!state_)
+    return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
+
+  qoob_sync_file_format_set (&state_->qoob, type);
+
+  return qoob_sync_usb_write_buffer (&state_->qoob,
+                                     name.c_str (),
+                                     reinterpret_cast<const char *> (data),
+                                     size,
+                                     static_cast<short int> (slot));
+}
+
+std::error_code
+device::write_file (int slot,
+                    const std::string &file,
+                    binary_type_t type) noexcept
+{
+  if (!state_)
+    return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
+
+  qoob_sync_file_format_set (&state_->qoob, type);
+
+  return qoob_sync_usb_write (&state_->qoob, 
+                              const_cast<char *> (file.c_str ()),
+                              static_cast<short int> (slot));
+}
+
+std::error_code
+device::erase (int slot) noexcept
+{
+  if (!state_)
+    return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
+
+  return qoob_sync_usb_erase (&state_->qoob, static_cast<short int> (slot));
+}
+
+std::error_code
+device::erase_forced (int from, int to) noexcept
+{
+  if (!state_)
+    return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
+
+  return qoob_sync_usb_erase_forced (&state_->qoob,
+                                     static_cast<short int> (from),
+                                     static_cast<short int> (to));
+}
+
+std::error_code
+device::verify (int slot,
+                const std::string &file,
+                binary_type_t type,
+                bool read_flash) noexcept
+{
+  qoob_error_t err = QOOB_ERROR_DIGEST_MISSING;
+  /* C API takes non-const file name but does not modify it */
+  char *path = const_cast<char *> (file.c_str ());
+
+  if (!state_)
+    return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
+
+  qoob_sync_file_format_set (&state_->qoob, type);
+
+  if (!read_flash)
+    err = qoob_sync_usb_verify_header (&state_->qoob, path, 
+                                       static_cast<short int> (slot));
+  if (err == QOOB_ERROR_DIGEST_MISSING)
+    err = qoob_sync_usb_verify (&state_->qoob, path, 
+                                static_cast<short int> (slot));
+
+  return err;
+}
+
+std::error_code
+device::minimize (qoob_minimize_t mode) noexcept
+{
+  if (!state_)
+    return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
+
+  return qoob_sync_minimize_set (&state_->qoob, mode);
+}
+
+std::error_code
+device::sparse (bool sparse) noexcept
+{
+  if (!state_)
+    return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
+
+  return qoob_sync_sparse_set (&state_->qoob, 
+                               sparse ? QOOB_TRUE : QOOB_FALSE);
+}
+
+std::error_code
+device::retries (int retries) noexcept
+{
+  if (!state_)
+    return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
+
+  return qoob_sync_retries_set (&state_->qoob, retries);
+}
+
+void
+device::progress (progress_function f)
+{
+  if (state_)
+    state_->progress = std::move (f);
+}
+
+qoob_t *
+device::native () noexcept
+{
+  return state_ ? &state_->qoob : nullptr;
+}
+
+} /* namespace qoob */
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
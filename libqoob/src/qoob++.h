@@ -0,0 +1,270 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _QOOB_PLUSPLUS_H_
+#define _QOOB_PLUSPLUS_H_
+
+/*
+ * C++17 layer over the syncronous API. Span overloads are inline so 
+ * library built as C++20 works with C++17 programs. Device handle owns 
+ * qoob_t and closes it in destructor. Slots are viewed in place, nothing
+ * is allocated for them. Reads and writes use caller's memory. Errors are
+ * std::error_code of qoob::category ().
+ */
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#endif
+
+extern "C" {
+#include "qoob.h"
+}
+
+namespace std {
+template <> struct is_error_code_enum<qoob_error_t> : true_type {};
+}
+
+namespace qoob {
+const std::error_category &category () noexcept;
+}
+
+/* Found by ADL as qoob_error_t is in global namespace */
+inline std::error_code
+make_error_code (qoob_error_t e) noexcept
+{
+  return std::error_code (static_cast<int> (e), qoob::category ());
+}
+
+namespace qoob {
+
+#if __cplusplus >= 202002L && __has_include(<span>)
+using byte_span = std::span<std::byte>;
+using const_byte_span = std::span<const std::byte>;
+#else
+/* Minimal std::span for C++17. Only what device needs. */
+template <typename T>
+class span
+{
+public:
+  constexpr span () noexcept : data_ (nullptr), size_ (0) {}
+  constexpr span (T *data, std::size_t size) noexcept 
+    : data_ (data), size_ (size) {}
+  template <typename C,
+            typename = decltype (std::declval<C &> ().data ()),
+            typename = decltype (std::declval<C &> ().size ())>
+  constexpr span (C &c) noexcept 
+    : data_ (reinterpret_cast<T *> (c.data ())), 
+      size_ (c.size () * sizeof (*c.data ()) / sizeof (T)) {}
+  template <typename U,
+            typename = std::enable_if_t<std::is_same_v<const U, T>>>
+  constexpr span (const span<U> &s) noexcept 
+    : data_ (s.data ()), size_ (s.size ()) {}
+
+  constexpr T *data () const noexcept { return data_; }
+  constexpr std::size_t size () const noexcept { return size_; }
+  constexpr bool empty () const noexcept { return size_ == 0; }
+  constexpr T *begin () const noexcept { return data_; }
+  constexpr T *end () const noexcept { return data_ + size_; }
+  constexpr T &operator[] (std::size_t i) const noexcept { return data_[i]; }
+  constexpr span subspan (std::size_t offset, std::size_t count) const 
+    noexcept { return span (data_ + offset, count); }
+
+private:
+  T *data_;
+  std::size_t size_;
+};
+
+using byte_span = span<std::byte>;
+using const_byte_span = span<const std::byte>;
+#endif
+
+/* One slot of the slot table. Valid until slots are listed again. */
+class slot_view
+{
+public:
+  slot_view (const qoob_slot_t *slot, int number) noexcept 
+    : slot_ (slot), number_ (number) {}
+
+  int number () const noexcept { return number_; }
+  binary_type_t type () const noexcept { return slot_->type; }
+  int slots_used () const noexcept { return slot_->slots_used; }
+  bool first () const noexcept { return slot_->first == QOOB_TRUE; }
+  bool empty () const noexcept 
+    { return first () && type () == QOOB_BINARY_TYPE_VOID; }
+  std::string_view name () const noexcept { return slot_->name; }
+
+  /* Payload length and digest stored by libqoob */
+  bool has_digest () const noexcept { return slot_->has_digest == QOOB_TRUE; }
+  unsigned long length () const noexcept { return slot_->length; }
+  const unsigned char *digest () const noexcept { return slot_->digest; }
+
+  std::size_t bytes () const noexcept 
+    { return static_cast<std::size_t> (slots_used ()) * QOOB_PRO_SLOT_SIZE; }
+
+  const qoob_slot_t &native () const noexcept { return *slot_; }
+
+private:
+  const qoob_slot_t *slot_;
+  int number_;
+};
+
+/* All slots of the device. Iterates slot_views by value. */
+class slot_table
+{
+public:
+  class iterator
+  {
+  public:
+    using value_type = slot_view;
+    using difference_type = std::ptrdiff_t;
+    using iterator_category = std::input_iterator_tag;
+
+    iterator (const qoob_slot_t *slots, int i) noexcept 
+      : slots_ (slots), i_ (i) {}
+    slot_view operator* () const noexcept 
+      { return slot_view (slots_ + i_, i_); }
+    iterator &operator++ () noexcept { i_++; return *this; }
+    bool operator== (const iterator &o) const noexcept { return i_ == o.i_; }
+    bool operator!= (const iterator &o) const noexcept { return i_ != o.i_; }
+
+  private:
+    const qoob_slot_t *slots_;
+    int i_;
+  };
+
+  explicit slot_table (const qoob_slot_t *slots) noexcept : slots_ (slots) {}
+
+  static constexpr int size () noexcept { return QOOB_PRO_SLOTS; }
+  slot_view operator[] (int i) const noexcept 
+    { return slot_view (slots_ + i, i); }
+  iterator begin () const noexcept { return iterator (slots_, 0); }
+  iterator end () const noexcept { return iterator (slots_, size ()); }
+
+private:
+  const qoob_slot_t *slots_;
+};
+
+using progress_function = std::function<void (qoob_sync_callback_t type,
+                                              int progress,
+                                              int total)>;
+
+/*
+ * Opened Qoob Pro. Move only. Interface and device lock are released in
+ * destructor. Empty handle is false.
+ */
+class device
+{
+public:
+  device () noexcept = default;
+  device (device &&) noexcept = default;
+  device &operator= (device &&) noexcept = default;
+  device (const device &) = delete;
+  device &operator= (const device &) = delete;
+  ~device () = default;
+
+  /* Bus and device names of every Qoob Pro plugged in */
+  static std::vector<std::pair<std::string, std::string>> 
+  find_all (std::error_code &ec);
+
+  /* First Qoob Pro found, or the one at bus and device, e.g. "001" "004" */
+  static device open (std::error_code &ec, int lock_timeout = -1);
+  static device open (const std::string &bus,
+                      const std::string &dev,
+                      std::error_code &ec,
+                      int lock_timeout = -1);
+
+  explicit operator bool () const noexcept { return state_ != nullptr; }
+
+  /* Reads slot information again. Slot views are updated in place. */
+  std::error_code list () noexcept;
+  slot_table slots () const noexcept;
+
+  /* Reads application at slot to out. out has to be slots().bytes ()
+     long at least. */
+  std::error_code read (int slot, byte_span out) noexcept
+    { return read (slot, out.data (), out.size ()); }
+  std::error_code read (int slot, std::byte *data, std::size_t size) noexcept;
+
+  /* Writes data of type to slot. ELF and DOL get GCB header and name
+     from name. GCB is written without copying. */
+  std::error_code write (int slot,
+                         const_byte_span data,
+                         binary_type_t type,
+                         const std::string &name = "") noexcept
+    { return write (slot, data.data (), data.size (), type, name); }
+  std::error_code write (int slot,
+                         const std::byte *data,
+                         std::size_t size,
+                         binary_type_t type,
+                         const std::string &name = "") noexcept;
+  std::error_code write_file (int slot,
+                              const std::string &file,
+                              binary_type_t type) noexcept;
+
+  std::error_code erase (int slot) noexcept;
+  std::error_code erase_forced (int from, int to) noexcept;
+
+  /* Header digest is used if there is one, otherwise flash is read.
+     read_flash compares flash content always. */
+  std::error_code verify (int slot,
+                          const std::string &file,
+                          binary_type_t type,
+                          bool read_flash = false) noexcept;
+
+  std::error_code minimize (qoob_minimize_t mode) noexcept;
+  std::error_code sparse (bool sparse) noexcept;
+  std::error_code retries (int retries) noexcept;
+  void progress (progress_function f);
+
+  qoob_t *native () noexcept;
+
+private:
+  struct state;
+  struct state_delete { void operator() (state *s) const noexcept; };
+
+  explicit device (std::unique_ptr<state, state_delete> s) noexcept;
+  static std::unique_ptr<state, state_delete> create (std::error_code &ec,
+                                                      int lock_timeout);
+
+  std::unique_ptr<state, state_delete> state_;
+};
+
+} /* namespace qoob */
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
@@ -0,0 +1,353 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <zlib.h>
+
+#include "qoob-archive.h"
+
+#define ARCHIVE_MAGIC "QARC"
+#define HEADER_SIZE 8
+#define ENTRY_SIZE (12+QOOB_DIGEST_SIZE)
+#define INDEX_SIZE (ENTRY_SIZE*QOOB_PRO_SLOTS)
+#define FOOTER_SIZE 8
+
+#define ENTRY_PRESENT 0x01
+
+static qoob_boolean_t write_all (int fd, const void *data, size_t size);
+static qoob_boolean_t read_at (int fd, 
+                               void *data, 
+                               size_t size, 
+                               off_t offset);
+static void put32 (unsigned char *p, unsigned long v);
+static unsigned long get32 (const unsigned char *p);
+
+/* Starts archive to fd. Nothing is read from fd so it can be a pipe. */
+qoob_error_t
+qoob_archive_create (qoob_archive_t *archive, int fd)
+{
+  unsigned char header[HEADER_SIZE];
+
+  if (archive == NULL || fd < 0) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  memset (archive, 0, sizeof (*archive));
+  archive->fd = fd;
+  archive->writing = QOOB_TRUE;
+
+  memset (header, 0, sizeof (header));
+  memcpy (header, ARCHIVE_MAGIC, 4);
+  header[4] = QOOB_ARCHIVE_VERSION;
+  if (write_all (fd, header, sizeof (header)) != QOOB_TRUE) {
+    return QOOB_ERROR_FD_WRITE;
+  }
+  archive->offset = HEADER_SIZE;
+
+  return QOOB_ERROR_OK;
+}
+
+/*
+ * Compresses one slot, QOOB_PRO_SLOT_SIZE bytes of data, to archive. App
+ * is first slot of the application which has slots_used slots.
+ */
+qoob_error_t
+qoob_archive_add_slot (qoob_archive_t *archive,
+                       short int slot,
+                       short int app,
+                       unsigned short int slots_used,
+                       const char *data)
+{
+  qoob_archive_slot_t *s;
+  unsigned char *packed;
+  uLongf size;
+  size_t i;
+
+  if (archive == NULL || archive->writing != QOOB_TRUE || data == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  if (slot < 0 || slot >= QOOB_PRO_SLOTS) {
+    return QOOB_ERROR_SLOT_OUT_OF_RANGE;
+  }
+
+  s = &archive->slot[slot];
+  s->present = QOOB_TRUE;
+  s->app = app;
+  s->slots_used = slots_used;
+  s->offset = archive->offset;
+  s->size = 0;
+  qoob_digest_buffer (data, QOOB_PRO_SLOT_SIZE, s->digest);
+
+  /* Erased slot is known from its digest only */
+  for (i=0; i<QOOB_PRO_SLOT_SIZE; i++) {
+    if ((unsigned char)data[i] != QOOB_PRO_ERASED_BYTE)
+      break;
+  }
+  if (i == QOOB_PRO_SLOT_SIZE) {
+    return QOOB_ERROR_OK;
+  }
+
+  size = compressBound (QOOB_PRO_SLOT_SIZE);
+  packed = (unsigned char *)malloc (size);
+  if (packed == NULL) {
+    return QOOB_ERROR_NO_MEMORY;
+  }
+
+  if (compress2 (packed, &size, (const Bytef *)data, QOOB_PRO_SLOT_SIZE, 
+                 Z_BEST_COMPRESSION) != Z_OK) {
+    free (packed);
+    return QOOB_ERROR_NO_MEMORY;
+  }
+
+  if (write_all (archive->fd, packed, size) != QOOB_TRUE) {
+    free (packed);
+    return QOOB_ERROR_FD_WRITE;
+  }
+  free (packed);
+
+  s->size = size;
+  archive->offset += size;
+
+  return QOOB_ERROR_OK;
+}
+
+/* Writes index. Archive is not usable before this. fd is not closed. */
+qoob_error_t
+qoob_archive_finish (qoob_archive_t *archive)
+{
+  unsigned char index[INDEX_SIZE+FOOTER_SIZE];
+  int i;
+
+  if (archive == NULL || archive->writing != QOOB_TRUE) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  memset (index, 0, sizeof (index));
+  for (i=0; i<QOOB_PRO_SLOTS; i++) {
+    const qoob_archive_slot_t *s = &archive->slot[i];
+    unsigned char *e = index + i*ENTRY_SIZE;
+
+    if (s->present != QOOB_TRUE)
+      continue;
+
+    e[0] = ENTRY_PRESENT;
+    e[1] = (unsigned char)s->app;
+    e[2] = (unsigned char)s->slots_used;
+    put32 (e+4, s->offset);
+    put32 (e+8, s->size);
+    memcpy (e+12, s->digest, QOOB_DIGEST_SIZE);
+  }
+  put32 (index+INDEX_SIZE, archive->offset);
+  memcpy (index+INDEX_SIZE+4, ARCHIVE_MAGIC, 4);
+
+  if (write_all (archive->fd, index, sizeof (index)) != QOOB_TRUE) {
+    return QOOB_ERROR_FD_WRITE;
+  }
+  archive->writing = QOOB_FALSE;
+
+  return QOOB_ERROR_OK;
+}
+
+/* Reads index of the archive. Slots are read when they are asked. */
+qoob_error_t
+qoob_archive_open (qoob_archive_t *archive, int fd)
+{
+  unsigned char header[HEADER_SIZE];
+  unsigned char index[INDEX_SIZE+FOOTER_SIZE];
+  off_t end;
+  int i;
+
+  if (archive == NULL || fd < 0) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  memset (archive, 0, sizeof (*archive));
+  archive->fd = fd;
+
+  end = lseek (fd, 0, SEEK_END);
+  if (end < 0) {
+    return QOOB_ERROR_FD_SEEK;
+  }
+  if (end < HEADER_SIZE+INDEX_SIZE+FOOTER_SIZE) {
+    return QOOB_ERROR_ARCHIVE_NOT_VALID;
+  }
+
+  if (read_at (fd, header, sizeof (header), 0) != QOOB_TRUE ||
+      read_at (fd, index, sizeof (index), 
+               end-INDEX_SIZE-FOOTER_SIZE) != QOOB_TRUE) {
+    return QOOB_ERROR_FD_READ;
+  }
+
+  /* Index is right after compressed slots */
+  archive->offset = (unsigned long)(end-INDEX_SIZE-FOOTER_SIZE);
+  if (memcmp (header, ARCHIVE_MAGIC, 4) != 0 ||
+      header[4] != QOOB_ARCHIVE_VERSION ||
+      memcmp (index+INDEX_SIZE+4, ARCHIVE_MAGIC, 4) != 0 ||
+      get32 (index+INDEX_SIZE) != archive->offset) {
+    return QOOB_ERROR_ARCHIVE_NOT_VALID;
+  }
+
+  for (i=0; i<QOOB_PRO_SLOTS; i++) {
+    qoob_archive_slot_t *s = &archive->slot[i];
+    const unsigned char *e = index + i*ENTRY_SIZE;
+
+    if (!(e[0] & ENTRY_PRESENT))
+      continue;
+
+    s->present = QOOB_TRUE;
+    s->app = e[1];
+    s->slots_used = e[2];
+    s->offset = get32 (e+4);
+    s->size = get32 (e+8);
+    memcpy (s->digest, e+12, QOOB_DIGEST_SIZE);
+
+    if (s->app > i || s->app + s->slots_used <= i ||
+        s->offset + s->size > archive->offset) {
+      return QOOB_ERROR_ARCHIVE_NOT_VALID;
+    }
+  }
+
+  return QOOB_ERROR_OK;
+}
+
+/*
+ * Uncompresses one slot to data which has room for QOOB_PRO_SLOT_SIZE 
+ * bytes. Content is checked against digest of the index.
+ */
+qoob_error_t
+qoob_archive_read_slot (qoob_archive_t *archive,
+                        short int slot,
+                        char *data)
+{
+  const qoob_archive_slot_t *s;
+  unsigned char digest[QOOB_DIGEST_SIZE];
+  unsigned char *packed;
+  uLongf size = QOOB_PRO_SLOT_SIZE;
+  int ret;
+
+  if (archive == NULL || archive->writing == QOOB_TRUE || data == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  if (slot < 0 || slot >= QOOB_PRO_SLOTS) {
+    return QOOB_ERROR_SLOT_OUT_OF_RANGE;
+  }
+
+  s = &archive->slot[slot];
+  if (s->present != QOOB_TRUE) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  if (s->size == 0) {
+    memset (data, QOOB_PRO_ERASED_BYTE, QOOB_PRO_SLOT_SIZE);
+  } else {
+    packed = (unsigned char *)malloc (s->size);
+    if (packed == NULL) {
+      return QOOB_ERROR_NO_MEMORY;
+    }
+    if (read_at (archive->fd, packed, s->size, (off_t)s->offset) != 
+        QOOB_TRUE) {
+      free (packed);
+      return QOOB_ERROR_FD_READ;
+    }
+    ret = uncompress ((Bytef *)data, &size, packed, s->size);
+    free (packed);
+    if (ret != Z_OK || size != QOOB_PRO_SLOT_SIZE) {
+      return QOOB_ERROR_ARCHIVE_NOT_VALID;
+    }
+  }
+
+  qoob_digest_buffer (data, QOOB_PRO_SLOT_SIZE, digest);
+  if (memcmp (digest, s->digest, QOOB_DIGEST_SIZE) != 0) {
+    return QOOB_ERROR_ARCHIVE_NOT_VALID;
+  }
+
+  return QOOB_ERROR_OK;
+}
+
+/* Static functions */
+static qoob_boolean_t
+write_all (int fd, const void *data, size_t size)
+{
+  const char *p = (const char *)data;
+
+  while (size > 0) {
+    ssize_t r = write (fd, p, size);
+
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return QOOB_FALSE;
+    p += r;
+    size -= (size_t)r;
+  }
+
+  return QOOB_TRUE;
+}
+
+static qoob_boolean_t
+read_at (int fd, void *data, size_t size, off_t offset)
+{
+  char *p = (char *)data;
+
+  while (size > 0) {
+    ssize_t r = pread (fd, p, size, offset);
+
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return QOOB_FALSE;
+    p += r;
+    size -= (size_t)r;
+    offset += r;
+  }
+
+  return QOOB_TRUE;
+}
+
+static void
+put32 (unsigned char *p, unsigned long v)
+{
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+  p[2] = (v >> 16) & 0xff;
+  p[3] = (v >> 24) & 0xff;
+}
+
+static unsigned long
+get32 (const unsigned char *p)
+{
+  return (unsigned long)p[0] | ((unsigned long)p[1] << 8) |
+    ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
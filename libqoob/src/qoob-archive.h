@@ -0,0 +1,86 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "qoob-defaults.h"
+#include "qoob-error.h"
+#include "qoob-digest.h"
+
+#ifndef _QOOB_ARCHIVE_H_
+#define _QOOB_ARCHIVE_H_
+
+/*
+ * Backup archive of flash slots. Every slot is compressed alone with zlib
+ * so one application can be taken out without the rest. Erased slots take
+ * no room. Index with SHA-256 of every slot is at the end, so archive can
+ * be written to a pipe as slots are read from the chip. Opening needs a 
+ * seekable file.
+ *
+ *   "QARC" version reserved[3]
+ *   compressed slots
+ *   index: 32 * (flags app slots_used reserved offset size digest[32])
+ *   index offset, "QARC"
+ *
+ * Numbers are little endian, 32 bits for offsets and sizes.
+ */
+
+#define QOOB_ARCHIVE_VERSION 1
+
+typedef struct QoobArchiveSlot qoob_archive_slot_t;
+struct QoobArchiveSlot
+{
+  qoob_boolean_t present;           /* Slot is in archive */
+  short int app;                    /* First slot of its application */
+  unsigned short int slots_used;    /* Slots of the application */
+  unsigned long offset;             /* Compressed data in archive */
+  unsigned long size;               /* Compressed size, 0 if erased */
+  unsigned char digest[QOOB_DIGEST_SIZE];
+};
+
+typedef struct QoobArchive qoob_archive_t;
+struct QoobArchive
+{
+  int fd;
+  qoob_boolean_t writing;
+  unsigned long offset;             /* End of written data */
+  qoob_archive_slot_t slot[QOOB_PRO_SLOTS];
+};
+
+qoob_error_t qoob_archive_create (qoob_archive_t *archive, int fd);
+qoob_error_t qoob_archive_add_slot (qoob_archive_t *archive,
+                                    short int slot,
+                                    short int app,
+                                    unsigned short int slots_used,
+                                    const char *data);
+qoob_error_t qoob_archive_finish (qoob_archive_t *archive);
+qoob_error_t qoob_archive_open (qoob_archive_t *archive, int fd);
+qoob_error_t qoob_archive_read_slot (qoob_archive_t *archive,
+                                     short int slot,
+                                     char *data);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
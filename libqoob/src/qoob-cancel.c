@@ -0,0 +1,108 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stddef.h>
+
+#include "qoob-cancel.h"
+
+void
+qoob_cancel_init (qoob_cancel_t *cancel)
+{
+  if (cancel == NULL)
+    return;
+
+  cancel->cancelled = 0;
+  cancel->has_deadline = QOOB_FALSE;
+  cancel->deadline.tv_sec = 0;
+  cancel->deadline.tv_nsec = 0;
+}
+
+/* Async signal safe */
+void
+qoob_cancel_request (qoob_cancel_t *cancel)
+{
+  if (cancel != NULL)
+    cancel->cancelled = 1;
+}
+
+/* Deadline is timeout milliseconds from now. Negative removes it. */
+void
+qoob_cancel_deadline_set (qoob_cancel_t *cancel, int timeout)
+{
+  if (cancel == NULL)
+    return;
+
+  if (timeout < 0) {
+    cancel->has_deadline = QOOB_FALSE;
+    return;
+  }
+
+  clock_gettime (CLOCK_MONOTONIC, &cancel->deadline);
+  cancel->deadline.tv_sec += timeout / 1000;
+  cancel->deadline.tv_nsec += (long)(timeout % 1000) * 1000000L;
+  if (cancel->deadline.tv_nsec >= 1000000000L) {
+    cancel->deadline.tv_sec++;
+    cancel->deadline.tv_nsec -= 1000000000L;
+  }
+  cancel->has_deadline = QOOB_TRUE;
+}
+
+/* QOOB_ERROR_CANCELLED, QOOB_ERROR_DEADLINE or QOOB_ERROR_OK to go on */
+qoob_error_t
+qoob_cancel_check (const qoob_cancel_t *cancel)
+{
+  if (cancel == NULL)
+    return QOOB_ERROR_OK;
+
+  if (cancel->cancelled)
+    return QOOB_ERROR_CANCELLED;
+
+  if (cancel->has_deadline == QOOB_TRUE && 
+      qoob_cancel_remaining (cancel) == 0)
+    return QOOB_ERROR_DEADLINE;
+
+  return QOOB_ERROR_OK;
+}
+
+/* Milliseconds to deadline, 0 if passed and -1 if there is none */
+int
+qoob_cancel_remaining (const qoob_cancel_t *cancel)
+{
+  struct timespec now;
+  long ms;
+
+  if (cancel == NULL || cancel->has_deadline == QOOB_FALSE)
+    return -1;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  ms = (cancel->deadline.tv_sec - now.tv_sec) * 1000L +
+    (cancel->deadline.tv_nsec - now.tv_nsec) / 1000000L;
+
+  return ms > 0 ? (int)ms : 0;
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
@@ -0,0 +1,60 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <signal.h>
+#include <time.h>
+
+#include "qoob-defaults.h"
+#include "qoob-error.h"
+
+#ifndef _QOOB_CANCEL_H_
+#define _QOOB_CANCEL_H_
+
+/*
+ * Cancellation token. Operations check it before every data packet and
+ * end device session cleanly when it is cancelled or deadline passes.
+ * qoob_cancel_request () may be called from other thread or signal
+ * handler.
+ */
+
+typedef struct QoobCancel qoob_cancel_t;
+struct QoobCancel
+{
+  volatile sig_atomic_t cancelled;
+  qoob_boolean_t has_deadline;
+  struct timespec deadline;         /* CLOCK_MONOTONIC */
+};
+
+void qoob_cancel_init (qoob_cancel_t *cancel);
+void qoob_cancel_request (qoob_cancel_t *cancel);
+void qoob_cancel_deadline_set (qoob_cancel_t *cancel, int timeout);
+qoob_error_t qoob_cancel_check (const qoob_cancel_t *cancel);
+int qoob_cancel_remaining (const qoob_cancel_t *cancel);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
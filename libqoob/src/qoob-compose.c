@@ -0,0 +1,238 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "qoob-file.h"
+#include "qoob-image.h"
+#include "qoob-sync.h"
+#include "qoob-sync-usb.h"
+#include "qoob-compose.h"
+
+/* Erased flash without applications */
+qoob_error_t
+qoob_compose_init (qoob_compose_t *compose)
+{
+  if (compose == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  compose->image = (char *)malloc (QOOB_PRO_TOTAL_SIZE);
+  if (compose->image == NULL) {
+    return QOOB_ERROR_NO_MEMORY;
+  }
+  memset (compose->image, QOOB_PRO_ERASED_BYTE, QOOB_PRO_TOTAL_SIZE);
+  compose->used = 0;
+
+  return QOOB_ERROR_OK;
+}
+
+/*
+ * qoob_compose_add ()
+ *
+ *   input: compose - image to add to
+ *          qoob - handle which gives minimize mode. No device is needed.
+ *          slot - first slot of the application
+ *          type - ELF, DOL or GCB. VOID is detected from content.
+ *          file - file to add
+ *
+ * Makes the same GCB image write would put to flash and places it to 
+ * slot. Slots of other applications in the image can not be used.
+ */
+qoob_error_t
+qoob_compose_add (qoob_compose_t *compose,
+                  qoob_t *qoob,
+                  short int slot,
+                  binary_type_t type,
+                  const char *file)
+{
+  char *data = NULL;
+  size_t size = 0;
+  qoob_error_t err;
+
+  if (file == NULL) {
+    return QOOB_ERROR_FILE_NOT_VALID;
+  }
+
+  err = qoob_image_load (file, &data, &size);
+  if (err != QOOB_ERROR_OK) {
+    return err;
+  }
+
+  err = qoob_compose_add_buffer (compose, qoob, slot, type, file, 
+                                 data, size);
+  free (data);
+
+  return err;
+}
+
+/* Same as qoob_compose_add (), name is used in made header */
+qoob_error_t
+qoob_compose_add_buffer (qoob_compose_t *compose,
+                         qoob_t *qoob,
+                         short int slot,
+                         binary_type_t type,
+                         const char *name,
+                         const char *buffer,
+                         size_t size)
+{
+  char *image = NULL;
+  size_t image_size = 0;
+  binary_type_t saved;
+  unsigned long mask = 0;
+  int used_slots;
+  qoob_error_t err;
+  int i;
+
+  if (compose == NULL || compose->image == NULL || qoob == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  if (name == NULL || buffer == NULL || size == 0) {
+    return QOOB_ERROR_FILE_NOT_VALID;
+  }
+
+  if (slot >= QOOB_PRO_SLOTS || slot < 0) {
+    return QOOB_ERROR_SLOT_OUT_OF_RANGE;
+  }
+
+  if (type == QOOB_BINARY_TYPE_VOID) {
+    qoob_file_format_parse_buffer (buffer, size, size, &type);
+  }
+  if (type == QOOB_BINARY_TYPE_CONFIG) {
+    type = QOOB_BINARY_TYPE_GCB;
+  }
+  if (type == QOOB_BINARY_TYPE_VOID) {
+    return QOOB_ERROR_NOT_SUPPORTED_FILE_FORMAT;
+  }
+
+  /* Format of the handle is kept as it was */
+  qoob_sync_file_format_get (qoob, &saved);
+  qoob_sync_file_format_set (qoob, type);
+  err = qoob_sync_usb_image (qoob, name, buffer, size, &image, &image_size);
+  qoob_sync_file_format_set (qoob, saved);
+  if (err != QOOB_ERROR_OK) {
+    return err;
+  }
+
+  used_slots = qoob_file_slots_needed (QOOB_BINARY_TYPE_GCB, image_size);
+  if (slot+used_slots > QOOB_PRO_SLOTS) {
+    free (image);
+    return QOOB_ERROR_TOO_BIG_DATA;
+  }
+
+  for (i=slot; i<slot+used_slots; i++) {
+    mask |= 1UL << i;
+  }
+  if (compose->used & mask) {
+    free (image);
+    return QOOB_ERROR_TRYING_TO_OVERWRITE;
+  }
+
+  memcpy (compose->image + (size_t)slot*QOOB_PRO_SLOT_SIZE, 
+          image, 
+          image_size);
+  compose->used |= mask;
+  free (image);
+
+  return QOOB_ERROR_OK;
+}
+
+/*
+ * Adds every entry of the layout. Slot counts of the layout are checked
+ * again with made images. Index of failed entry is put to entry, -1 if 
+ * none failed.
+ */
+qoob_error_t
+qoob_compose_layout (qoob_compose_t *compose,
+                     qoob_t *qoob,
+                     const qoob_layout_t *layout,
+                     int *entry)
+{
+  int i;
+
+  if (entry != NULL)
+    *entry = -1;
+
+  if (layout == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  for (i=0; i<layout->count; i++) {
+    const qoob_layout_entry_t *e = &layout->entries[i];
+    qoob_error_t err;
+
+    err = qoob_compose_add (compose, qoob, e->slot, e->type, e->file);
+    if (err != QOOB_ERROR_OK) {
+      if (entry != NULL)
+        *entry = i;
+      return err;
+    }
+  }
+
+  return QOOB_ERROR_OK;
+}
+
+qoob_error_t
+qoob_compose_save_fd (const qoob_compose_t *compose, 
+                      int fd)
+{
+  size_t done = 0;
+
+  if (compose == NULL || compose->image == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  while (done < QOOB_PRO_TOTAL_SIZE) {
+    ssize_t n = write (fd, compose->image+done, QOOB_PRO_TOTAL_SIZE-done);
+
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      return QOOB_ERROR_FD_WRITE;
+    }
+    done += (size_t)n;
+  }
+
+  return QOOB_ERROR_OK;
+}
+
+void
+qoob_compose_free (qoob_compose_t *compose)
+{
+  if (compose == NULL)
+    return;
+
+  free (compose->image);
+  compose->image = NULL;
+  compose->used = 0;
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
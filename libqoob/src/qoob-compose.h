@@ -0,0 +1,73 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stddef.h>
+
+#include "qoob-struct.h"
+#include "qoob-error.h"
+#include "qoob-layout.h"
+
+#ifndef _QOOB_COMPOSE_H_
+#define _QOOB_COMPOSE_H_
+
+/*
+ * Whole flash image composed offline. Applications are placed to their
+ * slots as write would put them, with the same header, and the rest is
+ * erased. Image can be written to a chip sequentially as it is.
+ */
+
+typedef struct QoobCompose qoob_compose_t;
+struct QoobCompose
+{
+  char *image;                /* QOOB_PRO_TOTAL_SIZE bytes */
+  unsigned long used;         /* Bit per slot which has an application */
+};
+
+qoob_error_t qoob_compose_init (qoob_compose_t *compose);
+qoob_error_t qoob_compose_add (qoob_compose_t *compose,
+                               qoob_t *qoob,
+                               short int slot,
+                               binary_type_t type,
+                               const char *file);
+qoob_error_t qoob_compose_add_buffer (qoob_compose_t *compose,
+                                      qoob_t *qoob,
+                                      short int slot,
+                                      binary_type_t type,
+                                      const char *name,
+                                      const char *buffer,
+                                      size_t size);
+qoob_error_t qoob_compose_layout (qoob_compose_t *compose,
+                                  qoob_t *qoob,
+                                  const qoob_layout_t *layout,
+                                  int *entry);
+qoob_error_t qoob_compose_save_fd (const qoob_compose_t *compose, 
+                                   int fd);
+void qoob_compose_free (qoob_compose_t *compose);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
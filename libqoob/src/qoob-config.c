@@ -0,0 +1,150 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "qoob-config.h"
+
+/*
+ * Takes config slot content. Data shorter than slot is padded as erased
+ * flash. Slot is not known here, see qoob_sync_usb_config_read ().
+ */
+qoob_error_t
+qoob_config_parse (qoob_config_t *config,
+                   const char *data,
+                   size_t size)
+{
+  if (config == NULL || data == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  if (size > QOOB_PRO_SLOT_SIZE) {
+    return QOOB_ERROR_TOO_BIG_DATA;
+  }
+
+  if (size < QOOB_CONFIG_MAGIC_SIZE ||
+      memcmp (data, QOOB_CONFIG_MAGIC, QOOB_CONFIG_MAGIC_SIZE) != 0) {
+    return QOOB_ERROR_NOT_SUPPORTED_FILE_FORMAT;
+  }
+
+  memcpy (config->data, data, size);
+  memset (config->data+size, QOOB_PRO_ERASED_BYTE, QOOB_PRO_SLOT_SIZE-size);
+  config->slot = -1;
+  config->changed = QOOB_FALSE;
+
+  return QOOB_ERROR_OK;
+}
+
+/* "OFFSET[:u8|u16|u32]". Offset is decimal, octal or hex like in C. */
+qoob_error_t
+qoob_config_key_parse (const char *str,
+                       qoob_config_key_t *key)
+{
+  char *end;
+
+  if (str == NULL || key == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  if (*str < '0' || *str > '9') {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  key->offset = strtoul (str, &end, 0);
+  key->width = 1;
+  if (strcmp (end, "") == 0 || strcmp (end, ":u8") == 0) {
+    key->width = 1;
+  } else if (strcmp (end, ":u16") == 0) {
+    key->width = 2;
+  } else if (strcmp (end, ":u32") == 0) {
+    key->width = 4;
+  } else {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  if (key->offset > QOOB_PRO_SLOT_SIZE - key->width) {
+    return QOOB_ERROR_SLOT_OUT_OF_RANGE;
+  }
+
+  return QOOB_ERROR_OK;
+}
+
+qoob_error_t
+qoob_config_get (const qoob_config_t *config,
+                 const qoob_config_key_t *key,
+                 unsigned long *value)
+{
+  int i;
+
+  if (config == NULL || key == NULL || value == NULL ||
+      key->offset > QOOB_PRO_SLOT_SIZE - key->width) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  *value = 0;
+  for (i=0; i<key->width; i++) {
+    *value = (*value << 8) | (unsigned char)config->data[key->offset+i];
+  }
+
+  return QOOB_ERROR_OK;
+}
+
+/* Magic can not be changed. Value has to fit to width of the key. */
+qoob_error_t
+qoob_config_set (qoob_config_t *config,
+                 const qoob_config_key_t *key,
+                 unsigned long value)
+{
+  unsigned long old;
+  int i;
+
+  if (config == NULL || key == NULL ||
+      key->offset > QOOB_PRO_SLOT_SIZE - key->width ||
+      key->offset < QOOB_CONFIG_MAGIC_SIZE) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  if (key->width < 4 && value >> (key->width*8) != 0) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  qoob_config_get (config, key, &old);
+  if (old == value) {
+    return QOOB_ERROR_OK;
+  }
+
+  for (i=key->width-1; i>=0; i--) {
+    config->data[key->offset+i] = (char)(value & 0xff);
+    value >>= 8;
+  }
+  config->changed = QOOB_TRUE;
+
+  return QOOB_ERROR_OK;
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
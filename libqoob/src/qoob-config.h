@@ -0,0 +1,75 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stddef.h>
+
+#include "qoob-defaults.h"
+#include "qoob-error.h"
+
+#ifndef _QOOB_CONFIG_H_
+#define _QOOB_CONFIG_H_
+
+/*
+ * Config slot of Qoob BIOS. It starts with "QCFG" and is one slot long.
+ * Meaning of the settings is not known, so values are addressed by 
+ * offset and width. Values are big endian as on GameCube. Key is 
+ * "OFFSET[:u8|u16|u32]", e.g. "0x24:u16". Default width is u8.
+ */
+
+#define QOOB_CONFIG_MAGIC "QCFG"
+#define QOOB_CONFIG_MAGIC_SIZE 4
+
+typedef struct QoobConfigKey qoob_config_key_t;
+struct QoobConfigKey
+{
+  unsigned long offset;
+  int width;                        /* Bytes: 1, 2 or 4 */
+};
+
+typedef struct QoobConfig qoob_config_t;
+struct QoobConfig
+{
+  short int slot;                   /* Slot where config was read */
+  qoob_boolean_t changed;           /* Set since parse */
+  char data[QOOB_PRO_SLOT_SIZE];    /* Whole slot as it is in flash */
+};
+
+qoob_error_t qoob_config_parse (qoob_config_t *config,
+                                const char *data,
+                                size_t size);
+qoob_error_t qoob_config_key_parse (const char *str,
+                                    qoob_config_key_t *key);
+qoob_error_t qoob_config_get (const qoob_config_t *config,
+                              const qoob_config_key_t *key,
+                              unsigned long *value);
+qoob_error_t qoob_config_set (qoob_config_t *config,
+                              const qoob_config_key_t *key,
+                              unsigned long value);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
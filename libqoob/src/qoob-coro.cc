@@ -0,0 +1,395 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <errno.h>
+#include <poll.h>
+
+#include <cstdint>
+
+#include "qoob-coro.h"
+
+namespace qoob {
+
+void
+loop::spawn (task<void> t)
+{
+  auto h = t.handle ();
+
+  tasks_.push_back (std::move (t));
+  post (h);
+}
+
+void
+loop::post (std::coroutine_handle<> h)
+{
+  ready_.push_back ([h] { h.resume (); });
+}
+
+void
+loop::queue (std::function<void ()> f)
+{
+  ready_.push_back (std::move (f));
+}
+
+void
+loop::watch (int fd, 
+             short events, 
+             int timeout, 
+             std::function<void (int)> ready)
+{
+  watcher w;
+
+  w.fd = fd;
+  w.events = events;
+  w.forever = timeout < 0;
+  w.deadline = std::chrono::steady_clock::now () + 
+    std::chrono::milliseconds (timeout < 0 ? 0 : timeout);
+  w.ready = std::move (ready);
+  watchers_.push_back (std::move (w));
+}
+
+void
+loop::run ()
+{
+  while (!ready_.empty () || !watchers_.empty ()) {
+    std::function<void ()> f;
+
+    if (ready_.empty ()) {
+      poll_watchers ();
+      continue;
+    }
+
+    f = std::move (ready_.front ());
+    ready_.pop_front ();
+    f ();
+
+    /* Done tasks are dropped, first exception is thrown */
+    for (auto i = tasks_.begin (); i != tasks_.end ();) {
+      if (i->done ()) {
+        task<void> t = std::move (*i);
+
+        i = tasks_.erase (i);
+        t.await_resume ();
+      } else {
+        i++;
+      }
+    }
+  }
+}
+
+/* One poll () for all watched fds. Ready and timed out ones are queued. */
+void
+loop::poll_watchers ()
+{
+  std::vector<struct pollfd> fds;
+  auto now = std::chrono::steady_clock::now ();
+  int timeout = -1;
+  int r, err;
+  std::size_t i, kept = 0;
+
+  for (auto &w : watchers_) {
+    fds.push_back ({w.fd, w.events, 0});
+    if (!w.forever) {
+      auto left = std::chrono::ceil<std::chrono::milliseconds> 
+        (w.deadline - now).count ();
+
+      if (left < 0)
+        left = 0;
+      if (timeout < 0 || left < timeout)
+        timeout = static_cast<int> (left);
+    }
+  }
+
+  r = ::poll (fds.data (), fds.size (), timeout);
+  err = errno;
+  if (r < 0 && err == EINTR)
+    return;
+
+  now = std::chrono::steady_clock::now ();
+  for (i = 0; i < watchers_.size (); i++) {
+    watcher &w = watchers_[i];
+    int result;
+
+    if (r < 0) {
+      result = -1;
+    } else if (fds[i].revents != 0) {
+      result = 1;
+    } else if (!w.forever && now >= w.deadline) {
+      result = 0;
+    } else {
+      if (kept != i)
+        watchers_[kept] = std::move (w);
+      kept++;
+      continue;
+    }
+
+    ready_.push_back ([f = std::move (w.ready), result, err] {
+      errno = err;
+      f (result);
+    });
+  }
+  watchers_.resize (kept);
+}
+
+/* Device operations are noexcept, nothing is thrown out of the fiber */
+void
+async_device::operation::await_suspend (std::coroutine_handle<> h)
+{
+  device_.submit ([this, h] {
+    loop &l = device_.loop_;
+
+    result_ = f_ (device_.device_);
+    /* Operation belongs to the coroutine, not touched after this */
+    l.post (h);
+  });
+}
+
+async_device::async_device (loop &l, 
+                            device d, 
+                            std::string bus, 
+                            std::string name)
+  : loop_ (l), 
+    device_ (std::move (d)), 
+    bus_ (std::move (bus)), 
+    name_ (std::move (name)),
+    stack_ (new char[stack_size])
+{
+  std::uintptr_t self = reinterpret_cast<std::uintptr_t> (this);
+
+  getcontext (&fiber_);
+  fiber_.uc_stack.ss_sp = stack_.get ();
+  fiber_.uc_stack.ss_size = stack_size;
+  fiber_.uc_link = nullptr;
+  /* makecontext () passes only ints */
+  makecontext (&fiber_, reinterpret_cast<void (*)()> (fiber_main), 2,
+               static_cast<int> (self >> 16 >> 16),
+               static_cast<int> (self & 0xffffffffu));
+
+  qoob_sync_wait_set (device_.native (), wait, this);
+}
+
+async_device::~async_device ()
+{
+  qoob_sync_wait_set (device_.native (), nullptr, nullptr);
+}
+
+std::vector<std::unique_ptr<async_device>>
+async_device::open_all (loop &l, std::error_code &ec, int lock_timeout)
+{
+  std::vector<std::unique_ptr<async_device>> devices;
+  auto found = device::find_all (ec);
+
+  for (auto &f : found) {
+    std::error_code oec;
+    device d = device::open (f.first, f.second, oec, lock_timeout);
+
+    if (oec)
+      continue;
+    devices.push_back (std::make_unique<async_device> (l, 
+                                                        std::move (d),
+                                                        f.first, 
+                                                        f.second));
+  }
+  if (!ec && devices.empty ())
+    ec = QOOB_ERROR_NOT_FOUND;
+
+  return devices;
+}
+
+async_device::operation
+async_device::list ()
+{
+  return operation (*this, [] (device &d) { return d.list (); });
+}
+
+async_device::operation
+async_device::read (int slot, byte_span out)
+{
+  return operation (*this, [=] (device &d) { return d.read (slot, out); });
+}
+
+async_device::operation
+async_device::write (int slot,
+                     const_byte_span data,
+                     binary_type_t type,
+                     std::string name)
+{
+  return operation (*this, [=] (device &d) 
+                    { return d.write (slot, data, type, name); });
+}
+
+async_device::operation
+async_device::write_file (int slot, std::string file, binary_type_t type)
+{
+  return operation (*this, [=] (device &d) 
+                    { return d.write_file (slot, file, type); });
+}
+
+async_device::operation
+async_device::erase (int slot)
+{
+  return operation (*this, [=] (device &d) { return d.erase (slot); });
+}
+
+async_device::operation
+async_device::erase_forced (int from, int to)
+{
+  return operation (*this, [=] (device &d) 
+                    { return d.erase_forced (from, to); });
+}
+
+async_device::operation
+async_device::verify (int slot, 
+                      std::string file, 
+                      binary_type_t type,
+                      bool read_flash)
+{
+  return operation (*this, [=] (device &d) 
+                    { return d.verify (slot, file, type, read_flash); });
+}
+
+/* Fiber is started from the loop when first job comes */
+void
+async_device::submit (std::function<void ()> job)
+{
+  jobs_.push_back (std::move (job));
+  if (!running_) {
+    running_ = true;
+    loop_.queue ([this] { resume (); });
+  }
+}
+
+void
+async_device::resume ()
+{
+  swapcontext (&caller_, &fiber_);
+}
+
+/* Runs queued jobs and goes back to the loop when there are none */
+void
+async_device::fiber_main (int hi, int lo)
+{
+  std::uintptr_t p = static_cast<unsigned int> (hi);
+  async_device *self;
+
+  p = p << 16 << 16 | static_cast<unsigned int> (lo);
+  self = reinterpret_cast<async_device *> (p);
+
+  while (1) {
+    while (!self->jobs_.empty ()) {
+      std::function<void ()> job = std::move (self->jobs_.front ());
+
+      self->jobs_.pop_front ();
+      job ();
+    }
+    self->running_ = false;
+    swapcontext (&self->fiber_, &self->caller_);
+  }
+}
+
+/* usbfs waits on the loop. Fiber is resumed when node is ready. */
+int
+async_device::wait (int fd, short events, int timeout, void *data)
+{
+  async_device *self = static_cast<async_device *> (data);
+
+  self->loop_.watch (fd, events, timeout, [self] (int r) {
+    self->wait_result_ = r;
+    self->wait_errno_ = errno;
+    self->resume ();
+  });
+  swapcontext (&self->fiber_, &self->caller_);
+
+  errno = self->wait_errno_;
+  return self->wait_result_;
+}
+
+namespace {
+
+task<std::error_code>
+flash_entry (async_device &d, const qoob_layout_entry_t &e)
+{
+  std::error_code ec;
+  int from = e.slot;
+  int to = e.slot + e.slots_used - 1;
+
+  ec = co_await d.verify (e.slot, e.file, e.type);
+  if (!ec)
+    co_return ec;
+  if (ec != QOOB_ERROR_VERIFY_FAILED && ec != QOOB_ERROR_SLOT_NOT_FIRST)
+    co_return ec;
+
+  /* Whole applications are erased, not only the slots layout needs */
+  while (from > 0 && !d.slots ()[from].first ())
+    from--;
+  while (to+1 < QOOB_PRO_SLOTS && !d.slots ()[to+1].first ())
+    to++;
+
+  ec = co_await d.erase_forced (from, to);
+  if (!ec)
+    ec = co_await d.list ();
+  if (!ec)
+    ec = co_await d.write_file (e.slot, e.file, e.type);
+  if (!ec)
+    ec = co_await d.list ();
+  if (!ec)
+    ec = co_await d.verify (e.slot, e.file, e.type, true);
+
+  co_return ec;
+}
+
+} /* namespace */
+
+task<std::error_code>
+flash_layout (async_device &d, const qoob_layout_t &layout)
+{
+  for (int i = 0; i < layout.count; i++) {
+    std::error_code ec = co_await flash_entry (d, layout.entries[i]);
+
+    if (ec)
+      co_return ec;
+  }
+
+  co_return std::error_code ();
+}
+
+task<std::vector<std::error_code>>
+flash_all (loop &l,
+           std::vector<std::unique_ptr<async_device>> &devices,
+           const qoob_layout_t &layout)
+{
+  std::vector<task<std::error_code>> tasks;
+
+  for (auto &d : devices)
+    tasks.push_back (flash_layout (*d, layout));
+
+  co_return co_await when_all (l, std::move (tasks));
+}
+
+} /* namespace qoob */
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
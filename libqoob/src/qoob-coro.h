@@ -0,0 +1,397 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _QOOB_CORO_H_
+#define _QOOB_CORO_H_
+
+/*
+ * C++20 coroutines to drive many devices from one thread. Coroutines run
+ * on qoob::loop. Device operations are awaitable and each device runs 
+ * them on own stack (ucontext) on the loop thread. usbfs transport gives
+ * its URB waits to the loop, which polls nodes of all devices at once, 
+ * so one thread keeps every device busy. hidraw and libusb 0.1 transfers
+ * block in the kernel and hold the loop while their packet is in flight.
+ */
+
+#include <ucontext.h>
+
+#include <chrono>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "qoob++.h"
+
+namespace qoob {
+
+template <typename T = void> class task;
+
+namespace detail {
+
+struct promise_base
+{
+  std::coroutine_handle<> continuation;
+  std::exception_ptr exception;
+
+  /* Awaiting coroutine continues when task is done */
+  struct final_awaiter
+  {
+    bool await_ready () noexcept { return false; }
+    template <typename P>
+    std::coroutine_handle<> await_suspend (std::coroutine_handle<P> h) 
+      noexcept
+    {
+      auto c = h.promise ().continuation;
+      return c ? c : std::noop_coroutine ();
+    }
+    void await_resume () noexcept {}
+  };
+
+  std::suspend_always initial_suspend () noexcept { return {}; }
+  final_awaiter final_suspend () noexcept { return {}; }
+  void unhandled_exception () noexcept 
+    { exception = std::current_exception (); }
+};
+
+template <typename T>
+struct promise : promise_base
+{
+  std::optional<T> value;
+
+  task<T> get_return_object () noexcept;
+  void return_value (T v) { value = std::move (v); }
+};
+
+template <>
+struct promise<void> : promise_base
+{
+  task<void> get_return_object () noexcept;
+  void return_void () noexcept {}
+};
+
+} /* namespace detail */
+
+/* Lazy coroutine. Starts when awaited or given to loop. */
+template <typename T>
+class task
+{
+public:
+  using promise_type = detail::promise<T>;
+
+  task (task &&o) noexcept : h_ (std::exchange (o.h_, {})) {}
+  task &operator= (task &&o) noexcept
+  {
+    if (this != &o) {
+      if (h_)
+        h_.destroy ();
+      h_ = std::exchange (o.h_, {});
+    }
+    return *this;
+  }
+  task (const task &) = delete;
+  task &operator= (const task &) = delete;
+  ~task () { if (h_) h_.destroy (); }
+
+  bool done () const noexcept { return !h_ || h_.done (); }
+  std::coroutine_handle<promise_type> handle () const noexcept { return h_; }
+
+  bool await_ready () const noexcept { return done (); }
+  std::coroutine_handle<> await_suspend (std::coroutine_handle<> c) noexcept
+  {
+    h_.promise ().continuation = c;
+    return h_;
+  }
+  T await_resume ()
+  {
+    auto &p = h_.promise ();
+
+    if (p.exception)
+      std::rethrow_exception (p.exception);
+    if constexpr (!std::is_void_v<T>)
+      return std::move (*p.value);
+  }
+
+private:
+  friend struct detail::promise<T>;
+  explicit task (std::coroutine_handle<promise_type> h) noexcept : h_ (h) {}
+
+  std::coroutine_handle<promise_type> h_;
+};
+
+template <typename T>
+task<T> 
+detail::promise<T>::get_return_object () noexcept
+{
+  return task<T> (std::coroutine_handle<promise<T>>::from_promise (*this));
+}
+
+inline task<void> 
+detail::promise<void>::get_return_object () noexcept
+{
+  return task<void> (std::coroutine_handle<promise<void>>::from_promise 
+                       (*this));
+}
+
+/*
+ * Single threaded event loop. Queued calls and coroutines are run in 
+ * order. When none is left, fds waited by devices are polled and calls 
+ * of the ready ones are queued.
+ */
+class loop
+{
+public:
+  loop () = default;
+  loop (const loop &) = delete;
+  loop &operator= (const loop &) = delete;
+
+  /* Task is started on next run () and kept until it is done */
+  void spawn (task<void> t);
+
+  /* Runs until nothing is ready or waiting for fd. Exception of
+     spawned task is thrown from here. */
+  void run ();
+
+  /* Runs t and everything spawned and gives result of t */
+  template <typename T>
+  T run (task<T> t)
+  {
+    std::optional<std::conditional_t<std::is_void_v<T>, bool, T>> result;
+
+    spawn (store (std::move (t), result));
+    run ();
+    if constexpr (!std::is_void_v<T>)
+      return std::move (*result);
+  }
+
+  /* Queues coroutine to be resumed */
+  void post (std::coroutine_handle<> h);
+
+  /* Queues function to be called */
+  void queue (std::function<void ()> f);
+
+  /* ready gets result as poll () gives it for fd: 1 when events came,
+     0 after timeout milliseconds (-1 waits forever), -1 with errno */
+  void watch (int fd, 
+              short events, 
+              int timeout, 
+              std::function<void (int)> ready);
+
+private:
+  template <typename T, typename R>
+  static task<void> store (task<T> t, std::optional<R> &result)
+  {
+    if constexpr (std::is_void_v<T>) {
+      co_await t;
+      result = true;
+    } else {
+      result = co_await t;
+    }
+  }
+
+  struct watcher
+  {
+    int fd;
+    short events;
+    bool forever;
+    std::chrono::steady_clock::time_point deadline;
+    std::function<void (int)> ready;
+  };
+
+  void poll_watchers ();
+
+  std::deque<std::function<void ()>> ready_;
+  std::deque<task<void>> tasks_;
+  std::vector<watcher> watchers_;
+};
+
+/*
+ * Device driven from a loop. Operations run in order on the stack of the
+ * device and give std::error_code when awaited. Slots must not be viewed
+ * while operation of the device is running and device must not be 
+ * destroyed before loop has run it.
+ */
+class async_device
+{
+public:
+  class operation
+  {
+  public:
+    operation (async_device &d, 
+               std::function<std::error_code (device &)> f) noexcept
+      : device_ (d), f_ (std::move (f)) {}
+
+    bool await_ready () const noexcept { return false; }
+    void await_suspend (std::coroutine_handle<> h);
+    std::error_code await_resume () const noexcept { return result_; }
+
+  private:
+    async_device &device_;
+    std::function<std::error_code (device &)> f_;
+    std::error_code result_;
+  };
+
+  async_device (loop &l, device d, std::string bus, std::string name);
+  async_device (const async_device &) = delete;
+  async_device &operator= (const async_device &) = delete;
+  ~async_device ();
+
+  /* Opens every Qoob Pro plugged in. Devices other programs hold are 
+     skipped after lock_timeout milliseconds. */
+  static std::vector<std::unique_ptr<async_device>> 
+  open_all (loop &l, std::error_code &ec, int lock_timeout = 0);
+
+  operation list ();
+  operation read (int slot, byte_span out);
+  operation write (int slot, 
+                   const_byte_span data, 
+                   binary_type_t type,
+                   std::string name = "");
+  operation write_file (int slot, std::string file, binary_type_t type);
+  operation erase (int slot);
+  operation erase_forced (int from, int to);
+  operation verify (int slot, 
+                    std::string file, 
+                    binary_type_t type,
+                    bool read_flash = false);
+
+  slot_table slots () const noexcept { return device_.slots (); }
+  const std::string &bus () const noexcept { return bus_; }
+  const std::string &name () const noexcept { return name_; }
+
+private:
+  static constexpr std::size_t stack_size = 256*1024;
+
+  static void fiber_main (int hi, int lo);
+  static int wait (int fd, short events, int timeout, void *data);
+  void submit (std::function<void ()> job);
+  void resume ();
+
+  loop &loop_;
+  device device_;
+  std::string bus_;
+  std::string name_;
+
+  std::deque<std::function<void ()>> jobs_;
+  bool running_ = false;            /* Jobs are queued to fiber */
+  int wait_result_ = 0;
+  int wait_errno_ = 0;
+  std::unique_ptr<char[]> stack_;
+  ucontext_t fiber_;
+  ucontext_t caller_;               /* Loop which resumed the fiber */
+};
+
+/* Runs tasks at the same time and gives their results in same order */
+template <typename T>
+task<std::vector<T>> when_all (loop &l, std::vector<task<T>> tasks);
+
+namespace detail {
+
+template <typename T>
+struct when_all_state
+{
+  loop *l;
+  std::size_t left;
+  std::coroutine_handle<> parent;
+  std::vector<std::optional<T>> results;
+  std::exception_ptr exception;
+};
+
+template <typename T>
+task<void>
+when_all_item (task<T> t, when_all_state<T> &s, std::size_t i)
+{
+  try {
+    s.results[i] = co_await t;
+  } catch (...) {
+    s.exception = std::current_exception ();
+  }
+  if (--s.left == 0)
+    s.l->post (s.parent);
+}
+
+template <typename T>
+struct when_all_start
+{
+  std::vector<task<void>> &items;
+  when_all_state<T> &state;
+
+  bool await_ready () const noexcept { return items.empty (); }
+  void await_suspend (std::coroutine_handle<> h)
+  {
+    state.parent = h;
+    for (auto &item : items)
+      state.l->post (item.handle ());
+  }
+  void await_resume () const noexcept {}
+};
+
+} /* namespace detail */
+
+template <typename T>
+task<std::vector<T>>
+when_all (loop &l, std::vector<task<T>> tasks)
+{
+  detail::when_all_state<T> state {&l, tasks.size (), {}, {}, {}};
+  std::vector<task<void>> items;
+  std::vector<T> results;
+
+  state.results.resize (tasks.size ());
+  for (std::size_t i = 0; i < tasks.size (); i++)
+    items.push_back (detail::when_all_item (std::move (tasks[i]), state, i));
+
+  co_await detail::when_all_start<T> {items, state};
+
+  if (state.exception)
+    std::rethrow_exception (state.exception);
+  for (auto &r : state.results)
+    results.push_back (std::move (*r));
+  co_return results;
+}
+
+/*
+ * Flashes slot layout to device. Entries already flashed are only 
+ * verified. Layout and device have to live until task is done.
+ */
+task<std::error_code> flash_layout (async_device &d, 
+                                    const qoob_layout_t &layout);
+
+/* Flashes layout to all devices at the same time. Results are in order
+   of devices. */
+task<std::vector<std::error_code>> 
+flash_all (loop &l,
+           std::vector<std::unique_ptr<async_device>> &devices,
+           const qoob_layout_t &layout);
+
+} /* namespace qoob */
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
@@ -40,7 +40,24 @@ typedef enum {
 
 #define QOOB_PRO_MAX_BUFFER 0x40 /* How much is written or read at once */
 
+#define QOOB_PRO_ERASED_BYTE 0xff /* Erased flash reads back as this */
+
 #define QOOB_GCB_HEADER_SIZE 0x100 /* Size of the GCB file 'header' */
+#define QOOB_GCB_NAME_OFFSET 0x04  /* Application name starts here */
+#define QOOB_GCB_NAME_SIZE 0x99    /* Maximum length of the name */
+#define QOOB_GCB_SLOTS_OFFSET 0xfd /* How many slots application uses */
+
+/* Unused header bytes where libqoob stores payload length and digest */
+#define QOOB_GCB_DIGEST_OFFSET 0xc0
+#define QOOB_GCB_DIGEST_MAGIC "QDG1"
+#define QOOB_GCB_DIGEST_MAGIC_SIZE 4
+#define QOOB_GCB_DIGEST_AREA_SIZE 0x28 /* Magic, length and digest */
+
+#define QOOB_DOL_HEADER_SIZE 0x100 /* Size of the DOL file header */
+
+#define QOOB_TIMEOUT_DEFAULT 1000  /* ms, until transfer latency is known */
+#define QOOB_TIMEOUT_MIN 50        /* ms, smallest learned timeout */
+#define QOOB_RETRIES_DEFAULT 3     /* Times slot or half slot is retried */
 
 #define QOOB_PREFIX_SEPARATOR '.'
 #define QOOB_DIRECTORY_SEPARATOR '/'
@@ -62,6 +79,10 @@ typedef enum {
   QOOB_SYNC_CALLBACK_WRITE_CONTENT,
   QOOB_SYNC_CALLBACK_ERASE,
   QOOB_SYNC_CALLBACK_LIST,
+  QOOB_SYNC_CALLBACK_MINIMIZE,  /* progress: slots after, total: before */
+  QOOB_SYNC_CALLBACK_SPARSE,    /* progress: packets skipped, total: all */
+  QOOB_SYNC_CALLBACK_LOCK_WAIT, /* progress: holder pid, total: waiting */
+  QOOB_SYNC_CALLBACK_RETRY,     /* progress: slot, total: retries so far */
 } qoob_sync_callback_t;
 
 #define TMP_DIR "/tmp"
@@ -0,0 +1,248 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include <string.h>
+
+#include "qoob-digest.h"
+
+#define ROR(x,n) (((x) >> (n)) | ((x) << (32-(n))))
+
+static const unsigned int k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 
+  0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 
+  0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 
+  0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 
+  0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 
+  0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static void transform (qoob_digest_t *digest, const unsigned char *data);
+
+void
+qoob_digest_init (qoob_digest_t *digest)
+{
+  digest->state[0] = 0x6a09e667;
+  digest->state[1] = 0xbb67ae85;
+  digest->state[2] = 0x3c6ef372;
+  digest->state[3] = 0xa54ff53a;
+  digest->state[4] = 0x510e527f;
+  digest->state[5] = 0x9b05688c;
+  digest->state[6] = 0x1f83d9ab;
+  digest->state[7] = 0x5be0cd19;
+  digest->length = 0;
+  digest->used = 0;
+}
+
+void
+qoob_digest_update (qoob_digest_t *digest, 
+                    const void *data, 
+                    size_t size)
+{
+  const unsigned char *p = (const unsigned char *)data;
+
+  digest->length += size;
+
+  /* Fill partial block first */
+  if (digest->used > 0) {
+    size_t n = 64 - digest->used;
+    if (n > size) 
+      n = size;
+    memcpy (digest->block + digest->used, p, n);
+    digest->used += n;
+    p += n;
+    size -= n;
+    if (digest->used < 64)
+      return;
+    transform (digest, digest->block);
+    digest->used = 0;
+  }
+
+  for (; size >= 64; p += 64, size -= 64) {
+    transform (digest, p);
+  }
+
+  if (size > 0) {
+    memcpy (digest->block, p, size);
+    digest->used = size;
+  }
+}
+
+void
+qoob_digest_final (qoob_digest_t *digest, 
+                   unsigned char out[QOOB_DIGEST_SIZE])
+{
+  unsigned long long int bits = digest->length * 8;
+  int i;
+
+  digest->block[digest->used++] = 0x80;
+  if (digest->used > 56) {
+    memset (digest->block + digest->used, 0, 64 - digest->used);
+    transform (digest, digest->block);
+    digest->used = 0;
+  }
+  memset (digest->block + digest->used, 0, 56 - digest->used);
+
+  /* Length in bits as big endian */
+  for (i=0; i<8; i++) {
+    digest->block[63-i] = (unsigned char)(bits >> (i*8));
+  }
+  transform (digest, digest->block);
+
+  for (i=0; i<8; i++) {
+    out[i*4] = (unsigned char)(digest->state[i] >> 24);
+    out[i*4+1] = (unsigned char)(digest->state[i] >> 16);
+    out[i*4+2] = (unsigned char)(digest->state[i] >> 8);
+    out[i*4+3] = (unsigned char)(digest->state[i]);
+  }
+}
+
+void
+qoob_digest_buffer (const void *data, 
+                    size_t size, 
+                    unsigned char out[QOOB_DIGEST_SIZE])
+{
+  qoob_digest_t digest;
+
+  qoob_digest_init (&digest);
+  qoob_digest_update (&digest, data, size);
+  qoob_digest_final (&digest, out);
+}
+
+void
+qoob_digest_to_string (const unsigned char digest[QOOB_DIGEST_SIZE],
+                       char out[QOOB_DIGEST_STRING_SIZE])
+{
+  static const char hex[] = "0123456789abcdef";
+  int i;
+
+  for (i=0; i<QOOB_DIGEST_SIZE; i++) {
+    out[i*2] = hex[digest[i] >> 4];
+    out[i*2+1] = hex[digest[i] & 0x0f];
+  }
+  out[QOOB_DIGEST_SIZE*2] = '\0';
+}
+
+/* Returns 0 if str was valid hex presentation of the digest */
+int
+qoob_digest_from_string (const char *str,
+                         unsigned char digest[QOOB_DIGEST_SIZE])
+{
+  int i;
+
+  for (i=0; i<QOOB_DIGEST_SIZE*2; i++) {
+    int v;
+    char c = str[i];
+
+    if (c >= '0' && c <= '9') {
+      v = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      v = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      v = c - 'A' + 10;
+    } else {
+      return 1;
+    }
+
+    if (i%2 == 0) {
+      digest[i/2] = (unsigned char)(v << 4);
+    } else {
+      digest[i/2] |= (unsigned char)v;
+    }
+  }
+
+  return 0;
+}
+
+/* Static functions */
+static void
+transform (qoob_digest_t *digest, const unsigned char *data)
+{
+  unsigned int w[64];
+  unsigned int a,b,c,d,e,f,g,h;
+  int i;
+
+  for (i=0; i<16; i++) {
+    w[i] = ((unsigned int)data[i*4] << 24) |
+           ((unsigned int)data[i*4+1] << 16) |
+           ((unsigned int)data[i*4+2] << 8) |
+           ((unsigned int)data[i*4+3]);
+  }
+  for (i=16; i<64; i++) {
+    unsigned int s0 = ROR(w[i-15],7) ^ ROR(w[i-15],18) ^ (w[i-15] >> 3);
+    unsigned int s1 = ROR(w[i-2],17) ^ ROR(w[i-2],19) ^ (w[i-2] >> 10);
+    w[i] = w[i-16] + s0 + w[i-7] + s1;
+  }
+
+  a = digest->state[0];
+  b = digest->state[1];
+  c = digest->state[2];
+  d = digest->state[3];
+  e = digest->state[4];
+  f = digest->state[5];
+  g = digest->state[6];
+  h = digest->state[7];
+
+  for (i=0; i<64; i++) {
+    unsigned int s1 = ROR(e,6) ^ ROR(e,11) ^ ROR(e,25);
+    unsigned int ch = (e & f) ^ (~e & g);
+    unsigned int t1 = h + s1 + ch + k[i] + w[i];
+    unsigned int s0 = ROR(a,2) ^ ROR(a,13) ^ ROR(a,22);
+    unsigned int maj = (a & b) ^ (a & c) ^ (b & c);
+    unsigned int t2 = s0 + maj;
+
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+
+  digest->state[0] += a;
+  digest->state[1] += b;
+  digest->state[2] += c;
+  digest->state[3] += d;
+  digest->state[4] += e;
+  digest->state[5] += f;
+  digest->state[6] += g;
+  digest->state[7] += h;
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
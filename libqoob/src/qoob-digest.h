@@ -0,0 +1,65 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include <stddef.h>
+
+#ifndef _QOOB_DIGEST_H_
+#define _QOOB_DIGEST_H_
+
+/* SHA-256 of the data. Used to identify images and flashed content. */
+#define QOOB_DIGEST_SIZE 32
+#define QOOB_DIGEST_STRING_SIZE (QOOB_DIGEST_SIZE*2+1)
+
+typedef struct QoobDigest qoob_digest_t;
+struct QoobDigest
+{
+  unsigned int state[8];
+  unsigned long long int length;   /* bytes hashed so far */
+  unsigned char block[64];
+  size_t used;                      /* bytes waiting in block */
+};
+
+void qoob_digest_init (qoob_digest_t *digest);
+void qoob_digest_update (qoob_digest_t *digest, 
+                         const void *data, 
+                         size_t size);
+void qoob_digest_final (qoob_digest_t *digest, 
+                        unsigned char out[QOOB_DIGEST_SIZE]);
+
+void qoob_digest_buffer (const void *data, 
+                         size_t size, 
+                         unsigned char out[QOOB_DIGEST_SIZE]);
+
+void qoob_digest_to_string (const unsigned char digest[QOOB_DIGEST_SIZE],
+                            char out[QOOB_DIGEST_STRING_SIZE]);
+int qoob_digest_from_string (const char *str,
+                             unsigned char digest[QOOB_DIGEST_SIZE]);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
@@ -0,0 +1,330 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+#ifndef QOOB_MINIMAL
+#include <usb.h>
+#endif
+
+#include "qoob-discover.h"
+#include "qoob-sync-usb.h"
+
+#define USBFS_DIR "/dev/bus/usb/"
+
+#ifdef __linux__
+#include <dirent.h>
+
+#define SYSFS_USB_DIR "/sys/bus/usb/devices"
+#define SYSFS_HIDRAW_DIR "/sys/class/hidraw"
+
+static qoob_error_t sysfs_all (qoob_device_t *devices, 
+                               int max, 
+                               int *count);
+static qoob_error_t sysfs_device (const char *dir, qoob_device_t *device);
+#endif
+
+#ifndef QOOB_MINIMAL
+static qoob_error_t libusb_all (qoob_t *qoob,
+                                qoob_device_t *devices,
+                                int max,
+                                int *count);
+#endif
+static void device_names (qoob_device_t *device, long bus, long dev);
+
+/*
+ * qoob_discover_all ()
+ *
+ * Finds at most max Qoob Pros. count tells how many were found. Returns 
+ * QOOB_ERROR_NOT_FOUND if there are none.
+ */
+qoob_error_t
+qoob_discover_all (qoob_t *qoob,
+                   qoob_device_t *devices,
+                   int max,
+                   int *count)
+{
+  qoob_error_t err;
+
+  if (qoob == NULL || devices == NULL || max <= 0 || count == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+  *count = 0;
+
+#ifdef __linux__
+  err = sysfs_all (devices, max, count);
+  if (err != QOOB_ERROR_FD_OPEN) {
+    return err;
+  }
+  /* No sysfs mounted */
+#endif
+
+#ifdef QOOB_MINIMAL
+  /* No libusb in minimal build */
+  err = QOOB_ERROR_NOT_FOUND;
+#else
+  err = libusb_all (qoob, devices, max, count);
+#endif
+
+  return err;
+}
+
+/*
+ * qoob_discover_path ()
+ *
+ * Bus and device of one device given by user. path can be 
+ * "BUS:DEVICE" like "1:4", usbfs node "/dev/bus/usb/001/004" or on Linux 
+ * also bus and port "1-1.2" as in sysfs, sysfs directory of the device or 
+ * hidraw node "/dev/hidraw0". Device is not checked to be Qoob Pro,
+ * qoob_sync_usb_find_path () does it.
+ */
+qoob_error_t
+qoob_discover_path (const char *path,
+                    qoob_device_t *device)
+{
+  unsigned int bus, dev;
+  char end;
+
+  if (path == NULL || device == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  if (strncmp (path, USBFS_DIR, strlen (USBFS_DIR)) == 0) {
+    if (sscanf (path + strlen (USBFS_DIR), "%u/%u%c", &bus, &dev, &end) != 2)
+      return QOOB_ERROR_INPUT_NOT_VALID;
+    device_names (device, bus, dev);
+    return QOOB_ERROR_OK;
+  }
+
+  if (sscanf (path, "%u:%u%c", &bus, &dev, &end) == 2) {
+    device_names (device, bus, dev);
+    return QOOB_ERROR_OK;
+  }
+
+#ifdef __linux__
+  {
+    char link[PATH_MAX];
+    char dir[PATH_MAX];
+    const char *name = strrchr (path, '/');
+
+    name = name != NULL ? name + 1 : path;
+
+    if (strncmp (name, "hidraw", 6) == 0) {
+      /* HID device under interface under USB device */
+      snprintf (link, sizeof (link), "%s/%s/device/../..", 
+                SYSFS_HIDRAW_DIR, name);
+    } else if (path[0] == '/') {
+      snprintf (link, sizeof (link), "%s", path);
+    } else {
+      snprintf (link, sizeof (link), "%s/%s", SYSFS_USB_DIR, path);
+    }
+
+    if (realpath (link, dir) == NULL) {
+      return QOOB_ERROR_NOT_FOUND;
+    }
+
+    return sysfs_device (dir, device);
+  }
+#else
+  return QOOB_ERROR_INPUT_NOT_VALID;
+#endif
+}
+
+#ifndef QOOB_MINIMAL
+/*
+ * qoob_discover_busses ()
+ *
+ * libusb lists busses and opens every device on them to read descriptors,
+ * so it is done only when libusb is needed. qoob_sync_rescan () makes 
+ * list to be read again.
+ */
+qoob_error_t
+qoob_discover_busses (qoob_t *qoob)
+{
+  if (qoob == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+  if (qoob->busses != NULL) {
+    return QOOB_ERROR_OK;
+  }
+
+  usb_find_busses ();
+  usb_find_devices ();
+  qoob->busses = usb_get_busses ();
+  if (qoob->busses == NULL) {
+    return QOOB_ERROR_NOT_FOUND;
+  }
+
+  return QOOB_ERROR_OK;
+}
+#endif
+
+/* Number in sysfs attribute file. -1 if it can not be read. */
+long
+qoob_discover_sysfs_number (const char *dir, const char *name, int base)
+{
+  char path[PATH_MAX];
+  char value[32];
+  char *end;
+  ssize_t r;
+  long ret;
+  int fd;
+
+  /* No stdio, it would allocate a buffer for every attribute */
+  snprintf (path, sizeof (path), "%s/%s", dir, name);
+  fd = open (path, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  r = read (fd, value, sizeof (value)-1);
+  close (fd);
+  if (r <= 0) {
+    return -1;
+  }
+  value[r] = '\0';
+
+  ret = strtol (value, &end, base);
+  if (end == value) {
+    ret = -1;
+  }
+
+  return ret;
+}
+
+#ifdef __linux__
+/* 
+ * Only vendor and product attributes of every USB device are read. Names 
+ * without ':' are devices, others are their interfaces.
+ */
+static qoob_error_t
+sysfs_all (qoob_device_t *devices, 
+           int max, 
+           int *count)
+{
+  DIR *dir;
+  struct dirent *entry;
+
+  dir = opendir (SYSFS_USB_DIR);
+  if (dir == NULL) {
+    return QOOB_ERROR_FD_OPEN;
+  }
+
+  while ((entry = readdir (dir)) != NULL && *count < max) {
+    char path[PATH_MAX];
+
+    if (entry->d_name[0] == '.' || strchr (entry->d_name, ':') != NULL)
+      continue;
+
+    snprintf (path, sizeof (path), "%s/%s", SYSFS_USB_DIR, entry->d_name);
+    if (qoob_discover_sysfs_number (path, "idVendor", 16) != QOOB_PRO_VENDOR ||
+        qoob_discover_sysfs_number (path, "idProduct", 16) != QOOB_PRO_PRODUCT)
+      continue;
+
+    if (sysfs_device (path, &devices[*count]) == QOOB_ERROR_OK) {
+      (*count)++;
+    }
+  }
+  closedir (dir);
+
+  return *count > 0 ? QOOB_ERROR_OK : QOOB_ERROR_NOT_FOUND;
+}
+
+/* Bus and device of sysfs USB device or its interface */
+static qoob_error_t
+sysfs_device (const char *dir, qoob_device_t *device)
+{
+  char parent[PATH_MAX];
+  long bus, dev;
+
+  bus = qoob_discover_sysfs_number (dir, "busnum", 10);
+  dev = qoob_discover_sysfs_number (dir, "devnum", 10);
+  if (bus < 0 || dev < 0) {
+    snprintf (parent, sizeof (parent), "%s/..", dir);
+    bus = qoob_discover_sysfs_number (parent, "busnum", 10);
+    dev = qoob_discover_sysfs_number (parent, "devnum", 10);
+  }
+  if (bus < 0 || dev < 0) {
+    return QOOB_ERROR_NOT_FOUND;
+  }
+
+  device_names (device, bus, dev);
+
+  return QOOB_ERROR_OK;
+}
+#endif
+
+#ifndef QOOB_MINIMAL
+static qoob_error_t
+libusb_all (qoob_t *qoob,
+            qoob_device_t *devices,
+            int max,
+            int *count)
+{
+  struct usb_bus *bus;
+  qoob_error_t err;
+
+  err = qoob_discover_busses (qoob);
+  if (err != QOOB_ERROR_OK) {
+    return err;
+  }
+
+  for (bus = qoob->busses; bus && *count < max; bus = bus->next) {
+    struct usb_device *dev;
+
+    for (dev = bus->devices; dev && *count < max; dev = dev->next) {
+      if (dev->descriptor.idVendor != QOOB_PRO_VENDOR || 
+          dev->descriptor.idProduct != QOOB_PRO_PRODUCT)
+        continue;
+
+      /* Precision keeps -Wformat-truncation quiet, names are short */
+      snprintf (devices[*count].bus, sizeof (devices[*count].bus), 
+                "%.*s", QOOB_DISCOVER_NAME_SIZE - 1, bus->dirname);
+      snprintf (devices[*count].device, sizeof (devices[*count].device), 
+                "%.*s", QOOB_DISCOVER_NAME_SIZE - 1, dev->filename);
+      (*count)++;
+    }
+  }
+
+  return *count > 0 ? QOOB_ERROR_OK : QOOB_ERROR_NOT_FOUND;
+}
+#endif
+
+/* Names as libusb and usbfs use them */
+static void
+device_names (qoob_device_t *device, long bus, long dev)
+{
+  snprintf (device->bus, QOOB_DISCOVER_NAME_SIZE, "%03ld", bus);
+  snprintf (device->device, QOOB_DISCOVER_NAME_SIZE, "%03ld", dev);
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
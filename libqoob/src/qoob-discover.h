@@ -0,0 +1,65 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "qoob-struct.h"
+#include "qoob-error.h"
+
+#ifndef _QOOB_DISCOVER_H_
+#define _QOOB_DISCOVER_H_
+
+/*
+ * Finding Qoob Pro devices. On Linux only sysfs attributes of USB devices
+ * are read, so nothing is opened until the device is chosen. Elsewhere
+ * libusb busses are listed, but only when they are needed first time.
+ */
+
+#define QOOB_DISCOVER_NAME_SIZE 32  /* Bus or device name, e.g. "001" */
+#define QOOB_DISCOVER_MAX 32        /* Devices found at once */
+
+typedef struct QoobDevice qoob_device_t;
+struct QoobDevice
+{
+  char bus[QOOB_DISCOVER_NAME_SIZE];
+  char device[QOOB_DISCOVER_NAME_SIZE];
+};
+
+qoob_error_t qoob_discover_all (qoob_t *qoob,
+                                qoob_device_t *devices,
+                                int max,
+                                int *count);
+qoob_error_t qoob_discover_path (const char *path,
+                                 qoob_device_t *device);
+#ifndef QOOB_MINIMAL
+qoob_error_t qoob_discover_busses (qoob_t *qoob);
+#endif
+long qoob_discover_sysfs_number (const char *dir, 
+                                 const char *name, 
+                                 int base);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
@@ -63,6 +63,30 @@ qoob_error_to_string (qoob_error_t e)
     return "File format is not supported.";
   case QOOB_ERROR_TOO_BIG_DATA:
     return "Data is too big. Not enough space at flash.";
+  case QOOB_ERROR_NO_MEMORY:
+    return "Not enough memory.";
+  case QOOB_ERROR_INDEX_NOT_VALID:
+    return "Image index file is not valid.";
+  case QOOB_ERROR_VERIFY_FAILED:
+    return "Flash content differs from the file.";
+  case QOOB_ERROR_LOCK:
+    return "Could not lock device. Check lock files.";
+  case QOOB_ERROR_LOCK_TIMEOUT:
+    return "Device is used by other program.";
+  case QOOB_ERROR_RECEIVE_DATA:
+    return "Receiving data from device fails.";
+  case QOOB_ERROR_LAYOUT_NOT_VALID:
+    return "Slot layout file is not valid.";
+  case QOOB_ERROR_DIGEST_MISSING:
+    return "Slot header has no digest.";
+  case QOOB_ERROR_CANCELLED:
+    return "Operation was cancelled.";
+  case QOOB_ERROR_DEADLINE:
+    return "Deadline of the operation passed.";
+  case QOOB_ERROR_ARCHIVE_NOT_VALID:
+    return "Backup archive is not valid.";
+  case QOOB_ERROR_CONFIG_NOT_FOUND:
+    return "No config slot in flash.";
   default:
     break;
   }
@@ -40,7 +40,19 @@ typedef enum {
   QOOB_ERROR_SEND_DATA,
   QOOB_ERROR_TRYING_TO_OVERWRITE,
   QOOB_ERROR_NOT_SUPPORTED_FILE_FORMAT,
-  QOOB_ERROR_TOO_BIG_DATA
+  QOOB_ERROR_TOO_BIG_DATA,
+  QOOB_ERROR_NO_MEMORY,
+  QOOB_ERROR_INDEX_NOT_VALID,
+  QOOB_ERROR_VERIFY_FAILED,
+  QOOB_ERROR_LOCK,
+  QOOB_ERROR_LOCK_TIMEOUT,
+  QOOB_ERROR_RECEIVE_DATA,
+  QOOB_ERROR_LAYOUT_NOT_VALID,
+  QOOB_ERROR_DIGEST_MISSING,
+  QOOB_ERROR_CANCELLED,
+  QOOB_ERROR_DEADLINE,
+  QOOB_ERROR_ARCHIVE_NOT_VALID,
+  QOOB_ERROR_CONFIG_NOT_FOUND
 } qoob_error_t;
 
 const char *qoob_error_to_string (qoob_error_t e);
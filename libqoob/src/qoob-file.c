@@ -18,20 +18,43 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
 
 #include "qoob-file.h"
 
+/* Gamecube main memory where DOL sections are loaded */
+#define DOL_MEMORY_START 0x80000000UL
+#define DOL_MEMORY_END 0x81800000UL
+
+#define DOL_TEXT_SECTIONS 7
+#define DOL_DATA_SECTIONS 11
+#define DOL_OFFSET_TEXT 0x00
+#define DOL_OFFSET_DATA 0x1c
+#define DOL_ADDRESS_TEXT 0x48
+#define DOL_ADDRESS_DATA 0x64
+#define DOL_SIZE_TEXT 0x90
+#define DOL_SIZE_DATA 0xac
+#define DOL_BSS_ADDRESS 0xd8
+#define DOL_BSS_SIZE 0xdc
+#define DOL_ENTRY 0xe0
+#define DOL_PADDING 0xe4
+
+static qoob_boolean_t is_dol (const char *buf, 
+                              size_t len, 
+                              size_t file_size);
+
 qoob_error_t 
 qoob_file_format_parse (qoob_t *qoob, 
                         const char *file, 
                         binary_type_t *type)
 {
   int fd;
-  char buf[4] = {0xff,0xff,0xff,0xff};
-  ssize_t read_return;
+  char buf[QOOB_DOL_HEADER_SIZE];
+  size_t len = 0;
+  struct stat sbuf;
 
   *type = QOOB_BINARY_TYPE_VOID;
 
@@ -44,12 +67,42 @@ qoob_file_format_parse (qoob_t *qoob,
     return QOOB_ERROR_FD_OPEN;
   }
 
-  read_return = read (fd, buf, 4);
-  if (read_return < 0) {
+  if (fstat (fd, &sbuf) == -1) {
     close (fd);
-    return QOOB_ERROR_FD_READ;
+    return QOOB_ERROR_FILE_STAT;
+  }
+
+  /* DOL detection needs whole header, magics only 4 bytes */
+  while (len < sizeof (buf)) {
+    ssize_t read_return = read (fd, buf+len, sizeof (buf)-len);
+    if (read_return < 0) {
+      close (fd);
+      return QOOB_ERROR_FD_READ;
+    }
+    if (read_return == 0)
+      break;
+    len += (size_t)read_return;
   }
 
+  close (fd);
+  
+  return qoob_file_format_parse_buffer (buf, len, (size_t)sbuf.st_size, type);
+}
+
+qoob_error_t 
+qoob_file_format_parse_buffer (const char *buf, 
+                               size_t len,
+                               size_t file_size,
+                               binary_type_t *type)
+{
+  *type = QOOB_BINARY_TYPE_VOID;
+
+  if (buf == NULL)
+    return QOOB_ERROR_INPUT_NOT_VALID;
+
+  if (len < 4)
+    return QOOB_ERROR_OK;
+
   /* ELF */
   if (buf[1] == (char)0x45 && 
       buf[2] == (char)0x4c && 
@@ -76,13 +129,198 @@ qoob_file_format_parse (qoob_t *qoob,
              buf[2] == (char)0x46 &&
              buf[3] == (char)0x47) {
     *type = QOOB_BINARY_TYPE_CONFIG;
+
+  /* DOL has no magic. Header has to be sane. */
+  } else if (is_dol (buf, len, file_size) == QOOB_TRUE) {
+    *type = QOOB_BINARY_TYPE_DOL;
   }
 
-  close (fd);
-  
   return QOOB_ERROR_OK;
 }
 
+/*
+ * qoob_file_slots_needed ()
+ *
+ * Returns how many slots file of given type and size takes from flash. 
+ * ELF and DOL files get GCB header before writing.
+ */
+unsigned short int
+qoob_file_slots_needed (binary_type_t type, 
+                        size_t size)
+{
+  if (type == QOOB_BINARY_TYPE_ELF ||
+      type == QOOB_BINARY_TYPE_DOL) {
+    size += QOOB_GCB_HEADER_SIZE;
+  }
+
+  if (size == 0)
+    return 1;
+
+  return (unsigned short int)((size+QOOB_PRO_SLOT_SIZE-1)/QOOB_PRO_SLOT_SIZE);
+}
+
+/*
+ * qoob_file_app_name ()
+ *
+ * Name which is written to GCB header. Filename without directory and 
+ * suffix. Name is truncated to QOOB_GCB_NAME_SIZE.
+ */
+void
+qoob_file_app_name (const char *file, 
+                    char *name, 
+                    size_t size)
+{
+  const char *start;
+  const char *end;
+  size_t len;
+
+  if (size == 0)
+    return;
+  name[0] = '\0';
+  if (file == NULL)
+    return;
+
+  start = strrchr (file, QOOB_DIRECTORY_SEPARATOR);
+  start = (start == NULL) ? file : start+1;
+
+  end = strrchr (start, QOOB_PREFIX_SEPARATOR);
+  if (end == NULL || end == start) {
+    end = start + strlen (start);
+  }
+
+  len = (size_t)(end-start);
+  if (len > QOOB_GCB_NAME_SIZE)
+    len = QOOB_GCB_NAME_SIZE;
+  if (len > size-1)
+    len = size-1;
+
+  memcpy (name, start, len);
+  name[len] = '\0';
+}
+
+const char *
+qoob_file_format_to_string (binary_type_t type)
+{
+  switch (type) {
+  case QOOB_BINARY_TYPE_CONFIG:
+    return "CFG";
+  case QOOB_BINARY_TYPE_BACKGROUND:
+    return "BG";
+  case QOOB_BINARY_TYPE_GCB:
+    return "GCB";
+  case QOOB_BINARY_TYPE_ELF:
+    return "ELF";
+  case QOOB_BINARY_TYPE_DOL:
+    return "DOL";
+  default:
+    break;
+  }
+  return "";
+}
+
+/* Static functions */
+static unsigned long
+get_be32 (const char *buf)
+{
+  const unsigned char *p = (const unsigned char *)buf;
+
+  return ((unsigned long)p[0] << 24) | 
+         ((unsigned long)p[1] << 16) |
+         ((unsigned long)p[2] << 8) | 
+         (unsigned long)p[3];
+}
+
+static qoob_boolean_t
+dol_section_valid (const char *buf,
+                   size_t file_size,
+                   int offset_index, 
+                   int address_index, 
+                   int size_index,
+                   qoob_boolean_t *used)
+{
+  unsigned long offset = get_be32 (buf+offset_index);
+  unsigned long address = get_be32 (buf+address_index);
+  unsigned long size = get_be32 (buf+size_index);
+
+  *used = QOOB_FALSE;
+  if (size == 0)
+    return QOOB_TRUE;
+
+  *used = QOOB_TRUE;
+  if (offset < QOOB_DOL_HEADER_SIZE || 
+      size > file_size || 
+      offset > file_size - size) {
+    return QOOB_FALSE;
+  }
+  if (address < DOL_MEMORY_START || 
+      size > DOL_MEMORY_END - address) {
+    return QOOB_FALSE;
+  }
+
+  return QOOB_TRUE;
+}
+
+static qoob_boolean_t
+is_dol (const char *buf, 
+        size_t len, 
+        size_t file_size)
+{
+  int i;
+  qoob_boolean_t used;
+  qoob_boolean_t text_found = QOOB_FALSE;
+  unsigned long entry;
+  unsigned long bss_address;
+  unsigned long bss_size;
+
+  if (len < QOOB_DOL_HEADER_SIZE || file_size <= QOOB_DOL_HEADER_SIZE)
+    return QOOB_FALSE;
+
+  for (i=0; i<DOL_TEXT_SECTIONS; i++) {
+    if (dol_section_valid (buf, file_size,
+                           DOL_OFFSET_TEXT+i*4,
+                           DOL_ADDRESS_TEXT+i*4,
+                           DOL_SIZE_TEXT+i*4,
+                           &used) != QOOB_TRUE) {
+      return QOOB_FALSE;
+    }
+    if (used == QOOB_TRUE)
+      text_found = QOOB_TRUE;
+  }
+
+  for (i=0; i<DOL_DATA_SECTIONS; i++) {
+    if (dol_section_valid (buf, file_size,
+                           DOL_OFFSET_DATA+i*4,
+                           DOL_ADDRESS_DATA+i*4,
+                           DOL_SIZE_DATA+i*4,
+                           &used) != QOOB_TRUE) {
+      return QOOB_FALSE;
+    }
+  }
+
+  if (text_found != QOOB_TRUE)
+    return QOOB_FALSE;
+
+  entry = get_be32 (buf+DOL_ENTRY);
+  if (entry < DOL_MEMORY_START || entry >= DOL_MEMORY_END)
+    return QOOB_FALSE;
+
+  bss_address = get_be32 (buf+DOL_BSS_ADDRESS);
+  bss_size = get_be32 (buf+DOL_BSS_SIZE);
+  if (bss_size != 0 &&
+      (bss_address < DOL_MEMORY_START || 
+       bss_size > DOL_MEMORY_END - bss_address)) {
+    return QOOB_FALSE;
+  }
+
+  /* Rest of the header is padding */
+  for (i=DOL_PADDING; i<QOOB_DOL_HEADER_SIZE; i++) {
+    if (buf[i] != 0)
+      return QOOB_FALSE;
+  }
+
+  return QOOB_TRUE;
+}
+
 /* Emacs indentatation information
    Local Variables:
    indent-tabs-mode:nil
@@ -17,6 +17,8 @@
  * Boston, MA 02111-1307, USA.
  */
 
+#include <stddef.h>
+
 #include "qoob.h"
 
 #ifndef _QOOB_FILE_FORMAT_H_
@@ -25,6 +27,17 @@
 qoob_error_t qoob_file_format_parse (qoob_t *qoob,
                                      const char *file,
                                      binary_type_t *type);
+qoob_error_t qoob_file_format_parse_buffer (const char *buf,
+                                            size_t len,
+                                            size_t file_size,
+                                            binary_type_t *type);
+const char *qoob_file_format_to_string (binary_type_t type);
+
+unsigned short int qoob_file_slots_needed (binary_type_t type, 
+                                           size_t size);
+void qoob_file_app_name (const char *file, 
+                         char *name, 
+                         size_t size);
 
 #endif
 
@@ -0,0 +1,709 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include "qoob-digest.h"
+#include "qoob-file.h"
+#include "qoob-image.h"
+
+/* Unstripped ELF can be much bigger than the flash */
+#define IMAGE_MAX_SIZE (QOOB_PRO_TOTAL_SIZE*16)
+
+#define ELF_HEADER_SIZE 52
+#define ELF_PHDR_SIZE 32
+#define ELF_CLASS_32 1
+#define ELF_DATA_MSB 2
+#define ELF_MACHINE_PPC 20
+#define ELF_PT_LOAD 1
+#define ELF_PF_X 1
+
+#define ELF_MAX_SEGMENTS 32
+
+/* Alignment of DOL sections and ELF segments which do not give one */
+#define SEGMENT_ALIGN 0x20
+
+#define DOL_TEXT_SECTIONS 7
+#define DOL_DATA_SECTIONS 11
+
+typedef struct ElfSegment elf_segment_t;
+struct ElfSegment
+{
+  unsigned long offset;
+  unsigned long vaddr;
+  unsigned long filesz;
+  unsigned long memsz;
+  unsigned long flags;
+  unsigned long align;
+  int phdr;                  /* index of the program header */
+};
+
+static unsigned long get32 (const char *p, qoob_boolean_t big);
+#ifndef QOOB_MINIMAL
+static qoob_error_t elf_segments (const char *data,
+                                  size_t size,
+                                  qoob_boolean_t *big,
+                                  elf_segment_t *segments,
+                                  int *count);
+static qoob_error_t elf_strip (const char *data,
+                               size_t size,
+                               char **out,
+                               size_t *out_size);
+static qoob_error_t elf_to_dol (const char *data,
+                                size_t size,
+                                char **out,
+                                size_t *out_size);
+static qoob_error_t dol_trim (const char *data,
+                             size_t size,
+                             char **out,
+                             size_t *out_size);
+#endif
+
+#ifndef QOOB_MINIMAL
+/*
+ * qoob_image_load ()
+ *
+ * Reads whole file to memory. Free data after use.
+ */
+qoob_error_t 
+qoob_image_load (const char *file, 
+                 char **data, 
+                 size_t *size)
+{
+  int fd;
+  struct stat sbuf;
+  size_t done = 0;
+
+  if (file == NULL || data == NULL || size == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  fd = open (file, O_RDONLY);
+  if (fd == -1) {
+    return QOOB_ERROR_FD_OPEN;
+  }
+
+  if (fstat (fd, &sbuf) == -1) {
+    close (fd);
+    return QOOB_ERROR_FILE_STAT;
+  }
+
+  if (sbuf.st_size > IMAGE_MAX_SIZE) {
+    close (fd);
+    return QOOB_ERROR_TOO_BIG_DATA;
+  }
+
+  *size = (size_t)sbuf.st_size;
+  *data = malloc (*size > 0 ? *size : 1);
+  if (*data == NULL) {
+    close (fd);
+    return QOOB_ERROR_NO_MEMORY;
+  }
+
+  while (done < *size) {
+    ssize_t r = read (fd, *data+done, *size-done);
+    if (r <= 0) {
+      free (*data);
+      *data = NULL;
+      close (fd);
+      return QOOB_ERROR_FD_READ;
+    }
+    done += (size_t)r;
+  }
+
+  close (fd);
+
+  return QOOB_ERROR_OK;
+}
+
+/*
+ * qoob_image_load_fd ()
+ *
+ * Reads fd until end of file. Works with pipes as fd is read only 
+ * sequentially. Free data after use. fd is not closed.
+ */
+qoob_error_t 
+qoob_image_load_fd (int fd, 
+                    char **data, 
+                    size_t *size)
+{
+  size_t allocated = QOOB_PRO_SLOT_SIZE;
+  size_t done = 0;
+  char *buf;
+
+  if (fd < 0 || data == NULL || size == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  buf = malloc (allocated);
+  if (buf == NULL) {
+    return QOOB_ERROR_NO_MEMORY;
+  }
+
+  while (1) {
+    ssize_t r;
+
+    if (done == allocated) {
+      char *more;
+
+      if (allocated >= IMAGE_MAX_SIZE) {
+        free (buf);
+        return QOOB_ERROR_TOO_BIG_DATA;
+      }
+      allocated *= 2;
+      more = realloc (buf, allocated);
+      if (more == NULL) {
+        free (buf);
+        return QOOB_ERROR_NO_MEMORY;
+      }
+      buf = more;
+    }
+
+    r = read (fd, buf+done, allocated-done);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r < 0) {
+      free (buf);
+      return QOOB_ERROR_FD_READ;
+    }
+    if (r == 0)
+      break;
+    done += (size_t)r;
+  }
+
+  *data = buf;
+  *size = done;
+
+  return QOOB_ERROR_OK;
+}
+
+/*
+ * qoob_image_minimize ()
+ *
+ * Drops everything from ELF or DOL which is not loaded to memory. Output
+ * is always new buffer. Free it after use.
+ */
+qoob_error_t 
+qoob_image_minimize (qoob_minimize_t mode,
+                     binary_type_t type,
+                     const char *data,
+                     size_t size,
+                     char **out,
+                     size_t *out_size,
+                     binary_type_t *out_type)
+{
+  qoob_error_t err;
+
+  if (data == NULL || out == NULL || out_size == NULL || out_type == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  *out = NULL;
+  *out_size = 0;
+  *out_type = type;
+
+  if (type == QOOB_BINARY_TYPE_ELF && mode == QOOB_MINIMIZE_STRIP) {
+    return elf_strip (data, size, out, out_size);
+  }
+
+  if (type == QOOB_BINARY_TYPE_ELF && mode == QOOB_MINIMIZE_DOL) {
+    err = elf_to_dol (data, size, out, out_size);
+    if (err == QOOB_ERROR_OK) {
+      *out_type = QOOB_BINARY_TYPE_DOL;
+    }
+    return err;
+  }
+
+  if (type == QOOB_BINARY_TYPE_DOL && mode != QOOB_MINIMIZE_NONE) {
+    return dol_trim (data, size, out, out_size);
+  }
+
+  /* Nothing to do. Just copy. */
+  *out = malloc (size > 0 ? size : 1);
+  if (*out == NULL) {
+    return QOOB_ERROR_NO_MEMORY;
+  }
+  memcpy (*out, data, size);
+  *out_size = size;
+
+  return QOOB_ERROR_OK;
+}
+
+/*
+ * qoob_image_gcb_build ()
+ *
+ * Adds GCB header in front of ELF or DOL and fills the last slot with 
+ * pad, zero as always or QOOB_PRO_ERASED_BYTE for sparse write. Free gcb
+ * after use.
+ */
+qoob_error_t 
+qoob_image_gcb_build (const char *name,
+                      const char *data,
+                      size_t size,
+                      char pad,
+                      char **gcb,
+                      size_t *gcb_size)
+{
+  unsigned short int used_slots;
+
+  if (data == NULL || gcb == NULL || gcb_size == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  used_slots = qoob_file_slots_needed (QOOB_BINARY_TYPE_ELF, size);
+  if (used_slots > QOOB_PRO_SLOTS) {
+    return QOOB_ERROR_TOO_BIG_DATA;
+  }
+
+  *gcb_size = (size_t)used_slots * QOOB_PRO_SLOT_SIZE;
+  *gcb = malloc (*gcb_size);
+  if (*gcb == NULL) {
+    return QOOB_ERROR_NO_MEMORY;
+  }
+  qoob_image_gcb_header (name, data, size, *gcb);
+
+  /* Given file and padding */
+  memcpy (*gcb+QOOB_GCB_HEADER_SIZE, data, size);
+  memset (*gcb+QOOB_GCB_HEADER_SIZE+size, pad, 
+          *gcb_size-QOOB_GCB_HEADER_SIZE-size);
+
+  return QOOB_ERROR_OK;
+}
+#endif
+
+/*
+ * qoob_image_gcb_header ()
+ *
+ * GCB header of ELF or DOL data, which goes right after it. Data has to
+ * fit to flash with the header.
+ */
+void
+qoob_image_gcb_header (const char *name,
+                       const char *data,
+                       size_t size,
+                       char header[QOOB_GCB_HEADER_SIZE])
+{
+  size_t name_len = 0;
+  unsigned char *digest;
+
+  memset (header, 0, QOOB_GCB_HEADER_SIZE);
+
+  /* 1. Write ELF\0 for both ELF and DOL there is such thing */
+  memcpy (header, "ELF\0", 4);
+
+  /* 2. Name */
+  if (name != NULL) {
+    name_len = strlen (name);
+    if (name_len > QOOB_GCB_NAME_SIZE)
+      name_len = QOOB_GCB_NAME_SIZE;
+    memcpy (header+QOOB_GCB_NAME_OFFSET, name, name_len);
+  }
+
+  /* 3. Rest of the header is zeros except how many slots is used */
+  header[QOOB_GCB_SLOTS_OFFSET] = 
+    (char)qoob_file_slots_needed (QOOB_BINARY_TYPE_ELF, size);
+
+  /* 3b. Length and digest of the payload, so flashed build can be
+     recognized from the slot info */
+  digest = (unsigned char *)header+QOOB_GCB_DIGEST_OFFSET;
+  memcpy (digest, QOOB_GCB_DIGEST_MAGIC, QOOB_GCB_DIGEST_MAGIC_SIZE);
+  digest += QOOB_GCB_DIGEST_MAGIC_SIZE;
+  digest[0] = (unsigned char)(size >> 24);
+  digest[1] = (unsigned char)(size >> 16);
+  digest[2] = (unsigned char)(size >> 8);
+  digest[3] = (unsigned char)size;
+  qoob_digest_buffer (data, size, digest+4);
+}
+
+/*
+ * qoob_image_gcb_digest ()
+ *
+ * Reads payload length and digest qoob_image_gcb_build () stored in the
+ * header. Returns QOOB_FALSE if header was made by some other tool.
+ */
+qoob_boolean_t
+qoob_image_gcb_digest (const char *header,
+                       unsigned long *length,
+                       unsigned char digest[QOOB_DIGEST_SIZE])
+{
+  const char *p;
+
+  if (header == NULL) {
+    return QOOB_FALSE;
+  }
+
+  p = header+QOOB_GCB_DIGEST_OFFSET;
+  if (memcmp (p, QOOB_GCB_DIGEST_MAGIC, QOOB_GCB_DIGEST_MAGIC_SIZE) != 0) {
+    return QOOB_FALSE;
+  }
+  p += QOOB_GCB_DIGEST_MAGIC_SIZE;
+
+  if (length != NULL) {
+    *length = get32 (p, QOOB_TRUE);
+  }
+  if (digest != NULL) {
+    memcpy (digest, p+4, QOOB_DIGEST_SIZE);
+  }
+
+  return QOOB_TRUE;
+}
+
+/* Static functions */
+static unsigned long
+get32 (const char *p, qoob_boolean_t big)
+{
+  const unsigned char *u = (const unsigned char *)p;
+
+  if (big == QOOB_TRUE)
+    return ((unsigned long)u[0] << 24) | ((unsigned long)u[1] << 16) |
+           ((unsigned long)u[2] << 8) | u[3];
+  return ((unsigned long)u[3] << 24) | ((unsigned long)u[2] << 16) |
+         ((unsigned long)u[1] << 8) | u[0];
+}
+
+#ifndef QOOB_MINIMAL
+static unsigned long
+get16 (const char *p, qoob_boolean_t big)
+{
+  const unsigned char *u = (const unsigned char *)p;
+
+  if (big == QOOB_TRUE)
+    return ((unsigned long)u[0] << 8) | u[1];
+  return ((unsigned long)u[1] << 8) | u[0];
+}
+
+static void
+put16 (char *p, unsigned long v, qoob_boolean_t big)
+{
+  if (big == QOOB_TRUE) {
+    p[0] = (char)(v >> 8);
+    p[1] = (char)v;
+  } else {
+    p[1] = (char)(v >> 8);
+    p[0] = (char)v;
+  }
+}
+
+static void
+put32 (char *p, unsigned long v, qoob_boolean_t big)
+{
+  if (big == QOOB_TRUE) {
+    p[0] = (char)(v >> 24);
+    p[1] = (char)(v >> 16);
+    p[2] = (char)(v >> 8);
+    p[3] = (char)v;
+  } else {
+    p[3] = (char)(v >> 24);
+    p[2] = (char)(v >> 16);
+    p[1] = (char)(v >> 8);
+    p[0] = (char)v;
+  }
+}
+
+static size_t
+align_up (size_t v, size_t a)
+{
+  return (v + a - 1) & ~(a - 1);
+}
+
+/* 
+ * First offset from v which keeps p_offset of the segment same modulo 
+ * p_align, so p_offset and p_vaddr stay congruent as ELF requires.
+ */
+static size_t
+align_segment (size_t v, const elf_segment_t *segment)
+{
+  if (segment->align <= 1) {
+    return align_up (v, SEGMENT_ALIGN);
+  }
+  return v + (segment->offset + segment->align - v % segment->align) 
+    % segment->align;
+}
+
+static qoob_error_t
+elf_segments (const char *data,
+              size_t size,
+              qoob_boolean_t *big,
+              elf_segment_t *segments,
+              int *count)
+{
+  unsigned long phoff;
+  unsigned long phentsize;
+  unsigned long phnum;
+  unsigned long i;
+
+  *count = 0;
+
+  if (size < ELF_HEADER_SIZE ||
+      data[0] != 0x7f || data[1] != 'E' || data[2] != 'L' || data[3] != 'F' ||
+      data[4] != ELF_CLASS_32) {
+    return QOOB_ERROR_NOT_SUPPORTED_FILE_FORMAT;
+  }
+  *big = (data[5] == ELF_DATA_MSB) ? QOOB_TRUE : QOOB_FALSE;
+
+  phoff = get32 (data+28, *big);
+  phentsize = get16 (data+42, *big);
+  phnum = get16 (data+44, *big);
+
+  if (phentsize < ELF_PHDR_SIZE || 
+      phoff > size || 
+      phnum > (size - phoff) / phentsize) {
+    return QOOB_ERROR_NOT_SUPPORTED_FILE_FORMAT;
+  }
+
+  for (i=0; i<phnum; i++) {
+    const char *ph = data + phoff + i*phentsize;
+    elf_segment_t *s;
+
+    if (get32 (ph, *big) != ELF_PT_LOAD)
+      continue;
+
+    if (*count == ELF_MAX_SEGMENTS) {
+      return QOOB_ERROR_NOT_SUPPORTED_FILE_FORMAT;
+    }
+
+    s = &segments[*count];
+    s->offset = get32 (ph+4, *big);
+    s->vaddr = get32 (ph+8, *big);
+    s->filesz = get32 (ph+16, *big);
+    s->memsz = get32 (ph+20, *big);
+    s->flags = get32 (ph+24, *big);
+    s->align = get32 (ph+28, *big);
+    s->phdr = (int)i;
+
+    if (s->filesz > size || s->offset > size - s->filesz) {
+      return QOOB_ERROR_NOT_SUPPORTED_FILE_FORMAT;
+    }
+    (*count)++;
+  }
+
+  if (*count == 0) {
+    return QOOB_ERROR_NOT_SUPPORTED_FILE_FORMAT;
+  }
+
+  return QOOB_ERROR_OK;
+}
+
+/* ELF header, PT_LOAD program headers and their data. No sections. */
+static qoob_error_t
+elf_strip (const char *data,
+           size_t size,
+           char **out,
+           size_t *out_size)
+{
+  elf_segment_t segments[ELF_MAX_SEGMENTS];
+  unsigned long phentsize;
+  unsigned long phoff;
+  qoob_boolean_t big;
+  qoob_error_t err;
+  size_t offset;
+  int count;
+  int i;
+
+  err = elf_segments (data, size, &big, segments, &count);
+  if (err != QOOB_ERROR_OK) {
+    return err;
+  }
+
+  phoff = get32 (data+28, big);
+  phentsize = get16 (data+42, big);
+
+  /* Layout */
+  offset = ELF_HEADER_SIZE + (size_t)count * ELF_PHDR_SIZE;
+  for (i=0; i<count; i++) {
+    offset = align_segment (offset, &segments[i]) + segments[i].filesz;
+  }
+
+  *out_size = offset;
+  *out = calloc (1, *out_size);
+  if (*out == NULL) {
+    return QOOB_ERROR_NO_MEMORY;
+  }
+
+  memcpy (*out, data, ELF_HEADER_SIZE);
+  put32 (*out+28, ELF_HEADER_SIZE, big);     /* e_phoff */
+  put32 (*out+32, 0, big);                   /* e_shoff */
+  put16 (*out+40, ELF_HEADER_SIZE, big);     /* e_ehsize */
+  put16 (*out+42, ELF_PHDR_SIZE, big);       /* e_phentsize */
+  put16 (*out+44, (unsigned long)count, big);/* e_phnum */
+  put16 (*out+48, 0, big);                   /* e_shnum */
+  put16 (*out+50, 0, big);                   /* e_shstrndx */
+
+  offset = ELF_HEADER_SIZE + (size_t)count * ELF_PHDR_SIZE;
+  for (i=0; i<count; i++) {
+    char *ph = *out + ELF_HEADER_SIZE + i*ELF_PHDR_SIZE;
+
+    offset = align_segment (offset, &segments[i]);
+
+    memcpy (ph, data + phoff + segments[i].phdr*phentsize, ELF_PHDR_SIZE);
+    put32 (ph+4, (unsigned long)offset, big);
+
+    memcpy (*out+offset, data+segments[i].offset, segments[i].filesz);
+    offset += segments[i].filesz;
+  }
+
+  return QOOB_ERROR_OK;
+}
+
+static qoob_error_t
+elf_to_dol (const char *data,
+            size_t size,
+            char **out,
+            size_t *out_size)
+{
+  elf_segment_t segments[ELF_MAX_SEGMENTS];
+  qoob_boolean_t big;
+  qoob_error_t err;
+  unsigned long bss_start = 0;
+  unsigned long bss_end = 0;
+  size_t offset;
+  int text = 0;
+  int dat = 0;
+  int count;
+  int i;
+
+  err = elf_segments (data, size, &big, segments, &count);
+  if (err != QOOB_ERROR_OK) {
+    return err;
+  }
+
+  if (get16 (data+18, big) != ELF_MACHINE_PPC) {
+    return QOOB_ERROR_NOT_SUPPORTED_FILE_FORMAT;
+  }
+
+  offset = QOOB_DOL_HEADER_SIZE;
+  for (i=0; i<count; i++) {
+    if (segments[i].filesz > 0) {
+      offset = align_up (offset, SEGMENT_ALIGN) + segments[i].filesz;
+    }
+  }
+
+  *out_size = offset;
+  *out = calloc (1, *out_size);
+  if (*out == NULL) {
+    return QOOB_ERROR_NO_MEMORY;
+  }
+
+  offset = QOOB_DOL_HEADER_SIZE;
+  for (i=0; i<count; i++) {
+    elf_segment_t *s = &segments[i];
+
+    /* Uninitialized part goes to bss */
+    if (s->memsz > s->filesz) {
+      unsigned long start = s->vaddr + s->filesz;
+      unsigned long end = s->vaddr + s->memsz;
+
+      if (bss_end == 0 || start < bss_start)
+        bss_start = start;
+      if (end > bss_end)
+        bss_end = end;
+    }
+
+    if (s->filesz == 0)
+      continue;
+
+    offset = align_up (offset, SEGMENT_ALIGN);
+
+    /* text: offsets 0x00, addresses 0x48, sizes 0x90
+       data: offsets 0x1c, addresses 0x64, sizes 0xac */
+    if (s->flags & ELF_PF_X) {
+      if (text == DOL_TEXT_SECTIONS)
+        goto toomany;
+      put32 (*out+0x00+text*4, (unsigned long)offset, QOOB_TRUE);
+      put32 (*out+0x48+text*4, s->vaddr, QOOB_TRUE);
+      put32 (*out+0x90+text*4, s->filesz, QOOB_TRUE);
+      text++;
+    } else {
+      if (dat == DOL_DATA_SECTIONS)
+        goto toomany;
+      put32 (*out+0x1c+dat*4, (unsigned long)offset, QOOB_TRUE);
+      put32 (*out+0x64+dat*4, s->vaddr, QOOB_TRUE);
+      put32 (*out+0xac+dat*4, s->filesz, QOOB_TRUE);
+      dat++;
+    }
+
+    memcpy (*out+offset, data+s->offset, s->filesz);
+    offset += s->filesz;
+  }
+
+  put32 (*out+0xd8, bss_start, QOOB_TRUE);
+  put32 (*out+0xdc, bss_end-bss_start, QOOB_TRUE);
+  put32 (*out+0xe0, get32 (data+24, big), QOOB_TRUE);
+
+  return QOOB_ERROR_OK;
+
+ toomany:
+  free (*out);
+  *out = NULL;
+  *out_size = 0;
+  return QOOB_ERROR_NOT_SUPPORTED_FILE_FORMAT;
+}
+
+/* DOL ends where its last section ends */
+static qoob_error_t
+dol_trim (const char *data,
+          size_t size,
+          char **out,
+          size_t *out_size)
+{
+  binary_type_t type;
+  size_t end = QOOB_DOL_HEADER_SIZE;
+  int i;
+
+  qoob_file_format_parse_buffer (data, size, size, &type);
+  if (type != QOOB_BINARY_TYPE_DOL) {
+    return QOOB_ERROR_NOT_SUPPORTED_FILE_FORMAT;
+  }
+
+  /* 7 text and 11 data sections. Offsets at 0x00, sizes at 0x90. */
+  for (i=0; i<DOL_TEXT_SECTIONS+DOL_DATA_SECTIONS; i++) {
+    size_t o = (size_t)get32 (data+i*4, QOOB_TRUE);
+    size_t s = (size_t)get32 (data+0x90+i*4, QOOB_TRUE);
+
+    if (s > 0 && o+s > end)
+      end = o+s;
+  }
+
+  *out_size = end;
+  *out = malloc (end);
+  if (*out == NULL) {
+    return QOOB_ERROR_NO_MEMORY;
+  }
+  memcpy (*out, data, end);
+
+  return QOOB_ERROR_OK;
+}
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
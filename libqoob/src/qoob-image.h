@@ -0,0 +1,79 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include <stddef.h>
+
+#include "qoob-defaults.h"
+#include "qoob-digest.h"
+#include "qoob-error.h"
+
+#ifndef _QOOB_IMAGE_H_
+#define _QOOB_IMAGE_H_
+
+/* How ELF and DOL files are minimized before GCB header is added */
+typedef enum {
+  QOOB_MINIMIZE_NONE = 0,
+  QOOB_MINIMIZE_STRIP,    /* ELF: loadable segments only. DOL: trim tail */
+  QOOB_MINIMIZE_DOL       /* ELF is converted to DOL. DOL: trim tail */
+} qoob_minimize_t;
+
+/* Functions which give new buffers are not in minimal build */
+#ifndef QOOB_MINIMAL
+qoob_error_t qoob_image_load (const char *file, 
+                              char **data, 
+                              size_t *size);
+qoob_error_t qoob_image_load_fd (int fd, 
+                                 char **data, 
+                                 size_t *size);
+
+qoob_error_t qoob_image_minimize (qoob_minimize_t mode,
+                                  binary_type_t type,
+                                  const char *data,
+                                  size_t size,
+                                  char **out,
+                                  size_t *out_size,
+                                  binary_type_t *out_type);
+
+qoob_error_t qoob_image_gcb_build (const char *name,
+                                   const char *data,
+                                   size_t size,
+                                   char pad,
+                                   char **gcb,
+                                   size_t *gcb_size);
+#endif
+void qoob_image_gcb_header (const char *name,
+                            const char *data,
+                            size_t size,
+                            char header[QOOB_GCB_HEADER_SIZE]);
+qoob_boolean_t qoob_image_gcb_digest (const char *header,
+                                      unsigned long *length,
+                                      unsigned char digest[QOOB_DIGEST_SIZE]);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
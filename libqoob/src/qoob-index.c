@@ -0,0 +1,821 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+
+#include "qoob-file.h"
+#include "qoob-index.h"
+
+#define INDEX_HEADER "# libqoob image index"
+#define INDEX_LINE_MAX (2*(PATH_MAX+QOOB_GCB_NAME_SIZE)+256) /* escaped */
+#define PROBE_BUFFER_SIZE 0x4000
+
+typedef struct ScanJob scan_job_t;
+struct ScanJob
+{
+  char *path;
+  qoob_index_entry_t entry;
+  qoob_error_t error;
+};
+
+typedef struct ScanQueue scan_queue_t;
+struct ScanQueue
+{
+  pthread_mutex_t lock;
+  scan_job_t *jobs;
+  int count;
+  int next;
+};
+
+static qoob_error_t index_load (qoob_index_t *index);
+static qoob_index_entry_t *index_find (qoob_index_t *index, 
+                                       const char *path,
+                                       int sorted);
+static qoob_error_t index_update (qoob_index_t *index, 
+                                  const char *path,
+                                  qoob_index_entry_t *entry,
+                                  int sorted);
+static void index_sort (qoob_index_t *index);
+static qoob_error_t collect_files (qoob_index_t *index,
+                                   const char *directory,
+                                   scan_job_t **jobs,
+                                   int *count,
+                                   int *allocated);
+static void *scan_worker (void *data);
+
+static const char *type_to_string (binary_type_t type);
+static binary_type_t string_to_type (const char *str);
+static void write_escaped (FILE *f, const char *str);
+static int unescape (char *str);
+
+qoob_error_t
+qoob_index_open (qoob_index_t *index, 
+                 const char *file)
+{
+  if (index == NULL || file == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  index->entries = NULL;
+  index->count = 0;
+  index->allocated = 0;
+  index->modified = QOOB_FALSE;
+
+  index->file = strdup (file);
+  if (index->file == NULL) {
+    return QOOB_ERROR_NO_MEMORY;
+  }
+
+  return index_load (index);
+}
+
+qoob_error_t
+qoob_index_save (qoob_index_t *index)
+{
+  FILE *f;
+  char *tmp;
+  int i;
+
+  if (index == NULL || index->file == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  if (index->modified != QOOB_TRUE) {
+    return QOOB_ERROR_OK;
+  }
+
+  /* Write to side and rename. Index is never half written. */
+  tmp = malloc (strlen (index->file) + 5);
+  if (tmp == NULL) {
+    return QOOB_ERROR_NO_MEMORY;
+  }
+  sprintf (tmp, "%s.tmp", index->file);
+
+  f = fopen (tmp, "w");
+  if (f == NULL) {
+    free (tmp);
+    return QOOB_ERROR_FD_OPEN;
+  }
+
+  fprintf (f, "%s %d\n", INDEX_HEADER, QOOB_INDEX_VERSION);
+  for (i=0; i<index->count; i++) {
+    qoob_index_entry_t *e = &index->entries[i];
+    char digest[QOOB_DIGEST_STRING_SIZE];
+
+    qoob_digest_to_string (e->digest, digest);
+    fprintf (f, "%ld\t%lld\t%s\t%u\t%s\t",
+             (long int)e->mtime,
+             (long long int)e->size,
+             type_to_string (e->type),
+             (unsigned int)e->slots_used,
+             digest);
+    write_escaped (f, e->name);
+    fputc ('\t', f);
+    write_escaped (f, e->path);
+    fputc ('\n', f);
+  }
+
+  if (fclose (f) != 0) {
+    unlink (tmp);
+    free (tmp);
+    return QOOB_ERROR_FD_WRITE;
+  }
+
+  if (rename (tmp, index->file) != 0) {
+    unlink (tmp);
+    free (tmp);
+    return QOOB_ERROR_FD_WRITE;
+  }
+  free (tmp);
+
+  index->modified = QOOB_FALSE;
+
+  return QOOB_ERROR_OK;
+}
+
+void
+qoob_index_close (qoob_index_t *index)
+{
+  int i;
+
+  if (index == NULL)
+    return;
+
+  for (i=0; i<index->count; i++) {
+    free (index->entries[i].path);
+  }
+  free (index->entries);
+  free (index->file);
+
+  index->entries = NULL;
+  index->file = NULL;
+  index->count = 0;
+  index->allocated = 0;
+}
+
+/*
+ * qoob_index_scan ()
+ *
+ *   input: index - index to update
+ *          directory - directory to scan recursively
+ *          threads - how many files are probed at once. Less than one
+ *                    means number of online processors.
+ *
+ * Only new and changed files are read. Entries of removed files under
+ * directory are dropped.
+ */
+qoob_error_t
+qoob_index_scan (qoob_index_t *index, 
+                 const char *directory,
+                 int threads)
+{
+  char root[PATH_MAX];
+  scan_queue_t queue;
+  pthread_t *workers = NULL;
+  int allocated = 0;
+  int sorted;
+  int started = 0;
+  qoob_error_t err;
+  size_t root_len;
+  int i;
+
+  if (index == NULL || directory == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  if (realpath (directory, root) == NULL) {
+    return QOOB_ERROR_FILE_NOT_VALID;
+  }
+
+  for (i=0; i<index->count; i++) {
+    index->entries[i].seen = QOOB_FALSE;
+  }
+
+  queue.jobs = NULL;
+  queue.count = 0;
+  queue.next = 0;
+
+  err = collect_files (index, root, &queue.jobs, &queue.count, &allocated);
+  if (err != QOOB_ERROR_OK) {
+    goto out;
+  }
+
+  if (threads < 1) {
+    long n = sysconf (_SC_NPROCESSORS_ONLN);
+    threads = (n > 0) ? (int)n : 1;
+  }
+  if (threads > queue.count) {
+    threads = queue.count;
+  }
+
+  pthread_mutex_init (&queue.lock, NULL);
+
+  if (threads > 1) {
+    workers = malloc (sizeof (pthread_t) * (size_t)threads);
+    if (workers == NULL) {
+      err = QOOB_ERROR_NO_MEMORY;
+      pthread_mutex_destroy (&queue.lock);
+      goto out;
+    }
+    for (started=0; started<threads; started++) {
+      if (pthread_create (&workers[started], NULL, scan_worker, &queue) != 0)
+        break;
+    }
+  }
+
+  /* Caller works too. Handles everything if threads were not started. */
+  scan_worker (&queue);
+
+  for (i=0; i<started; i++) {
+    pthread_join (workers[i], NULL);
+  }
+  free (workers);
+  pthread_mutex_destroy (&queue.lock);
+
+  /* Merge results. New files are appended after sorted part. */
+  sorted = index->count;
+  for (i=0; i<queue.count; i++) {
+    if (queue.jobs[i].error != QOOB_ERROR_OK)
+      continue;
+    err = index_update (index, queue.jobs[i].path, &queue.jobs[i].entry,
+                        sorted);
+    if (err != QOOB_ERROR_OK)
+      goto out;
+  }
+
+  /* Drop files which are not there anymore */
+  root_len = strlen (root);
+  for (i=0; i<index->count; ) {
+    qoob_index_entry_t *e = &index->entries[i];
+
+    if (e->seen != QOOB_TRUE &&
+        strncmp (e->path, root, root_len) == 0 &&
+        (e->path[root_len] == QOOB_DIRECTORY_SEPARATOR || 
+         root[root_len-1] == QOOB_DIRECTORY_SEPARATOR)) {
+      free (e->path);
+      memmove (e, e+1, sizeof (qoob_index_entry_t) * (size_t)(index->count-i-1));
+      index->count--;
+      index->modified = QOOB_TRUE;
+      continue;
+    }
+    i++;
+  }
+
+  index_sort (index);
+  err = QOOB_ERROR_OK;
+
+ out:
+  for (i=0; i<queue.count; i++) {
+    free (queue.jobs[i].path);
+  }
+  free (queue.jobs);
+
+  return err;
+}
+
+/*
+ * qoob_index_lookup ()
+ *
+ * Finds entry of the file. File is probed and added to the index if it 
+ * is not there or it has been changed. Returned entry is valid until index
+ * is modified next time.
+ */
+qoob_error_t
+qoob_index_lookup (qoob_index_t *index, 
+                   const char *path,
+                   const qoob_index_entry_t **entry)
+{
+  char real[PATH_MAX];
+  struct stat sbuf;
+  qoob_index_entry_t *e;
+  qoob_index_entry_t probed;
+  qoob_error_t err;
+
+  if (index == NULL || path == NULL || entry == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+  *entry = NULL;
+
+  if (realpath (path, real) == NULL) {
+    return QOOB_ERROR_FILE_NOT_VALID;
+  }
+
+  if (stat (real, &sbuf) == -1) {
+    return QOOB_ERROR_FILE_STAT;
+  }
+
+  e = index_find (index, real, index->count);
+  if (e != NULL && 
+      e->mtime == sbuf.st_mtime && 
+      e->size == sbuf.st_size) {
+    *entry = e;
+    return QOOB_ERROR_OK;
+  }
+
+  err = qoob_index_probe (real, &probed);
+  if (err != QOOB_ERROR_OK) {
+    return err;
+  }
+
+  err = index_update (index, real, &probed, index->count);
+  if (err != QOOB_ERROR_OK) {
+    return err;
+  }
+  index_sort (index);
+
+  *entry = index_find (index, real, index->count);
+
+  return QOOB_ERROR_OK;
+}
+
+/*
+ * qoob_index_probe ()
+ *
+ * Reads file once and fills everything except entry->path.
+ */
+qoob_error_t
+qoob_index_probe (const char *path, 
+                  qoob_index_entry_t *entry)
+{
+  int fd;
+  struct stat sbuf;
+  char buf[PROBE_BUFFER_SIZE];
+  char head[QOOB_GCB_HEADER_SIZE];
+  size_t head_len = 0;
+  qoob_digest_t digest;
+  qoob_boolean_t hash;
+  ssize_t r;
+  size_t i;
+
+  if (path == NULL || entry == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  fd = open (path, O_RDONLY);
+  if (fd == -1) {
+    return QOOB_ERROR_FD_OPEN;
+  }
+
+  if (fstat (fd, &sbuf) == -1 || !S_ISREG (sbuf.st_mode)) {
+    close (fd);
+    return QOOB_ERROR_FILE_STAT;
+  }
+
+  entry->mtime = sbuf.st_mtime;
+  entry->size = sbuf.st_size;
+  entry->seen = QOOB_TRUE;
+  memset (entry->digest, 0, QOOB_DIGEST_SIZE);
+
+  /* Files bigger than flash can not be written. Header is enough. */
+  hash = (sbuf.st_size <= QOOB_PRO_TOTAL_SIZE) ? QOOB_TRUE : QOOB_FALSE;
+
+  qoob_digest_init (&digest);
+  while ((r = read (fd, buf, sizeof (buf))) > 0) {
+    if (head_len < sizeof (head)) {
+      size_t n = sizeof (head) - head_len;
+      if (n > (size_t)r)
+        n = (size_t)r;
+      memcpy (head+head_len, buf, n);
+      head_len += n;
+    }
+    if (hash != QOOB_TRUE) {
+      if (head_len == sizeof (head))
+        break;
+      continue;
+    }
+    qoob_digest_update (&digest, buf, (size_t)r);
+  }
+  close (fd);
+
+  if (r < 0) {
+    return QOOB_ERROR_FD_READ;
+  }
+
+  if (hash == QOOB_TRUE) {
+    qoob_digest_final (&digest, entry->digest);
+  }
+
+  qoob_file_format_parse_buffer (head, head_len, (size_t)sbuf.st_size, 
+                                 &entry->type);
+  entry->slots_used = qoob_file_slots_needed (entry->type, 
+                                              (size_t)sbuf.st_size);
+
+  /* Name as it is shown in the slot list */
+  entry->name[0] = '\0';
+  switch (entry->type) {
+  case QOOB_BINARY_TYPE_GCB:
+    for (i=0; 
+         i<QOOB_GCB_NAME_SIZE && 
+           QOOB_GCB_NAME_OFFSET+i < head_len &&
+           head[QOOB_GCB_NAME_OFFSET+i] != '\0'; 
+         i++) {
+      entry->name[i] = head[QOOB_GCB_NAME_OFFSET+i];
+    }
+    entry->name[i] = '\0';
+    break;
+  case QOOB_BINARY_TYPE_CONFIG:
+    strcpy (entry->name, "Config");
+    break;
+  case QOOB_BINARY_TYPE_ELF:
+  case QOOB_BINARY_TYPE_DOL:
+    qoob_file_app_name (path, entry->name, sizeof (entry->name));
+    break;
+  default:
+    break;
+  }
+
+  /* Index is line based */
+  for (i=0; entry->name[i] != '\0'; i++) {
+    if ((unsigned char)entry->name[i] < 0x20) {
+      entry->name[i] = ' ';
+    }
+  }
+
+  return QOOB_ERROR_OK;
+}
+
+/* Static functions */
+static qoob_error_t
+index_load (qoob_index_t *index)
+{
+  FILE *f;
+  char *line;
+  char header[sizeof (INDEX_HEADER) + 16];
+  qoob_error_t err = QOOB_ERROR_OK;
+
+  f = fopen (index->file, "r");
+  if (f == NULL) {
+    /* New index */
+    if (errno == ENOENT)
+      return QOOB_ERROR_OK;
+    return QOOB_ERROR_FD_OPEN;
+  }
+
+  sprintf (header, "%s %d\n", INDEX_HEADER, QOOB_INDEX_VERSION);
+
+  line = malloc (INDEX_LINE_MAX);
+  if (line == NULL) {
+    fclose (f);
+    return QOOB_ERROR_NO_MEMORY;
+  }
+
+  if (fgets (line, INDEX_LINE_MAX, f) == NULL || 
+      strcmp (line, header) != 0) {
+    /* Other version is just rebuilt */
+    goto out;
+  }
+
+  while (fgets (line, INDEX_LINE_MAX, f) != NULL) {
+    qoob_index_entry_t e;
+    char *field[7];
+    char *p = line;
+    size_t len = strlen (line);
+    int i;
+
+    if (len == 0 || line[len-1] != '\n') {
+      err = QOOB_ERROR_INDEX_NOT_VALID;
+      break;
+    }
+    line[len-1] = '\0';
+
+    for (i=0; i<7; i++) {
+      field[i] = p;
+      if (i == 6)
+        break;
+      p = strchr (p, '\t');
+      if (p == NULL)
+        break;
+      *p++ = '\0';
+    }
+    if (i != 6 || 
+        qoob_digest_from_string (field[4], e.digest) != 0 ||
+        unescape (field[5]) != 0 || unescape (field[6]) != 0 ||
+        strlen (field[5]) > QOOB_GCB_NAME_SIZE) {
+      err = QOOB_ERROR_INDEX_NOT_VALID;
+      break;
+    }
+
+    e.mtime = (time_t)strtol (field[0], NULL, 10);
+    e.size = (off_t)strtoll (field[1], NULL, 10);
+    e.type = string_to_type (field[2]);
+    e.slots_used = (unsigned short int)strtoul (field[3], NULL, 10);
+    strcpy (e.name, field[5]);
+    e.seen = QOOB_FALSE;
+
+    /* Index is saved sorted and paths are unique */
+    err = index_update (index, field[6], &e, 0);
+    if (err != QOOB_ERROR_OK)
+      break;
+  }
+
+ out:
+  free (line);
+  fclose (f);
+
+  index_sort (index);
+  index->modified = QOOB_FALSE;
+
+  /* Broken index is rebuilt like other version */
+  if (err == QOOB_ERROR_INDEX_NOT_VALID) {
+    int i;
+
+    for (i=0; i<index->count; i++) {
+      free (index->entries[i].path);
+    }
+    index->count = 0;
+    index->modified = QOOB_TRUE;
+    err = QOOB_ERROR_OK;
+  }
+
+  return err;
+}
+
+static int
+entry_compare (const void *a, const void *b)
+{
+  return strcmp (((const qoob_index_entry_t *)a)->path,
+                 ((const qoob_index_entry_t *)b)->path);
+}
+
+static void
+index_sort (qoob_index_t *index)
+{
+  if (index->count > 1) {
+    qsort (index->entries, (size_t)index->count, 
+           sizeof (qoob_index_entry_t), entry_compare);
+  }
+}
+
+/* Searches first sorted entries */
+static qoob_index_entry_t *
+index_find (qoob_index_t *index, 
+            const char *path,
+            int sorted)
+{
+  qoob_index_entry_t key;
+
+  if (sorted == 0)
+    return NULL;
+
+  key.path = (char *)path;
+  return bsearch (&key, index->entries, (size_t)sorted,
+                  sizeof (qoob_index_entry_t), entry_compare);
+}
+
+/* Replaces or appends entry. Index has to be sorted after appends. */
+static qoob_error_t
+index_update (qoob_index_t *index, 
+              const char *path,
+              qoob_index_entry_t *entry,
+              int sorted)
+{
+  qoob_index_entry_t *e = index_find (index, path, sorted);
+
+  if (e == NULL) {
+    if (index->count == index->allocated) {
+      int allocated = (index->allocated > 0) ? index->allocated*2 : 64;
+      qoob_index_entry_t *n;
+
+      n = realloc (index->entries, 
+                   sizeof (qoob_index_entry_t) * (size_t)allocated);
+      if (n == NULL) {
+        return QOOB_ERROR_NO_MEMORY;
+      }
+      index->entries = n;
+      index->allocated = allocated;
+    }
+
+    e = &index->entries[index->count];
+    e->path = strdup (path);
+    if (e->path == NULL) {
+      return QOOB_ERROR_NO_MEMORY;
+    }
+    index->count++;
+  }
+
+  e->mtime = entry->mtime;
+  e->size = entry->size;
+  e->type = entry->type;
+  e->slots_used = entry->slots_used;
+  memcpy (e->name, entry->name, sizeof (e->name));
+  memcpy (e->digest, entry->digest, QOOB_DIGEST_SIZE);
+  e->seen = entry->seen;
+
+  index->modified = QOOB_TRUE;
+
+  return QOOB_ERROR_OK;
+}
+
+static qoob_error_t
+collect_files (qoob_index_t *index,
+               const char *directory,
+               scan_job_t **jobs,
+               int *count,
+               int *allocated)
+{
+  DIR *dir;
+  struct dirent *d;
+  qoob_error_t err = QOOB_ERROR_OK;
+
+  dir = opendir (directory);
+  if (dir == NULL) {
+    return QOOB_ERROR_FD_OPEN;
+  }
+
+  while ((d = readdir (dir)) != NULL) {
+    char path[PATH_MAX];
+    struct stat sbuf;
+    qoob_index_entry_t *e;
+
+    if (strcmp (d->d_name, ".") == 0 || strcmp (d->d_name, "..") == 0)
+      continue;
+
+    if (snprintf (path, sizeof (path), "%s%s%s", directory,
+                  (directory[strlen (directory)-1] == 
+                   QOOB_DIRECTORY_SEPARATOR) ? "" : "/",
+                  d->d_name) >= (int)sizeof (path)) {
+      continue;
+    }
+
+    /* Symbolic links are not followed. No loops. */
+    if (lstat (path, &sbuf) == -1)
+      continue;
+
+    if (S_ISDIR (sbuf.st_mode)) {
+      err = collect_files (index, path, jobs, count, allocated);
+      if (err != QOOB_ERROR_OK)
+        break;
+      continue;
+    }
+
+    if (!S_ISREG (sbuf.st_mode))
+      continue;
+
+    /* Unchanged */
+    e = index_find (index, path, index->count);
+    if (e != NULL && 
+        e->mtime == sbuf.st_mtime && 
+        e->size == sbuf.st_size) {
+      e->seen = QOOB_TRUE;
+      continue;
+    }
+
+    if (*count == *allocated) {
+      int n = (*allocated > 0) ? *allocated*2 : 64;
+      scan_job_t *j = realloc (*jobs, sizeof (scan_job_t) * (size_t)n);
+      if (j == NULL) {
+        err = QOOB_ERROR_NO_MEMORY;
+        break;
+      }
+      *jobs = j;
+      *allocated = n;
+    }
+
+    (*jobs)[*count].path = strdup (path);
+    if ((*jobs)[*count].path == NULL) {
+      err = QOOB_ERROR_NO_MEMORY;
+      break;
+    }
+    (*jobs)[*count].error = QOOB_ERROR_FILE_NOT_VALID;
+    (*count)++;
+  }
+
+  closedir (dir);
+
+  return err;
+}
+
+static void *
+scan_worker (void *data)
+{
+  scan_queue_t *queue = (scan_queue_t *)data;
+
+  while (1) {
+    scan_job_t *job;
+
+    pthread_mutex_lock (&queue->lock);
+    if (queue->next >= queue->count) {
+      pthread_mutex_unlock (&queue->lock);
+      break;
+    }
+    job = &queue->jobs[queue->next++];
+    pthread_mutex_unlock (&queue->lock);
+
+    job->error = qoob_index_probe (job->path, &job->entry);
+  }
+
+  return NULL;
+}
+
+static const char *
+type_to_string (binary_type_t type)
+{
+  switch (type) {
+  case QOOB_BINARY_TYPE_CONFIG:
+    return "config";
+  case QOOB_BINARY_TYPE_BACKGROUND:
+    return "background";
+  case QOOB_BINARY_TYPE_GCB:
+    return "gcb";
+  case QOOB_BINARY_TYPE_ELF:
+    return "elf";
+  case QOOB_BINARY_TYPE_DOL:
+    return "dol";
+  default:
+    break;
+  }
+  return "void";
+}
+
+static binary_type_t
+string_to_type (const char *str)
+{
+  if (strcmp (str, "config") == 0)
+    return QOOB_BINARY_TYPE_CONFIG;
+  if (strcmp (str, "background") == 0)
+    return QOOB_BINARY_TYPE_BACKGROUND;
+  if (strcmp (str, "gcb") == 0)
+    return QOOB_BINARY_TYPE_GCB;
+  if (strcmp (str, "elf") == 0)
+    return QOOB_BINARY_TYPE_ELF;
+  if (strcmp (str, "dol") == 0)
+    return QOOB_BINARY_TYPE_DOL;
+  return QOOB_BINARY_TYPE_VOID;
+}
+
+/* Tab, newline and backslash would break the line format */
+static void
+write_escaped (FILE *f, 
+               const char *str)
+{
+  for (; *str != '\0'; str++) {
+    switch (*str) {
+    case '\t': fputs ("\\t", f); break;
+    case '\n': fputs ("\\n", f); break;
+    case '\r': fputs ("\\r", f); break;
+    case '\\': fputs ("\\\\", f); break;
+    default: fputc (*str, f); break;
+    }
+  }
+}
+
+/* In place. Returns non-zero for unknown escape. */
+static int
+unescape (char *str)
+{
+  char *out = str;
+
+  for (; *str != '\0'; str++) {
+    if (*str != '\\') {
+      *out++ = *str;
+      continue;
+    }
+    switch (*++str) {
+    case 't': *out++ = '\t'; break;
+    case 'n': *out++ = '\n'; break;
+    case 'r': *out++ = '\r'; break;
+    case '\\': *out++ = '\\'; break;
+    default: return -1;
+    }
+  }
+  *out = '\0';
+
+  return 0;
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
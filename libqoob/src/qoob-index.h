@@ -0,0 +1,91 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include <sys/types.h>
+#include <time.h>
+
+#include "qoob-defaults.h"
+#include "qoob-error.h"
+#include "qoob-digest.h"
+
+#ifndef _QOOB_INDEX_H_
+#define _QOOB_INDEX_H_
+
+/* 
+ * Persistent index of image files. Keeps detected format, slot count, GCB 
+ * name and digest of each file so choosing images does not need to read 
+ * them again. Entry is valid as long as files mtime and size are same.
+ */
+
+#define QOOB_INDEX_VERSION 2
+
+typedef struct QoobIndexEntry qoob_index_entry_t;
+struct QoobIndexEntry
+{
+  char *path;
+  time_t mtime;
+  off_t size;
+
+  binary_type_t type;
+  unsigned short int slots_used;     /* Slots used after header synthesis */
+  char name[QOOB_GCB_NAME_SIZE+1];
+  unsigned char digest[QOOB_DIGEST_SIZE];
+
+  qoob_boolean_t seen;               /* Found in the latest scan */
+};
+
+typedef struct QoobIndex qoob_index_t;
+struct QoobIndex
+{
+  char *file;                        /* Where index is stored */
+
+  qoob_index_entry_t *entries;
+  int count;
+  int allocated;
+
+  qoob_boolean_t modified;
+};
+
+qoob_error_t qoob_index_open (qoob_index_t *index, 
+                              const char *file);
+qoob_error_t qoob_index_save (qoob_index_t *index);
+void qoob_index_close (qoob_index_t *index);
+
+qoob_error_t qoob_index_scan (qoob_index_t *index, 
+                              const char *directory,
+                              int threads);
+qoob_error_t qoob_index_lookup (qoob_index_t *index, 
+                                const char *path,
+                                const qoob_index_entry_t **entry);
+
+qoob_error_t qoob_index_probe (const char *path, 
+                               qoob_index_entry_t *entry);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
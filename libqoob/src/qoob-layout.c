@@ -0,0 +1,246 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <ctype.h>
+
+#include <sys/stat.h>
+
+#include "qoob-file.h"
+#include "qoob-layout.h"
+
+#define LAYOUT_LINE_MAX (PATH_MAX+64)
+
+static qoob_error_t layout_add (qoob_layout_t *layout,
+                                int *allocated,
+                                const char *base,
+                                short int slot,
+                                binary_type_t type,
+                                const char *file);
+static binary_type_t string_to_type (const char *str);
+
+/*
+ * qoob_layout_load ()
+ *
+ * Reads layout file and checks that every entry fits to flash and no
+ * entries overlap. On error line is set to the failing line, or zero if
+ * error is not about any single line.
+ */
+qoob_error_t
+qoob_layout_load (qoob_layout_t *layout, 
+                  const char *file,
+                  int *line)
+{
+  FILE *fp;
+  char buf[LAYOUT_LINE_MAX];
+  char base[PATH_MAX];
+  char *slash;
+  char used[QOOB_PRO_SLOTS];
+  int allocated = 0;
+  int n = 0;
+  int i;
+
+  if (layout == NULL || file == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  layout->entries = NULL;
+  layout->count = 0;
+  if (line != NULL)
+    *line = 0;
+
+  /* Directory of the layout with trailing slash */
+  strncpy (base, file, sizeof (base)-1);
+  base[sizeof (base)-1] = '\0';
+  slash = strrchr (base, '/');
+  if (slash != NULL)
+    slash[1] = '\0';
+  else
+    base[0] = '\0';
+
+  fp = fopen (file, "r");
+  if (fp == NULL) {
+    return QOOB_ERROR_FD_OPEN;
+  }
+
+  memset (used, 0, sizeof (used));
+  while (fgets (buf, sizeof (buf), fp) != NULL) {
+    char type[16];
+    short int slot;
+    char *p;
+    int len;
+    int pos = 0;
+    qoob_error_t err;
+    qoob_layout_entry_t *e;
+
+    n++;
+    if (line != NULL)
+      *line = n;
+
+    len = strlen (buf);
+    while (len > 0 && isspace ((unsigned char)buf[len-1]))
+      buf[--len] = '\0';
+    for (p = buf; isspace ((unsigned char)*p); p++)
+      ;
+    if (*p == '\0' || *p == '#')
+      continue;
+
+    if (sscanf (p, "%hd %15s %n", &slot, type, &pos) != 2 || 
+        p[pos] == '\0') {
+      fclose (fp);
+      qoob_layout_free (layout);
+      return QOOB_ERROR_LAYOUT_NOT_VALID;
+    }
+
+    err = layout_add (layout, &allocated, base, slot, 
+                      string_to_type (type), p+pos);
+    if (err != QOOB_ERROR_OK) {
+      fclose (fp);
+      qoob_layout_free (layout);
+      return err;
+    }
+
+    /* Each slot can be used only once */
+    e = &layout->entries[layout->count-1];
+    for (i=e->slot; i<e->slot+e->slots_used; i++) {
+      if (used[i]) {
+        fclose (fp);
+        qoob_layout_free (layout);
+        return QOOB_ERROR_LAYOUT_NOT_VALID;
+      }
+      used[i] = 1;
+    }
+  }
+  fclose (fp);
+
+  if (line != NULL)
+    *line = 0;
+
+  if (layout->count == 0) {
+    return QOOB_ERROR_LAYOUT_NOT_VALID;
+  }
+
+  return QOOB_ERROR_OK;
+}
+
+void
+qoob_layout_free (qoob_layout_t *layout)
+{
+  int i;
+
+  if (layout == NULL)
+    return;
+
+  for (i=0; i<layout->count; i++) {
+    free (layout->entries[i].file);
+  }
+  free (layout->entries);
+
+  layout->entries = NULL;
+  layout->count = 0;
+}
+
+/* Static functions */
+static qoob_error_t
+layout_add (qoob_layout_t *layout,
+            int *allocated,
+            const char *base,
+            short int slot,
+            binary_type_t type,
+            const char *file)
+{
+  qoob_layout_entry_t *e;
+  struct stat sbuf;
+  char *path;
+
+  if (type == QOOB_BINARY_TYPE_VOID) {
+    return QOOB_ERROR_NOT_SUPPORTED_FILE_FORMAT;
+  }
+  if (slot < 0 || slot >= QOOB_PRO_SLOTS) {
+    return QOOB_ERROR_SLOT_OUT_OF_RANGE;
+  }
+
+  path = (char *)malloc (strlen (base)+strlen (file)+1);
+  if (path == NULL) {
+    return QOOB_ERROR_NO_MEMORY;
+  }
+  if (file[0] == '/')
+    strcpy (path, file);
+  else
+    sprintf (path, "%s%s", base, file);
+
+  if (stat (path, &sbuf) == -1 || !S_ISREG (sbuf.st_mode)) {
+    free (path);
+    return QOOB_ERROR_FILE_STAT;
+  }
+
+  if (layout->count == *allocated) {
+    int size = *allocated ? *allocated*2 : 8;
+    qoob_layout_entry_t *entries;
+
+    entries = (qoob_layout_entry_t *)
+      realloc (layout->entries, sizeof (qoob_layout_entry_t)*size);
+    if (entries == NULL) {
+      free (path);
+      return QOOB_ERROR_NO_MEMORY;
+    }
+    layout->entries = entries;
+    *allocated = size;
+  }
+
+  e = &layout->entries[layout->count];
+  e->slot = slot;
+  e->type = type;
+  e->file = path;
+  e->slots_used = qoob_file_slots_needed (type, (size_t)sbuf.st_size);
+
+  if (e->slot+e->slots_used > QOOB_PRO_SLOTS) {
+    free (path);
+    return QOOB_ERROR_TOO_BIG_DATA;
+  }
+  layout->count++;
+
+  return QOOB_ERROR_OK;
+}
+
+static binary_type_t
+string_to_type (const char *str)
+{
+  if (strcmp (str, "gcb") == 0)
+    return QOOB_BINARY_TYPE_GCB;
+  if (strcmp (str, "elf") == 0)
+    return QOOB_BINARY_TYPE_ELF;
+  if (strcmp (str, "dol") == 0)
+    return QOOB_BINARY_TYPE_DOL;
+  return QOOB_BINARY_TYPE_VOID;
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
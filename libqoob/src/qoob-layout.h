@@ -0,0 +1,65 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include "qoob-defaults.h"
+#include "qoob-error.h"
+
+#ifndef _QOOB_LAYOUT_H_
+#define _QOOB_LAYOUT_H_
+
+/* 
+ * Slot layout describes what should be in flash. It is a text file where
+ * each line is "SLOT TYPE FILE". TYPE is gcb, elf or dol. Empty lines and 
+ * lines starting with '#' are skipped. Relative file names are relative to
+ * the layout file.
+ */
+
+typedef struct QoobLayoutEntry qoob_layout_entry_t;
+struct QoobLayoutEntry
+{
+  short int slot;                    /* First slot */
+  binary_type_t type;                /* How file is written */
+  char *file;
+  unsigned short int slots_used;
+};
+
+typedef struct QoobLayout qoob_layout_t;
+struct QoobLayout
+{
+  qoob_layout_entry_t *entries;
+  int count;
+};
+
+qoob_error_t qoob_layout_load (qoob_layout_t *layout, 
+                               const char *file,
+                               int *line);
+void qoob_layout_free (qoob_layout_t *layout);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
@@ -0,0 +1,174 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+
+#include "qoob-defaults.h"
+#include "qoob-error.h"
+#include "qoob-lock.h"
+
+/*
+ * Device lock of minimal build. No files are made: lock is flock of the
+ * usbfs node of the device, which is readable also when hidraw is used.
+ * Waiters are not served in order and holder is not known.
+ */
+
+#define LOCK_NODE_DIR "/dev/bus/usb"
+#define LOCK_POLL_INTERVAL 10 /* ms, used only with timeout */
+
+static int wait_lock (int fd, int timeout);
+
+void
+qoob_lock_init (qoob_lock_t *lock)
+{
+  if (lock == NULL)
+    return;
+
+  memset (lock, 0, sizeof (qoob_lock_t));
+  lock->fd = -1;
+  lock->node_fd = -1;
+}
+
+/*
+ * qoob_lock_acquire ()
+ *
+ * Same as in qoob-lock.c, but waiting is never called as holder is not 
+ * known.
+ */
+qoob_error_t
+qoob_lock_acquire (qoob_lock_t *lock,
+                   const char *bus,
+                   const char *device,
+                   int timeout,
+                   void (*waiting)(const qoob_lock_holder_t *h,
+                                   void *user_data),
+                   void *user_data)
+{
+  int ret;
+
+  if (lock == NULL || bus == NULL || device == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  if (lock->fd >= 0) {
+    return QOOB_ERROR_OK;
+  }
+
+  snprintf (lock->path, QOOB_LOCK_PATH_SIZE, "%s%c%s%c%s", 
+            LOCK_NODE_DIR, QOOB_DIRECTORY_SEPARATOR,
+            bus, QOOB_DIRECTORY_SEPARATOR, device);
+
+  lock->fd = open (lock->path, O_RDONLY);
+  if (lock->fd < 0) {
+    return QOOB_ERROR_LOCK;
+  }
+
+  ret = wait_lock (lock->fd, timeout);
+  if (ret != 0) {
+    close (lock->fd);
+    lock->fd = -1;
+    return ret > 0 ? QOOB_ERROR_LOCK_TIMEOUT : QOOB_ERROR_LOCK;
+  }
+
+  return QOOB_ERROR_OK;
+}
+
+void
+qoob_lock_release (qoob_lock_t *lock)
+{
+  if (lock == NULL || lock->fd < 0)
+    return;
+
+  flock (lock->fd, LOCK_UN);
+  close (lock->fd);
+  lock->fd = -1;
+}
+
+qoob_boolean_t
+qoob_lock_held (qoob_lock_t *lock)
+{
+  if (lock == NULL || lock->fd < 0)
+    return QOOB_FALSE;
+
+  return QOOB_TRUE;
+}
+
+/* Holder is not stored anywhere */
+qoob_error_t
+qoob_lock_holder (const char *bus,
+                  const char *device,
+                  qoob_lock_holder_t *holder)
+{
+  if (bus == NULL || device == NULL || holder == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  memset (holder, 0, sizeof (qoob_lock_holder_t));
+
+  return QOOB_ERROR_NOT_FOUND;
+}
+
+/* Static functions */
+
+/* Returns 0 when fd is locked, 1 on timeout and -1 on error */
+static int
+wait_lock (int fd, int timeout)
+{
+  struct timespec interval = {0, LOCK_POLL_INTERVAL * 1000000L};
+  int waited = 0;
+
+  if (timeout == QOOB_LOCK_WAIT_FOREVER) {
+    while (flock (fd, LOCK_EX) != 0) {
+      if (errno != EINTR) {
+        return -1;
+      }
+    }
+    return 0;
+  }
+
+  while (flock (fd, LOCK_EX|LOCK_NB) != 0) {
+    if (errno != EWOULDBLOCK && errno != EINTR) {
+      return -1;
+    }
+    if (waited >= timeout) {
+      return 1;
+    }
+    nanosleep (&interval, NULL);
+    waited += LOCK_POLL_INTERVAL;
+  }
+
+  return 0;
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
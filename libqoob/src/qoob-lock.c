@@ -0,0 +1,610 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "qoob-defaults.h"
+#include "qoob-error.h"
+#include "qoob-lock.h"
+
+/*
+ * Files of device lock with prefix RUNTIME_DIR/qoob-BUS-DEVICE, see
+ * qoob_lock_runtime_dir ():
+ *
+ *   .tickets  next free ticket. Taken under flock.
+ *   .N        ticket file. Flocked by its owner while waiting and holding.
+ *             Says "abandoned P" if owner gave up while waiting P.
+ *   .holder   "PID TICKET NAME" of the current holder.
+ */
+
+#define LOCK_FILE_MODE (S_IRUSR|S_IWUSR)
+#define LOCK_NODE_DIR "/dev/bus/usb"
+#define LOCK_POLL_INTERVAL 10 /* ms, used only with timeout */
+#define LOCK_ABANDONED "abandoned"
+#define LOCK_OTHER_USER "another user"
+
+static qoob_error_t lock_prefix (char *path,
+                                 const char *bus,
+                                 const char *device);
+static int node_open (const char *bus,
+                      const char *device);
+static int lock_file_open (const char *prefix,
+                           const char *suffix,
+                           int flags);
+static int ticket_open (const char *prefix,
+                        unsigned long ticket,
+                        int flags);
+static void ticket_unlink (const char *prefix,
+                           unsigned long ticket);
+static int read_text (int fd, char *buf, size_t size);
+static int write_text (int fd, const char *buf);
+static int wait_lock (int fd, const struct timespec *deadline);
+static void program_name (char *name, size_t size);
+static qoob_error_t read_holder (const char *prefix,
+                                 qoob_lock_holder_t *holder);
+
+void
+qoob_lock_init (qoob_lock_t *lock)
+{
+  if (lock == NULL)
+    return;
+
+  memset (lock, 0, sizeof (qoob_lock_t));
+  lock->fd = -1;
+  lock->node_fd = -1;
+}
+
+/*
+ * qoob_lock_runtime_dir ()
+ *
+ * Directory of lock files and sockets of the user: $XDG_RUNTIME_DIR or
+ * TMP_DIR/qoob-UID, which is made if it is missing. Directory has to be 
+ * owned by the user and closed from others, so nobody else can place 
+ * files or links in it.
+ */
+qoob_error_t
+qoob_lock_runtime_dir (char *dir, size_t size)
+{
+  const char *xdg = getenv ("XDG_RUNTIME_DIR");
+  struct stat st;
+  int n;
+
+  if (dir == NULL || size == 0) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  if (xdg != NULL && xdg[0] == QOOB_DIRECTORY_SEPARATOR) {
+    n = snprintf (dir, size, "%s", xdg);
+  } else {
+    n = snprintf (dir, size, "%s%cqoob-%ld", 
+                  TMP_DIR, 
+                  QOOB_DIRECTORY_SEPARATOR, 
+                  (long)geteuid ());
+  }
+  if (n < 0 || (size_t)n >= size) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  /* Fails if it is there already. Owner is checked below. */
+  mkdir (dir, S_IRWXU);
+
+  if (lstat (dir, &st) != 0) {
+    return QOOB_ERROR_LOCK;
+  }
+  if (!S_ISDIR (st.st_mode) || 
+      st.st_uid != geteuid () ||
+      (st.st_mode & (S_IRWXG|S_IRWXO)) != 0) {
+    return QOOB_ERROR_LOCK;
+  }
+
+  return QOOB_ERROR_OK;
+}
+
+/*
+ * qoob_lock_acquire ()
+ *
+ *   input: lock - lock to take
+ *          bus - bus of the device (usb_bus dirname)
+ *          device - device in the bus (usb_device filename)
+ *          timeout - milliseconds to wait or QOOB_LOCK_WAIT_FOREVER
+ *          waiting - called once before waiting, can be NULL
+ *
+ * Returns QOOB_ERROR_LOCK_TIMEOUT if device was not free in time.
+ */
+qoob_error_t
+qoob_lock_acquire (qoob_lock_t *lock,
+                   const char *bus,
+                   const char *device,
+                   int timeout,
+                   void (*waiting)(const qoob_lock_holder_t *h,
+                                   void *user_data),
+                   void *user_data)
+{
+  struct timespec deadline;
+  char buf[QOOB_LOCK_PATH_SIZE];
+  unsigned long pred;
+  qoob_boolean_t told = QOOB_FALSE;
+  int fd;
+
+  if (lock == NULL || bus == NULL || device == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  if (lock->fd >= 0) {
+    return QOOB_ERROR_OK;
+  }
+
+  if (lock_prefix (lock->path, bus, device) != QOOB_ERROR_OK) {
+    return QOOB_ERROR_LOCK;
+  }
+
+  if (timeout >= 0) {
+    clock_gettime (CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (long)(timeout % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+  }
+
+  /* Take ticket and lock own ticket file before anyone can wait it */
+  fd = lock_file_open (lock->path, ".tickets", O_RDWR|O_CREAT);
+  if (fd < 0) {
+    return QOOB_ERROR_LOCK;
+  }
+
+  if (flock (fd, LOCK_EX) != 0) {
+    close (fd);
+    return QOOB_ERROR_LOCK;
+  }
+
+  lock->ticket = 0;
+  if (read_text (fd, buf, sizeof (buf)) > 0) {
+    lock->ticket = strtoul (buf, NULL, 10);
+  }
+
+  snprintf (buf, sizeof (buf), "%lu\n", lock->ticket+1);
+  if (write_text (fd, buf) != 0) {
+    close (fd);
+    return QOOB_ERROR_LOCK;
+  }
+
+  lock->fd = ticket_open (lock->path, lock->ticket, O_RDWR|O_CREAT|O_TRUNC);
+  if (lock->fd < 0 || flock (lock->fd, LOCK_EX|LOCK_NB) != 0) {
+    if (lock->fd >= 0) {
+      close (lock->fd);
+    }
+    lock->fd = -1;
+    close (fd);
+    return QOOB_ERROR_LOCK;
+  }
+  close (fd);
+
+  /* Wait only the one before. Skip the ones which gave up. */
+  pred = lock->ticket;
+  while (pred > 0) {
+    int pfd;
+    int ret;
+
+    pred--;
+
+    pfd = ticket_open (lock->path, pred, O_RDONLY);
+    if (pfd < 0) {
+      /* Released already */
+      break;
+    }
+
+    if (flock (pfd, LOCK_EX|LOCK_NB) != 0) {
+      if (told == QOOB_FALSE && waiting != NULL) {
+        qoob_lock_holder_t holder;
+
+        if (read_holder (lock->path, &holder) == QOOB_ERROR_OK) {
+          /* Tell how many are before us */
+          holder.waiting = 0;
+          if (lock->ticket > holder.ticket+1)
+            holder.waiting = lock->ticket - holder.ticket - 1;
+          waiting (&holder, user_data);
+        }
+      }
+      told = QOOB_TRUE;
+
+      ret = wait_lock (pfd, timeout >= 0 ? &deadline : NULL);
+      if (ret != 0) {
+        close (pfd);
+
+        /* Next one has to wait the one we waited */
+        snprintf (buf, sizeof (buf), LOCK_ABANDONED " %lu\n", pred);
+        write_text (lock->fd, buf);
+        close (lock->fd);
+        lock->fd = -1;
+
+        return ret > 0 ? QOOB_ERROR_LOCK_TIMEOUT : QOOB_ERROR_LOCK;
+      }
+    }
+
+    ret = read_text (pfd, buf, sizeof (buf));
+    close (pfd);
+    ticket_unlink (lock->path, pred);
+
+    if (ret > 0 && 
+        strncmp (buf, LOCK_ABANDONED, strlen (LOCK_ABANDONED)) == 0) {
+      pred = strtoul (buf + strlen (LOCK_ABANDONED), NULL, 10) + 1;
+      continue;
+    }
+
+    /* Holder released or died */
+    break;
+  }
+
+  /* Lock files are per user, device node is the same for everybody */
+  lock->node_fd = node_open (bus, device);
+  if (lock->node_fd >= 0 && flock (lock->node_fd, LOCK_EX|LOCK_NB) != 0) {
+    int ret;
+
+    if (told == QOOB_FALSE && waiting != NULL) {
+      qoob_lock_holder_t holder;
+
+      /* Holder is not known, its lock files are not ours to read */
+      memset (&holder, 0, sizeof (holder));
+      snprintf (holder.name, sizeof (holder.name), LOCK_OTHER_USER);
+      waiting (&holder, user_data);
+    }
+
+    ret = wait_lock (lock->node_fd, timeout >= 0 ? &deadline : NULL);
+    if (ret != 0) {
+      close (lock->node_fd);
+      lock->node_fd = -1;
+
+      /* Next one waits the node itself */
+      ticket_unlink (lock->path, lock->ticket);
+      close (lock->fd);
+      lock->fd = -1;
+
+      return ret > 0 ? QOOB_ERROR_LOCK_TIMEOUT : QOOB_ERROR_LOCK;
+    }
+  }
+
+  /* Holder information */
+  fd = lock_file_open (lock->path, ".holder", O_RDWR|O_CREAT|O_TRUNC);
+  if (fd >= 0) {
+    char name[QOOB_LOCK_NAME_SIZE];
+
+    program_name (name, sizeof (name));
+    snprintf (buf, sizeof (buf), "%ld %lu %s\n", 
+              (long)getpid (), 
+              lock->ticket, 
+              name);
+    write_text (fd, buf);
+    close (fd);
+  }
+
+  return QOOB_ERROR_OK;
+}
+
+void
+qoob_lock_release (qoob_lock_t *lock)
+{
+  qoob_lock_holder_t holder;
+
+  if (lock == NULL || lock->fd < 0)
+    return;
+
+  if (read_holder (lock->path, &holder) == QOOB_ERROR_OK &&
+      holder.ticket == lock->ticket) {
+    char path[QOOB_LOCK_PATH_SIZE+16];
+
+    snprintf (path, sizeof (path), "%s.holder", lock->path);
+    unlink (path);
+  }
+
+  if (lock->node_fd >= 0) {
+    flock (lock->node_fd, LOCK_UN);
+    close (lock->node_fd);
+    lock->node_fd = -1;
+  }
+
+  /* Removed before unlock. Next one does not need it. */
+  ticket_unlink (lock->path, lock->ticket);
+  flock (lock->fd, LOCK_UN);
+  close (lock->fd);
+  lock->fd = -1;
+}
+
+qoob_boolean_t
+qoob_lock_held (qoob_lock_t *lock)
+{
+  if (lock == NULL || lock->fd < 0)
+    return QOOB_FALSE;
+
+  return QOOB_TRUE;
+}
+
+/*
+ * qoob_lock_holder ()
+ *
+ * Tells who holds the device. Returns QOOB_ERROR_NOT_FOUND if nobody does.
+ */
+qoob_error_t
+qoob_lock_holder (const char *bus,
+                  const char *device,
+                  qoob_lock_holder_t *holder)
+{
+  char prefix[QOOB_LOCK_PATH_SIZE];
+
+  if (bus == NULL || device == NULL || holder == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  if (lock_prefix (prefix, bus, device) != QOOB_ERROR_OK) {
+    memset (holder, 0, sizeof (qoob_lock_holder_t));
+    return QOOB_ERROR_NOT_FOUND;
+  }
+
+  return read_holder (prefix, holder);
+}
+
+/* Static functions */
+static qoob_error_t
+lock_prefix (char *path,
+             const char *bus,
+             const char *device)
+{
+  char *p;
+  size_t start;
+  qoob_error_t err;
+  int n;
+
+  err = qoob_lock_runtime_dir (path, QOOB_LOCK_PATH_SIZE);
+  if (err != QOOB_ERROR_OK) {
+    return err;
+  }
+
+  start = strlen (path);
+  n = snprintf (path + start, QOOB_LOCK_PATH_SIZE - start, "%cqoob-", 
+                QOOB_DIRECTORY_SEPARATOR);
+  start += (size_t)n;
+  if (start >= QOOB_LOCK_PATH_SIZE) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+  n = snprintf (path + start, QOOB_LOCK_PATH_SIZE - start, "%s-%s", 
+                bus, device);
+  if (n < 0 || (size_t)n >= QOOB_LOCK_PATH_SIZE - start) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  /* Bus can be path on some systems */
+  for (p = path + start; *p != '\0'; p++) {
+    if (*p == QOOB_DIRECTORY_SEPARATOR)
+      *p = '_';
+  }
+
+  return QOOB_ERROR_OK;
+}
+
+/* usbfs node as in qoob-lock-node.c. -1 if there is none. */
+static int
+node_open (const char *bus,
+           const char *device)
+{
+  char path[QOOB_LOCK_PATH_SIZE];
+
+  snprintf (path, sizeof (path), "%s%c%s%c%s", 
+            LOCK_NODE_DIR, QOOB_DIRECTORY_SEPARATOR,
+            bus, QOOB_DIRECTORY_SEPARATOR, device);
+
+  return open (path, O_RDONLY|O_NOFOLLOW);
+}
+
+/* Links are not followed and mode does not depend on umask */
+static int
+lock_file_open (const char *prefix,
+                const char *suffix,
+                int flags)
+{
+  char path[QOOB_LOCK_PATH_SIZE+32];
+  int fd;
+
+  snprintf (path, sizeof (path), "%s%s", prefix, suffix);
+
+  fd = open (path, flags|O_NOFOLLOW, LOCK_FILE_MODE);
+  if (fd >= 0 && (flags & O_CREAT) != 0 && fchmod (fd, LOCK_FILE_MODE) != 0) {
+    close (fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+static int
+ticket_open (const char *prefix,
+             unsigned long ticket,
+             int flags)
+{
+  char suffix[32];
+
+  snprintf (suffix, sizeof (suffix), ".%lu", ticket);
+
+  return lock_file_open (prefix, suffix, flags);
+}
+
+static void
+ticket_unlink (const char *prefix,
+               unsigned long ticket)
+{
+  char path[QOOB_LOCK_PATH_SIZE+32];
+
+  snprintf (path, sizeof (path), "%s.%lu", prefix, ticket);
+  unlink (path);
+}
+
+static int
+read_text (int fd, char *buf, size_t size)
+{
+  ssize_t r;
+
+  r = pread (fd, buf, size-1, 0);
+  if (r < 0) {
+    r = 0;
+  }
+  buf[r] = '\0';
+
+  return (int)r;
+}
+
+static int
+write_text (int fd, const char *buf)
+{
+  size_t len = strlen (buf);
+
+  if (ftruncate (fd, 0) != 0) {
+    return -1;
+  }
+  if (pwrite (fd, buf, len, 0) != (ssize_t)len) {
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * Returns 0 when fd is locked, 1 on timeout and -1 on error. Without
+ * deadline kernel wakes us up as soon as lock is free. 
+ */
+static int
+wait_lock (int fd, const struct timespec *deadline)
+{
+  struct timespec interval = {0, LOCK_POLL_INTERVAL * 1000000L};
+
+  if (deadline == NULL) {
+    while (flock (fd, LOCK_EX) != 0) {
+      if (errno != EINTR) {
+        return -1;
+      }
+    }
+    return 0;
+  }
+
+  while (1) {
+    struct timespec now;
+
+    if (flock (fd, LOCK_EX|LOCK_NB) == 0) {
+      return 0;
+    }
+    if (errno != EWOULDBLOCK && errno != EINTR) {
+      return -1;
+    }
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    if (now.tv_sec > deadline->tv_sec ||
+        (now.tv_sec == deadline->tv_sec && 
+         now.tv_nsec >= deadline->tv_nsec)) {
+      return 1;
+    }
+
+    nanosleep (&interval, NULL);
+  }
+}
+
+static void
+program_name (char *name, size_t size)
+{
+  FILE *f;
+
+  snprintf (name, size, "unknown");
+
+  f = fopen ("/proc/self/comm", "r");
+  if (f == NULL) {
+    return;
+  }
+  if (fgets (name, (int)size, f) != NULL) {
+    name[strcspn (name, "\n")] = '\0';
+  }
+  fclose (f);
+}
+
+static qoob_error_t
+read_holder (const char *prefix,
+             qoob_lock_holder_t *holder)
+{
+  char buf[QOOB_LOCK_PATH_SIZE];
+  long pid;
+  int n = 0;
+  int fd;
+
+  memset (holder, 0, sizeof (qoob_lock_holder_t));
+
+  fd = lock_file_open (prefix, ".holder", O_RDONLY);
+  if (fd < 0) {
+    return QOOB_ERROR_NOT_FOUND;
+  }
+  read_text (fd, buf, sizeof (buf));
+  close (fd);
+
+  if (sscanf (buf, "%ld %lu %n", &pid, &holder->ticket, &n) != 2 || n == 0) {
+    return QOOB_ERROR_NOT_FOUND;
+  }
+  buf[strcspn (buf, "\n")] = '\0';
+  strncpy (holder->name, buf+n, sizeof (holder->name)-1);
+  holder->pid = (pid_t)pid;
+
+  /* Ticket file is locked as long as holder lives */
+  fd = ticket_open (prefix, holder->ticket, O_RDONLY);
+  if (fd < 0) {
+    return QOOB_ERROR_NOT_FOUND;
+  }
+  if (flock (fd, LOCK_SH|LOCK_NB) == 0) {
+    close (fd);
+    return QOOB_ERROR_NOT_FOUND;
+  }
+  close (fd);
+
+  fd = lock_file_open (prefix, ".tickets", O_RDONLY);
+  if (fd >= 0) {
+    if (read_text (fd, buf, sizeof (buf)) > 0) {
+      unsigned long next = strtoul (buf, NULL, 10);
+
+      if (next > holder->ticket+1)
+        holder->waiting = next - holder->ticket - 1;
+    }
+    close (fd);
+  }
+
+  return QOOB_ERROR_OK;
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
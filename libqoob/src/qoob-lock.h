@@ -0,0 +1,90 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <sys/types.h>
+
+#include "qoob-defaults.h"
+#include "qoob-error.h"
+
+#ifndef _QOOB_LOCK_H_
+#define _QOOB_LOCK_H_
+
+/*
+ * Advisory lock of one device. Openers take a ticket and wait in ticket
+ * order, each one only for the one before it, so device goes to the next
+ * waiter as soon as it is released. Locks of crashed processes are freed
+ * by the kernel. Lock files are in the runtime directory of the user and 
+ * named by bus and device. Other users are kept out with flock of the 
+ * usbfs node of the device.
+ */
+
+#define QOOB_LOCK_PATH_SIZE 256
+#define QOOB_LOCK_NAME_SIZE 64
+
+#define QOOB_LOCK_WAIT_FOREVER -1
+
+typedef struct QoobLock qoob_lock_t;
+struct QoobLock
+{
+  char path[QOOB_LOCK_PATH_SIZE];   /* Prefix of the lock files */
+  unsigned long ticket;
+  int fd;                           /* Own ticket file. -1 if not held. */
+  int node_fd;                      /* Flocked usbfs node, -1 if none */
+};
+
+typedef struct QoobLockHolder qoob_lock_holder_t;
+struct QoobLockHolder
+{
+  pid_t pid;
+  char name[QOOB_LOCK_NAME_SIZE];   /* Program name of the holder */
+  unsigned long ticket;
+  unsigned long waiting;            /* Tickets taken after holder. In 
+                                       waiting callback only the ones 
+                                       before caller. */
+};
+
+void qoob_lock_init (qoob_lock_t *lock);
+#ifndef QOOB_MINIMAL
+qoob_error_t qoob_lock_runtime_dir (char *dir, size_t size);
+#endif
+qoob_error_t qoob_lock_acquire (qoob_lock_t *lock,
+                                const char *bus,
+                                const char *device,
+                                int timeout,
+                                void (*waiting)(const qoob_lock_holder_t *h,
+                                                void *user_data),
+                                void *user_data);
+void qoob_lock_release (qoob_lock_t *lock);
+qoob_boolean_t qoob_lock_held (qoob_lock_t *lock);
+
+qoob_error_t qoob_lock_holder (const char *bus,
+                               const char *device,
+                               qoob_lock_holder_t *holder);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
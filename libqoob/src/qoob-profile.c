@@ -0,0 +1,185 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef QOOB_MINIMAL
+#include <stdio.h>
+#endif
+#include <stddef.h>
+
+#include "qoob-profile.h"
+
+static long since_origin (const qoob_profile_t *profile, 
+                          const struct timespec *t);
+
+void
+qoob_profile_init (qoob_profile_t *profile)
+{
+  if (profile == NULL)
+    return;
+
+  clock_gettime (CLOCK_MONOTONIC, &profile->origin);
+  profile->count = 0;
+  profile->dropped = 0;
+}
+
+/* Start of a phase. Without profile clock is not read. */
+void
+qoob_profile_mark (const qoob_profile_t *profile, 
+                   struct timespec *mark)
+{
+  if (profile != NULL)
+    clock_gettime (CLOCK_MONOTONIC, mark);
+}
+
+/* Phase which started at mark ends now */
+void
+qoob_profile_add (qoob_profile_t *profile,
+                  qoob_phase_t phase,
+                  short int slot,
+                  const struct timespec *mark)
+{
+  struct timespec now;
+
+  if (profile == NULL)
+    return;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  qoob_profile_add_span (profile, phase, slot, mark, &now);
+}
+
+void
+qoob_profile_add_span (qoob_profile_t *profile,
+                       qoob_phase_t phase,
+                       short int slot,
+                       const struct timespec *start,
+                       const struct timespec *end)
+{
+  qoob_profile_event_t *e;
+
+  if (profile == NULL)
+    return;
+
+  if (profile->count >= QOOB_PROFILE_EVENTS_MAX) {
+    profile->dropped++;
+    return;
+  }
+
+  e = &profile->events[profile->count++];
+  e->phase = phase;
+  e->slot = slot;
+  e->start = since_origin (profile, start);
+  e->duration = since_origin (profile, end) - e->start;
+}
+
+const char *
+qoob_profile_phase_to_string (qoob_phase_t phase)
+{
+  switch (phase) {
+  case QOOB_PHASE_INIT:
+    return "init";
+  case QOOB_PHASE_FIND:
+    return "find";
+  case QOOB_PHASE_LOCK:
+    return "lock";
+  case QOOB_PHASE_OPEN:
+    return "open";
+  case QOOB_PHASE_LIST:
+    return "list";
+  case QOOB_PHASE_LOAD:
+    return "load";
+  case QOOB_PHASE_HEADER:
+    return "header";
+  case QOOB_PHASE_ERASE:
+    return "erase";
+  case QOOB_PHASE_WRITE:
+    return "write";
+  case QOOB_PHASE_READ:
+    return "read";
+  default:
+    break;
+  }
+  return "unknown";
+}
+
+#ifndef QOOB_MINIMAL
+/*
+ * Saves events in Chrome trace event format. File can be opened with
+ * chrome://tracing or Perfetto. Each event is complete event of its own.
+ */
+qoob_error_t
+qoob_profile_trace_save (const qoob_profile_t *profile,
+                         const char *file)
+{
+  FILE *fp;
+  int i;
+
+  if (profile == NULL || file == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  fp = fopen (file, "w");
+  if (fp == NULL) {
+    return QOOB_ERROR_FD_OPEN;
+  }
+
+  fprintf (fp, "{\"traceEvents\":[\n");
+  for (i=0; i<profile->count; i++) {
+    const qoob_profile_event_t *e = &profile->events[i];
+    const char *name = qoob_profile_phase_to_string (e->phase);
+
+    if (e->slot >= 0) {
+      fprintf (fp, "{\"name\":\"%s [%02d]\",\"cat\":\"%s\",\"ph\":\"X\","
+               "\"ts\":%ld,\"dur\":%ld,\"pid\":1,\"tid\":1,"
+               "\"args\":{\"slot\":%d}}",
+               name, e->slot, name, e->start, e->duration, e->slot);
+    } else {
+      fprintf (fp, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+               "\"ts\":%ld,\"dur\":%ld,\"pid\":1,\"tid\":1}",
+               name, name, e->start, e->duration);
+    }
+    fprintf (fp, i+1 < profile->count ? ",\n" : "\n");
+  }
+  fprintf (fp, "],\"displayTimeUnit\":\"ms\"}\n");
+
+  if (fclose (fp) != 0) {
+    return QOOB_ERROR_FD_WRITE;
+  }
+
+  return QOOB_ERROR_OK;
+}
+#endif
+
+/* Static functions */
+static long
+since_origin (const qoob_profile_t *profile, 
+              const struct timespec *t)
+{
+  return (long)(t->tv_sec - profile->origin.tv_sec)*1000000L +
+    (t->tv_nsec - profile->origin.tv_nsec)/1000;
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
@@ -0,0 +1,97 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <time.h>
+
+#include "qoob-defaults.h"
+#include "qoob-error.h"
+
+#ifndef _QOOB_PROFILE_H_
+#define _QOOB_PROFILE_H_
+
+/*
+ * Wall clock profile of operations. Library records monotonic time of
+ * every phase and of every slot in it when profile is given with 
+ * qoob_sync_profile_set (). Times are microseconds from 
+ * qoob_profile_init ().
+ */
+
+#define QOOB_PROFILE_EVENTS_MAX 1024
+
+typedef enum {
+  QOOB_PHASE_INIT,            /* Library init, recorded by caller */
+  QOOB_PHASE_FIND,            /* Finding the device */
+  QOOB_PHASE_LOCK,            /* Waiting other program to free device */
+  QOOB_PHASE_OPEN,            /* Opening and claiming interface */
+  QOOB_PHASE_LIST,            /* Reading slot header */
+  QOOB_PHASE_LOAD,            /* Reading file to memory */
+  QOOB_PHASE_HEADER,          /* Minimizing and GCB header for ELF or DOL */
+  QOOB_PHASE_ERASE,
+  QOOB_PHASE_WRITE,
+  QOOB_PHASE_READ,
+  QOOB_PHASE_COUNT
+} qoob_phase_t;
+
+typedef struct QoobProfileEvent qoob_profile_event_t;
+struct QoobProfileEvent
+{
+  qoob_phase_t phase;
+  short int slot;                   /* -1 if phase is not about slot */
+  long start;                       /* us from init */
+  long duration;                    /* us */
+};
+
+typedef struct QoobProfile qoob_profile_t;
+struct QoobProfile
+{
+  struct timespec origin;           /* CLOCK_MONOTONIC */
+  qoob_profile_event_t events[QOOB_PROFILE_EVENTS_MAX];
+  int count;
+  int dropped;                      /* Events which did not fit */
+};
+
+void qoob_profile_init (qoob_profile_t *profile);
+void qoob_profile_mark (const qoob_profile_t *profile, 
+                        struct timespec *mark);
+void qoob_profile_add (qoob_profile_t *profile,
+                       qoob_phase_t phase,
+                       short int slot,
+                       const struct timespec *mark);
+void qoob_profile_add_span (qoob_profile_t *profile,
+                            qoob_phase_t phase,
+                            short int slot,
+                            const struct timespec *start,
+                            const struct timespec *end);
+const char *qoob_profile_phase_to_string (qoob_phase_t phase);
+#ifndef QOOB_MINIMAL
+qoob_error_t qoob_profile_trace_save (const qoob_profile_t *profile,
+                                      const char *file);
+#endif
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
@@ -20,9 +20,17 @@
 #ifndef _QOOB_STRUCT_H_
 #define _QOOB_STRUCT_H_
 
+#ifndef QOOB_MINIMAL
 #include <usb.h>
+#endif
 
 #include "qoob-defaults.h"
+#include "qoob-image.h"
+#include "qoob-lock.h"
+#include "qoob-transport.h"
+#include "qoob-cancel.h"
+#include "qoob-profile.h"
+#include "qoob-table.h"
 
 /* Qoob and related structures */
 typedef struct QoobSlot qoob_slot_t;
@@ -35,20 +43,71 @@ struct QoobSlot {
   qoob_boolean_t first;         /* Tells is slot applications first slot */
 
   binary_type_t type;
+
+  /* Payload length and digest if libqoob made the header. Only in
+     applications first slot. */
+  qoob_boolean_t has_digest;
+  unsigned long length;
+  unsigned char digest[QOOB_DIGEST_SIZE];
+};
+
+/* Transfer latency and retries of the device */
+typedef struct QoobTransfer qoob_transfer_t;
+struct QoobTransfer {
+  int srtt;                   /* Smoothed latency of data transfer, us */
+  int rttvar;                 /* Variation of latency, us */
+  int timeout;                /* Timeout of data transfer, ms */
+  int retries;                /* Allowed retries of slot or half slot */
+  int retried;                /* Retries done after device was found */
+  qoob_transport_type_t transport; /* Transport device was opened with */
+  int discover_time;          /* Finding device took, us */
+  int open_time;              /* Opening and claiming device took, us */
 };
 
 typedef struct Qoob qoob_t;
 struct Qoob
 {
+#ifndef QOOB_MINIMAL
   struct usb_bus *busses;     /* USB busses */
   struct usb_device *dev;     /* USB device */
   usb_dev_handle *devh;       /* USB device handle */
+#endif
+  int fd;                     /* usbfs device node */
 
-  char *real_file;                 /* tmp file to read or write */
+  /* Transport of open device, NULL when device is not open */
+  const qoob_transport_t *transport;
+  qoob_transport_type_t transport_type;  /* Transport to use */
 
   binary_type_t binary_type;  /* binary type to write */
+  qoob_minimize_t minimize;   /* ELF/DOL minimization before write */
+  qoob_boolean_t sparse;      /* Skip packets which are in erased state */
+  qoob_lock_t lock;           /* Held while device is open */
+  int lock_timeout;           /* ms to wait for device, -1 forever */
+  qoob_transfer_t transfer;
+  qoob_cancel_t *cancel;      /* Checked before data packets, may be NULL */
+  qoob_profile_t *profile;    /* Phase times are added to it, may be NULL */
+  unsigned long completed;    /* Slots finished by last operation, bit 
+                                 per slot */
 
+  qoob_table_t table;          /* Applications listed from flash */
+
+  /* Slot view of the table, made again when it is asked after listing.
+     Use qoob_sync_slots_get (). */
   qoob_slot_t slot[QOOB_PRO_SLOTS];
+  qoob_boolean_t slot_stale;
+
+  /* Flash content read by qoob_sync_usb_read_range (). Allocated when 
+     first needed. Half slot is valid after it is read and until it is 
+     erased or written. */
+  char *cache;
+  qoob_boolean_t cached[QOOB_PRO_SLOTS*2];
+
+  /* Caller's storage given with qoob_sync_work_set (). Buffers of slots
+     and images are taken from it like from a stack before heap is used.
+     Minimal build has no heap, see README. */
+  char *work;
+  size_t work_size;
+  size_t work_used;
 
   /* Callbacks */
   void (*sync_cb) (qoob_sync_callback_t type,
@@ -57,6 +116,10 @@ struct Qoob
                    void *user_data);
   void *user_data;
 
+  /* Waits for usbfs node instead of poll (), see qoob_sync_wait_set () */
+  int (*wait_cb) (int fd, short events, int timeout, void *wait_data);
+  void *wait_data;
+
   qoob_boolean_t async;
 };
 
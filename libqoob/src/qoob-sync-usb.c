@@ -18,6 +18,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <unistd.h>
@@ -25,34 +26,36 @@
 #include <fcntl.h>
 
 #include <assert.h>
-
-#include <usb.h>
+#include <errno.h>
+#include <time.h>
 
 #include "qoob-struct.h"
 #include "qoob-defaults.h"
 #include "qoob-error.h"
+#include "qoob-file.h"
+#include "qoob-image.h"
+#include "qoob-discover.h"
 #include "qoob-sync-usb.h"
 
-#define EMPTY_SLOT_NAME "    Empty"
 #define CONFIG_SLOT_NAME "    Config"
-#define CONTINUING_TEXT " [%02d]"
+#define NAME_START 4 /* Name in header after file format */
 #define SLOTS_IN_USE_INDEX 2
 
-#define DEFAULT_TIMEOUT 1000
-#define SEND_REQUEST 0x9
-#define SEND_VALUE 0x200
-#define RECV_REQUEST 0x1
-#define RECV_VALUE 0x300
+#define DEFAULT_TIMEOUT QOOB_TIMEOUT_DEFAULT /* Commands, may wait flash */
+#define BATCH_PACKETS 16 /* Data packets given to transport at once */
 
 #define QOOB_READ_LOOP_DEFAULT (1024+16+2)
 #define QOOB_READ_LOOP_MISSING_BYTES 8
 #define QOOB_READ_LOOP_HALF_WAY 522
 
 #define QOOB_WRITE_LOOP_DEFAULT (1024+16+2)
-#define QOOB_WRITE_LOOP_HALF_WAY 522
 
 #define QOOB_DEFAULT_SEEK 0x8000
 
+/* After end of data. Sparse write leaves it erased, otherwise zeros. */
+#define WRITE_PAD(qoob) \
+  ((qoob)->sparse == QOOB_TRUE ? (char)QOOB_PRO_ERASED_BYTE : 0)
+
 #define QOOB_START_OK 0x01
 
 
@@ -89,68 +92,250 @@
        } while(0)
 
 
-static int send_command (usb_dev_handle *devh, 
+static int send_command (qoob_t *qoob, 
                          char *cmd1, 
                          char *cmd2, 
                          char *cmd3, 
                          unsigned char slot,
                          char *outbuf);
 
-static int send_data (usb_dev_handle *devh, 
-                      char *outbuf);
+static int transfer_many (qoob_t *qoob,
+                          qoob_boolean_t in,
+                          char *bufs,
+                          int count);
 
-static int receive_answer (usb_dev_handle *devh, 
+static int receive_answer (qoob_t *qoob, 
                            char *inbuf);
 
-static void add_to_slot_array (qoob_t *qoob, 
-                              int slot, 
-                              char *name, 
-                              char *info);
-
-static qoob_error_t write_with_header_to_tmp_file (qoob_t *qoob, 
-                                                   char *file,
-                                                   size_t size);
+static int packet_timeout (qoob_t *qoob);
+static qoob_error_t transfer_failed (qoob_t *qoob, qoob_error_t err);
+static qoob_error_t session_failed (qoob_t *qoob, 
+                                    char *buf, 
+                                    qoob_error_t err);
+
+static int receive_data (qoob_t *qoob, 
+                         char *inbuf);
+
+static qoob_boolean_t retry (qoob_t *qoob, 
+                             qoob_error_t err, 
+                             int *tries, 
+                             int slot);
+
+static void add_to_table (qoob_t *qoob, 
+                          int slot, 
+                          char *name, 
+                          char *info);
+static binary_type_t header_type (const char *header, 
+                                  const char *payload);
+static qoob_boolean_t app_is_image (qoob_t *qoob,
+                                    short int slot,
+                                    const char *image,
+                                    size_t size);
+static qoob_boolean_t slot_first (qoob_t *qoob, short int slot);
+static int slot_used (qoob_t *qoob, short int slot);
+static qoob_boolean_t slot_free (qoob_t *qoob, short int slot);
+
+static void lock_waiting (const qoob_lock_holder_t *holder,
+                          void *user_data);
+static qoob_error_t open_device (qoob_t *qoob,
+                                 const char *bus,
+                                 const char *device,
+                                 const struct timespec *start);
+static qoob_error_t open_named (qoob_t *qoob,
+                                const char *bus,
+                                const char *device,
+                                const struct timespec *start);
+static int elapsed_us (const struct timespec *start);
+
+static qoob_error_t list_slots (qoob_t *qoob,
+                                short int slot_from,
+                                short int slot_to);
+static qoob_error_t list_slot (qoob_t *qoob,
+                               char slot,
+                               char *name,
+                               char *info);
+
+static qoob_error_t erase_slot (qoob_t *qoob,
+                                int slot);
+
+static qoob_error_t read_half_slot (qoob_t *qoob,
+                                    int slot,
+                                    int half,
+                                    char *slot_data);
+
+static void cache_invalidate (qoob_t *qoob,
+                              int slot,
+                              int half);
+static qoob_error_t read_slots (qoob_t *qoob,
+                                short int slotnum,
+                                int count,
+                                char *data,
+                                int fd,
+                                qoob_archive_t *archive);
+static qoob_boolean_t write_all (int fd,
+                                 const char *data,
+                                 size_t size);
+
+static qoob_error_t write_gcb (qoob_t *qoob,
+                               const char *data,
+                               size_t size,
+                               short int slotnum);
+static qoob_error_t write_slots (qoob_t *qoob,
+                                 const char *data,
+                                 size_t size,
+                                 short int slotnum,
+                                 int used_slots,
+                                 unsigned long mask);
+static qoob_error_t write_slot (qoob_t *qoob,
+                                int slot,
+                                int last,
+                                const char *data,
+                                size_t size,
+                                size_t base,
+                                int first_half,
+                                int *skipped);
+static qoob_error_t write_header (qoob_t *qoob,
+                                  int slot,
+                                  const char *data,
+                                  size_t size,
+                                  int *skipped);
+static qoob_error_t write_half (qoob_t *qoob,
+                                int slot,
+                                int half,
+                                const char *data,
+                                size_t size,
+                                size_t base,
+                                qoob_boolean_t report,
+                                int *skipped);
+static qoob_boolean_t slot_changed (const char *a,
+                                    size_t a_size,
+                                    const char *b,
+                                    size_t b_size,
+                                    size_t base);
+static qoob_error_t write_data (qoob_t *qoob,
+                                const char *name,
+                                char *data,
+                                size_t size,
+                                short int slotnum);
+static qoob_error_t minimize_data (qoob_t *qoob,
+                                   char **data,
+                                   size_t *size);
+static qoob_error_t payload_compare (qoob_t *qoob,
+                                     qoob_minimize_t mode,
+                                     const char *data,
+                                     size_t size,
+                                     const qoob_app_t *app);
+static qoob_error_t write_with_header (qoob_t *qoob, 
+                                       const char *file,
+                                       char pad,
+                                       char **data,
+                                       size_t *size);
+static char *work_alloc (qoob_t *qoob, size_t size);
+static void work_free (qoob_t *qoob, char *data);
+static qoob_error_t load_file (qoob_t *qoob,
+                               const char *file,
+                               char **data,
+                               size_t *size);
 
+/*
+ * qoob_sync_usb_find ()
+ *
+ * Opens first QoobPro found. On Linux only sysfs is read to find it, so
+ * other USB devices are not opened. 
+ */
 qoob_error_t
 qoob_sync_usb_find (qoob_t *qoob)
 {
-  struct usb_bus *bus;
+  qoob_device_t found;
+  struct timespec start;
+  qoob_error_t err;
+  int count;
 
-  /* Go trough all hubs etc. to find right device */
-  for (bus = qoob->busses; bus; bus = bus->next) {
-    struct usb_device *dev;
-    usb_dev_handle *devh;
+  clock_gettime (CLOCK_MONOTONIC, &start);
 
-    for (dev = bus->devices; dev; dev = dev->next) {
+  err = qoob_discover_all (qoob, &found, 1, &count);
+  if (err != QOOB_ERROR_OK) {
+    return err;
+  }
 
-      /* If usb device is QoobPro */
-      if (dev->descriptor.idVendor == QOOB_PRO_VENDOR && 
-          dev->descriptor.idProduct == QOOB_PRO_PRODUCT) {
-        int ret;
+  return open_device (qoob, found.bus, found.device, &start);
+}
 
-        /* Get interface to us */
-        devh = usb_open (dev);
+/*
+ * qoob_sync_usb_find_device ()
+ *
+ * Like qoob_sync_usb_find () but opens only QoobPro at given bus and 
+ * device. Names are same as in lock files and lsusb, e.g. "001" "004".
+ */
+qoob_error_t
+qoob_sync_usb_find_device (qoob_t *qoob,
+                           const char *bus_name,
+                           const char *device_name)
+{
+  struct timespec start;
 
-        if ((ret = usb_claim_interface (devh, 0)) < 0) {
-          return QOOB_ERROR_CLAIM_INTERFACE;
-        }
+  if (qoob == NULL || bus_name == NULL || device_name == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
 
-#ifndef HAVE_DARWIN
-        /* There is only one altinterface. !!!Used shortcut!!! */
-        if (usb_set_altinterface (devh, 0) < 0) {
-          return QOOB_ERROR_ALT_INTERFACE;
-        }
-#endif
+  clock_gettime (CLOCK_MONOTONIC, &start);
 
-        qoob->dev = dev;
-        qoob->devh = devh;
+  return open_named (qoob, bus_name, device_name, &start);
+}
 
-        return QOOB_ERROR_OK;
-      }
-    }
+/*
+ * qoob_sync_usb_find_path ()
+ *
+ * Opens QoobPro given by user without looking at other devices. See
+ * qoob_discover_path () for forms of path, e.g. "1-1.2" or 
+ * "/dev/bus/usb/001/004".
+ */
+qoob_error_t
+qoob_sync_usb_find_path (qoob_t *qoob,
+                         const char *path)
+{
+  qoob_device_t device;
+  struct timespec start;
+  qoob_error_t err;
+
+  if (qoob == NULL || path == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
   }
 
-  return QOOB_ERROR_NOT_FOUND;
+  clock_gettime (CLOCK_MONOTONIC, &start);
+
+  err = qoob_discover_path (path, &device);
+  if (err != QOOB_ERROR_OK) {
+    return err;
+  }
+
+  return open_named (qoob, device.bus, device.device, &start);
+}
+
+/*
+ * qoob_sync_usb_holder ()
+ *
+ * Tells which program holds the device. Returns QOOB_ERROR_NOT_FOUND if 
+ * there is no device or it is free.
+ */
+qoob_error_t
+qoob_sync_usb_holder (qoob_t *qoob,
+                      qoob_lock_holder_t *holder)
+{
+  qoob_device_t found;
+  qoob_error_t err;
+  int count;
+
+  if (qoob == NULL || holder == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  err = qoob_discover_all (qoob, &found, 1, &count);
+  if (err != QOOB_ERROR_OK) {
+    return err;
+  }
+
+  return qoob_lock_holder (found.bus, found.device, holder);
 }
 
 /* TODO: Check and reqrite asap with better knowledge about usb and flasher */
@@ -161,17 +346,16 @@ qoob_sync_usb_find (qoob_t *qoob)
  *   input: qoob - qoob handle
  *          slots - slots to return. 
  * 
- * Remember to free slots with qoob_sync_slot_free () after use.
+ * Remember to free slots with qoob_sync_slot_free () after use. If slots
+ * is NULL only application table is updated and nothing is allocated.
+ * Table can be read without copy with qoob_sync_table_get ().
  * 
  */
 qoob_error_t 
 qoob_sync_usb_list (qoob_t *qoob, 
                qoob_slot_t **slots)
 {
-  char slot = 0;
-  int tmpptr = 0;
-  char buf[QOOB_PRO_MAX_BUFFER] = {0,};
-  char tmpbuf[QOOB_PRO_MAX_BUFFER*4] = {0,};
+  qoob_error_t err;
 
   if (qoob == NULL) {
     return QOOB_ERROR_INPUT_NOT_VALID;;
@@ -179,97 +363,90 @@ qoob_sync_usb_list (qoob_t *qoob,
 
   assert (qoob->async == QOOB_FALSE);
 
-  if (qoob->devh == NULL) {
+  if (qoob->transport == NULL) {
     return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
   }
 
-  /* TODO: implement system, which tries to 'connect' three times if fails */
-#if 0   /* Do not remove this part */
-  /* tests */
-  send_command (qoob->devh, 
-                QOOB_USB_CMD_GET_ANSWER, 
-                QOOB_USB_CMD_ZERO, 
-                QOOB_USB_CMD_ZERO, 
-                0, 
-                buf);
-  receive_answer (qoob->devh, buf);
-  send_command (qoob->devh, 
-                QOOB_USB_CMD_GET_ANSWER, 
-                QOOB_USB_CMD_ZERO, 
-                QOOB_USB_CMD_ZERO, 
-                0, 
-                buf);
-  receive_answer (qoob->devh, buf);
-#endif
+  err = list_slots (qoob, 0, QOOB_PRO_SLOTS-1);
+  if (err != QOOB_ERROR_OK) {
+    return err;
+  }
 
-  /* Actual reading */
-  while (1) {
-    int i;
+  if (slots == NULL) {
+    return QOOB_ERROR_OK;
+  }
 
-    if (qoob->sync_cb != NULL) {
-      qoob->sync_cb (QOOB_SYNC_CALLBACK_LIST, 
-                     slot+1, 
-                     QOOB_PRO_SLOTS,
-                     qoob->user_data);
-    }
+  *slots = qoob_sync_slot_copy (qoob_sync_slots_get (qoob));
+  if (*slots == NULL) {
+    return QOOB_ERROR_NO_MEMORY;
+  }
 
-    tmpptr = 0;
-    QOOB_START (qoob->devh, buf);
-    receive_answer (qoob->devh, buf);
-    if (buf[2] != QOOB_START_OK)
-    {
-      return QOOB_ERROR_DEVICE_UNKNOWN1;
-    }
+  return QOOB_ERROR_OK;
+}
 
-    /* Slot reading */
-    send_command (qoob->devh, 
-                  QOOB_USB_CMD_READ_SLOT, 
-                  QOOB_USB_CMD_ZERO, 
-                  QOOB_USB_CMD_READ_SLOT_INFO,
-                  slot,
-                  buf);
-
-    for (i=0;i<4;i++) {
-      receive_answer (qoob->devh, buf);
-      memcpy (tmpbuf+tmpptr, buf+1, QOOB_PRO_MAX_BUFFER-1);
-      tmpptr += QOOB_PRO_MAX_BUFFER;
-    }
+/*
+ * qoob_sync_usb_list_range ()
+ *
+ *   input: qoob - qoob handle
+ *          slot_from - first changed slot
+ *          slot_to - last changed slot
+ *          slots - slots to return or NULL, see qoob_sync_usb_list ()
+ *
+ * Lists again only applications which have slots between slot_from and
+ * slot_to. Rest of the slot list is taken from the previous list, so it
+ * has to be up to date. Range is widened to whole applications of the
+ * previous list.
+ */
+qoob_error_t 
+qoob_sync_usb_list_range (qoob_t *qoob, 
+                          short int slot_from,
+                          short int slot_to,
+                          qoob_slot_t **slots)
+{
+  const qoob_app_t *app;
+  qoob_error_t err;
 
-    /* Other information */
-    receive_answer (qoob->devh, buf);
+  if (qoob == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
 
-    /* Add name to slot */
-    if ((buf[SLOTS_IN_USE_INDEX] > 0) && 
-        (buf[SLOTS_IN_USE_INDEX] <= QOOB_PRO_SLOTS)) {
-      add_to_slot_array (qoob, (int)slot, tmpbuf, buf);
-      /* Takes buf[2] slots */
-      slot += (char)buf[SLOTS_IN_USE_INDEX];
-    } else {
+  assert (qoob->async == QOOB_FALSE);
 
-      /* Add empty slot */
-      memset (tmpbuf, 0, QOOB_PRO_MAX_BUFFER*4);
-      memcpy (tmpbuf, EMPTY_SLOT_NAME, strlen (EMPTY_SLOT_NAME));
-      memset (buf, 0, QOOB_PRO_MAX_BUFFER);
-      buf[SLOTS_IN_USE_INDEX] = 1;
+  if (qoob->transport == NULL) {
+    return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
+  }
 
-      /* Adds just readed slot to qoob->slot */
-      add_to_slot_array (qoob, (int)slot, tmpbuf, buf);
+  if (slot_from >= QOOB_PRO_SLOTS || slot_from < 0 ||
+      slot_to >= QOOB_PRO_SLOTS || slot_to < 0) {
+    return QOOB_ERROR_SLOT_OUT_OF_RANGE;
+  }
 
-      slot++;
-    }
+  if (slot_from > slot_to) {
+    return QOOB_ERROR_SLOT_RANGE_NOT_VALID;
+  }
 
-    QOOB_END (qoob->devh, buf);
-    receive_answer (qoob->devh, buf);
+  app = qoob_table_app_at (&qoob->table, slot_from);
+  if (app != NULL) {
+    slot_from = app->slot;
+  }
+  app = qoob_table_app_at (&qoob->table, slot_to);
+  if (app != NULL) {
+    slot_to = app->slot + app->slots_used - 1;
+  }
 
-    if (slot > 31)
-      break;
+  err = list_slots (qoob, slot_from, slot_to);
+  if (err != QOOB_ERROR_OK) {
+    return err;
   }
 
-  *slots = malloc (sizeof (qoob_slot_t) * QOOB_PRO_SLOTS);
-  if (*slots == NULL)
-    abort ();
+  if (slots == NULL) {
+    return QOOB_ERROR_OK;
+  }
 
-  memcpy (*slots, qoob->slot, (sizeof (qoob_slot_t) * QOOB_PRO_SLOTS));
+  *slots = qoob_sync_slot_copy (qoob_sync_slots_get (qoob));
+  if (*slots == NULL) {
+    return QOOB_ERROR_NO_MEMORY;
+  }
 
   return QOOB_ERROR_OK;
 }
@@ -279,39 +456,32 @@ qoob_sync_usb_read (qoob_t *qoob,
                char *file,
                short int slotnum)
 {
-  int ret,i,j;
-  char buf[QOOB_PRO_MAX_BUFFER] = {0,};
   int fd;
-  size_t wrote;
-  off_t seek_to = 0;
+  qoob_error_t err;
 
   if (qoob == NULL) {
     return QOOB_ERROR_INPUT_NOT_VALID;;
   }
 
-  assert (qoob->async == QOOB_FALSE);
-
-  if (qoob->devh == NULL) {
-    return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
-  }
-
   if (file == NULL) {
     return QOOB_ERROR_FILE_NOT_VALID;
   }
-  
+
+  /* File is not truncated if it can not be read */
+  if (qoob->transport == NULL) {
+    return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
+  }
   if (slotnum >= QOOB_PRO_SLOTS || slotnum < 0) {
     return QOOB_ERROR_SLOT_OUT_OF_RANGE;
   }
-
-  if (qoob->slot[slotnum].first != QOOB_TRUE) {
+  if (slot_first (qoob, slotnum) != QOOB_TRUE) {
     return QOOB_ERROR_SLOT_NOT_FIRST;
   }
 
 #ifdef DEBUG
-  printf ("file: %s - slot [%02d] - slots used: %d\n", 
+  printf ("\nReading file '%s' starting at slot [%02d]", 
           file, 
-          slotnum, 
-          qoob->slot[slotnum].slots_used);
+          slotnum);
 #endif
 
   fd = open (file, 
@@ -322,296 +492,2223 @@ qoob_sync_usb_read (qoob_t *qoob,
     return QOOB_ERROR_FD_OPEN;
   }
 
-#ifdef DEBUG
-  printf ("\nReading file '%s' starting at slot [%02d]", 
-          file, 
-          slotnum);
-#endif
-
-  QOOB_START (qoob->devh, buf);
-  receive_answer (qoob->devh, buf);
-
-  /* No need to size of the file with gcb fileformat. 
-     Just read slots used by app 
-   */
-  for (i = (int)slotnum; 
-       i < (int)(slotnum + 
-                 qoob->slot[slotnum].slots_used); 
-       i++) {
-    off_t sret = 0;
-    int content = -1;
-
-    if (qoob->sync_cb != NULL) {
-      qoob->sync_cb (QOOB_SYNC_CALLBACK_READ_SLOT, 
-                     i,
-                     slotnum+qoob->slot[slotnum].slots_used-1,
-                     qoob->user_data);
-    }
-
-    sret = lseek (fd, seek_to, SEEK_SET);
-    if (sret < 0) {
-      close (fd);
-      return QOOB_ERROR_FD_SEEK;
-    }
-    seek_to = seek_to + QOOB_DEFAULT_SEEK;
-
-    /* Reading app to file */
-    send_command (qoob->devh, 
-                  QOOB_USB_CMD_READ_SLOT, 
-                  QOOB_USB_CMD_ZERO, 
-                  QOOB_USB_CMD_READ_SLOT_ALL,
-                  (char)i,
-                  buf);
-
-    /* Get 64 byte packet, but first byte is always zero. 
-     * only 63 bytes is valid data to read.
-     */
-    for (j=0; j<QOOB_READ_LOOP_DEFAULT; j++) {
-      if (qoob->sync_cb != NULL) {
-        ++content;
-        qoob->sync_cb (QOOB_SYNC_CALLBACK_READ_CONTENT,
-                       (content*(QOOB_PRO_MAX_BUFFER-1)),
-                       (QOOB_DEFAULT_SEEK*2)-1,
-                       qoob->user_data);
-      }
-
-      ret = receive_answer (qoob->devh, buf);
-      
-      wrote = write (fd, buf+1, (size_t)(ret-1));
-      if (wrote == -1) {
-        close (fd);
-        return QOOB_ERROR_FD_WRITE;
-      }
-
-      /* Seek to middle of the slot */
-      if(((j+1)%QOOB_READ_LOOP_HALF_WAY) == 0) {
-
-        send_command (qoob->devh, 
-                      QOOB_USB_CMD_READ_SLOT, 
-                      QOOB_USB_CMD_READ_SLOT_ALL_HALF_WAY,
-                      QOOB_USB_CMD_READ_SLOT_ALL,
-                      (char)i,
-                      buf);
-
-        memset (buf, 0, QOOB_PRO_MAX_BUFFER);
-
-        ret = lseek (fd, seek_to, SEEK_SET);
-        if (ret < 0) {
-          close (fd);
-          return QOOB_ERROR_FD_SEEK;
-        }
-        seek_to = seek_to + QOOB_DEFAULT_SEEK;
-        content = QOOB_READ_LOOP_HALF_WAY-2;
-      }
-    } /* for (j...*/
-
-    ret = receive_answer (qoob->devh, buf);
-    wrote = write (fd, buf+1, (size_t)(QOOB_READ_LOOP_MISSING_BYTES));
-    if (wrote == -1) {
-      close (fd);
-      return QOOB_ERROR_FD_WRITE;
-    }
-
-    if (qoob->sync_cb != NULL) {
-      qoob->sync_cb (QOOB_SYNC_CALLBACK_READ_CONTENT,
-                     (QOOB_DEFAULT_SEEK*2)-1,
-                     (QOOB_DEFAULT_SEEK*2)-1,
-                     qoob->user_data);
-    }
+  err = qoob_sync_usb_read_fd (qoob, fd, slotnum);
 
-  } /* for (i...*/
-
-  QOOB_END (qoob->devh, buf);
-  receive_answer (qoob->devh, buf);
-
-  close (fd);
+  if (close (fd) == -1 && err == QOOB_ERROR_OK) {
+    err = QOOB_ERROR_FD_WRITE;
+  }
 
-  return QOOB_ERROR_OK;
+  return err;
 }
 
+/*
+ * qoob_sync_usb_read_fd ()
+ *
+ *   input: qoob - qoob handle
+ *          fd - where application is written, e.g. pipe
+ *          slotnum - first slot of the application
+ *
+ * Writes slots of the application to fd in order as they are read. Only
+ * one slot is kept in memory. fd is not closed.
+ */
 qoob_error_t 
-qoob_sync_usb_erase_forced (qoob_t *qoob, 
-                       short int slot_from, 
-                       short int slot_to)
+qoob_sync_usb_read_fd (qoob_t *qoob,
+                       int fd,
+                       short int slotnum)
 {
-  int i;
-  char buf[QOOB_PRO_MAX_BUFFER];
+  char *data;
+  qoob_error_t err;
 
   if (qoob == NULL) {
-    return QOOB_ERROR_INPUT_NOT_VALID;
+    return QOOB_ERROR_INPUT_NOT_VALID;;
   }
 
   assert (qoob->async == QOOB_FALSE);
 
-  if (qoob->devh == NULL) {
+  if (qoob->transport == NULL) {
     return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
   }
 
-  if (slot_from >= QOOB_PRO_SLOTS || slot_from < 0) {
-    return QOOB_ERROR_SLOT_OUT_OF_RANGE;
+  if (fd < 0) {
+    return QOOB_ERROR_FILE_NOT_VALID;
   }
-
-  if (slot_to >= QOOB_PRO_SLOTS || slot_to < 0) {
+  
+  if (slotnum >= QOOB_PRO_SLOTS || slotnum < 0) {
     return QOOB_ERROR_SLOT_OUT_OF_RANGE;
   }
 
-  if (slot_from > slot_to ) {
-    return QOOB_ERROR_SLOT_RANGE_NOT_VALID;
+  if (slot_first (qoob, slotnum) != QOOB_TRUE) {
+    return QOOB_ERROR_SLOT_NOT_FIRST;
   }
 
 #ifdef DEBUG
-  printf ("\nErasing flash starting at slot [%02d] to slot [%02d].\n", 
-          slot_from, slot_to);
+  printf ("slot [%02d] - slots used: %d\n", 
+          slotnum, 
+          slot_used (qoob, slotnum));
 #endif
-  for (i=slot_from; i<=slot_to; i++) {
-
-    if (qoob->sync_cb != NULL) {
-      qoob->sync_cb (QOOB_SYNC_CALLBACK_ERASE,
-                     i,
-                     slot_to,
-                     qoob->user_data);
-    }
 
-    QOOB_START (qoob->devh, buf);
-    receive_answer (qoob->devh, buf);
-
-    send_command (qoob->devh, 
-                  QOOB_USB_CMD_ERASE, 
-                  QOOB_USB_CMD_ZERO, 
-                  QOOB_USB_CMD_ZERO,
-                  (char)i,
-                  buf);
-    send_command (qoob->devh,
-                  QOOB_USB_CMD_GET_ANSWER,
-                  QOOB_USB_CMD_ZERO,
-                  QOOB_USB_CMD_ZERO,
-                  0,
-                  buf);
-
-    QOOB_END (qoob->devh, buf);
-    receive_answer (qoob->devh, buf);
+  /* No need to size of the file with gcb fileformat. 
+     Just read slots used by app 
+   */
+  data = work_alloc (qoob, QOOB_PRO_SLOT_SIZE);
+  if (data == NULL) {
+    return QOOB_ERROR_NO_MEMORY;
   }
 
-  return QOOB_ERROR_OK;
+  err = read_slots (qoob, slotnum, slot_used (qoob, slotnum), data, fd, 
+                    NULL);
+  work_free (qoob, data);
+
+  return err;
 }
 
+/*
+ * qoob_sync_usb_read_buffer ()
+ *
+ *   input: qoob - qoob handle
+ *          buffer - where application is read
+ *          size - size of buffer. At least slots used times 
+ *                 QOOB_PRO_SLOT_SIZE.
+ *          slotnum - first slot of the application
+ *
+ * Reads slots of the application straight to caller's buffer.
+ */
 qoob_error_t 
-qoob_sync_usb_erase (qoob_t *qoob, 
-                short int slot_num) 
+qoob_sync_usb_read_buffer (qoob_t *qoob,
+                           char *buffer,
+                           size_t size,
+                           short int slotnum)
 {
-
-  /* TODO: add checks */
   if (qoob == NULL) {
-    return QOOB_ERROR_INPUT_NOT_VALID;;
+    return QOOB_ERROR_INPUT_NOT_VALID;
   }
 
   assert (qoob->async == QOOB_FALSE);
 
-  if (qoob->slot[slot_num].first != QOOB_TRUE) {
+  if (qoob->transport == NULL) {
+    return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
+  }
+
+  if (slotnum >= QOOB_PRO_SLOTS || slotnum < 0) {
+    return QOOB_ERROR_SLOT_OUT_OF_RANGE;
+  }
+
+  if (slot_first (qoob, slotnum) != QOOB_TRUE) {
     return QOOB_ERROR_SLOT_NOT_FIRST;
   }
 
-  return qoob_sync_usb_erase_forced (qoob, 
-                                 slot_num, 
-                                 slot_num +
-                                   qoob->slot[slot_num].slots_used - 
-                                   1);
+  if (buffer == NULL ||
+      size < (size_t)slot_used (qoob, slotnum)*QOOB_PRO_SLOT_SIZE) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
 
-  return QOOB_ERROR_OK;
+  return read_slots (qoob, 
+                     slotnum, 
+                     slot_used (qoob, slotnum), 
+                     buffer, 
+                     -1,
+                     NULL);
 }
 
+#ifndef QOOB_MINIMAL
+/* Archives need zlib which uses heap */
+/*
+ * qoob_sync_usb_backup ()
+ *
+ *   input: qoob - qoob handle
+ *          archive - archive started with qoob_archive_create ()
+ *          slot_from - first slot
+ *          slot_to - last slot
+ *
+ * Reads applications which have slots between slot_from and slot_to to 
+ * archive. Each slot is compressed as soon as it is read, so only one 
+ * slot is kept in memory. Empty slots are left out. Slot list has to be
+ * up to date. Caller finishes the archive.
+ */
+qoob_error_t
+qoob_sync_usb_backup (qoob_t *qoob,
+                      qoob_archive_t *archive,
+                      short int slot_from,
+                      short int slot_to)
+{
+  const qoob_app_t *app;
+  unsigned long completed = 0;
+  char *data;
+  qoob_error_t err = QOOB_ERROR_OK;
 
-#define REMOVE_TMPFILE(rf, c) \
-do {\
-  if ((c) == QOOB_TRUE) {                            \
-    if ((unlink (rf)) != 0) {\
-      fprintf (stderr, \
-               "Error: Could not remove temporary file from /tmp!!!\n"); \
-    }\
-  }\
-} while (0)
+  if (qoob == NULL || archive == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
 
-qoob_error_t 
-qoob_sync_usb_write (qoob_t *qoob,
-                char *file,
-                short int slotnum)
+  assert (qoob->async == QOOB_FALSE);
+
+  if (qoob->transport == NULL) {
+    return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
+  }
+
+  if (slot_from >= QOOB_PRO_SLOTS || slot_from < 0 ||
+      slot_to >= QOOB_PRO_SLOTS || slot_to < 0) {
+    return QOOB_ERROR_SLOT_OUT_OF_RANGE;
+  }
+
+  if (slot_from > slot_to) {
+    return QOOB_ERROR_SLOT_RANGE_NOT_VALID;
+  }
+
+  data = work_alloc (qoob, QOOB_PRO_SLOT_SIZE);
+  if (data == NULL) {
+    return QOOB_ERROR_NO_MEMORY;
+  }
+
+  for (app = qoob_table_next (&qoob->table, NULL);
+       app != NULL;
+       app = qoob_table_next (&qoob->table, app)) {
+    if (app->slot > slot_to || 
+        app->slot + app->slots_used - 1 < slot_from) {
+      continue;
+    }
+
+    err = read_slots (qoob, app->slot, app->slots_used, data, -1, archive);
+    completed |= qoob->completed;
+    if (err != QOOB_ERROR_OK) {
+      break;
+    }
+  }
+  qoob->completed = completed;
+  work_free (qoob, data);
+
+  return err;
+}
+
+/*
+ * qoob_sync_usb_restore ()
+ *
+ *   input: qoob - qoob handle
+ *          archive - archive opened with qoob_archive_open ()
+ *          slotnum - first slot of the application in archive
+ *
+ * Writes application of the archive back to its slots. Slots are checked
+ * against their digests before flash is touched, and then uncompressed 
+ * one at a time in the write loop. Slots have to be free as in write. 
+ * Header is written last as in other writes.
+ */
+qoob_error_t
+qoob_sync_usb_restore (qoob_t *qoob,
+                       qoob_archive_t *archive,
+                       short int slotnum)
 {
-  int ret,i,j;
+  const qoob_archive_slot_t *s;
   char buf[QOOB_PRO_MAX_BUFFER];
-  char tmpbuf[QOOB_PRO_MAX_BUFFER];
-  int fd;
+  char *data;
+  int skipped = 0;
+  int last;
+  int i;
+  qoob_error_t err;
+
+  if (qoob == NULL || archive == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  assert (qoob->async == QOOB_FALSE);
+
+  if (qoob->transport == NULL) {
+    return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
+  }
+
+  if (slotnum >= QOOB_PRO_SLOTS || slotnum < 0) {
+    return QOOB_ERROR_SLOT_OUT_OF_RANGE;
+  }
+
+  s = &archive->slot[slotnum];
+  if (s->present != QOOB_TRUE || s->app != slotnum) {
+    return QOOB_ERROR_SLOT_NOT_FIRST;
+  }
+
+  last = slotnum + s->slots_used - 1;
+  if (last >= QOOB_PRO_SLOTS) {
+    return QOOB_ERROR_ARCHIVE_NOT_VALID;
+  }
+
+  for (i=slotnum; i<=last; i++) {
+    if (archive->slot[i].present != QOOB_TRUE ||
+        archive->slot[i].app != slotnum) {
+      return QOOB_ERROR_ARCHIVE_NOT_VALID;
+    }
+    if (slot_free (qoob, i) != QOOB_TRUE) {
+      return QOOB_ERROR_TRYING_TO_OVERWRITE;
+    }
+  }
+
+  data = work_alloc (qoob, QOOB_PRO_SLOT_SIZE);
+  if (data == NULL) {
+    return QOOB_ERROR_NO_MEMORY;
+  }
+
+  for (i=slotnum; i<=last; i++) {
+    err = qoob_archive_read_slot (archive, (short int)i, data);
+    if (err != QOOB_ERROR_OK) {
+      work_free (qoob, data);
+      return err;
+    }
+  }
+
+  err = qoob_sync_usb_erase_forced (qoob, slotnum, (short int)last);
+  if (err != QOOB_ERROR_OK) {
+    qoob->completed = 0;
+    work_free (qoob, data);
+    return err;
+  }
+
+  qoob->completed = 0;
+
+  QOOB_START (qoob, buf);
+  receive_answer (qoob, buf);
+
+  for (i=slotnum; i<=last; i++) {
+    err = qoob_archive_read_slot (archive, (short int)i, data);
+    if (err == QOOB_ERROR_OK) {
+      err = write_slot (qoob, i, last, data, QOOB_PRO_SLOT_SIZE, 0, 
+                        i == slotnum ? 1 : 0, &skipped);
+    }
+    if (err != QOOB_ERROR_OK) {
+      work_free (qoob, data);
+      return session_failed (qoob, buf, err);
+    }
+  }
+
+  /* Header last as in write_slots () */
+  err = qoob_archive_read_slot (archive, slotnum, data);
+  if (err == QOOB_ERROR_OK) {
+    err = write_header (qoob, slotnum, data, QOOB_PRO_SLOT_SIZE, &skipped);
+  }
+  if (err != QOOB_ERROR_OK) {
+    work_free (qoob, data);
+    return session_failed (qoob, buf, err);
+  }
+
+  QOOB_END (qoob, buf);
+  receive_answer (qoob, buf);
+  work_free (qoob, data);
+
+  if (qoob->sparse == QOOB_TRUE && qoob->sync_cb != NULL) {
+    qoob->sync_cb (QOOB_SYNC_CALLBACK_SPARSE,
+                   skipped,
+                   (last-slotnum+1)*QOOB_WRITE_LOOP_DEFAULT,
+                   qoob->user_data);
+  }
+
+  return QOOB_ERROR_OK;
+}
+#endif
+
+/*
+ * qoob_sync_usb_config_read ()
+ *
+ *   input: qoob - qoob handle
+ *          config - where config slot is parsed
+ *
+ * Finds config slot from slot list and reads it. Config has to fit to one
+ * slot, because only that slot is rewritten on qoob_sync_usb_config_write.
+ */
+qoob_error_t
+qoob_sync_usb_config_read (qoob_t *qoob,
+                           qoob_config_t *config)
+{
+  const qoob_app_t *app;
+  char *data;
+  qoob_error_t err;
+
+  if (qoob == NULL || config == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  assert (qoob->async == QOOB_FALSE);
+
+  if (qoob->transport == NULL) {
+    return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
+  }
+
+  for (app = qoob_table_next (&qoob->table, NULL);
+       app != NULL;
+       app = qoob_table_next (&qoob->table, app)) {
+    if (app->type == QOOB_BINARY_TYPE_CONFIG) {
+      break;
+    }
+  }
+
+  if (app == NULL) {
+    return QOOB_ERROR_CONFIG_NOT_FOUND;
+  }
+
+  if (app->slots_used != 1) {
+    return QOOB_ERROR_NOT_SUPPORTED_FILE_FORMAT;
+  }
+
+  data = work_alloc (qoob, QOOB_PRO_SLOT_SIZE);
+  if (data == NULL) {
+    return QOOB_ERROR_NO_MEMORY;
+  }
+
+  err = read_slots (qoob, app->slot, 1, data, -1, NULL);
+  if (err == QOOB_ERROR_OK) {
+    err = qoob_config_parse (config, data, QOOB_PRO_SLOT_SIZE);
+  }
+  if (err == QOOB_ERROR_OK) {
+    config->slot = app->slot;
+  }
+  work_free (qoob, data);
+
+  return err;
+}
+
+/*
+ * qoob_sync_usb_config_write ()
+ *
+ *   input: qoob - qoob handle
+ *          config - config read with qoob_sync_usb_config_read ()
+ *
+ * Erases and writes back only the config slot. Nothing is done if no 
+ * value was changed. Slot has to still have the config.
+ */
+qoob_error_t
+qoob_sync_usb_config_write (qoob_t *qoob,
+                            qoob_config_t *config)
+{
+  const qoob_app_t *app;
+  qoob_error_t err;
+
+  if (qoob == NULL || config == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  assert (qoob->async == QOOB_FALSE);
+
+  if (qoob->transport == NULL) {
+    return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
+  }
+
+  if (config->changed != QOOB_TRUE) {
+    qoob->completed = 0;
+    return QOOB_ERROR_OK;
+  }
+
+  if (config->slot >= QOOB_PRO_SLOTS || config->slot < 0) {
+    return QOOB_ERROR_SLOT_OUT_OF_RANGE;
+  }
+
+  app = qoob_table_app_at (&qoob->table, config->slot);
+  if (app == NULL || app->slot != config->slot || app->slots_used != 1 ||
+      app->type != QOOB_BINARY_TYPE_CONFIG) {
+    return QOOB_ERROR_CONFIG_NOT_FOUND;
+  }
+
+  err = qoob_sync_usb_erase_forced (qoob, config->slot, config->slot);
+  if (err != QOOB_ERROR_OK) {
+    qoob->completed = 0;
+    return err;
+  }
+
+  err = write_slots (qoob, config->data, QOOB_PRO_SLOT_SIZE, config->slot,
+                     1, 1UL << config->slot);
+  if (err == QOOB_ERROR_OK) {
+    config->changed = QOOB_FALSE;
+  }
+
+  return err;
+}
+
+/*
+ * qoob_sync_usb_read_range ()
+ *
+ *   input: qoob - qoob handle
+ *          offset - byte offset from start of the flash
+ *          buf - where size bytes are read
+ *
+ * Reads only half slots which the range touches and are not read before.
+ * Half slots stay in cache until they are erased or written or device is
+ * closed, so reading same range again needs no transfers.
+ */
+qoob_error_t
+qoob_sync_usb_read_range (qoob_t *qoob,
+                          unsigned long offset,
+                          char *buf,
+                          size_t size)
+{
+  char cmd[QOOB_PRO_MAX_BUFFER] = {0,};
+  qoob_boolean_t started = QOOB_FALSE;
+  unsigned long i;
+  qoob_error_t err = QOOB_ERROR_OK;
+
+  if (qoob == NULL || buf == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  assert (qoob->async == QOOB_FALSE);
+
+  if (qoob->transport == NULL) {
+    return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
+  }
+
+  if (offset > QOOB_PRO_TOTAL_SIZE || 
+      size > QOOB_PRO_TOTAL_SIZE - offset) {
+    return QOOB_ERROR_SLOT_OUT_OF_RANGE;
+  }
+  if (size == 0) {
+    return QOOB_ERROR_OK;
+  }
+
+  if (qoob->cache == NULL) {
+    qoob->cache = work_alloc (qoob, QOOB_PRO_TOTAL_SIZE);
+    if (qoob->cache == NULL) {
+      return QOOB_ERROR_NO_MEMORY;
+    }
+    memset (qoob->cached, 0, sizeof (qoob->cached));
+  }
+
+  qoob->completed = 0;
+
+  for (i = offset/QOOB_DEFAULT_SEEK; 
+       i <= (offset+size-1)/QOOB_DEFAULT_SEEK; 
+       i++) {
+    int slot = (int)(i/2);
+    int half = (int)(i%2);
+    int tries = 0;
+
+    if (qoob->cached[i] == QOOB_TRUE) {
+      qoob->completed |= 1UL << slot;
+      continue;
+    }
+
+    if (started == QOOB_FALSE) {
+      QOOB_START (qoob, cmd);
+      receive_answer (qoob, cmd);
+      started = QOOB_TRUE;
+    }
+
+    while ((err = read_half_slot (qoob, 
+                                  slot, 
+                                  half, 
+                                  qoob->cache + 
+                                    (size_t)slot*QOOB_PRO_SLOT_SIZE)) != 
+           QOOB_ERROR_OK) {
+      if (retry (qoob, err, &tries, slot) == QOOB_FALSE) {
+        break;
+      }
+    }
+    if (err != QOOB_ERROR_OK) {
+      break;
+    }
+    qoob->cached[i] = QOOB_TRUE;
+    qoob->completed |= 1UL << slot;
+  }
+
+  if (started == QOOB_TRUE) {
+    QOOB_END (qoob, cmd);
+    receive_answer (qoob, cmd);
+  }
+  if (err != QOOB_ERROR_OK) {
+    return err;
+  }
+
+  memcpy (buf, qoob->cache+offset, size);
+
+  return QOOB_ERROR_OK;
+}
+
+/*
+ * qoob_sync_usb_verify ()
+ *
+ *   input: qoob - qoob handle
+ *          file - file which should be flashed
+ *          slotnum - first slot of the application
+ *
+ * Builds image from file same way as qoob_sync_usb_write () does and 
+ * compares it to flash content. Erased tail of the image is not compared
+ * so applications written by older versions, which padded with zeros, are
+ * also accepted. Returns QOOB_ERROR_VERIFY_FAILED if content differs.
+ */
+qoob_error_t
+qoob_sync_usb_verify (qoob_t *qoob,
+                      char *file,
+                      short int slotnum)
+{
+  char *data = NULL;
+  char *flash;
+  size_t size = 0;
+  size_t used;
   int used_slots;
-  off_t seek_to = 0;
+  const qoob_app_t *app;
   qoob_error_t err;
-  struct stat sbuf;
-  qoob_boolean_t is_tmpfile = QOOB_FALSE;
 
   if (qoob == NULL) {
-    return QOOB_ERROR_INPUT_NOT_VALID;;
+    return QOOB_ERROR_INPUT_NOT_VALID;
   }
 
   assert (qoob->async == QOOB_FALSE);
 
-  if (qoob->devh == NULL) {
+  if (qoob->transport == NULL) {
     return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
   }
 
   if (file == NULL) {
     return QOOB_ERROR_FILE_NOT_VALID;
   }
-  
+
+  if (slotnum >= QOOB_PRO_SLOTS || slotnum < 0) {
+    return QOOB_ERROR_SLOT_OUT_OF_RANGE;
+  }
+
+  if (slot_first (qoob, slotnum) != QOOB_TRUE) {
+    return QOOB_ERROR_SLOT_NOT_FIRST;
+  }
+
+  err = load_file (qoob, file, &data, &size);
+  if (err != QOOB_ERROR_OK) {
+    return err;
+  }
+
+  if (qoob->binary_type == QOOB_BINARY_TYPE_ELF ||
+      qoob->binary_type == QOOB_BINARY_TYPE_DOL) {
+
+    /* Padding is not compared below, flash may have zeros or erased
+       bytes there depending on sparse setting of the write */
+    err = write_with_header (qoob, file, (char)QOOB_PRO_ERASED_BYTE, 
+                             &data, &size);
+    if (err != QOOB_ERROR_OK) {
+      work_free (qoob, data);
+      return err;
+    }
+
+    /* Older versions left digest area zeros */
+    app = qoob_table_app_at (&qoob->table, slotnum);
+    if (app == NULL || app->has_digest != QOOB_TRUE) {
+      memset (data+QOOB_GCB_DIGEST_OFFSET, 0, QOOB_GCB_DIGEST_AREA_SIZE);
+    }
+  }
+
+  /* Slot count in flash header has to match before reading anything */
+  used_slots = qoob_file_slots_needed (QOOB_BINARY_TYPE_GCB, size);
+  app = qoob_table_app_at (&qoob->table, slotnum);
+  if (app == NULL || app->type == QOOB_BINARY_TYPE_VOID ||
+      app->slots_used != used_slots) {
+    work_free (qoob, data);
+    return QOOB_ERROR_VERIFY_FAILED;
+  }
+
+  used = size;
+  while (used > 0 && 
+         (unsigned char)data[used-1] == QOOB_PRO_ERASED_BYTE) {
+    used--;
+  }
+
+  flash = work_alloc (qoob, (size_t)used_slots * QOOB_PRO_SLOT_SIZE);
+  if (flash == NULL) {
+    work_free (qoob, data);
+    return QOOB_ERROR_NO_MEMORY;
+  }
+
+  err = read_slots (qoob, slotnum, used_slots, flash, -1, NULL);
+  if (err == QOOB_ERROR_OK && memcmp (flash, data, used) != 0) {
+    err = QOOB_ERROR_VERIFY_FAILED;
+  }
+
+  work_free (qoob, flash);
+  work_free (qoob, data);
+
+  return err;
+}
+
+/*
+ * qoob_sync_usb_verify_header ()
+ *
+ *   input: qoob - qoob handle
+ *          file - file which should be flashed
+ *          slotnum - first slot of the application
+ *
+ * Compares payload length and digest, which libqoob stores to the header
+ * it builds, to the file. Uses only listed slot information so nothing 
+ * is read from flash. Returns QOOB_ERROR_DIGEST_MISSING if slot or GCB 
+ * file has no digest, or if application was written with other minimize
+ * setting, and qoob_sync_usb_verify () has to be used instead. Header is
+ * written last, so it does not match after interrupted write.
+ */
+qoob_error_t
+qoob_sync_usb_verify_header (qoob_t *qoob,
+                             char *file,
+                             short int slotnum)
+{
+  char *data = NULL;
+  size_t size = 0;
+  unsigned long length;
+  unsigned char digest[QOOB_DIGEST_SIZE];
+  int used_slots;
+  const qoob_app_t *app;
+  qoob_error_t err;
+
+  if (qoob == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  assert (qoob->async == QOOB_FALSE);
+
+  if (qoob->transport == NULL) {
+    return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
+  }
+
+  if (file == NULL) {
+    return QOOB_ERROR_FILE_NOT_VALID;
+  }
+
   if (slotnum >= QOOB_PRO_SLOTS || slotnum < 0) {
     return QOOB_ERROR_SLOT_OUT_OF_RANGE;
   }
 
-  qoob->real_file = strdup (file);
+  if (slot_first (qoob, slotnum) != QOOB_TRUE) {
+    return QOOB_ERROR_SLOT_NOT_FIRST;
+  }
+  app = qoob_table_app_at (&qoob->table, slotnum);
+  if (app == NULL || app->type == QOOB_BINARY_TYPE_VOID) {
+    return QOOB_ERROR_VERIFY_FAILED;
+  }
+  if (app->has_digest != QOOB_TRUE) {
+    return QOOB_ERROR_DIGEST_MISSING;
+  }
+
+  err = load_file (qoob, file, &data, &size);
+  if (err != QOOB_ERROR_OK) {
+    return err;
+  }
+
+  /* GCB has its header already */
+  if (qoob->binary_type != QOOB_BINARY_TYPE_ELF &&
+      qoob->binary_type != QOOB_BINARY_TYPE_DOL) {
+    if (size < QOOB_GCB_HEADER_SIZE ||
+        qoob_image_gcb_digest (data, &length, digest) != QOOB_TRUE) {
+      work_free (qoob, data);
+      return QOOB_ERROR_DIGEST_MISSING;
+    }
+    used_slots = qoob_file_slots_needed (QOOB_BINARY_TYPE_GCB, size);
+    work_free (qoob, data);
+
+    if (app->slots_used != used_slots ||
+        app->length != length ||
+        memcmp (app->digest, digest, QOOB_DIGEST_SIZE) != 0) {
+      return QOOB_ERROR_VERIFY_FAILED;
+    }
+    return QOOB_ERROR_OK;
+  }
+
+  err = payload_compare (qoob, qoob->minimize, data, size, app);
+#ifndef QOOB_MINIMAL
+  if (err == QOOB_ERROR_VERIFY_FAILED) {
+    int mode;
+
+    /* Written with other minimize setting, header can not tell if it 
+       is what write would put there now */
+    for (mode = QOOB_MINIMIZE_NONE; mode <= QOOB_MINIMIZE_DOL; mode++) {
+      if (mode != (int)qoob->minimize &&
+          payload_compare (qoob, (qoob_minimize_t)mode, 
+                           data, size, app) == QOOB_ERROR_OK) {
+        err = QOOB_ERROR_DIGEST_MISSING;
+        break;
+      }
+    }
+  }
+#endif
+  work_free (qoob, data);
+
+  return err;
+}
+
+qoob_error_t 
+qoob_sync_usb_erase_forced (qoob_t *qoob, 
+                       short int slot_from, 
+                       short int slot_to)
+{
+  int i;
+
+  if (qoob == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  assert (qoob->async == QOOB_FALSE);
+
+  if (qoob->transport == NULL) {
+    return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
+  }
+
+  if (slot_from >= QOOB_PRO_SLOTS || slot_from < 0) {
+    return QOOB_ERROR_SLOT_OUT_OF_RANGE;
+  }
+
+  if (slot_to >= QOOB_PRO_SLOTS || slot_to < 0) {
+    return QOOB_ERROR_SLOT_OUT_OF_RANGE;
+  }
+
+  if (slot_from > slot_to ) {
+    return QOOB_ERROR_SLOT_RANGE_NOT_VALID;
+  }
+
+#ifdef DEBUG
+  printf ("\nErasing flash starting at slot [%02d] to slot [%02d].\n", 
+          slot_from, slot_to);
+#endif
+  qoob->completed = 0;
+
+  /* Every slot is own session so cancel is checked between them */
+  for (i=slot_from; i<=slot_to; i++) {
+    qoob_error_t err;
+    struct timespec mark;
+    int tries = 0;
+
+    qoob_profile_mark (qoob->profile, &mark);
+
+    err = qoob_cancel_check (qoob->cancel);
+    if (err != QOOB_ERROR_OK) {
+      return err;
+    }
+
+    if (qoob->sync_cb != NULL) {
+      qoob->sync_cb (QOOB_SYNC_CALLBACK_ERASE,
+                     i,
+                     slot_to,
+                     qoob->user_data);
+    }
+
+    while ((err = erase_slot (qoob, i)) != QOOB_ERROR_OK) {
+      if (retry (qoob, err, &tries, i) == QOOB_FALSE) {
+        return err;
+      }
+    }
+    qoob->completed |= 1UL << i;
+    qoob_profile_add (qoob->profile, QOOB_PHASE_ERASE, (short int)i, &mark);
+  }
+
+  return QOOB_ERROR_OK;
+}
+
+qoob_error_t 
+qoob_sync_usb_erase (qoob_t *qoob, 
+                short int slot_num) 
+{
+
+  /* TODO: add checks */
+  if (qoob == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;;
+  }
+
+  assert (qoob->async == QOOB_FALSE);
+
+  if (slot_first (qoob, slot_num) != QOOB_TRUE) {
+    return QOOB_ERROR_SLOT_NOT_FIRST;
+  }
+
+  return qoob_sync_usb_erase_forced (qoob, 
+                                 slot_num, 
+                                 slot_num +
+                                   slot_used (qoob, slot_num) - 
+                                   1);
+
+  return QOOB_ERROR_OK;
+}
+
+
+qoob_error_t 
+qoob_sync_usb_write (qoob_t *qoob,
+                char *file,
+                short int slotnum)
+{
+  char *data = NULL;
+  size_t size = 0;
+  struct timespec mark;
+  qoob_error_t err;
+
+  if (qoob == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;;
+  }
+
+  assert (qoob->async == QOOB_FALSE);
+
+  if (qoob->transport == NULL) {
+    return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
+  }
+
+  if (file == NULL) {
+    return QOOB_ERROR_FILE_NOT_VALID;
+  }
+  
+  if (slotnum >= QOOB_PRO_SLOTS || slotnum < 0) {
+    return QOOB_ERROR_SLOT_OUT_OF_RANGE;
+  }
+
+  qoob_profile_mark (qoob->profile, &mark);
+  err = load_file (qoob, file, &data, &size);
+  if (err != QOOB_ERROR_OK) {
+    return err;
+  }
+  qoob_profile_add (qoob->profile, QOOB_PHASE_LOAD, -1, &mark);
+
+  return write_data (qoob, file, data, size, slotnum);
+}
+
+/*
+ * qoob_sync_usb_write_buffer ()
+ *
+ *   input: qoob - qoob handle
+ *          name - file name of the data. ELF and DOL get application name
+ *                 from it.
+ *          buffer - content of the file
+ *          slotnum - first slot of the application
+ *
+ * Same as qoob_sync_usb_write () for data which is already in memory.
+ */
+qoob_error_t 
+qoob_sync_usb_write_buffer (qoob_t *qoob,
+                            const char *name,
+                            const char *buffer,
+                            size_t size,
+                            short int slotnum)
+{
+  char *data;
+
+  if (qoob == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  assert (qoob->async == QOOB_FALSE);
+
+  if (qoob->transport == NULL) {
+    return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
+  }
+
+  if (name == NULL || (buffer == NULL && size > 0)) {
+    return QOOB_ERROR_FILE_NOT_VALID;
+  }
+  
+  if (slotnum >= QOOB_PRO_SLOTS || slotnum < 0) {
+    return QOOB_ERROR_SLOT_OUT_OF_RANGE;
+  }
+
+  if (size > QOOB_PRO_TOTAL_SIZE) {
+    return QOOB_ERROR_TOO_BIG_DATA;
+  }
+
+  /* GCB is written as it is, no need to copy */
+  if (qoob->binary_type != QOOB_BINARY_TYPE_ELF &&
+      qoob->binary_type != QOOB_BINARY_TYPE_DOL) {
+    return write_gcb (qoob, buffer, size, slotnum);
+  }
+
+  data = work_alloc (qoob, size);
+  if (data == NULL) {
+    return QOOB_ERROR_NO_MEMORY;
+  }
+  memcpy (data, buffer, size);
+
+  return write_data (qoob, name, data, size, slotnum);
+}
+
+#ifndef QOOB_MINIMAL
+/* Caller frees the image so it has to be from heap */
+/*
+ * qoob_sync_usb_image ()
+ *
+ *   input: qoob - qoob handle
+ *          name - file name of the data. ELF and DOL get application name
+ *                 from it.
+ *          buffer - content of the file
+ *          image - GCB image which write puts to flash. Free with free ().
+ *
+ * Builds the image in memory the same way as qoob_sync_usb_write () does
+ * before it writes. File format and minimizing are taken from handle.
+ * Device is not needed.
+ */
+qoob_error_t
+qoob_sync_usb_image (qoob_t *qoob,
+                     const char *name,
+                     const char *buffer,
+                     size_t size,
+                     char **image,
+                     size_t *image_size)
+{
+  char *data;
+  qoob_error_t err;
+
+  if (qoob == NULL || image == NULL || image_size == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  if (name == NULL || (buffer == NULL && size > 0)) {
+    return QOOB_ERROR_FILE_NOT_VALID;
+  }
+
+  if (size > QOOB_PRO_TOTAL_SIZE) {
+    return QOOB_ERROR_TOO_BIG_DATA;
+  }
+
+  data = (char *)malloc (size > 0 ? size : 1);
+  if (data == NULL) {
+    return QOOB_ERROR_NO_MEMORY;
+  }
+  memcpy (data, buffer, size);
+
+  if (qoob->binary_type == QOOB_BINARY_TYPE_ELF ||
+      qoob->binary_type == QOOB_BINARY_TYPE_DOL) {
+    err = write_with_header (qoob, name, WRITE_PAD (qoob), &data, &size);
+    if (err != QOOB_ERROR_OK) {
+      free (data);
+      return err;
+    }
+  }
+
+  *image = data;
+  *image_size = size;
+
+  return QOOB_ERROR_OK;
+}
+#endif
+
+/*
+ * qoob_sync_usb_write_changed ()
+ *
+ *   input: qoob - qoob handle
+ *          previous - GCB image which is in flash at slotnum or NULL if 
+ *                     it is not known
+ *          image - GCB image to write, see qoob_sync_usb_image ()
+ *          slotnum - first slot of the application
+ *
+ * Erases and writes only slots whose content differs from the previous 
+ * image and erases slots the image does not need anymore. Without 
+ * previous image every slot is written. Previous image may be 
+ * overwritten. Without it only application at slotnum with the name and
+ * type of the image may be, e.g. when earlier watch wrote it. Other slots
+ * have to be free in slot list as in write, or 
+ * QOOB_ERROR_TRYING_TO_OVERWRITE is returned. Completed slots are the 
+ * written ones.
+ */
+qoob_error_t
+qoob_sync_usb_write_changed (qoob_t *qoob,
+                             const char *previous,
+                             size_t previous_size,
+                             const char *image,
+                             size_t size,
+                             short int slotnum)
+{
+  int used_slots;
+  int owned;
+  unsigned long mask = 0;
+  qoob_error_t err;
+  int i;
+
+  if (qoob == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  assert (qoob->async == QOOB_FALSE);
+
+  if (qoob->transport == NULL) {
+    return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
+  }
+
+  if (image == NULL || size == 0) {
+    return QOOB_ERROR_FILE_NOT_VALID;
+  }
+
+  if (slotnum >= QOOB_PRO_SLOTS || slotnum < 0) {
+    return QOOB_ERROR_SLOT_OUT_OF_RANGE;
+  }
+
+  used_slots = qoob_file_slots_needed (QOOB_BINARY_TYPE_GCB, size);
+  if ((slotnum+used_slots-1) >= QOOB_PRO_SLOTS) {
+    return QOOB_ERROR_TOO_BIG_DATA;
+  }
+
+  /* Slots which belong to the application being replaced */
+  if (previous != NULL) {
+    owned = qoob_file_slots_needed (QOOB_BINARY_TYPE_GCB, previous_size);
+  } else if (app_is_image (qoob, slotnum, image, size) == QOOB_TRUE) {
+    owned = slot_used (qoob, slotnum);
+  } else {
+    owned = 0;
+  }
+  if (slotnum+owned > QOOB_PRO_SLOTS) {
+    owned = QOOB_PRO_SLOTS-slotnum;
+  }
+
+  for (i=slotnum+owned; i<(slotnum+used_slots); i++) {
+    if (slot_free (qoob, i) != QOOB_TRUE) {
+      return QOOB_ERROR_TRYING_TO_OVERWRITE;
+    }
+  }
+
+  for (i=slotnum; i<(slotnum+used_slots); i++) {
+    size_t base = (size_t)(i-slotnum)*QOOB_PRO_SLOT_SIZE;
+
+    if (previous == NULL ||
+        slot_changed (previous, previous_size, image, size, base)) {
+      mask |= 1UL << i;
+    }
+  }
+
+  /* Changed slots and slots left over from bigger previous image */
+  for (i=slotnum; i<(slotnum+(owned > used_slots ? owned : used_slots)); 
+       i++) {
+    if (i >= slotnum+used_slots || (mask & (1UL << i))) {
+      err = qoob_sync_usb_erase_forced (qoob, i, i);
+      if (err != QOOB_ERROR_OK) {
+        qoob->completed = 0;
+        return err;
+      }
+    }
+  }
+
+  if (mask == 0) {
+    qoob->completed = 0;
+    return QOOB_ERROR_OK;
+  }
+
+  return write_slots (qoob, image, size, slotnum, used_slots, mask);
+}
+
+void
+qoob_sync_usb_clear (qoob_t *qoob)
+{
+  if (qoob == NULL)
+    return;
+
+  if (qoob->transport != NULL) {
+    qoob->transport->close (qoob);
+    qoob->transport = NULL;
+  }
+
+  work_free (qoob, qoob->cache);
+  qoob->cache = NULL;
+
+  qoob_lock_release (&qoob->lock);
+}
+
+/* Static functions */
+
+/*
+ * Data transfers learn timeout from measured latency same way as TCP 
+ * retransmission timer (RFC 6298) does: smoothed latency plus four times 
+ * its variation. Timeout doubles after each timeout. 
+ */
+static void
+transfer_sample (qoob_t *qoob, int latency)
+{
+  qoob_transfer_t *t = &qoob->transfer;
+  int timeout;
+
+  if (t->srtt == 0) {
+    t->srtt = latency;
+    t->rttvar = latency/2;
+  } else {
+    int delta = t->srtt - latency;
+
+    if (delta < 0)
+      delta = -delta;
+    t->rttvar = (3*t->rttvar + delta)/4;
+    t->srtt = (7*t->srtt + latency)/8;
+  }
+
+  /* Microseconds to milliseconds, rounded up */
+  timeout = (t->srtt + 4*t->rttvar + 999)/1000;
+  if (timeout < QOOB_TIMEOUT_MIN)
+    timeout = QOOB_TIMEOUT_MIN;
+  if (timeout > QOOB_TIMEOUT_DEFAULT)
+    timeout = QOOB_TIMEOUT_DEFAULT;
+  t->timeout = timeout;
+}
+
+static void
+transfer_backoff (qoob_t *qoob)
+{
+  qoob_transfer_t *t = &qoob->transfer;
+
+  t->timeout *= 2;
+  if (t->timeout > QOOB_TIMEOUT_DEFAULT)
+    t->timeout = QOOB_TIMEOUT_DEFAULT;
+}
+
+static int
+control_msg (qoob_t *qoob,
+             qoob_boolean_t in,
+             char *buf,
+             qoob_boolean_t data)
+{
+  struct timespec start, end;
+  int ret;
+
+  /* Only data packets are cancelled, commands end the session */
+  if (data == QOOB_TRUE && 
+      qoob_cancel_check (qoob->cancel) != QOOB_ERROR_OK) {
+    return -ECANCELED;
+  }
+
+  clock_gettime (CLOCK_MONOTONIC, &start);
+
+  ret = qoob->transport->control (qoob, 
+                                  in,
+                                  buf,
+                                  data == QOOB_TRUE ? 
+                                    packet_timeout (qoob) : DEFAULT_TIMEOUT);
+
+  if (data == QOOB_FALSE) {
+    return ret;
+  }
+
+  if (ret >= 0) {
+    clock_gettime (CLOCK_MONOTONIC, &end);
+    transfer_sample (qoob, 
+                     (int)((end.tv_sec - start.tv_sec)*1000000L +
+                           (end.tv_nsec - start.tv_nsec)/1000));
+  } else if (ret == -ETIMEDOUT) {
+    transfer_backoff (qoob);
+  }
+
+  return ret;
+}
+
+/* 
+ * Data packets back to back. Transport may keep several of them in 
+ * flight. Received packets are always full, short ones are zero padded.
+ */
+static int
+transfer_many (qoob_t *qoob,
+               qoob_boolean_t in,
+               char *bufs,
+               int count)
+{
+  struct timespec start, end;
+  int ret;
+  int i;
+
+  if (qoob->transport->control_many == NULL) {
+    for (i=0; i<count; i++) {
+      char *buf = bufs + (size_t)i*QOOB_PRO_MAX_BUFFER;
+
+      ret = control_msg (qoob, in, buf, QOOB_TRUE);
+      if (ret < 0) {
+        return ret;
+      }
+      if (in == QOOB_TRUE && ret < QOOB_PRO_MAX_BUFFER) {
+        memset (buf+ret, 0, QOOB_PRO_MAX_BUFFER-ret);
+      }
+    }
+    return count;
+  }
+
+  if (qoob_cancel_check (qoob->cancel) != QOOB_ERROR_OK) {
+    return -ECANCELED;
+  }
+
+  clock_gettime (CLOCK_MONOTONIC, &start);
+
+  ret = qoob->transport->control_many (qoob, 
+                                       in, 
+                                       bufs, 
+                                       count, 
+                                       packet_timeout (qoob));
+
+  /* Packets were queued so latency of one is its share of the batch */
+  if (ret >= 0) {
+    clock_gettime (CLOCK_MONOTONIC, &end);
+    transfer_sample (qoob, 
+                     (int)(((end.tv_sec - start.tv_sec)*1000000L +
+                            (end.tv_nsec - start.tv_nsec)/1000) / count));
+  } else if (ret == -ETIMEDOUT) {
+    transfer_backoff (qoob);
+  }
+
+  return ret;
+}
+
+/* Commands set device state so sending again is safe */
+static int 
+send_command (qoob_t *qoob, 
+              char *cmd1, 
+              char *cmd2, 
+              char *cmd3, 
+              unsigned char slot, 
+              char *outbuf) 
+{
+  int ret;
+  int i;
+
+  /* build send command */
+  memset (outbuf, 0, QOOB_PRO_MAX_BUFFER);
+  if (cmd2 != NULL)
+    *outbuf = (unsigned char)(*cmd1);     /* actual command */
+  if (slot != 0)
+    *(outbuf+1) = (unsigned char)slot;
+  if (cmd2 != NULL)
+    *(outbuf+2) = (unsigned char)(*cmd2); /* HI-byte of seek */
+ /* *(outbuf+3)                              LO-byte of seek */
+  if (cmd3 != NULL)
+    *(outbuf+4) = (unsigned char)(*cmd3); /* ???? */
+
+#ifdef DEBUG
+  printf ("%s - outbuf:\n", __FUNCTION__);
+  {
+    int i;
+    for (i=0;i<QOOB_PRO_MAX_BUFFER;i++) {
+      printf ("0x%02x ", (unsigned char)outbuf[i]);
+    }
+    printf ("\n");
+  }
+#endif
+
+  for (i=0; ; i++) {
+    ret = control_msg (qoob, QOOB_FALSE, outbuf, QOOB_FALSE);
+    if (ret >= 0 || i >= qoob->transfer.retries) {
+      break;
+    }
+  }
+
+  return ret;
+}
+
+/* Answer to command. Can wait flash so timeout is not learned. */
+static int receive_answer (qoob_t *qoob, 
+                           char *inbuf)
+{
+  int ret;
+
+  ret = control_msg (qoob, QOOB_TRUE, inbuf, QOOB_FALSE);
+
+#ifdef DEBUG
+  printf ("\n%s - inbuf:\n", __FUNCTION__);
+  {
+    int i;
+    for (i=0;i<QOOB_PRO_MAX_BUFFER;i++) {
+      printf ("0x%02x ", (unsigned char)inbuf[i]);
+    }
+    printf ("\n");
+  }
+#endif
+
+  return ret;
+}
+
+static int receive_data (qoob_t *qoob, 
+                         char *inbuf)
+{
+  int ret;
+
+  ret = control_msg (qoob, QOOB_TRUE, inbuf, QOOB_TRUE);
+
+#ifdef DEBUG
+  printf ("\n%s - inbuf:\n", __FUNCTION__);
+  {
+    int i;
+    for (i=0;i<QOOB_PRO_MAX_BUFFER;i++) {
+      printf ("0x%02x ", (unsigned char)inbuf[i]);
+    }
+    printf ("\n");
+  }
+#endif
+
+  return ret;
+}
+
+/*
+ * Tells should failed unit (slot or half of the slot) be done again. Only
+ * transfer errors are retried and at most qoob->transfer.retries times.
+ */
+static qoob_boolean_t
+retry (qoob_t *qoob, 
+       qoob_error_t err, 
+       int *tries, 
+       int slot)
+{
+  if (err != QOOB_ERROR_SEND_DATA && err != QOOB_ERROR_RECEIVE_DATA) {
+    return QOOB_FALSE;
+  }
+
+  if (*tries >= qoob->transfer.retries) {
+    return QOOB_FALSE;
+  }
+
+  (*tries)++;
+  qoob->transfer.retried++;
+
+  if (qoob->sync_cb != NULL) {
+    qoob->sync_cb (QOOB_SYNC_CALLBACK_RETRY,
+                   slot,
+                   qoob->transfer.retried,
+                   qoob->user_data);
+  }
+
+  return QOOB_TRUE;
+}
+
+/* Learned timeout, but not past deadline */
+static int
+packet_timeout (qoob_t *qoob)
+{
+  int remaining = qoob_cancel_remaining (qoob->cancel);
+
+  if (remaining > 0 && remaining < qoob->transfer.timeout) {
+    return remaining;
+  }
+
+  return qoob->transfer.timeout;
+}
+
+/* Failure is told as cancel or deadline if that was the reason */
+static qoob_error_t
+transfer_failed (qoob_t *qoob, qoob_error_t err)
+{
+  qoob_error_t cancel = qoob_cancel_check (qoob->cancel);
+
+  return cancel != QOOB_ERROR_OK ? cancel : err;
+}
+
+/* 
+ * Ends device session after failure so next operation finds device in
+ * known state. Device which does not answer is not waited again.
+ */
+static qoob_error_t
+session_failed (qoob_t *qoob, 
+                char *buf, 
+                qoob_error_t err)
+{
+  if (err != QOOB_ERROR_SEND_DATA && err != QOOB_ERROR_RECEIVE_DATA) {
+    QOOB_END (qoob, buf);
+    receive_answer (qoob, buf);
+  }
+
+  return err;
+}
+
+/*
+ * Lists applications starting at slot_from until slot_to is passed. 
+ * slot_from has to be first slot of an application.
+ */
+static qoob_error_t
+list_slots (qoob_t *qoob,
+            short int slot_from,
+            short int slot_to)
+{
+  short int slot = slot_from;
+  char buf[QOOB_PRO_MAX_BUFFER] = {0,};
+  char tmpbuf[QOOB_PRO_MAX_BUFFER*4] = {0,};
+
+  /* Slot which fails is read again. See retry (). */
+#if 0   /* Do not remove this part */
+  /* tests */
+  send_command (qoob, 
+                QOOB_USB_CMD_GET_ANSWER, 
+                QOOB_USB_CMD_ZERO, 
+                QOOB_USB_CMD_ZERO, 
+                0, 
+                buf);
+  receive_answer (qoob, buf);
+  send_command (qoob, 
+                QOOB_USB_CMD_GET_ANSWER, 
+                QOOB_USB_CMD_ZERO, 
+                QOOB_USB_CMD_ZERO, 
+                0, 
+                buf);
+  receive_answer (qoob, buf);
+#endif
+
+  qoob->completed = 0;
+
+  /* Actual reading */
+  while (1) {
+    qoob_error_t err;
+    struct timespec mark;
+    int tries = 0;
+
+    qoob_profile_mark (qoob->profile, &mark);
+
+    if (qoob->sync_cb != NULL) {
+      qoob->sync_cb (QOOB_SYNC_CALLBACK_LIST, 
+                     slot+1, 
+                     slot_to+1,
+                     qoob->user_data);
+    }
+
+    while ((err = list_slot (qoob, slot, tmpbuf, buf)) != QOOB_ERROR_OK) {
+      if (retry (qoob, err, &tries, (int)slot) == QOOB_FALSE) {
+        return err;
+      }
+    }
+    qoob_profile_add (qoob->profile, QOOB_PHASE_LIST, slot, &mark);
+
+    /* Add name to slot */
+    if ((buf[SLOTS_IN_USE_INDEX] > 0) && 
+        (buf[SLOTS_IN_USE_INDEX] <= QOOB_PRO_SLOTS)) {
+      int n;
+
+      add_to_table (qoob, (int)slot, tmpbuf, buf);
+      /* Takes buf[2] slots */
+      for (n=0; n<buf[SLOTS_IN_USE_INDEX] && slot+n<QOOB_PRO_SLOTS; n++) {
+        qoob->completed |= 1UL << (slot+n);
+      }
+      slot += (char)buf[SLOTS_IN_USE_INDEX];
+    } else {
+      /* Empty slot has no entry in table */
+      qoob_table_empty (&qoob->table, slot);
+      qoob->slot_stale = QOOB_TRUE;
+      qoob->completed |= 1UL << slot;
+
+      slot++;
+    }
+
+    if (slot > slot_to)
+      break;
+  }
+
+  return QOOB_ERROR_OK;
+}
+
+/* Reads name and information packets of the slot */
+static qoob_error_t
+list_slot (qoob_t *qoob,
+           char slot,
+           char *name,
+           char *info)
+{
+  char buf[QOOB_PRO_MAX_BUFFER];
+  int tmpptr = 0;
+  int i;
+
+  QOOB_START (qoob, buf);
+  if (receive_answer (qoob, buf) < 0) {
+    return QOOB_ERROR_RECEIVE_DATA;
+  }
+  if (buf[2] != QOOB_START_OK)
+  {
+    return QOOB_ERROR_DEVICE_UNKNOWN1;
+  }
+
+  /* Slot reading */
+  if (send_command (qoob, 
+                    QOOB_USB_CMD_READ_SLOT, 
+                    QOOB_USB_CMD_ZERO, 
+                    QOOB_USB_CMD_READ_SLOT_INFO,
+                    slot,
+                    buf) < 0) {
+    return QOOB_ERROR_SEND_DATA;
+  }
+
+  for (i=0;i<4;i++) {
+    if (receive_data (qoob, buf) < 0) {
+      return session_failed (qoob, buf, 
+                             transfer_failed (qoob, 
+                                              QOOB_ERROR_RECEIVE_DATA));
+    }
+    memcpy (name+tmpptr, buf+1, QOOB_PRO_MAX_BUFFER-1);
+    tmpptr += QOOB_PRO_MAX_BUFFER;
+  }
+
+  /* Other information */
+  if (receive_data (qoob, info) < 0) {
+    return session_failed (qoob, buf, 
+                           transfer_failed (qoob, QOOB_ERROR_RECEIVE_DATA));
+  }
+
+  QOOB_END (qoob, buf);
+  receive_answer (qoob, buf);
+
+  return QOOB_ERROR_OK;
+}
+
+static qoob_error_t
+erase_slot (qoob_t *qoob,
+            int slot)
+{
+  char buf[QOOB_PRO_MAX_BUFFER];
+
+  QOOB_START (qoob, buf);
+  receive_answer (qoob, buf);
+
+  if (send_command (qoob, 
+                    QOOB_USB_CMD_ERASE, 
+                    QOOB_USB_CMD_ZERO, 
+                    QOOB_USB_CMD_ZERO,
+                    (char)slot,
+                    buf) < 0) {
+    return QOOB_ERROR_SEND_DATA;
+  }
+  send_command (qoob,
+                QOOB_USB_CMD_GET_ANSWER,
+                QOOB_USB_CMD_ZERO,
+                QOOB_USB_CMD_ZERO,
+                0,
+                buf);
+
+  QOOB_END (qoob, buf);
+  cache_invalidate (qoob, slot, -1);
+  if (receive_answer (qoob, buf) < 0) {
+    return QOOB_ERROR_RECEIVE_DATA;
+  }
+
+  return QOOB_ERROR_OK;
+}
+
+static void
+add_to_table (qoob_t *qoob, 
+              int slot_number, 
+              char *name, 
+              char *info)
+{
+  int i;
+  qoob_app_t app;
+  char app_name[QOOB_TABLE_NAME_SIZE];
+  char header[QOOB_GCB_HEADER_SIZE];
+
+  app.slot = (short int)slot_number;
+  app.slots_used = info[SLOTS_IN_USE_INDEX];
+
+  /* Name packets carry 63 bytes of the header each, info packet the rest */
+  for (i=0; i<QOOB_GCB_HEADER_SIZE; i++) {
+    int packet = i / (QOOB_PRO_MAX_BUFFER-1);
+
+    if (packet < 4) {
+      header[i] = name[packet*QOOB_PRO_MAX_BUFFER + 
+                       i%(QOOB_PRO_MAX_BUFFER-1)];
+    } else {
+      header[i] = info[1 + i - 4*(QOOB_PRO_MAX_BUFFER-1)];
+    }
+  }
+
+  /* Payload starts after the header in the info packet */
+  app.type = header_type (header, info+5);
+  if (app.type == QOOB_BINARY_TYPE_CONFIG) {
+    strncpy (name, CONFIG_SLOT_NAME, strlen (CONFIG_SLOT_NAME));
+  }
+
+  app.has_digest = qoob_image_gcb_digest (header, &app.length, app.digest);
+
+  memcpy (app_name, name+NAME_START, QOOB_PRO_MAX_BUFFER*4-NAME_START);
+  app_name[QOOB_PRO_MAX_BUFFER*4-NAME_START] = '\0';
+
+  qoob_table_add (&qoob->table, &app, app_name);
+  qoob->slot_stale = QOOB_TRUE;
+}
+
+/* Type from the header and first bytes of the payload after it */
+static binary_type_t
+header_type (const char *header, 
+             const char *payload)
+{
+  if (header[0]=='E' &&
+      header[1]=='L' &&
+      header[2]=='F' &&
+      payload[1]=='E' &&
+      payload[2]=='L' &&
+      payload[3]=='F') {
+    return QOOB_BINARY_TYPE_ELF;
+  } else if (header[0]=='E' &&
+             header[1]=='L' &&
+             header[2]=='F') {
+    return QOOB_BINARY_TYPE_DOL;
+  } else if (header[0]=='(' &&
+             header[1]=='C' &&
+             header[2]==')') {
+    return QOOB_BINARY_TYPE_GCB;
+  } else if (header[0]=='Q' &&
+             header[1]=='C' &&
+             header[2]=='F' &&
+             header[3]=='G') {
+    return QOOB_BINARY_TYPE_CONFIG;
+  }
+
+  return QOOB_BINARY_TYPE_VOID;
+}
+
+/* 
+ * Tells if listed application at slot has the name and type of GCB 
+ * image. Listing gets only the name which fits to the first packet.
+ */
+static qoob_boolean_t
+app_is_image (qoob_t *qoob,
+              short int slot,
+              const char *image,
+              size_t size)
+{
+  const qoob_app_t *app = qoob_table_app_at (&qoob->table, slot);
+  char name[QOOB_PRO_MAX_BUFFER-NAME_START];
+
+  if (app == NULL || app->slot != slot || 
+      size < QOOB_GCB_HEADER_SIZE+4) {
+    return QOOB_FALSE;
+  }
+
+  if (app->type != header_type (image, image+QOOB_GCB_HEADER_SIZE)) {
+    return QOOB_FALSE;
+  }
+
+  memcpy (name, image+NAME_START, sizeof (name)-1);
+  name[sizeof (name)-1] = '\0';
+
+  return strcmp (name, qoob_table_app_name (&qoob->table, app)) == 0 ?
+    QOOB_TRUE : QOOB_FALSE;
+}
+
+/* Empty or not listed slot is first slot of its own */
+static qoob_boolean_t
+slot_first (qoob_t *qoob, short int slot)
+{
+  const qoob_app_t *app = qoob_table_app_at (&qoob->table, slot);
+
+  return (app == NULL || app->slot == slot) ? QOOB_TRUE : QOOB_FALSE;
+}
+
+static int
+slot_used (qoob_t *qoob, short int slot)
+{
+  const qoob_app_t *app = qoob_table_app_at (&qoob->table, slot);
+
+  if (app != NULL) {
+    return app->slots_used;
+  }
+
+  return (qoob->table.listed & (1UL << slot)) ? 1 : 0;
+}
+
+/* Application with unknown header may be written over from its first 
+   slot, but not from the middle */
+static qoob_boolean_t
+slot_free (qoob_t *qoob, short int slot)
+{
+  const qoob_app_t *app = qoob_table_app_at (&qoob->table, slot);
+
+  if (app == NULL) {
+    return QOOB_TRUE;
+  }
+
+  return (app->slot == slot && app->type == QOOB_BINARY_TYPE_VOID) ? 
+    QOOB_TRUE : QOOB_FALSE;
+}
+
+/*
+ * Reads half of the slot to slot_data. Device sends first half in 522 
+ * packets where last ones go over the half so extra bytes are dropped. 
+ * Second half comes in 520 packets and 8 byte tail. Half starts with seek
+ * so it can be read again if transfer fails.
+ */
+static qoob_error_t
+read_half_slot (qoob_t *qoob,
+                int slot,
+                int half,
+                char *slot_data)
+{
+  char buf[QOOB_PRO_MAX_BUFFER] = {0,};
+  char batch[BATCH_PACKETS*QOOB_PRO_MAX_BUFFER];
+  size_t offset = (size_t)half*QOOB_DEFAULT_SEEK;
+  size_t end = offset + QOOB_DEFAULT_SEEK;
+  int packets;
+  int content;
+  int count;
+  int ret,j;
+
+  if (half == 0) {
+    packets = QOOB_READ_LOOP_HALF_WAY;
+    content = -1;
+  } else {
+    packets = QOOB_READ_LOOP_DEFAULT - QOOB_READ_LOOP_HALF_WAY;
+    content = QOOB_READ_LOOP_HALF_WAY-2;
+  }
+
+  if (send_command (qoob, 
+                    QOOB_USB_CMD_READ_SLOT, 
+                    half == 0 ? 
+                      QOOB_USB_CMD_ZERO : 
+                      QOOB_USB_CMD_READ_SLOT_ALL_HALF_WAY,
+                    QOOB_USB_CMD_READ_SLOT_ALL,
+                    (char)slot,
+                    buf) < 0) {
+    return QOOB_ERROR_SEND_DATA;
+  }
+
+  /* Get 64 byte packets, but first byte is always zero. 
+   * only 63 bytes is valid data to read.
+   */
+  for (j=0; j<packets; j+=count) {
+    int k;
+
+    count = packets - j;
+    if (count > BATCH_PACKETS)
+      count = BATCH_PACKETS;
+
+    if (transfer_many (qoob, QOOB_TRUE, batch, count) < 0) {
+      return transfer_failed (qoob, QOOB_ERROR_RECEIVE_DATA);
+    }
+
+    for (k=0; k<count; k++) {
+      size_t n = QOOB_PRO_MAX_BUFFER-1;
+
+      if (qoob->sync_cb != NULL) {
+        ++content;
+        qoob->sync_cb (QOOB_SYNC_CALLBACK_READ_CONTENT,
+                       (content*(QOOB_PRO_MAX_BUFFER-1)),
+                       (QOOB_DEFAULT_SEEK*2)-1,
+                       qoob->user_data);
+      }
+
+      if (n > end - offset)
+        n = end - offset;
+      memcpy (slot_data+offset, batch+k*QOOB_PRO_MAX_BUFFER+1, n);
+      offset += n;
+    }
+  }
+
+  if (half == 0) {
+    return QOOB_ERROR_OK;
+  }
+
+  ret = receive_data (qoob, buf);
+  if (ret < 0) {
+    return transfer_failed (qoob, QOOB_ERROR_RECEIVE_DATA);
+  }
+  if (end - offset >= QOOB_READ_LOOP_MISSING_BYTES) {
+    memcpy (slot_data+offset, buf+1, QOOB_READ_LOOP_MISSING_BYTES);
+  }
+
+  return QOOB_ERROR_OK;
+}
+
+/* Half -1 invalidates both halves of the slot */
+static void
+cache_invalidate (qoob_t *qoob,
+                  int slot,
+                  int half)
+{
+  if (qoob->cache == NULL)
+    return;
+
+  if (half != 1)
+    qoob->cached[slot*2] = QOOB_FALSE;
+  if (half != 0)
+    qoob->cached[slot*2+1] = QOOB_FALSE;
+}
+
+/*
+ * Reads count slots starting at slotnum to data. Data has to have room for
+ * count slots. If fd or archive is given each slot is written to it when 
+ * it is read and data needs room only for one slot.
+ */
+static qoob_error_t
+read_slots (qoob_t *qoob,
+            short int slotnum,
+            int count,
+            char *data,
+            int fd,
+            qoob_archive_t *archive)
+{
+  char buf[QOOB_PRO_MAX_BUFFER] = {0,};
+  int i;
+
+  qoob->completed = 0;
+
+  QOOB_START (qoob, buf);
+  receive_answer (qoob, buf);
+
+  for (i = (int)slotnum; i < (int)slotnum + count; i++) {
+    char *slot_data = data;
+    struct timespec mark;
+    int half;
+
+    qoob_profile_mark (qoob->profile, &mark);
+
+    if (fd < 0 && archive == NULL) {
+      slot_data += (size_t)(i-slotnum)*QOOB_PRO_SLOT_SIZE;
+    }
+
+    if (qoob->sync_cb != NULL) {
+      qoob->sync_cb (QOOB_SYNC_CALLBACK_READ_SLOT, 
+                     i,
+                     slotnum+count-1,
+                     qoob->user_data);
+    }
+
+    for (half=0; half<2; half++) {
+      qoob_error_t err;
+      int tries = 0;
+
+      while ((err = read_half_slot (qoob, i, half, slot_data)) != 
+             QOOB_ERROR_OK) {
+        if (retry (qoob, err, &tries, i) == QOOB_FALSE) {
+          return session_failed (qoob, buf, err);
+        }
+      }
+    }
+
+    if (qoob->sync_cb != NULL) {
+      qoob->sync_cb (QOOB_SYNC_CALLBACK_READ_CONTENT,
+                     (QOOB_DEFAULT_SEEK*2)-1,
+                     (QOOB_DEFAULT_SEEK*2)-1,
+                     qoob->user_data);
+    }
+
+    /* Whole slot is known now */
+    if (qoob->cache != NULL) {
+      memcpy (qoob->cache + (size_t)i*QOOB_PRO_SLOT_SIZE, 
+              slot_data, 
+              QOOB_PRO_SLOT_SIZE);
+      qoob->cached[i*2] = QOOB_TRUE;
+      qoob->cached[i*2+1] = QOOB_TRUE;
+    }
+
+    if (fd >= 0 && 
+        write_all (fd, slot_data, QOOB_PRO_SLOT_SIZE) != QOOB_TRUE) {
+      return session_failed (qoob, buf, QOOB_ERROR_FD_WRITE);
+    }
+#ifndef QOOB_MINIMAL
+    if (archive != NULL) {
+      qoob_error_t err;
+
+      err = qoob_archive_add_slot (archive, (short int)i, slotnum, 
+                                   (unsigned short int)count, slot_data);
+      if (err != QOOB_ERROR_OK) {
+        return session_failed (qoob, buf, err);
+      }
+    }
+#endif
+    qoob->completed |= 1UL << i;
+    qoob_profile_add (qoob->profile, QOOB_PHASE_READ, (short int)i, &mark);
+
+  } /* for (i...*/
+
+  QOOB_END (qoob, buf);
+  receive_answer (qoob, buf);
+
+  return QOOB_ERROR_OK;
+}
+
+/* Pipes may take less than asked */
+static qoob_boolean_t
+write_all (int fd,
+           const char *data,
+           size_t size)
+{
+  while (size > 0) {
+    ssize_t r = write (fd, data, size);
+
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return QOOB_FALSE;
+    data += r;
+    size -= (size_t)r;
+  }
+
+  return QOOB_TRUE;
+}
+
+static void
+lock_waiting (const qoob_lock_holder_t *holder,
+              void *user_data)
+{
+  qoob_t *qoob = (qoob_t *)user_data;
+
+  if (qoob->sync_cb != NULL) {
+    qoob->sync_cb (QOOB_SYNC_CALLBACK_LOCK_WAIT,
+                   (int)holder->pid,
+                   (int)holder->waiting,
+                   qoob->user_data);
+  }
+}
+
+/* Opens device at bus and device if it is QoobPro */
+static qoob_error_t
+open_named (qoob_t *qoob,
+            const char *bus,
+            const char *device,
+            const struct timespec *start)
+{
+  qoob_device_t found[QOOB_DISCOVER_MAX];
+  qoob_error_t err;
+  int count;
+  int i;
+
+  err = qoob_discover_all (qoob, found, QOOB_DISCOVER_MAX, &count);
+  if (err != QOOB_ERROR_OK) {
+    return err;
+  }
+
+  /* Names may be given without leading zeros */
+  for (i=0; i<count; i++) {
+    if (strtol (found[i].bus, NULL, 10) == strtol (bus, NULL, 10) &&
+        strtol (found[i].device, NULL, 10) == strtol (device, NULL, 10)) {
+      return open_device (qoob, found[i].bus, found[i].device, start);
+    }
+  }
+
+  return QOOB_ERROR_NOT_FOUND;
+}
+
+/* start is when finding the device started. Waiting for the lock is not
+   counted in discover or open time. */
+static qoob_error_t
+open_device (qoob_t *qoob,
+             const char *bus,
+             const char *device,
+             const struct timespec *start)
+{
+  const qoob_transport_t *transport;
+  struct timespec locking;
+  struct timespec opened;
+  int discover_time;
+  int lock_timeout = qoob->lock_timeout;
+  int remaining = qoob_cancel_remaining (qoob->cancel);
+  qoob_error_t err;
+
+  discover_time = elapsed_us (start);
+  qoob_profile_add (qoob->profile, QOOB_PHASE_FIND, -1, start);
+  qoob_profile_mark (qoob->profile, &locking);
+
+  err = qoob_cancel_check (qoob->cancel);
+  if (err != QOOB_ERROR_OK) {
+    return err;
+  }
+
+  /* Wait in queue if other program uses the device, not past deadline */
+  if (remaining >= 0 && 
+      (lock_timeout == QOOB_LOCK_WAIT_FOREVER || remaining < lock_timeout)) {
+    lock_timeout = remaining;
+  }
+  err = qoob_lock_acquire (&qoob->lock, 
+                           bus, 
+                           device,
+                           lock_timeout,
+                           lock_waiting,
+                           qoob);
+  if (err == QOOB_ERROR_LOCK_TIMEOUT) {
+    return transfer_failed (qoob, err);
+  }
+  if (err != QOOB_ERROR_OK) {
+    return err;
+  }
+
+  clock_gettime (CLOCK_MONOTONIC, &opened);
+  qoob_profile_add_span (qoob->profile, QOOB_PHASE_LOCK, -1, 
+                         &locking, &opened);
+
+  /* usbfs needs interface free of usbhid, hidraw works with usbhid and
+     libusb is fallback if neither can be used */
+  if (qoob->transport_type == QOOB_TRANSPORT_AUTO) {
+    static const qoob_transport_t *const order[] = {
+      &qoob_transport_usbfs,
+      &qoob_transport_hidraw,
+#ifndef QOOB_MINIMAL
+      &qoob_transport_libusb
+#endif
+    };
+    unsigned int i;
+
+    for (i = 0; i < sizeof (order)/sizeof (order[0]); i++) {
+      transport = order[i];
+      err = transport->open (qoob, bus, device);
+      if (err == QOOB_ERROR_OK)
+        break;
+    }
+  } else {
+    transport = qoob_transport_get (qoob->transport_type);
+    err = transport != NULL ? 
+      transport->open (qoob, bus, device) : QOOB_ERROR_INPUT_NOT_VALID;
+  }
+  if (err != QOOB_ERROR_OK) {
+    qoob_lock_release (&qoob->lock);
+    return err;
+  }
+
+  qoob->transport = transport;
+
+  /* Latency is learned again for every device */
+  qoob->transfer.srtt = 0;
+  qoob->transfer.rttvar = 0;
+  qoob->transfer.timeout = QOOB_TIMEOUT_DEFAULT;
+  qoob->transfer.retried = 0;
+  qoob->transfer.transport = transport->type;
+  qoob->transfer.discover_time = discover_time;
+  qoob->transfer.open_time = elapsed_us (&opened);
+  qoob_profile_add (qoob->profile, QOOB_PHASE_OPEN, -1, &opened);
+
+  return QOOB_ERROR_OK;
+}
+
+static int
+elapsed_us (const struct timespec *start)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+
+  return (int)((now.tv_sec - start->tv_sec)*1000000L +
+               (now.tv_nsec - start->tv_nsec)/1000);
+}
+
+/* Packet is 63 bytes from data at offset. Pad after end of data. */
+static void
+fill_packet (char *buf, 
+             const char *data, 
+             size_t size, 
+             size_t offset,
+             char pad)
+{
+  memset (buf, pad, QOOB_PRO_MAX_BUFFER);
+  buf[0] = 0;
+  if (offset < size) {
+    size_t n = size - offset;
+    if (n > QOOB_PRO_MAX_BUFFER-1)
+      n = QOOB_PRO_MAX_BUFFER-1;
+    memcpy (buf+1, data+offset, n);
+  }
+}
+
+/*
+ * Returns first offset between from and to which is not in erased state or
+ * (size_t)-1 if there is none. Offsets after end of data are erased. 
+ * Compared word at a time.
+ */
+static size_t
+find_not_erased (const char *data,
+                 size_t size,
+                 size_t from,
+                 size_t to)
+{
+  const unsigned char *p = (const unsigned char *)data + from;
+  const unsigned char *end;
+
+  if (to > size)
+    to = size;
+  if (from >= to)
+    return (size_t)-1;
+
+  end = (const unsigned char *)data + to;
+
+  while ((size_t)(end - p) >= sizeof (unsigned long)) {
+    unsigned long w;
+
+    memcpy (&w, p, sizeof (w));
+    if (w != ~0UL)
+      break;
+    p += sizeof (unsigned long);
+  }
+
+  for (; p < end; p++) {
+    if (*p != QOOB_PRO_ERASED_BYTE)
+      return (size_t)(p - (const unsigned char *)data);
+  }
+
+  return (size_t)-1;
+}
+
+/*
+ * Writes half of the slot. Slot data starts at base. Write position of
+ * device is moved with WRITE_SLOT command which takes high byte of the
+ * offset in the slot. Only 0x00 and 0x80 are known to work, so with 
+ * sparse writing half which is all erased is skipped and packets are not
+ * sent after the last one which is not erased. Progress is told only if
+ * report is true.
+ */
+static qoob_error_t
+write_half_slot (qoob_t *qoob,
+                 int slot,
+                 int half,
+                 const char *data,
+                 size_t size,
+                 size_t base,
+                 qoob_boolean_t report,
+                 int *skipped)
+{
+  char buf[QOOB_PRO_MAX_BUFFER];
+  char batch[BATCH_PACKETS*QOOB_PRO_MAX_BUFFER];
+  int queued = 0;
+  size_t start = base + (size_t)half*QOOB_DEFAULT_SEEK;
+  size_t end = start + QOOB_DEFAULT_SEEK;
+  size_t offset = start;
+  qoob_boolean_t seek = QOOB_TRUE;
+  char pad = WRITE_PAD (qoob);
+
+  cache_invalidate (qoob, slot, half);
+
+  while (offset < end) {
+    if (qoob->sparse == QOOB_TRUE) {
+      /* Rest of the half is erased */
+      if (find_not_erased (data, size, offset, end) == (size_t)-1) {
+        *skipped += (int)((end - offset + QOOB_PRO_MAX_BUFFER-2) /
+                          (QOOB_PRO_MAX_BUFFER-1));
+        break;
+      }
+    }
+
+    if (seek == QOOB_TRUE) {
+      char high = (char)((offset - base) >> 8);
 
-  /* If flashed non GCB file have to add 'header' */
-  if (qoob->binary_type == QOOB_BINARY_TYPE_ELF ||
-      qoob->binary_type == QOOB_BINARY_TYPE_DOL) {
+      /* Packets before seek go first */
+      if (queued > 0 &&
+          transfer_many (qoob, QOOB_FALSE, batch, queued) < 0) {
+        return transfer_failed (qoob, QOOB_ERROR_SEND_DATA);
+      }
+      queued = 0;
 
-    if (stat (qoob->real_file, &sbuf) == -1) {
-      free (qoob->real_file);
-      qoob->real_file = NULL;
-      return QOOB_ERROR_FILE_STAT;
+#ifdef DEBUG
+      printf ("seek_to: 0x%lx\n", (unsigned long int)(offset - base));
+#endif
+      if (send_command (qoob, 
+                        QOOB_USB_CMD_WRITE_SLOT, 
+                        &high,
+                        QOOB_USB_CMD_WRITE_SLOT_ALL,
+                        (char)slot,
+                        buf) < 0) {
+        return QOOB_ERROR_SEND_DATA;
+      }
+      seek = QOOB_FALSE;
     }
 
-    err = write_with_header_to_tmp_file (qoob, file, sbuf.st_size);
-    if (err != QOOB_ERROR_OK) {
-      free (qoob->real_file);
-      qoob->real_file = NULL;
-      return err;
+    if (qoob->sync_cb != NULL && report == QOOB_TRUE) {
+      qoob->sync_cb (QOOB_SYNC_CALLBACK_WRITE_CONTENT,
+                     (int)(offset - base),
+                     (QOOB_DEFAULT_SEEK*2)-1,
+                     qoob->user_data);
     }
-    is_tmpfile = QOOB_TRUE;
-  }
 
-#ifdef DEBUG
-  printf ("Real file: '%s'\n", qoob->real_file);
-#endif
+    fill_packet (batch+queued*QOOB_PRO_MAX_BUFFER, data, size, offset, pad);
+    offset += QOOB_PRO_MAX_BUFFER-1;
+    queued++;
 
-  /* FIXME: add more test cases */
-  if (stat (qoob->real_file, &sbuf) == -1) {
-    free (qoob->real_file);
-    qoob->real_file = NULL;
-    return QOOB_ERROR_FILE_STAT;
+    if (queued == BATCH_PACKETS) {
+      if (transfer_many (qoob, QOOB_FALSE, batch, queued) < 0) {
+        return transfer_failed (qoob, QOOB_ERROR_SEND_DATA);
+      }
+      queued = 0;
+    }
   }
 
-   /* Get how many slots are used */
-  used_slots = sbuf.st_size/QOOB_PRO_SLOT_SIZE;
-  if (sbuf.st_size > (QOOB_PRO_SLOT_SIZE) && 
-      sbuf.st_size%(QOOB_PRO_SLOT_SIZE)) {
-    used_slots++;
+  if (queued > 0 &&
+      transfer_many (qoob, QOOB_FALSE, batch, queued) < 0) {
+    return transfer_failed (qoob, QOOB_ERROR_SEND_DATA);
   }
 
+  return QOOB_ERROR_OK;
+}
+
+static qoob_error_t 
+write_gcb (qoob_t *qoob,
+           const char *data,
+           size_t size,
+           short int slotnum)
+{
+  int ret,i;
+  int used_slots;
+
+   /* Get how many slots are used */
+  used_slots = qoob_file_slots_needed (QOOB_BINARY_TYPE_GCB, size);
+
   if ((slotnum+used_slots-1) >= QOOB_PRO_SLOTS) {
     return QOOB_ERROR_TOO_BIG_DATA;
   }
 
+  /* Continuing slots of an application have no type */
   for (i=slotnum; i<(slotnum+used_slots); i++) {
-    if (qoob->slot[i].type != QOOB_BINARY_TYPE_VOID) {
-      REMOVE_TMPFILE(qoob->real_file, is_tmpfile);
-      free (qoob->real_file);
-      qoob->real_file = NULL;
+    if (slot_free (qoob, i) != QOOB_TRUE) {
       return QOOB_ERROR_TRYING_TO_OVERWRITE;
     }
   }
@@ -619,9 +2716,7 @@ qoob_sync_usb_write (qoob_t *qoob,
   /* Flash can have still some data so data is erased anyway */
   ret = qoob_sync_usb_erase_forced (qoob, slotnum, (slotnum+used_slots-1));
   if (ret != QOOB_ERROR_OK) {
-    REMOVE_TMPFILE(qoob->real_file, is_tmpfile);
-    free (qoob->real_file);
-    qoob->real_file = NULL;
+    qoob->completed = 0;
     return ret;
   }
 
@@ -629,438 +2724,483 @@ qoob_sync_usb_write (qoob_t *qoob,
   printf ("Slots used: %d\n", used_slots);
 #endif
 
-  fd = open (qoob->real_file, O_RDONLY);
-  if (fd == -1) {
-    REMOVE_TMPFILE(qoob->real_file, is_tmpfile);
-    free (qoob->real_file);
-    qoob->real_file = NULL;
-    return QOOB_ERROR_FD_OPEN;
-  }
-  
-  QOOB_START (qoob->devh, buf);
-  receive_answer (qoob->devh, buf);
+  return write_slots (qoob, data, size, slotnum, used_slots, ~0UL);
+}
+
+/*
+ * Writes slots of GCB image which are in mask in one session. Slots have
+ * to be erased already. Bit 0 of mask is slot 0. First half of slotnum,
+ * which has the header, is written last. Header with length and digest 
+ * is then in flash only if the whole application is.
+ */
+static qoob_error_t
+write_slots (qoob_t *qoob,
+             const char *data,
+             size_t size,
+             short int slotnum,
+             int used_slots,
+             unsigned long mask)
+{
+  int ret,i;
+  char buf[QOOB_PRO_MAX_BUFFER];
+  int skipped = 0;
+
+  qoob->completed = 0;
+
+  QOOB_START (qoob, buf);
+  receive_answer (qoob, buf);
 
 #ifdef DEBUG
-  printf ("\nWriting file '%s' starting at slot [%02d].\n", 
-          file, slotnum);
+  printf ("\nWriting starting at slot [%02d].\n", slotnum);
 #endif
 
   for (i=slotnum; i<(slotnum+used_slots); i++) {
-    size_t written = 0;
-    qoob_boolean_t runned = QOOB_FALSE;
-    int content = -1;
+    size_t base = (size_t)(i-slotnum)*QOOB_PRO_SLOT_SIZE;
 
-    if (qoob->sync_cb != NULL) {
-      qoob->sync_cb (QOOB_SYNC_CALLBACK_WRITE_SLOT, 
-                     i,
-                     slotnum+used_slots-1,
-                     qoob->user_data);
+    if (!(mask & (1UL << i))) {
+      continue;
     }
 
-    memset (tmpbuf, 0, QOOB_PRO_MAX_BUFFER);
-
-    send_command (qoob->devh, 
-                  QOOB_USB_CMD_WRITE_SLOT, 
-                  QOOB_USB_CMD_ZERO, 
-                  QOOB_USB_CMD_WRITE_SLOT_ALL,
-                  (char)i,
-                  buf);
-
-    ret = lseek (fd, seek_to, SEEK_SET);
-    if (ret < 0) {
-      REMOVE_TMPFILE(qoob->real_file, is_tmpfile);
-      close (fd);
-      free (qoob->real_file);
-      qoob->real_file = NULL;
-      return QOOB_ERROR_FD_SEEK;
+    ret = write_slot (qoob, i, slotnum+used_slots-1, data, size, base, 
+                      i == slotnum ? 1 : 0, &skipped);
+    if (ret != QOOB_ERROR_OK) {
+      return session_failed (qoob, buf, ret);
     }
-    seek_to = seek_to + QOOB_DEFAULT_SEEK;
-
-    for (j=0; j<QOOB_WRITE_LOOP_DEFAULT; j++) {
-      size_t r;
+  }
 
-      if (qoob->sync_cb != NULL) {
-        ++content;
-        qoob->sync_cb (QOOB_SYNC_CALLBACK_WRITE_CONTENT,
-                       (content*(QOOB_PRO_MAX_BUFFER-1)),
-                       (QOOB_DEFAULT_SEEK*2)-1,
-                       qoob->user_data);
-      }
+  if (mask & (1UL << slotnum)) {
+    ret = write_header (qoob, slotnum, data, size, &skipped);
+    if (ret != QOOB_ERROR_OK) {
+      return session_failed (qoob, buf, ret);
+    }
+  }
 
-#ifdef DEBUG
-      printf ("[%d] written %ld, sbuf.st_size %ld\n", 
-              j, (long int)written, (long int)sbuf.st_size); 
-#endif
+  QOOB_END (qoob, buf);
+  receive_answer (qoob, buf);
 
-      memset (buf, 0, QOOB_PRO_MAX_BUFFER);
+  if (qoob->sparse == QOOB_TRUE && qoob->sync_cb != NULL) {
+    qoob->sync_cb (QOOB_SYNC_CALLBACK_SPARSE,
+                   skipped,
+                   used_slots*QOOB_WRITE_LOOP_DEFAULT,
+                   qoob->user_data);
+  }
 
-      if ((runned == QOOB_FALSE) && 
-          (((j+1)%QOOB_WRITE_LOOP_HALF_WAY) == 0)) {
-        off_t ret = 0;
-        runned = QOOB_TRUE;
+  return QOOB_ERROR_OK;
+}
 
-#ifdef DEBUG
-        printf ("About half way!\n");
-#endif
-        send_command (qoob->devh, 
-                      QOOB_USB_CMD_WRITE_SLOT, 
-                      QOOB_USB_CMD_WRITE_SLOT_ALL,
-                      QOOB_USB_CMD_WRITE_SLOT_ALL,
-                      (char)i,
-                      buf);
-        memset (buf, 0, QOOB_PRO_MAX_BUFFER);
-
-        ret = lseek (fd, seek_to, SEEK_SET);
-        if (ret < 0) {
-          REMOVE_TMPFILE(qoob->real_file, is_tmpfile);
-          close (fd);
-          free (qoob->real_file);
-          qoob->real_file = NULL;
-          return QOOB_ERROR_FD_SEEK;
-        }
+/*
+ * Writes slot from data starting at base. Session has to be started. Last
+ * is last slot of the write for callbacks. Halves before first_half are 
+ * left for write_header () and slot is not completed before it.
+ */
+static qoob_error_t
+write_slot (qoob_t *qoob,
+            int slot,
+            int last,
+            const char *data,
+            size_t size,
+            size_t base,
+            int first_half,
+            int *skipped)
+{
+  struct timespec mark;
+  int half;
 
-#ifdef DEBUG
-        printf ("seek_to: 0x%lx\n", (unsigned long int)seek_to);
-#endif
-        seek_to = seek_to + QOOB_DEFAULT_SEEK;
-        content = QOOB_WRITE_LOOP_HALF_WAY-2;
-      }
+  qoob_profile_mark (qoob->profile, &mark);
 
-      r = read (fd, buf+1, QOOB_PRO_MAX_BUFFER-1);
-      if (r == -1) {
-        REMOVE_TMPFILE(qoob->real_file, is_tmpfile);
-        close (fd);
-        free (qoob->real_file);
-        qoob->real_file = NULL;
-        return QOOB_ERROR_FD_READ;
-      }
+  if (qoob->sync_cb != NULL) {
+    qoob->sync_cb (QOOB_SYNC_CALLBACK_WRITE_SLOT, 
+                   slot,
+                   last,
+                   qoob->user_data);
+  }
 
-      ret = send_data (qoob->devh, buf);
-      if (ret < 0) {
-        REMOVE_TMPFILE(qoob->real_file, is_tmpfile);
-        close (fd);
-        free (qoob->real_file);
-        qoob->real_file = NULL;
-        return QOOB_ERROR_SEND_DATA;
-      }
+  for (half=first_half; half<2; half++) {
+    qoob_error_t ret;
 
-      written += (ret - 1);
-    }
-    if (qoob->sync_cb != NULL) {
-      qoob->sync_cb (QOOB_SYNC_CALLBACK_WRITE_CONTENT,
-                     (QOOB_DEFAULT_SEEK*2)-1,
-                     (QOOB_DEFAULT_SEEK*2)-1,
-                     qoob->user_data);
+    ret = write_half (qoob, slot, half, data, size, base, QOOB_TRUE, 
+                      skipped);
+    if (ret != QOOB_ERROR_OK) {
+      return ret;
     }
   }
+  if (first_half == 0) {
+    qoob->completed |= 1UL << slot;
+  }
+  qoob_profile_add (qoob->profile, QOOB_PHASE_WRITE, (short int)slot, &mark);
 
-  QOOB_END (qoob->devh, buf);
-  receive_answer (qoob->devh, buf);
-
-  REMOVE_TMPFILE(qoob->real_file, is_tmpfile);
-  close (fd);
-  free (qoob->real_file);
-  qoob->real_file = NULL;
+  if (qoob->sync_cb != NULL) {
+    qoob->sync_cb (QOOB_SYNC_CALLBACK_WRITE_CONTENT,
+                   (QOOB_DEFAULT_SEEK*2)-1,
+                   (QOOB_DEFAULT_SEEK*2)-1,
+                   qoob->user_data);
+  }
 
   return QOOB_ERROR_OK;
+}
+
+/*
+ * Writes first half of the slot, which was left out by write_slot (). 
+ * data is the whole image or only this slot. Progress was told already.
+ */
+static qoob_error_t
+write_header (qoob_t *qoob,
+              int slot,
+              const char *data,
+              size_t size,
+              int *skipped)
+{
+  struct timespec mark;
+  qoob_error_t ret;
+
+  qoob_profile_mark (qoob->profile, &mark);
+
+  ret = write_half (qoob, slot, 0, data, size, 0, QOOB_FALSE, skipped);
+  if (ret != QOOB_ERROR_OK) {
+    return ret;
+  }
+  qoob->completed |= 1UL << slot;
+  qoob_profile_add (qoob->profile, QOOB_PHASE_WRITE, (short int)slot, &mark);
 
+  return QOOB_ERROR_OK;
 }
 
-void
-qoob_sync_usb_clear (qoob_t *qoob)
+/*
+ * Writes half of the slot and retries it after transfer errors. Flash is
+ * programmed with AND so half can be written again.
+ */
+static qoob_error_t
+write_half (qoob_t *qoob,
+            int slot,
+            int half,
+            const char *data,
+            size_t size,
+            size_t base,
+            qoob_boolean_t report,
+            int *skipped)
 {
-  if (qoob == NULL)
-    return;
+  int half_skipped;
+  int tries = 0;
+  qoob_error_t ret;
 
-  if (qoob->devh != NULL) {
-    usb_release_interface (qoob->devh, 0);
-    usb_close (qoob->devh);
-    qoob->devh = NULL;
+  while (1) {
+    half_skipped = 0;
+    ret = write_half_slot (qoob, slot, half, data, size, base, report,
+                           &half_skipped);
+    if (ret == QOOB_ERROR_OK) {
+      break;
+    }
+    if (retry (qoob, ret, &tries, slot) == QOOB_FALSE) {
+      return ret;
+    }
   }
+  *skipped += half_skipped;
+
+  return QOOB_ERROR_OK;
 }
 
-/* Static functions */
-static int 
-send_command (usb_dev_handle *devh, 
-              char *cmd1, 
-              char *cmd2, 
-              char *cmd3, 
-              unsigned char slot, 
-              char *outbuf) 
+/*
+ * Tells if slot starting at base differs between two images. Bytes after
+ * end of an image are erased.
+ */
+static qoob_boolean_t
+slot_changed (const char *a,
+              size_t a_size,
+              const char *b,
+              size_t b_size,
+              size_t base)
 {
+  size_t end = base + QOOB_PRO_SLOT_SIZE;
+  size_t common = a_size < b_size ? a_size : b_size;
 
-  /* build send command */
-  memset (outbuf, 0, QOOB_PRO_MAX_BUFFER);
-  if (cmd2 != NULL)
-    *outbuf = (unsigned char)(*cmd1);     /* actual command */
-  if (slot != 0)
-    *(outbuf+1) = (unsigned char)slot;
-  if (cmd2 != NULL)
-    *(outbuf+2) = (unsigned char)(*cmd2); /* HI-byte of seek */
- /* *(outbuf+3)                              LO-byte of seek */
-  if (cmd3 != NULL)
-    *(outbuf+4) = (unsigned char)(*cmd3); /* ???? */
+  if (common > end)
+    common = end;
 
-#ifdef DEBUG
-  printf ("%s - outbuf:\n", __FUNCTION__);
-  {
-    int i;
-    for (i=0;i<QOOB_PRO_MAX_BUFFER;i++) {
-      printf ("0x%02x ", (unsigned char)outbuf[i]);
+  if (common > base && memcmp (a+base, b+base, common-base) != 0)
+    return QOOB_TRUE;
+
+  if (common < base)
+    common = base;
+
+  if (find_not_erased (a, a_size, common, end) != (size_t)-1 ||
+      find_not_erased (b, b_size, common, end) != (size_t)-1)
+    return QOOB_TRUE;
+
+  return QOOB_FALSE;
+}
+
+/* Adds header if needed and writes. Data is freed. */
+static qoob_error_t
+write_data (qoob_t *qoob,
+            const char *name,
+            char *data,
+            size_t size,
+            short int slotnum)
+{
+  qoob_error_t err;
+
+  /* If flashed non GCB file have to add 'header' */
+  if (qoob->binary_type == QOOB_BINARY_TYPE_ELF ||
+      qoob->binary_type == QOOB_BINARY_TYPE_DOL) {
+
+    err = write_with_header (qoob, name, WRITE_PAD (qoob), &data, &size);
+    if (err != QOOB_ERROR_OK) {
+      work_free (qoob, data);
+      return err;
     }
-    printf ("\n");
   }
-#endif
 
-  /* FIXME: check names to defines from USB-specification */
-  return usb_control_msg (devh, 
-                          USB_TYPE_CLASS+USB_RECIP_INTERFACE, 
-                          SEND_REQUEST, 
-                          SEND_VALUE, 
-                          0, 
-                          outbuf,
-                          QOOB_PRO_MAX_BUFFER,
-                          DEFAULT_TIMEOUT);
+  err = write_gcb (qoob, data, size, slotnum);
+  work_free (qoob, data);
 
+  return err;
 }
 
-static int 
-send_data (usb_dev_handle *devh, 
-           char *outbuf) 
+#ifdef QOOB_MINIMAL
+/* Minimizing is not allowed, see qoob_sync_minimize_set () */
+static qoob_error_t
+minimize_data (qoob_t *qoob,
+               char **data,
+               size_t *size)
 {
-  int ret;
+  return QOOB_ERROR_OK;
+}
+#else
+/* Replaces ELF or DOL data with minimized one if it is asked */
+static qoob_error_t
+minimize_data (qoob_t *qoob,
+               char **data,
+               size_t *size)
+{
+  char *min;
+  size_t min_size;
+  binary_type_t type;
+  qoob_error_t err;
 
-  /* FIXME: check names to defines from USB-specification */
-  ret = usb_control_msg (devh, 
-                         USB_TYPE_CLASS+USB_RECIP_INTERFACE, 
-                         SEND_REQUEST, 
-                         SEND_VALUE,
-                         0,
-                         outbuf,
-                         QOOB_PRO_MAX_BUFFER,
-                         DEFAULT_TIMEOUT);
+  if (qoob->minimize == QOOB_MINIMIZE_NONE) {
+    return QOOB_ERROR_OK;
+  }
 
-  if (ret < 0) {
-    fprintf (stderr, "Could not send data to QoobPro!!! Error: %d\n", ret);
+  err = qoob_image_minimize (qoob->minimize, qoob->binary_type, 
+                             *data, *size,
+                             &min, &min_size, &type);
+  if (err != QOOB_ERROR_OK) {
+    return err;
   }
 
-#ifdef DEBUG
-  printf ("\n%s - outbuf:\n", __FUNCTION__);
-  {
-    int i;
-    for (i=0;i<QOOB_PRO_MAX_BUFFER;i++) {
-      printf ("0x%02x ", (unsigned char)outbuf[i]);
-    }
-    printf ("\n");
+  /* Tell how many slots was saved */
+  if (qoob->sync_cb != NULL) {
+    qoob->sync_cb (QOOB_SYNC_CALLBACK_MINIMIZE,
+                   qoob_file_slots_needed (type, min_size),
+                   qoob_file_slots_needed (qoob->binary_type, *size),
+                   qoob->user_data);
   }
-#endif
 
-  return ret;
+  work_free (qoob, *data);
+  *data = min;
+  *size = min_size;
+
+  return QOOB_ERROR_OK;
 }
+#endif
 
-static int receive_answer (usb_dev_handle *devh, 
-                           char *inbuf)
+/*
+ * Compares ELF or DOL payload, minimized with given mode as write would
+ * do, to length and digest in the header of the application.
+ */
+static qoob_error_t
+payload_compare (qoob_t *qoob,
+                 qoob_minimize_t mode,
+                 const char *data,
+                 size_t size,
+                 const qoob_app_t *app)
 {
-  int ret;
-
-  /* FIXME: check names to defines from USB-specification */
-  ret = usb_control_msg (devh, 
-                         USB_TYPE_CLASS+USB_RECIP_INTERFACE+USB_ENDPOINT_IN, 
-                         RECV_REQUEST, 
-                         RECV_VALUE, 
-                         0, 
-                         inbuf,
-                         QOOB_PRO_MAX_BUFFER,
-                         DEFAULT_TIMEOUT);
+  unsigned char digest[QOOB_DIGEST_SIZE];
+#ifndef QOOB_MINIMAL
+  char *min = NULL;
+  binary_type_t type;
+  qoob_error_t err;
 
-#ifdef DEBUG
-  printf ("\n%s - inbuf:\n", __FUNCTION__);
-  {
-    int i;
-    for (i=0;i<QOOB_PRO_MAX_BUFFER;i++) {
-      printf ("0x%02x ", (unsigned char)inbuf[i]);
+  if (mode != QOOB_MINIMIZE_NONE) {
+    err = qoob_image_minimize (mode, qoob->binary_type, data, size,
+                               &min, &size, &type);
+    if (err != QOOB_ERROR_OK) {
+      return err;
     }
-    printf ("\n");
+    data = min;
   }
 #endif
 
-  return ret;
+  qoob_digest_buffer (data, size, digest);
+#ifndef QOOB_MINIMAL
+  free (min);
+#endif
 
+  if (app->slots_used != qoob_file_slots_needed (QOOB_BINARY_TYPE_ELF, 
+                                                 size) ||
+      app->length != (unsigned long)size ||
+      memcmp (app->digest, digest, QOOB_DIGEST_SIZE) != 0) {
+    return QOOB_ERROR_VERIFY_FAILED;
+  }
 
+  return QOOB_ERROR_OK;
 }
 
-static void
-add_to_slot_array (qoob_t *qoob, 
-                   int slot_number, 
-                   char *name, 
-                   char *info)
+/*
+ * Replaces data with GCB image. ELF or DOL is minimized first if it is
+ * asked. Last slot is filled with pad. In minimal build data has to be on
+ * top of work area, where it grows in place to make room for the header.
+ * Last slot is not padded there, write pads the last packet.
+ */
+static qoob_error_t 
+write_with_header (qoob_t *qoob,
+                   const char *file,
+                   char pad,
+                   char **data,
+                   size_t *size)
 {
-  int i;
-  unsigned short int used_slots;
-  int name_start = 0;
-  char continuing [QOOB_PRO_MAX_BUFFER];
-
-  used_slots = info[SLOTS_IN_USE_INDEX];
-  name_start = 4;
-
-  if (name[0]=='E' &&
-      name[1]=='L' &&
-      name[2]=='F' &&
-      info[6]=='E' &&
-      info[7]=='L' &&
-      info[8]=='F') {
-    qoob->slot[slot_number].type = QOOB_BINARY_TYPE_ELF;
-  } else if (name[0]=='E' &&
-             name[1]=='L' &&
-             name[2]=='F') {
-    qoob->slot[slot_number].type = QOOB_BINARY_TYPE_DOL;
-  } else if (name[0]=='(' &&
-             name[1]=='C' &&
-             name[2]==')') {
-    qoob->slot[slot_number].type = QOOB_BINARY_TYPE_GCB;
-  } else if (name[0]=='Q' &&
-             name[1]=='C' &&
-             name[2]=='F' &&
-             name[3]=='G') {
-    strncpy (name, CONFIG_SLOT_NAME, strlen (CONFIG_SLOT_NAME));
-    qoob->slot[slot_number].type = QOOB_BINARY_TYPE_CONFIG;
-  } else {
-    qoob->slot[slot_number].type = QOOB_BINARY_TYPE_VOID;
-  }
+  char name[QOOB_GCB_NAME_SIZE+1];
+#ifndef QOOB_MINIMAL
+  char *gcb;
+  size_t gcb_size;
+#endif
+  struct timespec mark;
+  qoob_error_t err;
 
+  qoob_profile_mark (qoob->profile, &mark);
 
-  for (i=0; i<used_slots; i++) {
-    memcpy (qoob->slot[slot_number+i].name, 
-            name+name_start, 
-            QOOB_PRO_MAX_BUFFER*4);
-    qoob->slot[slot_number+i].slots_used = used_slots;
+  err = minimize_data (qoob, data, size);
+  if (err != QOOB_ERROR_OK) {
+    return err;
+  }
 
-    if (i != 0) {
-      sprintf (continuing, CONTINUING_TEXT, i+1);
-      memcpy (qoob->slot[slot_number+i].name +
-                strlen (qoob->slot[slot_number+i].name), 
-              continuing, 
-              strlen (continuing));
-      qoob->slot[slot_number+i].first = QOOB_FALSE;
-    }
+  qoob_file_app_name (file, name, sizeof (name));
+
+#ifdef QOOB_MINIMAL
+  if (qoob_file_slots_needed (QOOB_BINARY_TYPE_ELF, *size) > 
+      QOOB_PRO_SLOTS) {
+    return QOOB_ERROR_TOO_BIG_DATA;
+  }
+  if (*data + *size != qoob->work + qoob->work_used ||
+      work_alloc (qoob, QOOB_GCB_HEADER_SIZE) == NULL) {
+    return QOOB_ERROR_NO_MEMORY;
+  }
+  memmove (*data + QOOB_GCB_HEADER_SIZE, *data, *size);
+  qoob_image_gcb_header (name, *data + QOOB_GCB_HEADER_SIZE, *size, *data);
+  *size += QOOB_GCB_HEADER_SIZE;
+#else
+  err = qoob_image_gcb_build (name, *data, *size, pad, &gcb, &gcb_size);
+  if (err != QOOB_ERROR_OK) {
+    return err;
   }
+
+  work_free (qoob, *data);
+  *data = gcb;
+  *size = gcb_size;
+#endif
+
+  qoob_profile_add (qoob->profile, QOOB_PHASE_HEADER, -1, &mark);
+
+  return QOOB_ERROR_OK;
 }
 
-static qoob_error_t 
-write_with_header_to_tmp_file (qoob_t *qoob,
-                               char *file,
-                               size_t size)
-{
-  size_t i = 4;
-  int fd, fd_orig;
-  char new_name[] = TMP_DIR "/qoob-XXXXXX";
-  size_t w;
-  size_t r;
-  char *end = NULL;
-  char *start = NULL;
-  char buf[4096];
-  char used_slots;
-  int left = QOOB_PRO_SLOT_SIZE-((QOOB_GCB_HEADER_SIZE+size)%QOOB_PRO_SLOT_SIZE);
-
-  used_slots = (char)((size+QOOB_GCB_HEADER_SIZE+left)/QOOB_PRO_SLOT_SIZE);
-  if (((size+QOOB_GCB_HEADER_SIZE+left)>QOOB_PRO_SLOT_SIZE) && 
-      ((size+QOOB_GCB_HEADER_SIZE+left)%QOOB_PRO_SLOT_SIZE)) {    
-    used_slots++;
+/*
+ * Takes size bytes from top of work area or from heap if it does not 
+ * fit. Minimal build has only work area.
+ */
+static char *
+work_alloc (qoob_t *qoob,
+            size_t size)
+{
+  if (qoob->work != NULL && size <= qoob->work_size - qoob->work_used) {
+    char *data = qoob->work + qoob->work_used;
+
+    qoob->work_used += size;
+    return data;
   }
-  
-  end = file + strlen (file)-1;
 
-  fd = mkstemp (new_name);
+#ifdef QOOB_MINIMAL
+  return NULL;
+#else
+  return (char *)malloc (size > 0 ? size : 1);
+#endif
+}
 
-  fd_orig = open (file, O_RDONLY);
-  if (fd_orig == -1) {
-    close (fd);
-    return QOOB_ERROR_FD_OPEN;
+/* Gives data back. Work area is freed from data up like a stack. */
+static void
+work_free (qoob_t *qoob,
+           char *data)
+{
+  if (data == NULL) {
+    return;
   }
 
-  /* 1. Write ELF\0 for both ELF and DOL there is such thing */
-  w = write (fd, "ELF\0", 4);
-  if (w != 4) {
-    goto werror;
-  }
-  
-  /* 2. Filename */
-  /* Get filename */
-  for (; end != file && *end != QOOB_PREFIX_SEPARATOR; end--);
-  if (end == file) {
-    end = file + strlen (file)-1;
-  }
-  start = end;
-  for (; start != file && *start != QOOB_DIRECTORY_SEPARATOR; start--);
-  if (*start == QOOB_DIRECTORY_SEPARATOR) {
-    start++;
+  if (qoob->work != NULL && 
+      data >= qoob->work && data < qoob->work + qoob->work_size) {
+    qoob->work_used = (size_t)(data - qoob->work);
+    return;
   }
 
-  /* Write filename */
-  i += (size_t)(end-start);
-  w = write (fd, start, (size_t)(end-start));
-  if (w != (size_t)(end-start)) {
-    goto werror;
-  }
+#ifndef QOOB_MINIMAL
+  free (data);
+#endif
+}
 
-  /* 3. Fill rest of the header */
-  /* Write zeros to rest of header except to 0xfd is written how many slots 
-     is used 
-   */
-  for (; i<QOOB_GCB_HEADER_SIZE; i++) {
-    if (i == 0xfd) {
-      w = write (fd, (char *)&used_slots, 1);
-    }else {
-      w = write (fd, "\0", 1);
-    }
-    if (w != 1) {
-      goto werror;
-    }
+/* Whole file to memory. Free with work_free (). */
+static qoob_error_t
+load_file (qoob_t *qoob,
+           const char *file,
+           char **data,
+           size_t *size)
+{
+#ifdef QOOB_MINIMAL
+  struct stat sbuf;
+  size_t done = 0;
+  int fd;
+
+  fd = open (file, O_RDONLY);
+  if (fd == -1) {
+    return QOOB_ERROR_FD_OPEN;
   }
 
-  /* 4. Write given file */
-  while ((r = read (fd_orig, buf, 4095)) == 4095) {
-    w = write (fd, buf, r);
-    if (w != r) {
-      goto werror;
-    }
-    i += w;
+  if (fstat (fd, &sbuf) == -1) {
+    close (fd);
+    return QOOB_ERROR_FILE_STAT;
   }
-  w = write (fd, buf, r);
-  if (w != r) {
-    goto werror;
+
+  /* Without minimizing bigger file would not fit to flash */
+  if (sbuf.st_size > QOOB_PRO_TOTAL_SIZE) {
+    close (fd);
+    return QOOB_ERROR_TOO_BIG_DATA;
   }
-  i += w;
 
-  /* 5. Fill the rest of the last slot */
-  while (i%QOOB_PRO_SLOT_SIZE) {
-    w = write (fd, "\0", 1);
-    i += w;
-    if (w != 1) {
-      goto werror;
-    }
+  *size = (size_t)sbuf.st_size;
+  *data = work_alloc (qoob, *size);
+  if (*data == NULL) {
+    close (fd);
+    return QOOB_ERROR_NO_MEMORY;
   }
 
-  free (qoob->real_file);
-  qoob->real_file = strdup (new_name);
+  while (done < *size) {
+    ssize_t r = read (fd, *data+done, *size-done);
 
-  /* If situation is that there are no mem.
-     Better to leave whole application.
-   */
-  if (qoob->real_file == NULL) {
-    fprintf (stderr, "Not enough memory!!!\n");
-    exit (112);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0) {
+      work_free (qoob, *data);
+      *data = NULL;
+      close (fd);
+      return QOOB_ERROR_FD_READ;
+    }
+    done += (size_t)r;
   }
 
   close (fd);
-  close (fd_orig);
-
 
   return QOOB_ERROR_OK;
- werror:
-  close (fd);
-  close (fd_orig);
-  return QOOB_ERROR_FD_WRITE;
+#else
+  return qoob_image_load (file, data, size);
+#endif
 }
 
 /* Emacs indentatation information
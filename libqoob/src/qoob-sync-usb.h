@@ -19,6 +19,8 @@
 
 #include "qoob-struct.h"
 #include "qoob-error.h"
+#include "qoob-archive.h"
+#include "qoob-config.h"
 
 #ifndef _QOOB_SYNC_USB_H_
 #define _QOOB_SYNC_USB_H_
@@ -51,12 +53,68 @@
 #define QOOB_USB_CMD_ERASE "\x02"
 
 qoob_error_t qoob_sync_usb_find (qoob_t *qoob);
+qoob_error_t qoob_sync_usb_find_device (qoob_t *qoob,
+                                        const char *bus_name,
+                                        const char *device_name);
+qoob_error_t qoob_sync_usb_find_path (qoob_t *qoob,
+                                      const char *path);
+qoob_error_t qoob_sync_usb_holder (qoob_t *qoob,
+                                   qoob_lock_holder_t *holder);
 qoob_error_t qoob_sync_usb_read (qoob_t *qoob,
                                  char *file,
                                  short int slotnum);
+qoob_error_t qoob_sync_usb_read_fd (qoob_t *qoob,
+                                    int fd,
+                                    short int slotnum);
+qoob_error_t qoob_sync_usb_read_buffer (qoob_t *qoob,
+                                        char *buffer,
+                                        size_t size,
+                                        short int slotnum);
 qoob_error_t qoob_sync_usb_write (qoob_t *qoob,
                                   char *file,
                                   short int slotnum);
+qoob_error_t qoob_sync_usb_write_buffer (qoob_t *qoob,
+                                         const char *name,
+                                         const char *buffer,
+                                         size_t size,
+                                         short int slotnum);
+#ifndef QOOB_MINIMAL
+qoob_error_t qoob_sync_usb_image (qoob_t *qoob,
+                                  const char *name,
+                                  const char *buffer,
+                                  size_t size,
+                                  char **image,
+                                  size_t *image_size);
+#endif
+qoob_error_t qoob_sync_usb_write_changed (qoob_t *qoob,
+                                          const char *previous,
+                                          size_t previous_size,
+                                          const char *image,
+                                          size_t size,
+                                          short int slotnum);
+#ifndef QOOB_MINIMAL
+qoob_error_t qoob_sync_usb_backup (qoob_t *qoob,
+                                   qoob_archive_t *archive,
+                                   short int slot_from,
+                                   short int slot_to);
+qoob_error_t qoob_sync_usb_restore (qoob_t *qoob,
+                                    qoob_archive_t *archive,
+                                    short int slotnum);
+#endif
+qoob_error_t qoob_sync_usb_config_read (qoob_t *qoob,
+                                        qoob_config_t *config);
+qoob_error_t qoob_sync_usb_config_write (qoob_t *qoob,
+                                         qoob_config_t *config);
+qoob_error_t qoob_sync_usb_read_range (qoob_t *qoob,
+                                       unsigned long offset,
+                                       char *buf,
+                                       size_t size);
+qoob_error_t qoob_sync_usb_verify (qoob_t *qoob,
+                                   char *file,
+                                   short int slotnum);
+qoob_error_t qoob_sync_usb_verify_header (qoob_t *qoob,
+                                          char *file,
+                                          short int slotnum);
 qoob_error_t qoob_sync_usb_erase (qoob_t *qoob, 
                                   short int slot_num);
 qoob_error_t qoob_sync_usb_erase_forced (qoob_t *qoob, 
@@ -64,6 +122,10 @@ qoob_error_t qoob_sync_usb_erase_forced (qoob_t *qoob,
                                          short int slot_to);
 qoob_error_t qoob_sync_usb_list (qoob_t *qoob,
                                  qoob_slot_t **slots);
+qoob_error_t qoob_sync_usb_list_range (qoob_t *qoob,
+                                       short int slot_from,
+                                       short int slot_to,
+                                       qoob_slot_t **slots);
 
 void qoob_sync_usb_clear (qoob_t *qoob);
 
@@ -20,11 +20,12 @@
 #include <stdio.h>
 #include <string.h>
 
-#include <usb.h>
-
 #include "qoob-sync.h"
 #include "qoob-sync-usb.h"
 
+#define EMPTY_SLOT_NAME "Empty"
+#define CONTINUING_TEXT " [%02d]"
+
 qoob_error_t
 qoob_sync_init (qoob_t *qoob)
 {
@@ -33,37 +34,56 @@ qoob_sync_init (qoob_t *qoob)
   if (qoob == NULL)
     return 1;
 
-  /* initialize libusb */
+#ifndef QOOB_MINIMAL
+  /* initialize libusb. Busses are listed when they are needed first
+     time, see qoob_discover_busses (). */
   usb_init();
 #ifdef DEBUG
   usb_set_debug (255);
 #endif
-  usb_find_busses();
-  usb_find_devices();
 
   qoob->busses = NULL;
   qoob->dev = NULL;
   qoob->devh = NULL;
-
-  qoob->real_file = NULL;
+#endif
+  qoob->fd = -1;
+  qoob->transport = NULL;
+  qoob->transport_type = QOOB_TRANSPORT_AUTO;
+  qoob->cache = NULL;
+  qoob->work = NULL;
+  qoob->work_size = 0;
+  qoob->work_used = 0;
+
+  qoob->binary_type = QOOB_BINARY_TYPE_VOID;
+  qoob->minimize = QOOB_MINIMIZE_NONE;
+  qoob->sparse = QOOB_FALSE;
+
+  qoob_lock_init (&qoob->lock);
+  qoob->lock_timeout = QOOB_LOCK_WAIT_FOREVER;
+
+  memset (&qoob->transfer, 0, sizeof (qoob->transfer));
+  qoob->transfer.timeout = QOOB_TIMEOUT_DEFAULT;
+  qoob->transfer.retries = QOOB_RETRIES_DEFAULT;
+  qoob->cancel = NULL;
+  qoob->profile = NULL;
+  qoob->completed = 0;
 
   for (i=0; i<QOOB_PRO_SLOTS; i++) { 
     qoob->slot[i].first = QOOB_TRUE;
     qoob->slot[i].slots_used = 0;
     qoob->slot[i].type = QOOB_BINARY_TYPE_VOID;
+    qoob->slot[i].has_digest = QOOB_FALSE;
   }
-
-  /* get busses */
-  qoob->busses = usb_get_busses();
-  if (qoob->busses == NULL) {
-    fprintf (stderr, "Could not find any USB busses!!!\n");
-    return 2;
-  }
+  qoob_table_init (&qoob->table);
+  qoob->slot_stale = QOOB_FALSE;
 
   qoob->sync_cb = NULL;
 
   qoob->user_data = NULL;
 
+  qoob->wait_cb = NULL;
+  qoob->wait_data = NULL;
+
   qoob->async = QOOB_FALSE;
 
   return 0;
@@ -78,21 +98,55 @@ qoob_sync_deinit (qoob_t *qoob)
   if (qoob == NULL)
     return;
 
+#ifndef QOOB_MINIMAL
   qoob->busses = NULL;
   qoob->dev = NULL;
   qoob->devh = NULL;
+#endif
+  qoob->fd = -1;
+  qoob->transport = NULL;
+  qoob->cancel = NULL;
+  qoob->profile = NULL;
   
   for (i=0; i<QOOB_PRO_SLOTS; i++) { 
     qoob->slot[i].first = QOOB_TRUE;
     qoob->slot[i].slots_used = 0;
     qoob->slot[i].type = QOOB_BINARY_TYPE_VOID;
+    qoob->slot[i].has_digest = QOOB_FALSE;
   }
+  qoob_table_init (&qoob->table);
+  qoob->slot_stale = QOOB_FALSE;
 
   qoob->sync_cb = NULL;
 
   qoob->user_data = NULL;
 }
 
+/*
+ * qoob_sync_rescan ()
+ *
+ * Makes libusb bus and device lists to be read again when they are 
+ * needed next time, so devices plugged in after they were read can be 
+ * found. sysfs is always read as it is. Must not be called while device
+ * is open.
+ */
+qoob_error_t
+qoob_sync_rescan (qoob_t *qoob)
+{
+  if (qoob == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+  if (qoob->transport != NULL) {
+    return QOOB_ERROR_DEVICE_HANDLE_NOT_VALID;
+  }
+
+#ifndef QOOB_MINIMAL
+  qoob->busses = NULL;
+#endif
+
+  return QOOB_ERROR_OK;
+}
+
 qoob_error_t
 qoob_sync_file_format_set (qoob_t *qoob, binary_type_t type)
 {
@@ -115,6 +169,211 @@ qoob_sync_file_format_get (qoob_t *qoob, binary_type_t *type)
   return 0;
 }
 
+qoob_error_t
+qoob_sync_minimize_set (qoob_t *qoob, qoob_minimize_t mode)
+{
+  if (qoob == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+#ifdef QOOB_MINIMAL
+  /* Converted image would need heap */
+  if (mode != QOOB_MINIMIZE_NONE) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+#endif
+  qoob->minimize = mode;
+
+  return QOOB_ERROR_OK;
+}
+
+qoob_error_t
+qoob_sync_minimize_get (qoob_t *qoob, qoob_minimize_t *mode)
+{
+  if (qoob == NULL || mode == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+  *mode = qoob->minimize;
+
+  return QOOB_ERROR_OK;
+}
+
+qoob_error_t
+qoob_sync_sparse_set (qoob_t *qoob, qoob_boolean_t sparse)
+{
+  if (qoob == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+  qoob->sparse = sparse;
+
+  return QOOB_ERROR_OK;
+}
+
+/*
+ * Milliseconds to wait if other program uses the device. Negative waits
+ * forever and zero fails at once.
+ */
+qoob_error_t
+qoob_sync_lock_timeout_set (qoob_t *qoob, int timeout)
+{
+  if (qoob == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+  qoob->lock_timeout = timeout < 0 ? QOOB_LOCK_WAIT_FOREVER : timeout;
+
+  return QOOB_ERROR_OK;
+}
+
+/* Transport used when device is opened next time */
+qoob_error_t
+qoob_sync_transport_set (qoob_t *qoob, qoob_transport_type_t type)
+{
+  if (qoob == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+  qoob->transport_type = type;
+
+  return QOOB_ERROR_OK;
+}
+
+/* Transport of open device or the one which is asked if not open */
+qoob_error_t
+qoob_sync_transport_get (qoob_t *qoob, qoob_transport_type_t *type)
+{
+  if (qoob == NULL || type == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+  *type = qoob->transport != NULL ? 
+    qoob->transport->type : qoob->transport_type;
+
+  return QOOB_ERROR_OK;
+}
+
+/* How many times failed slot or half slot is tried again */
+qoob_error_t
+qoob_sync_retries_set (qoob_t *qoob, int retries)
+{
+  if (qoob == NULL || retries < 0) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+  qoob->transfer.retries = retries;
+
+  return QOOB_ERROR_OK;
+}
+
+/* Learned latency and timeout and retries done */
+qoob_error_t
+qoob_sync_transfer_get (qoob_t *qoob, qoob_transfer_t *transfer)
+{
+  if (qoob == NULL || transfer == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+  *transfer = qoob->transfer;
+
+  return QOOB_ERROR_OK;
+}
+
+/*
+ * Token which stops following operations when it is cancelled or its
+ * deadline passes. Caller owns it and it has to live while it is set.
+ * NULL removes it.
+ */
+qoob_error_t
+qoob_sync_cancel_set (qoob_t *qoob, qoob_cancel_t *cancel)
+{
+  if (qoob == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+  qoob->cancel = cancel;
+
+  return QOOB_ERROR_OK;
+}
+
+/*
+ * Profile which gets time of every phase and slot of following 
+ * operations. Caller owns it. NULL stops profiling.
+ */
+qoob_error_t
+qoob_sync_profile_set (qoob_t *qoob, qoob_profile_t *profile)
+{
+  if (qoob == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+  qoob->profile = profile;
+
+  return QOOB_ERROR_OK;
+}
+
+/*
+ * Event loop of the caller waits while usbfs transfers are in flight. 
+ * wait is called instead of poll () for usbfs node fd and it returns as
+ * poll () would: 1 when fd is ready, 0 after timeout milliseconds and -1 
+ * with errno on error. Caller can run other devices until then. Other 
+ * transports block in the kernel and do not call it. NULL polls again.
+ */
+qoob_error_t
+qoob_sync_wait_set (qoob_t *qoob,
+                    int (*wait)(int fd, 
+                                short events, 
+                                int timeout, 
+                                void *wait_data),
+                    void *wait_data)
+{
+  if (qoob == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+  qoob->wait_cb = wait;
+  qoob->wait_data = wait_data;
+
+  return QOOB_ERROR_OK;
+}
+
+/*
+ * Storage for slot buffers and images. Operations take what they need
+ * from it and give it back before they return, except read cache which 
+ * is kept until device is closed. Heap is used when it is too small,
+ * or QOOB_ERROR_NO_MEMORY is returned in minimal build. One slot is 
+ * enough for read, config and erase, whole image for write and verify.
+ * Caller owns it. NULL stops using it.
+ */
+qoob_error_t
+qoob_sync_work_set (qoob_t *qoob, char *work, size_t size)
+{
+  if (qoob == NULL || (work == NULL && size > 0)) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+  if (qoob->work_used > 0) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+  qoob->work = work;
+  qoob->work_size = size;
+
+  return QOOB_ERROR_OK;
+}
+
+/* Slots which last operation finished, also when it failed or was 
+   cancelled. Bit 0 is slot 0. */
+qoob_error_t
+qoob_sync_completed_get (qoob_t *qoob, unsigned long *completed)
+{
+  if (qoob == NULL || completed == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+  *completed = qoob->completed;
+
+  return QOOB_ERROR_OK;
+}
+
+qoob_error_t
+qoob_sync_sparse_get (qoob_t *qoob, qoob_boolean_t *sparse)
+{
+  if (qoob == NULL || sparse == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+  *sparse = qoob->sparse;
+
+  return QOOB_ERROR_OK;
+}
+
 
 /* callback */
 qoob_error_t
@@ -139,9 +398,84 @@ qoob_sync_set_callback (qoob_t *qoob,
   return QOOB_ERROR_OK;
 }
 
+/* Applications of the latest list. Valid until next list, no copy. */
+const qoob_table_t *
+qoob_sync_table_get (qoob_t *qoob)
+{
+  if (qoob == NULL) {
+    return NULL;
+  }
+
+  return &qoob->table;
+}
+
+/*
+ * Slot view of the latest list with entry for every slot. It is made 
+ * from application table when it is asked first time after listing. 
+ * Valid until next list.
+ */
+const qoob_slot_t *
+qoob_sync_slots_get (qoob_t *qoob)
+{
+  int i;
+
+  if (qoob == NULL) {
+    return NULL;
+  }
+
+  if (qoob->slot_stale != QOOB_TRUE) {
+    return qoob->slot;
+  }
+
+  for (i=0; i<QOOB_PRO_SLOTS; i++) {
+    const qoob_app_t *app = qoob_table_app_at (&qoob->table, i);
+    qoob_slot_t *slot = &qoob->slot[i];
+
+    memset (slot->name, 0, sizeof (slot->name));
+    slot->first = QOOB_TRUE;
+    slot->type = QOOB_BINARY_TYPE_VOID;
+    slot->has_digest = QOOB_FALSE;
+
+    if (app == NULL) {
+      /* Not listed yet slot uses nothing */
+      if (qoob->table.listed & (1UL << i)) {
+        strcpy (slot->name, EMPTY_SLOT_NAME);
+        slot->slots_used = 1;
+      } else {
+        slot->slots_used = 0;
+      }
+      continue;
+    }
+
+    strcpy (slot->name, qoob_table_app_name (&qoob->table, app));
+    slot->slots_used = app->slots_used;
+
+    if (app->slot == i) {
+      slot->type = app->type;
+      slot->has_digest = app->has_digest;
+      slot->length = app->length;
+      memcpy (slot->digest, app->digest, QOOB_DIGEST_SIZE);
+    } else {
+      sprintf (slot->name + strlen (slot->name), CONTINUING_TEXT, 
+               i - app->slot + 1);
+      slot->first = QOOB_FALSE;
+    }
+  }
+  qoob->slot_stale = QOOB_FALSE;
+
+  return qoob->slot;
+}
+
+/* 
+ * Copy of the slot view. NULL if there is no memory. Minimal build has
+ * no heap so it gives always NULL, use qoob_sync_slots_get () there.
+ */
 qoob_slot_t *
-qoob_sync_slot_copy (qoob_slot_t *slot)
+qoob_sync_slot_copy (const qoob_slot_t *slot)
 {
+#ifdef QOOB_MINIMAL
+  return NULL;
+#else
   qoob_slot_t *ret;
 
   if (slot == NULL) {
@@ -150,17 +484,20 @@ qoob_sync_slot_copy (qoob_slot_t *slot)
   
   ret = (qoob_slot_t *)malloc (sizeof (qoob_slot_t) * QOOB_PRO_SLOTS);
   if (ret == NULL)
-    abort ();
+    return NULL;
 
   memcpy (ret, slot, sizeof (qoob_slot_t) * QOOB_PRO_SLOTS);
   
   return ret;
+#endif
 }
 
 void qoob_sync_slot_free (qoob_slot_t *slot)
 {
+#ifndef QOOB_MINIMAL
   if (slot != NULL)
     free (slot);
+#endif
 }
 
 /* Emacs indentatation information
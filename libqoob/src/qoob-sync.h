@@ -17,8 +17,6 @@
  * Boston, MA 02111-1307, USA.
  */
 
-#include <usb.h>
-
 #include "qoob-struct.h"
 #include "qoob-error.h"
 
@@ -27,11 +25,38 @@
 
 qoob_error_t qoob_sync_init (qoob_t *qoob);
 void qoob_sync_deinit (qoob_t *qoob);
+qoob_error_t qoob_sync_rescan (qoob_t *qoob);
 
 qoob_error_t qoob_sync_file_format_set (qoob_t *qoob, binary_type_t type);
 qoob_error_t qoob_sync_file_format_get (qoob_t *qoob, binary_type_t *type);
 
-qoob_slot_t *qoob_sync_slot_copy (qoob_slot_t *slot);
+qoob_error_t qoob_sync_minimize_set (qoob_t *qoob, qoob_minimize_t mode);
+qoob_error_t qoob_sync_minimize_get (qoob_t *qoob, qoob_minimize_t *mode);
+qoob_error_t qoob_sync_sparse_set (qoob_t *qoob, qoob_boolean_t sparse);
+qoob_error_t qoob_sync_sparse_get (qoob_t *qoob, qoob_boolean_t *sparse);
+qoob_error_t qoob_sync_lock_timeout_set (qoob_t *qoob, int timeout);
+qoob_error_t qoob_sync_retries_set (qoob_t *qoob, int retries);
+qoob_error_t qoob_sync_transport_set (qoob_t *qoob, 
+                                      qoob_transport_type_t type);
+qoob_error_t qoob_sync_transport_get (qoob_t *qoob, 
+                                      qoob_transport_type_t *type);
+qoob_error_t qoob_sync_transfer_get (qoob_t *qoob, 
+                                     qoob_transfer_t *transfer);
+qoob_error_t qoob_sync_cancel_set (qoob_t *qoob, qoob_cancel_t *cancel);
+qoob_error_t qoob_sync_profile_set (qoob_t *qoob, qoob_profile_t *profile);
+qoob_error_t qoob_sync_work_set (qoob_t *qoob, char *work, size_t size);
+qoob_error_t qoob_sync_wait_set (qoob_t *qoob,
+                                 int (*wait)(int fd, 
+                                             short events, 
+                                             int timeout, 
+                                             void *wait_data),
+                                 void *wait_data);
+qoob_error_t qoob_sync_completed_get (qoob_t *qoob, 
+                                      unsigned long *completed);
+
+const qoob_table_t *qoob_sync_table_get (qoob_t *qoob);
+const qoob_slot_t *qoob_sync_slots_get (qoob_t *qoob);
+qoob_slot_t *qoob_sync_slot_copy (const qoob_slot_t *slot);
 void qoob_sync_slot_free (qoob_slot_t *slot);
 
 /* callbacks */
@@ -0,0 +1,235 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+
+#include "qoob-table.h"
+
+static void remove_overlapping (qoob_table_t *table, 
+                                short int slot_from,
+                                short int slot_to);
+static unsigned long slot_mask (short int slot, int count);
+static unsigned short int intern (qoob_table_t *table, const char *name);
+static void compact (qoob_table_t *table);
+
+void
+qoob_table_init (qoob_table_t *table)
+{
+  if (table == NULL)
+    return;
+
+  table->count = 0;
+  table->used = 0;
+  table->listed = 0;
+  table->names_size = 0;
+}
+
+/* Application which uses slot or NULL */
+const qoob_app_t *
+qoob_table_app_at (const qoob_table_t *table,
+                   short int slot)
+{
+  int i;
+
+  if (table == NULL || slot < 0 || slot >= QOOB_PRO_SLOTS ||
+      !(table->used & (1UL << slot))) {
+    return NULL;
+  }
+
+  for (i=0; i<table->count; i++) {
+    const qoob_app_t *app = &table->apps[i];
+
+    if (slot >= app->slot && slot < app->slot + app->slots_used)
+      return app;
+  }
+
+  return NULL;
+}
+
+/*
+ * Iterates applications in slot order. NULL gives the first one. Returns 
+ * NULL after the last one.
+ */
+const qoob_app_t *
+qoob_table_next (const qoob_table_t *table,
+                 const qoob_app_t *app)
+{
+  if (table == NULL)
+    return NULL;
+
+  app = app == NULL ? table->apps : app+1;
+  if (app >= table->apps + table->count)
+    return NULL;
+
+  return app;
+}
+
+const char *
+qoob_table_app_name (const qoob_table_t *table,
+                     const qoob_app_t *app)
+{
+  if (table == NULL || app == NULL)
+    return NULL;
+
+  return table->names + app->name;
+}
+
+/* Application replaces the ones which used any of its slots */
+void
+qoob_table_add (qoob_table_t *table, 
+                const qoob_app_t *app,
+                const char *name)
+{
+  int used = app->slots_used;
+  unsigned short int offset;
+  int i;
+
+  if (app->slot + used > QOOB_PRO_SLOTS)
+    used = QOOB_PRO_SLOTS - app->slot;
+
+  remove_overlapping (table, app->slot, app->slot + used - 1);
+
+  /* Before insert, compacting looks only at applications in table */
+  offset = intern (table, name);
+
+  for (i=table->count; i>0 && table->apps[i-1].slot > app->slot; i--)
+    table->apps[i] = table->apps[i-1];
+  table->apps[i] = *app;
+  table->apps[i].slots_used = used;
+  table->apps[i].name = offset;
+  table->count++;
+
+  table->used |= slot_mask (app->slot, used);
+  table->listed |= slot_mask (app->slot, used);
+}
+
+/* Slot was listed empty */
+void
+qoob_table_empty (qoob_table_t *table, short int slot)
+{
+  remove_overlapping (table, slot, slot);
+  table->listed |= 1UL << slot;
+}
+
+/* Static functions */
+static void
+remove_overlapping (qoob_table_t *table, 
+                    short int slot_from,
+                    short int slot_to)
+{
+  int i;
+  int n = 0;
+
+  for (i=0; i<table->count; i++) {
+    qoob_app_t *app = &table->apps[i];
+
+    if (app->slot <= slot_to && 
+        app->slot + app->slots_used - 1 >= slot_from) {
+      table->used &= ~slot_mask (app->slot, app->slots_used);
+      continue;
+    }
+    table->apps[n++] = *app;
+  }
+  table->count = n;
+}
+
+static unsigned long
+slot_mask (short int slot, int count)
+{
+  unsigned long mask = 0;
+  int i;
+
+  for (i=slot; i<slot+count && i<QOOB_PRO_SLOTS; i++)
+    mask |= 1UL << i;
+
+  return mask;
+}
+
+/* Offset of the name in table. Names of removed applications are 
+   dropped when room runs out. */
+static unsigned short int
+intern (qoob_table_t *table, const char *name)
+{
+  size_t len = strlen (name);
+  size_t offset;
+
+  if (len > QOOB_TABLE_NAME_SIZE-1)
+    len = QOOB_TABLE_NAME_SIZE-1;
+
+  for (offset = 0; offset < table->names_size; 
+       offset += strlen (table->names+offset)+1) {
+    if (strncmp (table->names+offset, name, len) == 0 &&
+        table->names[offset+len] == '\0')
+      return (unsigned short int)offset;
+  }
+
+  if (table->names_size + len + 1 > sizeof (table->names))
+    compact (table);
+
+  offset = table->names_size;
+  memcpy (table->names+offset, name, len);
+  table->names[offset+len] = '\0';
+  table->names_size += len+1;
+
+  return (unsigned short int)offset;
+}
+
+/* Only names of applications in table are kept */
+static void
+compact (qoob_table_t *table)
+{
+  char names[sizeof (table->names)];
+  size_t size = 0;
+  int i;
+
+  for (i=0; i<table->count; i++) {
+    const char *name = table->names + table->apps[i].name;
+    size_t len = strlen (name);
+    size_t offset;
+    int j;
+
+    /* Shared with earlier application */
+    for (j=0; j<i; j++) {
+      if (strcmp (names + table->apps[j].name, name) == 0)
+        break;
+    }
+    if (j < i) {
+      table->apps[i].name = table->apps[j].name;
+      continue;
+    }
+
+    offset = size;
+    memcpy (names+offset, name, len+1);
+    size += len+1;
+    table->apps[i].name = (unsigned short int)offset;
+  }
+
+  memcpy (table->names, names, size);
+  table->names_size = size;
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
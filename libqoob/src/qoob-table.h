@@ -0,0 +1,85 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stddef.h>
+
+#include "qoob-defaults.h"
+#include "qoob-digest.h"
+
+#ifndef _QOOB_TABLE_H_
+#define _QOOB_TABLE_H_
+
+/*
+ * Application table. One entry per application in flash, sorted by 
+ * first slot, and bitmap of used slots. Names are interned to table so
+ * application with the same name shares it. Table has no pointers and
+ * can be copied as it is. Empty slots have no entry.
+ */
+
+/* Longest name with terminating zero */
+#define QOOB_TABLE_NAME_SIZE (QOOB_PRO_MAX_BUFFER*4)
+
+typedef struct QoobApp qoob_app_t;
+struct QoobApp
+{
+  short int slot;                   /* First slot */
+  unsigned short int slots_used;
+  binary_type_t type;               /* VOID if header is not known */
+  unsigned short int name;          /* See qoob_table_app_name () */
+  qoob_boolean_t has_digest;        /* Header made by libqoob */
+  unsigned long length;
+  unsigned char digest[QOOB_DIGEST_SIZE];
+};
+
+typedef struct QoobTable qoob_table_t;
+struct QoobTable
+{
+  qoob_app_t apps[QOOB_PRO_SLOTS];
+  int count;
+  unsigned long used;               /* Bit per slot of an application */
+  unsigned long listed;             /* Bit per slot which is listed */
+  char names[QOOB_PRO_SLOTS*QOOB_TABLE_NAME_SIZE];
+  size_t names_size;
+};
+
+void qoob_table_init (qoob_table_t *table);
+const qoob_app_t *qoob_table_app_at (const qoob_table_t *table,
+                                     short int slot);
+const qoob_app_t *qoob_table_next (const qoob_table_t *table,
+                                   const qoob_app_t *app);
+const char *qoob_table_app_name (const qoob_table_t *table,
+                                 const qoob_app_t *app);
+
+/* Used by listing */
+void qoob_table_add (qoob_table_t *table, 
+                     const qoob_app_t *app,
+                     const char *name);
+void qoob_table_empty (qoob_table_t *table, short int slot);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
@@ -0,0 +1,265 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "qoob-struct.h"
+#include "qoob-discover.h"
+#include "qoob-sync-usb.h"
+#include "qoob-transport.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/hidraw.h>
+
+#define HIDRAW_CLASS_DIR "/sys/class/hidraw"
+#define HIDRAW_DEV_DIR "/dev"
+#define HIDRAW_REPORT_SIZE (1+QOOB_PRO_MAX_BUFFER) /* Report id and data */
+
+static qoob_error_t hidraw_open (struct Qoob *qoob,
+                                 const char *bus,
+                                 const char *device);
+static void hidraw_close (struct Qoob *qoob);
+static int hidraw_control (struct Qoob *qoob,
+                           qoob_boolean_t in,
+                           char *buf,
+                           int timeout);
+static qoob_error_t hidraw_node (const char *bus,
+                                 const char *device,
+                                 char *path,
+                                 size_t size);
+
+const qoob_transport_t qoob_transport_hidraw = {
+  "hidraw",
+  QOOB_TRANSPORT_HIDRAW,
+  hidraw_open,
+  hidraw_close,
+  hidraw_control,
+  NULL
+};
+
+/*
+ * usbhid keeps the interface and hidraw node is given to us instead, so
+ * nothing is claimed and usbhid quirk is not needed.
+ */
+static qoob_error_t
+hidraw_open (struct Qoob *qoob,
+             const char *bus,
+             const char *device)
+{
+  char path[PATH_MAX];
+  struct hidraw_devinfo info;
+  qoob_error_t err;
+  int fd;
+
+  err = hidraw_node (bus, device, path, sizeof (path));
+  if (err != QOOB_ERROR_OK) {
+    return err;
+  }
+
+  fd = open (path, O_RDWR | O_CLOEXEC);
+  if (fd == -1) {
+    return QOOB_ERROR_FD_OPEN;
+  }
+
+  if (ioctl (fd, HIDIOCGRAWINFO, &info) < 0 ||
+      (unsigned short)info.vendor != QOOB_PRO_VENDOR ||
+      (unsigned short)info.product != QOOB_PRO_PRODUCT) {
+    close (fd);
+    return QOOB_ERROR_NOT_FOUND;
+  }
+
+  qoob->fd = fd;
+
+  return QOOB_ERROR_OK;
+}
+
+static void
+hidraw_close (struct Qoob *qoob)
+{
+  if (qoob->fd >= 0) {
+    close (qoob->fd);
+  }
+  qoob->fd = -1;
+}
+
+/*
+ * Reports are unnumbered, so report id 0 is put in front of the data and
+ * usbhid strips it. Send is SET_REPORT of output report and receive is 
+ * GET_REPORT of feature report, same requests as with other transports.
+ * Kernel uses its own timeout for report requests.
+ */
+static int
+hidraw_control (struct Qoob *qoob,
+                qoob_boolean_t in,
+                char *buf,
+                int timeout)
+{
+  char report[HIDRAW_REPORT_SIZE];
+  int ret;
+
+  report[0] = 0;
+
+  if (in == QOOB_TRUE) {
+    ret = ioctl (qoob->fd, HIDIOCGFEATURE (sizeof (report)), report);
+    if (ret < 0) {
+      return -errno;
+    }
+    ret = ret > 0 ? ret - 1 : 0;
+    if (ret > QOOB_PRO_MAX_BUFFER) {
+      ret = QOOB_PRO_MAX_BUFFER;
+    }
+    memcpy (buf, report + 1, ret);
+
+    return ret;
+  }
+
+  memcpy (report + 1, buf, QOOB_PRO_MAX_BUFFER);
+  ret = -1;
+#ifdef HIDIOCSOUTPUT
+  /* Linux 5.11 and newer. Always SET_REPORT even if device has out
+     endpoint. */
+  ret = ioctl (qoob->fd, HIDIOCSOUTPUT (sizeof (report)), report);
+  if (ret < 0 && errno != EINVAL && errno != ENOTTY) {
+    return -errno;
+  }
+#endif
+  if (ret < 0) {
+    ret = write (qoob->fd, report, sizeof (report));
+    if (ret < 0) {
+      return -errno;
+    }
+  }
+
+  return ret > 0 ? ret - 1 : 0;
+}
+
+/*
+ * Finds hidraw node of interface 0 of USB device at bus and device from 
+ * sysfs. Node's device is HID device under USB interface under USB 
+ * device, e.g. .../1-1/1-1:1.0/0003:03EB:0001.0001.
+ */
+static qoob_error_t
+hidraw_node (const char *bus,
+             const char *device,
+             char *path,
+             size_t size)
+{
+  DIR *dir;
+  struct dirent *entry;
+  long busnum = strtol (bus, NULL, 10);
+  long devnum = strtol (device, NULL, 10);
+  qoob_error_t err = QOOB_ERROR_NOT_FOUND;
+
+  dir = opendir (HIDRAW_CLASS_DIR);
+  if (dir == NULL) {
+    return QOOB_ERROR_NOT_FOUND;
+  }
+
+  while ((entry = readdir (dir)) != NULL) {
+    char link[PATH_MAX];
+    char hid[PATH_MAX];
+    char *slash;
+
+    if (strncmp (entry->d_name, "hidraw", 6) != 0)
+      continue;
+
+    snprintf (link, sizeof (link), "%s/%s/device", 
+              HIDRAW_CLASS_DIR, entry->d_name);
+    if (realpath (link, hid) == NULL)
+      continue;
+
+    /* USB interface */
+    slash = strrchr (hid, '/');
+    if (slash == NULL)
+      continue;
+    *slash = '\0';
+    if (qoob_discover_sysfs_number (hid, "bInterfaceNumber", 16) != 0)
+      continue;
+
+    /* USB device */
+    slash = strrchr (hid, '/');
+    if (slash == NULL)
+      continue;
+    *slash = '\0';
+    if (qoob_discover_sysfs_number (hid, "busnum", 10) != busnum ||
+        qoob_discover_sysfs_number (hid, "devnum", 10) != devnum)
+      continue;
+
+    snprintf (path, size, "%s/%s", HIDRAW_DEV_DIR, entry->d_name);
+    err = QOOB_ERROR_OK;
+    break;
+  }
+  closedir (dir);
+
+  return err;
+}
+
+#else
+
+/* hidraw is Linux only. Opening fails so libusb is used instead. */
+static qoob_error_t
+hidraw_open (struct Qoob *qoob,
+             const char *bus,
+             const char *device)
+{
+  return QOOB_ERROR_NOT_FOUND;
+}
+
+static void
+hidraw_close (struct Qoob *qoob)
+{
+}
+
+static int
+hidraw_control (struct Qoob *qoob,
+                qoob_boolean_t in,
+                char *buf,
+                int timeout)
+{
+  return -ENODEV;
+}
+
+const qoob_transport_t qoob_transport_hidraw = {
+  "hidraw",
+  QOOB_TRANSPORT_HIDRAW,
+  hidraw_open,
+  hidraw_close,
+  hidraw_control,
+  NULL
+};
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
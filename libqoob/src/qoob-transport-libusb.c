@@ -0,0 +1,163 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+
+#include <usb.h>
+
+#include "qoob-struct.h"
+#include "qoob-discover.h"
+#include "qoob-transport.h"
+
+static qoob_error_t libusb_open (struct Qoob *qoob,
+                                 const char *bus_name,
+                                 const char *device_name);
+static void libusb_close (struct Qoob *qoob);
+static int libusb_control (struct Qoob *qoob,
+                           qoob_boolean_t in,
+                           char *buf,
+                           int timeout);
+static struct usb_device *find_device (struct Qoob *qoob,
+                                       const char *bus_name,
+                                       const char *device_name);
+
+const qoob_transport_t qoob_transport_libusb = {
+  "libusb",
+  QOOB_TRANSPORT_LIBUSB,
+  libusb_open,
+  libusb_close,
+  libusb_control,
+  NULL
+};
+
+/* Device is searched from libusb busses. List is read again once if
+   device was plugged in after it was read. */
+static qoob_error_t
+libusb_open (struct Qoob *qoob,
+             const char *bus_name,
+             const char *device_name)
+{
+  struct usb_device *dev;
+  usb_dev_handle *devh;
+
+  if (qoob_discover_busses (qoob) != QOOB_ERROR_OK) {
+    return QOOB_ERROR_NOT_FOUND;
+  }
+
+  dev = find_device (qoob, bus_name, device_name);
+  if (dev == NULL) {
+    qoob->busses = NULL;
+    if (qoob_discover_busses (qoob) == QOOB_ERROR_OK) {
+      dev = find_device (qoob, bus_name, device_name);
+    }
+  }
+  if (dev == NULL) {
+    return QOOB_ERROR_NOT_FOUND;
+  }
+
+  /* Get interface to us */
+  devh = usb_open (dev);
+  if (devh == NULL) {
+    return QOOB_ERROR_NOT_FOUND;
+  }
+
+  if (usb_claim_interface (devh, 0) < 0) {
+    usb_close (devh);
+    return QOOB_ERROR_CLAIM_INTERFACE;
+  }
+
+#ifndef HAVE_DARWIN
+  /* There is only one altinterface. !!!Used shortcut!!! */
+  if (usb_set_altinterface (devh, 0) < 0) {
+    usb_release_interface (devh, 0);
+    usb_close (devh);
+    return QOOB_ERROR_ALT_INTERFACE;
+  }
+#endif
+
+  qoob->dev = dev;
+  qoob->devh = devh;
+
+  return QOOB_ERROR_OK;
+}
+
+static struct usb_device *
+find_device (struct Qoob *qoob,
+             const char *bus_name,
+             const char *device_name)
+{
+  struct usb_bus *bus;
+
+  for (bus = qoob->busses; bus; bus = bus->next) {
+    struct usb_device *dev;
+
+    if (strcmp (bus->dirname, bus_name) != 0)
+      continue;
+
+    for (dev = bus->devices; dev; dev = dev->next) {
+      if (strcmp (dev->filename, device_name) == 0)
+        return dev;
+    }
+  }
+
+  return NULL;
+}
+
+static void
+libusb_close (struct Qoob *qoob)
+{
+  if (qoob->devh != NULL) {
+    usb_release_interface (qoob->devh, 0);
+    usb_close (qoob->devh);
+  }
+  qoob->devh = NULL;
+  qoob->dev = NULL;
+}
+
+static int
+libusb_control (struct Qoob *qoob,
+                qoob_boolean_t in,
+                char *buf,
+                int timeout)
+{
+  return usb_control_msg (qoob->devh, 
+                          in == QOOB_TRUE ?
+                            QOOB_TRANSPORT_TYPE_IN :
+                            QOOB_TRANSPORT_TYPE_OUT, 
+                          in == QOOB_TRUE ? 
+                            QOOB_TRANSPORT_RECV_REQUEST : 
+                            QOOB_TRANSPORT_SEND_REQUEST, 
+                          in == QOOB_TRUE ? 
+                            QOOB_TRANSPORT_RECV_VALUE : 
+                            QOOB_TRANSPORT_SEND_VALUE, 
+                          0, 
+                          buf,
+                          QOOB_PRO_MAX_BUFFER,
+                          timeout);
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
@@ -0,0 +1,334 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "qoob-struct.h"
+#include "qoob-transport.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/usbdevice_fs.h>
+
+#define USBFS_DIR "/dev/bus/usb"
+#define USBFS_PATH_SIZE 64
+#define USBFS_IN_FLIGHT 8        /* Data packets queued at once */
+#define USBFS_SETUP_SIZE 8       /* Setup packet in front of control URB */
+#define USBFS_URB_SIZE (USBFS_SETUP_SIZE+QOOB_PRO_MAX_BUFFER)
+
+static qoob_error_t usbfs_open (struct Qoob *qoob,
+                                const char *bus,
+                                const char *device);
+static void usbfs_close (struct Qoob *qoob);
+static int usbfs_control (struct Qoob *qoob,
+                          qoob_boolean_t in,
+                          char *buf,
+                          int timeout);
+static int usbfs_control_many (struct Qoob *qoob,
+                               qoob_boolean_t in,
+                               char *bufs,
+                               int count,
+                               int timeout);
+static int usbfs_wait (struct Qoob *qoob, int timeout);
+static void setup_packet (unsigned char *setup, qoob_boolean_t in);
+
+const qoob_transport_t qoob_transport_usbfs = {
+  "usbfs",
+  QOOB_TRANSPORT_USBFS,
+  usbfs_open,
+  usbfs_close,
+  usbfs_control,
+  usbfs_control_many
+};
+
+static qoob_error_t
+usbfs_open (struct Qoob *qoob,
+            const char *bus,
+            const char *device)
+{
+  char path[USBFS_PATH_SIZE];
+  unsigned int interface = 0;
+  struct usbdevfs_setinterface alt = {0, 0};
+  int fd;
+
+  snprintf (path, sizeof (path), "%s/%s/%s", USBFS_DIR, bus, device);
+  fd = open (path, O_RDWR | O_CLOEXEC);
+  if (fd == -1) {
+    return QOOB_ERROR_FD_OPEN;
+  }
+
+  if (ioctl (fd, USBDEVFS_CLAIMINTERFACE, &interface) < 0) {
+    close (fd);
+    return QOOB_ERROR_CLAIM_INTERFACE;
+  }
+
+  /* There is only one altinterface */
+  if (ioctl (fd, USBDEVFS_SETINTERFACE, &alt) < 0) {
+    ioctl (fd, USBDEVFS_RELEASEINTERFACE, &interface);
+    close (fd);
+    return QOOB_ERROR_ALT_INTERFACE;
+  }
+
+  qoob->fd = fd;
+
+  return QOOB_ERROR_OK;
+}
+
+static void
+usbfs_close (struct Qoob *qoob)
+{
+  unsigned int interface = 0;
+
+  if (qoob->fd >= 0) {
+    ioctl (qoob->fd, USBDEVFS_RELEASEINTERFACE, &interface);
+    close (qoob->fd);
+  }
+  qoob->fd = -1;
+}
+
+static int
+usbfs_control (struct Qoob *qoob,
+               qoob_boolean_t in,
+               char *buf,
+               int timeout)
+{
+  struct usbdevfs_ctrltransfer ctrl;
+  int ret;
+
+  /* USBDEVFS_CONTROL blocks, URB lets event loop wait */
+  if (qoob->wait_cb != NULL) {
+    ret = usbfs_control_many (qoob, in, buf, 1, timeout);
+    return ret < 0 ? ret : QOOB_PRO_MAX_BUFFER;
+  }
+
+  memset (&ctrl, 0, sizeof (ctrl));
+  ctrl.bRequestType = in == QOOB_TRUE ? 
+    QOOB_TRANSPORT_TYPE_IN : QOOB_TRANSPORT_TYPE_OUT;
+  ctrl.bRequest = in == QOOB_TRUE ? 
+    QOOB_TRANSPORT_RECV_REQUEST : QOOB_TRANSPORT_SEND_REQUEST;
+  ctrl.wValue = in == QOOB_TRUE ? 
+    QOOB_TRANSPORT_RECV_VALUE : QOOB_TRANSPORT_SEND_VALUE;
+  ctrl.wIndex = 0;
+  ctrl.wLength = QOOB_PRO_MAX_BUFFER;
+  ctrl.timeout = (unsigned int)timeout;
+  ctrl.data = buf;
+
+  ret = ioctl (qoob->fd, USBDEVFS_CONTROL, &ctrl);
+
+  return ret < 0 ? -errno : ret;
+}
+
+/*
+ * Keeps USBFS_IN_FLIGHT control URBs submitted and reaps them as they
+ * complete, so device gets next packet without waiting for the ioctl 
+ * round trip. Endpoint 0 completes URBs in order they were submitted.
+ */
+static int
+usbfs_control_many (struct Qoob *qoob,
+                    qoob_boolean_t in,
+                    char *bufs,
+                    int count,
+                    int timeout)
+{
+  struct usbdevfs_urb urb[USBFS_IN_FLIGHT];
+  unsigned char xfer[USBFS_IN_FLIGHT][USBFS_URB_SIZE];
+  qoob_boolean_t busy[USBFS_IN_FLIGHT];
+  int submitted = 0;
+  int done = 0;
+  int ret = count;
+  int i;
+
+  for (i=0; i<USBFS_IN_FLIGHT; i++) {
+    busy[i] = QOOB_FALSE;
+  }
+
+  while (done < count) {
+    struct usbdevfs_urb *reaped;
+    int r;
+
+    /* Keep queue full */
+    for (i=0; i<USBFS_IN_FLIGHT && submitted < count; i++) {
+      char *buf = bufs + (size_t)submitted*QOOB_PRO_MAX_BUFFER;
+
+      if (busy[i] == QOOB_TRUE)
+        continue;
+
+      setup_packet (xfer[i], in);
+      if (in == QOOB_TRUE) {
+        memset (xfer[i]+USBFS_SETUP_SIZE, 0, QOOB_PRO_MAX_BUFFER);
+      } else {
+        memcpy (xfer[i]+USBFS_SETUP_SIZE, buf, QOOB_PRO_MAX_BUFFER);
+      }
+
+      memset (&urb[i], 0, sizeof (urb[i]));
+      urb[i].type = USBDEVFS_URB_TYPE_CONTROL;
+      urb[i].endpoint = 0;
+      urb[i].buffer = xfer[i];
+      urb[i].buffer_length = USBFS_URB_SIZE;
+      urb[i].usercontext = buf;
+
+      if (ioctl (qoob->fd, USBDEVFS_SUBMITURB, &urb[i]) < 0) {
+        ret = -errno;
+        goto cancel;
+      }
+      busy[i] = QOOB_TRUE;
+      submitted++;
+    }
+
+    r = usbfs_wait (qoob, timeout);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r < 0) {
+      ret = -errno;
+      goto cancel;
+    }
+    if (r == 0) {
+      ret = -ETIMEDOUT;
+      goto cancel;
+    }
+
+    while (ioctl (qoob->fd, USBDEVFS_REAPURBNDELAY, &reaped) == 0) {
+      int k = (int)(reaped - urb);
+
+      busy[k] = QOOB_FALSE;
+      done++;
+
+      if (reaped->status != 0) {
+        ret = reaped->status < 0 ? reaped->status : -EIO;
+        goto cancel;
+      }
+      if (in == QOOB_TRUE) {
+        memcpy (reaped->usercontext, 
+                xfer[k]+USBFS_SETUP_SIZE, 
+                QOOB_PRO_MAX_BUFFER);
+      }
+    }
+    if (errno != EAGAIN) {
+      ret = -errno;
+      goto cancel;
+    }
+  }
+
+  return count;
+
+ cancel:
+  /* URBs still queued are taken back before their buffers go away */
+  for (i=0; i<USBFS_IN_FLIGHT; i++) {
+    if (busy[i] == QOOB_TRUE)
+      ioctl (qoob->fd, USBDEVFS_DISCARDURB, &urb[i]);
+  }
+  /* One reap for each URB which was busy */
+  for (i=0; i<USBFS_IN_FLIGHT; i++) {
+    struct usbdevfs_urb *reaped;
+
+    if (busy[i] == QOOB_TRUE &&
+        ioctl (qoob->fd, USBDEVFS_REAPURB, &reaped) < 0)
+      break;
+  }
+
+  return ret;
+}
+
+/* usbfs node is writable when some URB is completed */
+static int
+usbfs_wait (struct Qoob *qoob, int timeout)
+{
+  struct pollfd pfd;
+
+  if (qoob->wait_cb != NULL) {
+    return qoob->wait_cb (qoob->fd, POLLOUT, timeout, qoob->wait_data);
+  }
+
+  pfd.fd = qoob->fd;
+  pfd.events = POLLOUT;
+  pfd.revents = 0;
+
+  return poll (&pfd, 1, timeout);
+}
+
+/* Setup packet of HID class request, wLength is packet size */
+static void
+setup_packet (unsigned char *setup, qoob_boolean_t in)
+{
+  int request = in == QOOB_TRUE ? 
+    QOOB_TRANSPORT_RECV_REQUEST : QOOB_TRANSPORT_SEND_REQUEST;
+  int value = in == QOOB_TRUE ? 
+    QOOB_TRANSPORT_RECV_VALUE : QOOB_TRANSPORT_SEND_VALUE;
+
+  setup[0] = in == QOOB_TRUE ? 
+    QOOB_TRANSPORT_TYPE_IN : QOOB_TRANSPORT_TYPE_OUT;
+  setup[1] = (unsigned char)request;
+  setup[2] = (unsigned char)(value & 0xff);
+  setup[3] = (unsigned char)(value >> 8);
+  setup[4] = 0;                             /* wIndex, interface 0 */
+  setup[5] = 0;
+  setup[6] = QOOB_PRO_MAX_BUFFER & 0xff;    /* wLength */
+  setup[7] = QOOB_PRO_MAX_BUFFER >> 8;
+}
+
+#else
+
+/* usbfs is Linux only. Opening fails so libusb is used instead. */
+static qoob_error_t
+usbfs_open (struct Qoob *qoob,
+            const char *bus,
+            const char *device)
+{
+  return QOOB_ERROR_NOT_FOUND;
+}
+
+static void
+usbfs_close (struct Qoob *qoob)
+{
+}
+
+static int
+usbfs_control (struct Qoob *qoob,
+               qoob_boolean_t in,
+               char *buf,
+               int timeout)
+{
+  return -ENODEV;
+}
+
+const qoob_transport_t qoob_transport_usbfs = {
+  "usbfs",
+  QOOB_TRANSPORT_USBFS,
+  usbfs_open,
+  usbfs_close,
+  usbfs_control,
+  NULL
+};
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
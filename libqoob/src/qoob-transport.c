@@ -0,0 +1,83 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+
+#include "qoob-transport.h"
+
+/*
+ * qoob_transport_get ()
+ *
+ * Transport of type. QOOB_TRANSPORT_AUTO has no own transport so NULL is
+ * returned for it.
+ */
+const qoob_transport_t *
+qoob_transport_get (qoob_transport_type_t type)
+{
+  switch (type) {
+#ifndef QOOB_MINIMAL
+  case QOOB_TRANSPORT_LIBUSB:
+    return &qoob_transport_libusb;
+#endif
+  case QOOB_TRANSPORT_USBFS:
+    return &qoob_transport_usbfs;
+  case QOOB_TRANSPORT_HIDRAW:
+    return &qoob_transport_hidraw;
+  default:
+    break;
+  }
+
+  return NULL;
+}
+
+/* Transport type by name: auto, libusb, usbfs or hidraw */
+qoob_error_t
+qoob_transport_parse (const char *name, 
+                      qoob_transport_type_t *type)
+{
+  if (name == NULL || type == NULL) {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  if (strcmp (name, "auto") == 0) {
+    *type = QOOB_TRANSPORT_AUTO;
+#ifndef QOOB_MINIMAL
+  } else if (strcmp (name, qoob_transport_libusb.name) == 0) {
+    *type = QOOB_TRANSPORT_LIBUSB;
+#endif
+  } else if (strcmp (name, qoob_transport_usbfs.name) == 0) {
+    *type = QOOB_TRANSPORT_USBFS;
+  } else if (strcmp (name, qoob_transport_hidraw.name) == 0) {
+    *type = QOOB_TRANSPORT_HIDRAW;
+  } else {
+    return QOOB_ERROR_INPUT_NOT_VALID;
+  }
+
+  return QOOB_ERROR_OK;
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
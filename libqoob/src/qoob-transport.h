@@ -0,0 +1,98 @@
+/* 
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "qoob-defaults.h"
+#include "qoob-error.h"
+
+#ifndef _QOOB_TRANSPORT_H_
+#define _QOOB_TRANSPORT_H_
+
+/*
+ * Transport moves 64 byte packets to and from the device. Packets are
+ * HID class requests to interface 0. libusb 0.1 works everywhere. usbfs
+ * talks to /dev/bus/usb directly on Linux and keeps several data packets 
+ * queued at once. hidraw sends the same requests as HID reports through
+ * usbhid on Linux, so interface is not claimed.
+ */
+
+#define QOOB_TRANSPORT_TYPE_OUT 0x21     /* Class, interface, to device */
+#define QOOB_TRANSPORT_TYPE_IN 0xa1      /* Class, interface, to host */
+#define QOOB_TRANSPORT_SEND_REQUEST 0x9  /* SET_REPORT */
+#define QOOB_TRANSPORT_SEND_VALUE 0x200  /* Output report 0 */
+#define QOOB_TRANSPORT_RECV_REQUEST 0x1  /* GET_REPORT */
+#define QOOB_TRANSPORT_RECV_VALUE 0x300  /* Feature report 0 */
+
+typedef enum {
+  QOOB_TRANSPORT_AUTO = 0,    /* First of usbfs, hidraw, libusb to open */
+  QOOB_TRANSPORT_LIBUSB,
+  QOOB_TRANSPORT_USBFS,
+  QOOB_TRANSPORT_HIDRAW
+} qoob_transport_type_t;
+
+struct Qoob;
+
+typedef struct QoobTransport qoob_transport_t;
+struct QoobTransport
+{
+  const char *name;
+  qoob_transport_type_t type;
+
+  /* Opens and claims device at bus and device, e.g. "001" "004" */
+  qoob_error_t (*open) (struct Qoob *qoob, 
+                        const char *bus, 
+                        const char *device);
+  void (*close) (struct Qoob *qoob);
+
+  /* One packet. Returns bytes moved or negative errno. */
+  int (*control) (struct Qoob *qoob, 
+                  qoob_boolean_t in, 
+                  char *buf, 
+                  int timeout);
+
+  /* count packets back to back, several of them in flight. timeout is 
+     for one packet. Returns count or negative errno. NULL if transport
+     can not queue packets. */
+  int (*control_many) (struct Qoob *qoob, 
+                       qoob_boolean_t in, 
+                       char *bufs, 
+                       int count, 
+                       int timeout);
+};
+
+#ifndef QOOB_MINIMAL
+extern const qoob_transport_t qoob_transport_libusb;
+#endif
+extern const qoob_transport_t qoob_transport_usbfs;
+extern const qoob_transport_t qoob_transport_hidraw;
+
+const qoob_transport_t *qoob_transport_get (qoob_transport_type_t type);
+qoob_error_t qoob_transport_parse (const char *name, 
+                                   qoob_transport_type_t *type);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
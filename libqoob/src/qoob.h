@@ -27,13 +27,52 @@
 /* Errors */
 #include "qoob-error.h"
 
-/* Errors */
+/* File formats */
 #include "qoob-file.h"
+#include "qoob-image.h"
+
+/* Image index */
+#include "qoob-digest.h"
+#ifndef QOOB_MINIMAL
+#include "qoob-index.h"
+
+/* Slot layout */
+#include "qoob-layout.h"
+#endif
+
+/* USB transports */
+#include "qoob-transport.h"
+
+/* Finding devices */
+#include "qoob-discover.h"
+
+/* Cancellation and deadlines */
+#include "qoob-cancel.h"
+
+/* Phase timing */
+#include "qoob-profile.h"
+
+/* Listed applications */
+#include "qoob-table.h"
+
+/* Device lock */
+#include "qoob-lock.h"
 
 /* Syncronous api */
 #include "qoob-sync.h"
 #include "qoob-sync-usb.h"
 
+#ifndef QOOB_MINIMAL
+/* Offline flash image */
+#include "qoob-compose.h"
+
+/* Backup archives */
+#include "qoob-archive.h"
+#endif
+
+/* Config slot */
+#include "qoob-config.h"
+
 /* Future asyncronous API
 
  TODO: Will done after syncronous one is in better than ok.
@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/time.h>
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <qoob.h>
+
+#include "qoob-flasher-util.h"
+#include "qoob-flasher-batch.h"
+
+/* 
+ * Batch mode runs commands of a script with one device session. Device
+ * is found, opened and listed once. Slot list is kept in memory between 
+ * commands and only slots which a command changed are listed again.
+ * Script is read and checked before device is opened.
+ */
+
+#define BATCH_LINE_MAX 4096
+
+typedef struct Batch batch_t;
+struct Batch
+{
+  qoob_flasher_t *flasher;
+  qoob_flasher_step_t *steps;
+  int count;
+  int relisted;               /* Slots listed again after changes */
+};
+
+static qoob_error_t batch_load (batch_t *batch, int *line);
+static void batch_free (batch_t *batch);
+static qoob_error_t open_device (qoob_flasher_t *flasher);
+static qoob_error_t run_step (batch_t *batch, qoob_flasher_step_t *step);
+static qoob_error_t relist (batch_t *batch, 
+                            short int slot_from, 
+                            short int slot_to);
+static double elapsed (const struct timeval *start);
+
+/*
+ * Runs commands until one fails. Returns exit status of qoob-flasher.
+ */
+int
+qoob_flasher_batch_run (qoob_flasher_t *flasher)
+{
+  batch_t batch;
+  struct timeval start;
+  qoob_error_t err;
+  int line;
+  int i;
+
+  memset (&batch, 0, sizeof (batch));
+  batch.flasher = flasher;
+
+  err = batch_load (&batch, &line);
+  if (err != QOOB_ERROR_OK) {
+    if (line > 0) {
+      printf ("Error: %s:%d: invalid command\n", flasher->batch_file, line);
+    } else {
+      printf ("Error: %s: %s\n", 
+              flasher->batch_file, qoob_error_to_string (err));
+    }
+    batch_free (&batch);
+    return 1;
+  }
+
+  gettimeofday (&start, NULL);
+
+  err = open_device (flasher);
+  if (err != QOOB_ERROR_OK) {
+    printf ("Error: %s\n", qoob_error_to_string (err));
+    batch_free (&batch);
+    return 1;
+  }
+
+  for (i=0; i<batch.count; i++) {
+    qoob_flasher_step_t *step = &batch.steps[i];
+
+    err = qoob_cancel_check (&flasher->cancel);
+    if (err == QOOB_ERROR_OK) {
+      err = run_step (&batch, step);
+    }
+    if (err != QOOB_ERROR_OK) {
+      printf ("Error: %s:%d: %s\n", 
+              flasher->batch_file, step->line, qoob_error_to_string (err));
+      batch_free (&batch);
+      return 1;
+    }
+  }
+
+  if (flasher->verbose > 0) {
+    printf ("\n%d command(s) done in %.2f s. %d slot(s) listed again.\n",
+            batch.count, elapsed (&start), batch.relisted);
+  }
+
+  batch_free (&batch);
+
+  return 0;
+}
+
+/* Static functions */
+
+/* Line is set to the invalid line or zero if file could not be read */
+static qoob_error_t
+batch_load (batch_t *batch, int *line)
+{
+  FILE *fp;
+  char buf[BATCH_LINE_MAX];
+  int allocated = 0;
+  int n = 0;
+
+  *line = 0;
+
+  if (strcmp (batch->flasher->batch_file, "-") == 0) {
+    fp = stdin;
+  } else {
+    fp = fopen (batch->flasher->batch_file, "r");
+    if (fp == NULL) {
+      return QOOB_ERROR_FD_OPEN;
+    }
+  }
+
+  while (fgets (buf, sizeof (buf), fp) != NULL) {
+    qoob_flasher_step_t *step;
+    char *p;
+    int len;
+
+    n++;
+
+    len = strlen (buf);
+    while (len > 0 && isspace ((unsigned char)buf[len-1]))
+      buf[--len] = '\0';
+    for (p = buf; isspace ((unsigned char)*p); p++)
+      ;
+    if (*p == '\0' || *p == '#')
+      continue;
+
+    if (batch->count == allocated) {
+      qoob_flasher_step_t *steps;
+
+      allocated = allocated > 0 ? allocated*2 : 16;
+      steps = realloc (batch->steps, 
+                       sizeof (qoob_flasher_step_t) * allocated);
+      if (steps == NULL) {
+        /* Steps read so far are freed by batch_free () */
+        if (fp != stdin)
+          fclose (fp);
+        return QOOB_ERROR_NO_MEMORY;
+      }
+      batch->steps = steps;
+    }
+
+    step = &batch->steps[batch->count];
+    if (qoob_flasher_util_parse_step (p, step) != 0) {
+      if (fp != stdin)
+        fclose (fp);
+      *line = n;
+      return QOOB_ERROR_INPUT_NOT_VALID;
+    }
+    step->line = n;
+    batch->count++;
+  }
+
+  if (fp != stdin)
+    fclose (fp);
+
+  return QOOB_ERROR_OK;
+}
+
+static void
+batch_free (batch_t *batch)
+{
+  int i;
+
+  for (i=0; i<batch->count; i++) {
+    free (batch->steps[i].file);
+  }
+  free (batch->steps);
+  batch->steps = NULL;
+  batch->count = 0;
+}
+
+/* Opened and listed once for every command */
+static qoob_error_t
+open_device (qoob_flasher_t *flasher)
+{
+  qoob_error_t err;
+
+  if (flasher->device_path != NULL) {
+    err = qoob_sync_usb_find_path (&flasher->qoob, flasher->device_path);
+  } else {
+    err = qoob_sync_usb_find (&flasher->qoob);
+  }
+  if (err != QOOB_ERROR_OK) {
+    return err;
+  }
+
+  qoob_sync_slot_free (flasher->slots);
+  flasher->slots = NULL;
+
+  return qoob_sync_usb_list (&flasher->qoob, &flasher->slots);
+}
+
+static qoob_error_t
+run_step (batch_t *batch, qoob_flasher_step_t *step)
+{
+  qoob_flasher_t *flasher = batch->flasher;
+  qoob_error_t err;
+  short int last;
+
+  switch (step->command) {
+  case FLASHER_COMMAND_LIST:
+    qoob_flasher_util_print_slots (flasher->slots);
+    return QOOB_ERROR_OK;
+
+  case FLASHER_COMMAND_READ:
+    if (flasher->verbose > 0) {
+      printf ("Reading slot [%02d] to %s.\n", step->slot_num, step->file);
+    }
+    return qoob_sync_usb_read (&flasher->qoob, step->file, step->slot_num);
+
+  case FLASHER_COMMAND_WRITE:
+    if (flasher->verbose > 0) {
+      printf ("Writing %s to slot [%02d].\n", step->file, step->slot_num);
+    }
+    qoob_sync_file_format_set (&flasher->qoob, step->type);
+    err = qoob_sync_usb_write (&flasher->qoob, step->file, step->slot_num);
+    if (err != QOOB_ERROR_OK) {
+      return err;
+    }
+
+    /* Header of the first slot tells the rest */
+    return relist (batch, step->slot_num, step->slot_num);
+
+  case FLASHER_COMMAND_VERIFY:
+    if (flasher->verbose > 0) {
+      printf ("Verifying %s at slot [%02d].\n", step->file, step->slot_num);
+    }
+    qoob_sync_file_format_set (&flasher->qoob, step->type);
+    err = qoob_sync_usb_verify_header (&flasher->qoob, 
+                                       step->file, 
+                                       step->slot_num);
+    if (err == QOOB_ERROR_DIGEST_MISSING) {
+      err = qoob_sync_usb_verify (&flasher->qoob, 
+                                  step->file, 
+                                  step->slot_num);
+    }
+    return err;
+
+  case FLASHER_COMMAND_ERASE:
+    if (flasher->verbose > 0) {
+      printf ("Erasing application at slot [%02d].\n", step->slot_num);
+    }
+    last = step->slot_num + flasher->slots[step->slot_num].slots_used - 1;
+    err = qoob_sync_usb_erase (&flasher->qoob, step->slot_num);
+    if (err != QOOB_ERROR_OK) {
+      return err;
+    }
+    return relist (batch, step->slot_num, last);
+
+  case FLASHER_COMMAND_FORCE_ERASE:
+    if (flasher->verbose > 0) {
+      printf ("Erasing slot [%02d].\n", step->slot_num);
+    }
+    err = qoob_sync_usb_erase_forced (&flasher->qoob, 
+                                      step->slot_num, 
+                                      step->slot_num);
+    if (err != QOOB_ERROR_OK) {
+      return err;
+    }
+    return relist (batch, step->slot_num, step->slot_num);
+
+  default:
+    break;
+  }
+
+  return QOOB_ERROR_INPUT_NOT_VALID;
+}
+
+/* Changed slots are listed again. -s prints the list after change. */
+static qoob_error_t
+relist (batch_t *batch, 
+        short int slot_from, 
+        short int slot_to)
+{
+  qoob_flasher_t *flasher = batch->flasher;
+  qoob_slot_t *slots = NULL;
+  unsigned long completed = 0;
+  qoob_error_t err;
+
+  err = qoob_sync_usb_list_range (&flasher->qoob, slot_from, slot_to, 
+                                  &slots);
+  if (err != QOOB_ERROR_OK) {
+    return err;
+  }
+  qoob_sync_slot_free (flasher->slots);
+  flasher->slots = slots;
+
+  qoob_sync_completed_get (&flasher->qoob, &completed);
+  for (; completed != 0; completed &= completed-1)
+    batch->relisted++;
+
+  if (flasher->list == QOOB_TRUE) {
+    qoob_flasher_util_print_slots (flasher->slots);
+  }
+
+  return QOOB_ERROR_OK;
+}
+
+static double
+elapsed (const struct timeval *start)
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+
+  return (now.tv_sec-start->tv_sec) + (now.tv_usec-start->tv_usec)/1e6;
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <qoob.h>
+
+#include "qoob-flasher-util.h"
+#include "qoob-flasher-client.h"
+#include "qoob-flasherd-proto.h"
+
+static char *absolute_path (const char *file);
+static void parse_slot (qoob_slot_t *slots, const char *line);
+
+/*
+ * Returns connected socket or -1 if qoob-flasherd is not running or it is
+ * run by other user.
+ */
+int
+qoob_flasher_client_connect (const char *path)
+{
+  struct sockaddr_un addr;
+  int fd;
+
+  if (path == NULL || strlen (path) >= sizeof (addr.sun_path)) {
+    return -1;
+  }
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, path);
+
+  fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+
+  if (connect (fd, (struct sockaddr *)&addr, sizeof (addr)) != 0 ||
+      flasherd_proto_peer_is_user (fd) == QOOB_FALSE) {
+    close (fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+/*
+ * Sends command of the flasher to daemon and waits until it is done.
+ * Progress is given to cb same way as libqoob does. Slot table from the
+ * daemon is stored to flasher->slots. Closes flasher->daemon_fd.
+ */
+qoob_error_t
+qoob_flasher_client_run (qoob_flasher_t *flasher,
+                         void (*cb)(qoob_sync_callback_t type,
+                                    int progress,
+                                    int total,
+                                    void *user_data))
+{
+  const char *command;
+  char *file = NULL;
+  char line[FLASHERD_LINE_MAX];
+  binary_type_t type;
+  qoob_minimize_t minimize;
+  qoob_boolean_t sparse;
+  short int slot = flasher->slot_num;
+  short int slot_to = flasher->slot_num;
+  qoob_error_t ret = QOOB_ERROR_FD_READ;
+  FILE *f;
+
+  switch (flasher->command) {
+  case FLASHER_COMMAND_READ:
+    command = FLASHERD_REQ_READ;
+    break;
+  case FLASHER_COMMAND_WRITE:
+    command = FLASHERD_REQ_WRITE;
+    break;
+  case FLASHER_COMMAND_ERASE:
+    command = FLASHERD_REQ_ERASE;
+    break;
+  case FLASHER_COMMAND_FORCE_ERASE:
+    command = FLASHERD_REQ_FORCE_ERASE;
+    slot = flasher->erase_from;
+    slot_to = flasher->erase_to;
+    break;
+  case FLASHER_COMMAND_VERIFY:
+    command = FLASHERD_REQ_VERIFY;
+    break;
+  default:
+    command = FLASHERD_REQ_LIST;
+    break;
+  }
+
+  if (flasher->file != NULL &&
+      (flasher->command == FLASHER_COMMAND_READ ||
+       flasher->command == FLASHER_COMMAND_WRITE ||
+       flasher->command == FLASHER_COMMAND_VERIFY)) {
+    file = absolute_path (flasher->file);
+    if (file == NULL) {
+      return QOOB_ERROR_NO_MEMORY;
+    }
+  }
+
+  qoob_sync_file_format_get (&flasher->qoob, &type);
+  qoob_sync_minimize_get (&flasher->qoob, &minimize);
+  qoob_sync_sparse_get (&flasher->qoob, &sparse);
+
+  snprintf (line, sizeof (line), "%s %d %d %d %d %d %d %s\n",
+            command,
+            flasher->priority,
+            (int)slot,
+            (int)slot_to,
+            (int)type,
+            (int)minimize,
+            (int)sparse,
+            file != NULL ? file : FLASHERD_NO_FILE);
+  free (file);
+
+  if (write (flasher->daemon_fd, line, strlen (line)) != strlen (line)) {
+    close (flasher->daemon_fd);
+    flasher->daemon_fd = -1;
+    return QOOB_ERROR_FD_WRITE;
+  }
+
+  f = fdopen (flasher->daemon_fd, "r");
+  if (f == NULL) {
+    close (flasher->daemon_fd);
+    flasher->daemon_fd = -1;
+    return QOOB_ERROR_FD_OPEN;
+  }
+  flasher->daemon_fd = -1;
+
+  if (flasher->slots == NULL) {
+    flasher->slots = calloc (QOOB_PRO_SLOTS, sizeof (qoob_slot_t));
+    if (flasher->slots == NULL) {
+      fclose (f);
+      return QOOB_ERROR_NO_MEMORY;
+    }
+  }
+
+  while (fgets (line, sizeof (line), f) != NULL) {
+    int a, b, c;
+
+    line[strcspn (line, "\n")] = '\0';
+
+    if (sscanf (line, FLASHERD_REP_PROGRESS " %d %d %d", &a, &b, &c) == 3) {
+      cb ((qoob_sync_callback_t)a, b, c, flasher);
+    } else if (strncmp (line, FLASHERD_REP_SLOT " ", 
+                        strlen (FLASHERD_REP_SLOT " ")) == 0) {
+      parse_slot (flasher->slots, line);
+    } else if (sscanf (line, FLASHERD_REP_QUEUED " %d", &a) == 1) {
+      if (flasher->verbose > 0 && a > 0) {
+        printf ("Waiting for %d job(s) in qoob-flasherd queue.\n", a);
+      }
+    } else if (sscanf (line, FLASHERD_REP_ERROR " %d", &a) == 1) {
+      ret = (qoob_error_t)a;
+      break;
+    } else if (strcmp (line, FLASHERD_REP_OK) == 0) {
+      ret = QOOB_ERROR_OK;
+      break;
+    }
+  }
+
+  fclose (f);
+
+  return ret;
+}
+
+/* Daemon has other working directory */
+static char *
+absolute_path (const char *file)
+{
+  char cwd[FLASHERD_LINE_MAX];
+  char *path;
+
+  if (file[0] == QOOB_DIRECTORY_SEPARATOR) {
+    return strdup (file);
+  }
+
+  if (getcwd (cwd, sizeof (cwd)) == NULL) {
+    return NULL;
+  }
+
+  path = malloc (strlen (cwd) + strlen (file) + 2);
+  if (path == NULL) {
+    return NULL;
+  }
+  sprintf (path, "%s%c%s", cwd, QOOB_DIRECTORY_SEPARATOR, file);
+
+  return path;
+}
+
+static void
+parse_slot (qoob_slot_t *slots, const char *line)
+{
+  int num, type, used, first;
+  unsigned long length;
+  char digest[QOOB_DIGEST_STRING_SIZE];
+  int n = 0;
+
+  /* Name may start with spaces. Only the separator is skipped. */
+  if (sscanf (line, FLASHERD_REP_SLOT " %d %d %d %d %lu %64s%n",
+              &num, &type, &used, &first, &length, digest, &n) != 6 || 
+      line[n] != ' ') {
+    return;
+  }
+  n++;
+  if (num < 0 || num >= QOOB_PRO_SLOTS) {
+    return;
+  }
+
+  slots[num].type = (binary_type_t)type;
+  slots[num].slots_used = (unsigned short int)used;
+  slots[num].first = first ? QOOB_TRUE : QOOB_FALSE;
+  slots[num].length = length;
+  slots[num].has_digest = 
+    qoob_digest_from_string (digest, slots[num].digest) == 0 ? 
+    QOOB_TRUE : QOOB_FALSE;
+  memset (slots[num].name, 0, sizeof (slots[num].name));
+  strncpy (slots[num].name, line+n, sizeof (slots[num].name)-1);
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
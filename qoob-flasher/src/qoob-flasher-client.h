@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#include "qoob.h"
+
+#include "qoob-flasher-util.h"
+
+#ifndef _QOOB_FLASHER_CLIENT_H_
+#define _QOOB_FLASHER_CLIENT_H_
+
+int qoob_flasher_client_connect (const char *path);
+qoob_error_t qoob_flasher_client_run (qoob_flasher_t *flasher,
+                                      void (*cb)(qoob_sync_callback_t type,
+                                                 int progress,
+                                                 int total,
+                                                 void *user_data));
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
@@ -0,0 +1,544 @@
+/*
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+
+#ifdef __linux__
+# include <linux/netlink.h>
+#endif
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <qoob.h>
+
+#include "qoob-flasher-util.h"
+#include "qoob-flasher-station.h"
+
+/* 
+ * Station mode flashes every QoobPro plugged in. Kernel uevents tell when
+ * device is plugged in. Bus list is also read again every second because 
+ * libusb-0.1 has no hotplug support and device node may appear after the 
+ * event. Each device is flashed in own process as libusb-0.1 is not
+ * thread safe.
+ */
+
+#define STATION_POLL_MS 1000
+#define STATION_OPEN_TRIES 20
+#define STATION_OPEN_DELAY_US 100000
+#define STATION_UEVENT_SIZE 4096
+#define STATION_NAME_SIZE 16
+
+typedef enum {
+  PORT_FREE,
+  PORT_BUSY,                  /* Child is flashing */
+  PORT_DONE                   /* Result told. Waiting for unplug */
+} port_state_t;
+
+typedef struct StationPort station_port_t;
+struct StationPort
+{
+  port_state_t state;
+  char bus[STATION_NAME_SIZE];
+  char device[STATION_NAME_SIZE];
+  pid_t pid;
+  struct timeval start;
+  qoob_boolean_t present;     /* Found in the latest scan */
+};
+
+typedef struct Station station_t;
+struct Station
+{
+  qoob_flasher_t *flasher;
+  qoob_layout_t layout;
+  station_port_t port[STATION_PORTS_MAX];
+  struct timeval start;
+  int passed;
+  int failed;
+};
+
+static volatile sig_atomic_t stop = 0;
+
+static int uevent_open (void);
+static qoob_boolean_t uevent_is_qoob (int fd);
+static void scan_devices (station_t *station);
+static void start_device (station_t *station, 
+                          const char *bus, 
+                          const char *device);
+static void reap_devices (station_t *station, 
+                          qoob_boolean_t block);
+static int flash_device (station_t *station, 
+                         const char *bus, 
+                         const char *device);
+static qoob_error_t flash_entry (station_t *station, 
+                                 const char *tag,
+                                 qoob_layout_entry_t *e);
+static qoob_error_t list_slots (qoob_flasher_t *flasher);
+static double elapsed (const struct timeval *start);
+static void on_signal (int sig);
+
+/*
+ * Runs until SIGINT or SIGTERM. Returns exit status of qoob-flasher.
+ */
+int
+qoob_flasher_station_run (qoob_flasher_t *flasher)
+{
+  station_t station;
+  struct sigaction sa;
+  struct pollfd pfd;
+  qoob_error_t err;
+  int line;
+  int busy;
+  int i;
+
+  memset (&station, 0, sizeof (station));
+  station.flasher = flasher;
+
+  err = qoob_layout_load (&station.layout, flasher->layout_file, &line);
+  if (err != QOOB_ERROR_OK) {
+    if (line > 0) {
+      printf ("Error: %s:%d: %s\n", 
+              flasher->layout_file, line, qoob_error_to_string (err));
+    } else {
+      printf ("Error: %s: %s\n", 
+              flasher->layout_file, qoob_error_to_string (err));
+    }
+    return 1;
+  }
+
+  printf ("Station layout %s:\n", flasher->layout_file);
+  for (i=0; i<station.layout.count; i++) {
+    qoob_layout_entry_t *e = &station.layout.entries[i];
+
+    printf (" [%02d]\t[%s]\t%d slot(s)\t%s\n", 
+            e->slot,
+            qoob_file_format_to_string (e->type),
+            e->slots_used,
+            e->file);
+  }
+  printf ("Waiting for devices. Stop with Ctrl-C.\n");
+  fflush (stdout);
+
+  /* Poll is interrupted when child exits or user stops */
+  memset (&sa, 0, sizeof (sa));
+  sa.sa_handler = on_signal;
+  sigemptyset (&sa.sa_mask);
+  sigaction (SIGINT, &sa, NULL);
+  sigaction (SIGTERM, &sa, NULL);
+  sigaction (SIGCHLD, &sa, NULL);
+
+  pfd.fd = uevent_open ();
+  pfd.events = POLLIN;
+
+  gettimeofday (&station.start, NULL);
+
+  /* Devices plugged in before start */
+  scan_devices (&station);
+
+  while (!stop) {
+    int r;
+
+    r = poll (&pfd, pfd.fd >= 0 ? 1 : 0, STATION_POLL_MS);
+    reap_devices (&station, QOOB_FALSE);
+
+    if (r == 0 ||
+        (r > 0 && uevent_is_qoob (pfd.fd) == QOOB_TRUE)) {
+      scan_devices (&station);
+    }
+  }
+
+  if (pfd.fd >= 0)
+    close (pfd.fd);
+
+  /* Let started devices finish. They ignore SIGINT. */
+  busy = 0;
+  for (i=0; i<STATION_PORTS_MAX; i++) {
+    if (station.port[i].state == PORT_BUSY)
+      busy++;
+  }
+  if (busy > 0) {
+    printf ("Waiting for %d device(s) to finish.\n", busy);
+    fflush (stdout);
+    reap_devices (&station, QOOB_TRUE);
+  }
+
+  printf ("\nStation stopped. %d passed, %d failed in %.0f s", 
+          station.passed, 
+          station.failed, 
+          elapsed (&station.start));
+  if (elapsed (&station.start) > 0) {
+    printf (" (%.0f devices per hour)", 
+            (station.passed+station.failed)*3600.0/
+            elapsed (&station.start));
+  }
+  printf (".\n");
+
+  qoob_layout_free (&station.layout);
+
+  return station.failed > 0 ? 1 : 0;
+}
+
+/* Static functions */
+static int
+uevent_open (void)
+{
+#ifdef __linux__
+  struct sockaddr_nl addr;
+  int fd;
+
+  fd = socket (AF_NETLINK, SOCK_DGRAM, NETLINK_KOBJECT_UEVENT);
+  if (fd < 0) {
+    return -1;
+  }
+
+  memset (&addr, 0, sizeof (addr));
+  addr.nl_family = AF_NETLINK;
+  addr.nl_pid = getpid ();
+  addr.nl_groups = 1;         /* Kernel events */
+  if (bind (fd, (struct sockaddr *)&addr, sizeof (addr)) < 0) {
+    close (fd);
+    return -1;
+  }
+
+  return fd;
+#else
+  return -1;
+#endif
+}
+
+/*
+ * Reads one uevent. Event is "ACTION@DEVPATH" followed by zero separated 
+ * KEY=VALUE pairs.
+ */
+static qoob_boolean_t
+uevent_is_qoob (int fd)
+{
+  char buf[STATION_UEVENT_SIZE];
+  qoob_boolean_t usb_device = QOOB_FALSE;
+  qoob_boolean_t qoob = QOOB_FALSE;
+  ssize_t len;
+  ssize_t i;
+  char product[STATION_NAME_SIZE];
+
+  len = recv (fd, buf, sizeof (buf)-1, MSG_DONTWAIT);
+  if (len <= 0) {
+    return QOOB_FALSE;
+  }
+  buf[len] = '\0';
+
+  snprintf (product, sizeof (product), "PRODUCT=%x/%x/", 
+            QOOB_PRO_VENDOR, QOOB_PRO_PRODUCT);
+
+  for (i=0; i<len; i+=strlen (buf+i)+1) {
+    if (strcmp (buf+i, "DEVTYPE=usb_device") == 0)
+      usb_device = QOOB_TRUE;
+    else if (strncmp (buf+i, product, strlen (product)) == 0)
+      qoob = QOOB_TRUE;
+  }
+
+  return (usb_device == QOOB_TRUE && qoob == QOOB_TRUE) ? 
+    QOOB_TRUE : QOOB_FALSE;
+}
+
+static void
+scan_devices (station_t *station)
+{
+  qoob_t *qoob = &station->flasher->qoob;
+  qoob_device_t found[QOOB_DISCOVER_MAX];
+  int count = 0;
+  int i, j;
+
+  if (qoob_sync_rescan (qoob) != QOOB_ERROR_OK) {
+    return;
+  }
+
+  for (i=0; i<STATION_PORTS_MAX; i++) {
+    station->port[i].present = QOOB_FALSE;
+  }
+
+  qoob_discover_all (qoob, found, QOOB_DISCOVER_MAX, &count);
+
+  for (j=0; j<count; j++) {
+    qoob_boolean_t known = QOOB_FALSE;
+
+    for (i=0; i<STATION_PORTS_MAX; i++) {
+      station_port_t *p = &station->port[i];
+
+      if (p->state != PORT_FREE &&
+          strcmp (p->bus, found[j].bus) == 0 &&
+          strcmp (p->device, found[j].device) == 0) {
+        p->present = QOOB_TRUE;
+        known = QOOB_TRUE;
+      }
+    }
+    if (known == QOOB_FALSE) {
+      start_device (station, found[j].bus, found[j].device);
+    }
+  }
+
+  /* Unplugged. Same address can be flashed again. */
+  for (i=0; i<STATION_PORTS_MAX; i++) {
+    station_port_t *p = &station->port[i];
+
+    if (p->state == PORT_DONE && p->present == QOOB_FALSE) {
+      if (station->flasher->verbose > 0) {
+        printf ("[%s-%s] unplugged\n", p->bus, p->device);
+        fflush (stdout);
+      }
+      p->state = PORT_FREE;
+    }
+  }
+}
+
+static void
+start_device (station_t *station, 
+              const char *bus, 
+              const char *device)
+{
+  station_port_t *p = NULL;
+  pid_t pid;
+  int i;
+
+  for (i=0; i<STATION_PORTS_MAX; i++) {
+    if (station->port[i].state == PORT_FREE) {
+      p = &station->port[i];
+      break;
+    }
+  }
+  if (p == NULL) {
+    return;
+  }
+
+  snprintf (p->bus, sizeof (p->bus), "%.*s", 
+            (int)sizeof (p->bus)-1, bus);
+  snprintf (p->device, sizeof (p->device), "%.*s", 
+            (int)sizeof (p->device)-1, device);
+  p->present = QOOB_TRUE;
+  gettimeofday (&p->start, NULL);
+
+  printf ("[%s-%s] started\n", p->bus, p->device);
+  fflush (stdout);
+
+  pid = fork ();
+  if (pid < 0) {
+    printf ("[%s-%s] Error: %s\n", p->bus, p->device, strerror (errno));
+    fflush (stdout);
+    return;
+  }
+  if (pid == 0) {
+    /* Flashing is not interrupted when station is stopped */
+    signal (SIGINT, SIG_IGN);
+    signal (SIGTERM, SIG_IGN);
+    signal (SIGCHLD, SIG_DFL);
+    fflush (stdout);
+    _exit (flash_device (station, p->bus, p->device));
+  }
+
+  p->pid = pid;
+  p->state = PORT_BUSY;
+}
+
+static void
+reap_devices (station_t *station, 
+              qoob_boolean_t block)
+{
+  pid_t pid;
+  int status;
+  int i;
+
+  while ((pid = waitpid (-1, &status, block == QOOB_TRUE ? 0 : WNOHANG)) > 0) {
+    for (i=0; i<STATION_PORTS_MAX; i++) {
+      station_port_t *p = &station->port[i];
+      qoob_boolean_t pass;
+
+      if (p->state != PORT_BUSY || p->pid != pid)
+        continue;
+
+      pass = (WIFEXITED (status) && WEXITSTATUS (status) == 0) ? 
+        QOOB_TRUE : QOOB_FALSE;
+      if (pass == QOOB_TRUE)
+        station->passed++;
+      else
+        station->failed++;
+
+      printf ("[%s-%s] %s in %.1f s. %d passed, %d failed.\n", 
+              p->bus,
+              p->device,
+              pass == QOOB_TRUE ? "PASS" : "FAIL",
+              elapsed (&p->start),
+              station->passed,
+              station->failed);
+      fflush (stdout);
+
+      p->state = PORT_DONE;
+    }
+  }
+}
+
+/*
+ * Child process. Opens device at given address and makes flash to match
+ * the layout. Returns zero if all entries are flashed.
+ */
+static int
+flash_device (station_t *station, 
+              const char *bus, 
+              const char *device)
+{
+  qoob_flasher_t *flasher = station->flasher;
+  qoob_t *qoob = &flasher->qoob;
+  char tag[STATION_NAME_SIZE*2+2];
+  qoob_error_t err = QOOB_ERROR_NOT_FOUND;
+  int i;
+
+  snprintf (tag, sizeof (tag), "%s-%s", bus, device);
+
+  /* Device node may not be ready or accessible yet */
+  for (i=0; i<STATION_OPEN_TRIES; i++) {
+    err = qoob_sync_rescan (qoob);
+    if (err == QOOB_ERROR_OK) {
+      err = qoob_sync_usb_find_device (qoob, bus, device);
+    }
+    if (err != QOOB_ERROR_NOT_FOUND && 
+        err != QOOB_ERROR_CLAIM_INTERFACE) {
+      break;
+    }
+    usleep (STATION_OPEN_DELAY_US);
+  }
+
+  if (err == QOOB_ERROR_OK) {
+    err = list_slots (flasher);
+  }
+
+  for (i=0; err == QOOB_ERROR_OK && i<station->layout.count; i++) {
+    err = flash_entry (station, tag, &station->layout.entries[i]);
+  }
+
+  if (err != QOOB_ERROR_OK) {
+    printf ("[%s] Error: %s\n", tag, qoob_error_to_string (err));
+  }
+  fflush (stdout);
+
+  qoob_sync_usb_clear (qoob);
+
+  return err == QOOB_ERROR_OK ? 0 : 1;
+}
+
+static qoob_error_t
+flash_entry (station_t *station, 
+             const char *tag,
+             qoob_layout_entry_t *e)
+{
+  qoob_flasher_t *flasher = station->flasher;
+  qoob_t *qoob = &flasher->qoob;
+  short int from = e->slot;
+  short int to = e->slot+e->slots_used-1;
+  const qoob_app_t *app;
+  qoob_error_t err;
+
+  qoob_sync_file_format_set (qoob, e->type);
+
+  /* Digest in the header is enough to skip flashed entry. Content is
+     still compared after writing. */
+  err = qoob_sync_usb_verify_header (qoob, e->file, e->slot);
+  if (err == QOOB_ERROR_DIGEST_MISSING)
+    err = qoob_sync_usb_verify (qoob, e->file, e->slot);
+  if (err == QOOB_ERROR_OK) {
+    if (flasher->verbose > 0) {
+      printf ("[%s] [%02d] %s is flashed\n", tag, e->slot, e->file);
+    }
+    return err;
+  }
+  if (err != QOOB_ERROR_VERIFY_FAILED &&
+      err != QOOB_ERROR_SLOT_NOT_FIRST) {
+    return err;
+  }
+
+  /* Whole applications are erased, not only the slots layout needs */
+  app = qoob_table_app_at (qoob_sync_table_get (qoob), from);
+  if (app != NULL)
+    from = app->slot;
+  app = qoob_table_app_at (qoob_sync_table_get (qoob), to);
+  if (app != NULL)
+    to = app->slot + app->slots_used - 1;
+
+  if (flasher->verbose > 0) {
+    printf ("[%s] [%02d] writing %s\n", tag, e->slot, e->file);
+    fflush (stdout);
+  }
+
+  err = qoob_sync_usb_erase_forced (qoob, from, to);
+  if (err == QOOB_ERROR_OK)
+    err = list_slots (flasher);
+  if (err == QOOB_ERROR_OK)
+    err = qoob_sync_usb_write (qoob, e->file, e->slot);
+  if (err == QOOB_ERROR_OK)
+    err = list_slots (flasher);
+  if (err == QOOB_ERROR_OK)
+    err = qoob_sync_usb_verify (qoob, e->file, e->slot);
+
+  return err;
+}
+
+/* Slot list is read again after flash is changed */
+static qoob_error_t
+list_slots (qoob_flasher_t *flasher)
+{
+  qoob_sync_slot_free (flasher->slots);
+  flasher->slots = NULL;
+
+  return qoob_sync_usb_list (&flasher->qoob, &flasher->slots);
+}
+
+static double
+elapsed (const struct timeval *start)
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+
+  return (now.tv_sec-start->tv_sec) + (now.tv_usec-start->tv_usec)/1e6;
+}
+
+static void
+on_signal (int sig)
+{
+  if (sig != SIGCHLD)
+    stop = 1;
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
@@ -22,6 +22,10 @@
 #include <getopt.h>
 #include <string.h>
 
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
 #include <qoob.h>
 
 #include "qoob-flasher-util.h"
@@ -43,12 +47,35 @@ qoob_flasher_util_parse_options (qoob_flasher_t *flasher,
       {"read", required_argument, 0, 'r'},
       {"force-erase", required_argument, 0, 'f'},
       {"erase", required_argument, 0, 'e'},
+      {"index", required_argument, 0, 'i'},
+      {"scan", required_argument, 0, 'S'},
+      {"images", no_argument, 0, 'I'},
+      {"minimize", optional_argument, 0, 'm'},
+      {"sparse", no_argument, 0, 'p'},
+      {"verify", required_argument, 0, 'c'},
+      {"no-daemon", no_argument, 0, 'n'},
+      {"priority", required_argument, 0, 'P'},
+      {"socket", required_argument, 0, 'k'},
+      {"timeout", required_argument, 0, 't'},
+      {"retries", required_argument, 0, 'R'},
+      {"station", required_argument, 0, 'b'},
+      {"transport", required_argument, 0, 'T'},
+      {"device", required_argument, 0, 'D'},
+      {"deadline", required_argument, 0, 'W'},
+      {"watch", no_argument, 0, 'a'},
+      {"batch", required_argument, 0, 'B'},
+      {"profile", optional_argument, 0, 'o'},
+      {"compose", required_argument, 0, 'x'},
+      {"backup", optional_argument, 0, 'z'},
+      {"restore", optional_argument, 0, 'Z'},
+      {"config-get", required_argument, 0, 'g'},
+      {"config-set", required_argument, 0, 'G'},
       {0, 0, 0, 0}
     };
 
     int index = 0;
      
-    char c = getopt_long (*argc, *argv, "hvsldqw:r:f:e:", long_options, &index);
+    char c = getopt_long (*argc, *argv, "hvsldqw:r:f:e:i:S:Im::pc:nP:k:t:R:b:T:D:W:aB:o::x:z::Z::g:G:", long_options, &index);
      
     if (c == -1)
       break;
@@ -91,6 +118,128 @@ qoob_flasher_util_parse_options (qoob_flasher_t *flasher,
       flasher->command = FLASHER_COMMAND_FORCE_ERASE;
       flasher->slot_num = (int)strtol (optarg, NULL, 10);
       break;
+    case 'i':
+      free (flasher->index_file);
+      flasher->index_file = strdup (optarg);
+      break;
+    case 'S':
+      flasher->command = FLASHER_COMMAND_SCAN;
+      free (flasher->scan_dir);
+      flasher->scan_dir = strdup (optarg);
+      break;
+    case 'I':
+      flasher->command = FLASHER_COMMAND_IMAGES;
+      break;
+    case 'm':
+      if (optarg == NULL || strcmp (optarg, "strip") == 0) {
+        qoob_sync_minimize_set (&flasher->qoob, QOOB_MINIMIZE_STRIP);
+      } else if (strcmp (optarg, "dol") == 0) {
+        qoob_sync_minimize_set (&flasher->qoob, QOOB_MINIMIZE_DOL);
+      } else {
+        flasher->help = QOOB_TRUE;
+      }
+      break;
+    case 'p':
+      qoob_sync_sparse_set (&flasher->qoob, QOOB_TRUE);
+      break;
+    case 'c':
+      flasher->command = FLASHER_COMMAND_VERIFY;
+      flasher->slot_num = (int)strtol (optarg, NULL, 10);
+      break;
+    case 'n':
+      flasher->daemon = QOOB_FALSE;
+      break;
+    case 'P':
+      flasher->priority = (int)strtol (optarg, NULL, 10);
+      break;
+    case 'k':
+      free (flasher->socket);
+      flasher->socket = strdup (optarg);
+      break;
+    case 't':
+      qoob_sync_lock_timeout_set (&flasher->qoob,
+                                  (int)(strtod (optarg, NULL) * 1000));
+      break;
+    case 'R':
+      if (qoob_sync_retries_set (&flasher->qoob, 
+                                 (int)strtol (optarg, NULL, 10)) != 
+          QOOB_ERROR_OK) {
+        flasher->help = QOOB_TRUE;
+      }
+      break;
+    case 'T': {
+      qoob_transport_type_t type;
+
+      if (qoob_transport_parse (optarg, &type) != QOOB_ERROR_OK) {
+        flasher->help = QOOB_TRUE;
+        break;
+      }
+      qoob_sync_transport_set (&flasher->qoob, type);
+    }
+      break;
+    case 'D':
+      free (flasher->device_path);
+      flasher->device_path = strdup (optarg);
+      break;
+    case 'W':
+      qoob_cancel_deadline_set (&flasher->cancel,
+                                (int)(strtod (optarg, NULL) * 1000));
+      break;
+    case 'a':
+      flasher->watch = QOOB_TRUE;
+      break;
+    case 'o':
+      if (flasher->profile == NULL) {
+        flasher->profile = (qoob_profile_t *)malloc (sizeof (qoob_profile_t));
+        if (flasher->profile == NULL)
+          abort ();
+        qoob_profile_init (flasher->profile);
+      }
+      free (flasher->trace_file);
+      flasher->trace_file = optarg != NULL ? strdup (optarg) : NULL;
+      break;
+    case 'B':
+      flasher->command = FLASHER_COMMAND_BATCH;
+      free (flasher->batch_file);
+      flasher->batch_file = strdup (optarg);
+      break;
+    case 'z':
+      flasher->command = FLASHER_COMMAND_BACKUP;
+      flasher->slot_num = optarg != NULL ? 
+        (int)strtol (optarg, NULL, 10) : -1;
+      break;
+    case 'Z':
+      flasher->command = FLASHER_COMMAND_RESTORE;
+      flasher->slot_num = optarg != NULL ? 
+        (int)strtol (optarg, NULL, 10) : -1;
+      break;
+    case 'g':
+    case 'G': {
+      char **args;
+
+      /* Get has no value and set has to have one */
+      if ((strchr (optarg, '=') != NULL) != (c == 'G')) {
+        flasher->help = QOOB_TRUE;
+        break;
+      }
+      args = (char **)realloc (flasher->config_args, 
+                               (flasher->config_count+1)*sizeof (char *));
+      if (args == NULL)
+        abort ();
+      flasher->config_args = args;
+      flasher->config_args[flasher->config_count++] = strdup (optarg);
+      flasher->command = FLASHER_COMMAND_CONFIG;
+    }
+      break;
+    case 'x':
+      free (flasher->image_file);
+      flasher->image_file = strdup (optarg);
+      break;
+    case 'b':
+      flasher->command = FLASHER_COMMAND_STATION;
+      free (flasher->layout_file);
+      flasher->layout_file = strdup (optarg);
+      break;
     case '?':
       break;
     default:
@@ -113,7 +262,8 @@ qoob_flasher_util_test_options (qoob_flasher_t *flasher)
   }
 
   if (flasher->command == FLASHER_COMMAND_READ ||
-      flasher->command == FLASHER_COMMAND_WRITE) {
+      flasher->command == FLASHER_COMMAND_WRITE ||
+      flasher->command == FLASHER_COMMAND_VERIFY) {
     qoob_error_t ret;
     binary_type_t type;
 
@@ -124,12 +274,72 @@ qoob_flasher_util_test_options (qoob_flasher_t *flasher)
     }
 
     ret = qoob_sync_file_format_get (&(flasher->qoob), &type);    
-    if ((flasher->command == FLASHER_COMMAND_WRITE) && 
+    if ((flasher->command != FLASHER_COMMAND_READ) && 
         (ret != QOOB_ERROR_OK)) {
       return 1;
     }
-    if ((flasher->command == FLASHER_COMMAND_WRITE) &&
-        (type == QOOB_BINARY_TYPE_VOID)) {
+    /* Image index knows format of the file. Stdin is detected. */
+    if ((flasher->command != FLASHER_COMMAND_READ) &&
+        (type == QOOB_BINARY_TYPE_VOID) &&
+        (flasher->index_file == NULL) &&
+        !(flasher->command == FLASHER_COMMAND_WRITE &&
+          strcmp (flasher->file, "-") == 0)) {
+      return 1;
+    }
+  }
+
+  /* Watched file has to be a file */
+  if (flasher->watch == QOOB_TRUE) {
+    if (flasher->command != FLASHER_COMMAND_WRITE ||
+        strcmp (flasher->file, "-") == 0) {
+      return 1;
+    }
+  }
+
+  /* Without slot whole archive is done. Restore needs seekable file. */
+  if (flasher->command == FLASHER_COMMAND_BACKUP ||
+      flasher->command == FLASHER_COMMAND_RESTORE) {
+    if (flasher->slot_num >= QOOB_PRO_SLOTS || 
+        flasher->slot_num < -1 || 
+        flasher->file == NULL) {
+      return 1;
+    }
+    if (flasher->command == FLASHER_COMMAND_RESTORE &&
+        strcmp (flasher->file, "-") == 0) {
+      return 1;
+    }
+  }
+
+  /* Keys have to be valid before device is touched */
+  if (flasher->command == FLASHER_COMMAND_CONFIG) {
+    int i;
+
+    for (i=0; i<flasher->config_count; i++) {
+      qoob_config_key_t key;
+      char *arg = flasher->config_args[i];
+      char *eq = strchr (arg, '=');
+      qoob_error_t ret;
+
+      if (eq != NULL)
+        *eq = '\0';
+      ret = qoob_config_key_parse (arg, &key);
+      if (eq != NULL)
+        *eq = '=';
+      if (ret != QOOB_ERROR_OK) {
+        return 1;
+      }
+    }
+  }
+
+  /* Image is composed of station layout */
+  if (flasher->image_file != NULL &&
+      flasher->command != FLASHER_COMMAND_STATION) {
+    return 1;
+  }
+
+  if (flasher->command == FLASHER_COMMAND_SCAN ||
+      flasher->command == FLASHER_COMMAND_IMAGES) {
+    if (flasher->index_file == NULL) {
       return 1;
     }
   }
@@ -145,6 +355,128 @@ qoob_flasher_util_test_options (qoob_flasher_t *flasher)
   return 0;
 }
 
+/*
+ * Parses one line of batch script:
+ *
+ *   list
+ *   read SLOT FILE
+ *   write SLOT FORMAT FILE
+ *   verify SLOT FORMAT FILE
+ *   erase SLOT
+ *   force-erase SLOT
+ *
+ * FORMAT is gcb, elf or dol. FILE is rest of the line. Returns 0 if line 
+ * is valid. File is allocated to step.
+ */
+int
+qoob_flasher_util_parse_step (char *line, qoob_flasher_step_t *step)
+{
+  char command[16];
+  char format[16];
+  short int slot = 0;
+  int pos = 0;
+
+  step->file = NULL;
+  step->type = QOOB_BINARY_TYPE_VOID;
+  step->slot_num = -1;
+
+  if (sscanf (line, "%15s %n", command, &pos) != 1) {
+    return 1;
+  }
+  line += pos;
+
+  if (strcmp (command, "list") == 0) {
+    step->command = FLASHER_COMMAND_LIST;
+    return *line != '\0';
+  }
+
+  if (strcmp (command, "read") == 0) {
+    step->command = FLASHER_COMMAND_READ;
+  } else if (strcmp (command, "write") == 0) {
+    step->command = FLASHER_COMMAND_WRITE;
+  } else if (strcmp (command, "verify") == 0) {
+    step->command = FLASHER_COMMAND_VERIFY;
+  } else if (strcmp (command, "erase") == 0) {
+    step->command = FLASHER_COMMAND_ERASE;
+  } else if (strcmp (command, "force-erase") == 0) {
+    step->command = FLASHER_COMMAND_FORCE_ERASE;
+  } else {
+    return 1;
+  }
+
+  if (sscanf (line, "%hd %n", &slot, &pos) != 1 ||
+      slot < 0 || slot >= QOOB_PRO_SLOTS) {
+    return 1;
+  }
+  step->slot_num = slot;
+  line += pos;
+
+  if (step->command == FLASHER_COMMAND_ERASE ||
+      step->command == FLASHER_COMMAND_FORCE_ERASE) {
+    return *line != '\0';
+  }
+
+  if (step->command != FLASHER_COMMAND_READ) {
+    if (sscanf (line, "%15s %n", format, &pos) != 1) {
+      return 1;
+    }
+    line += pos;
+
+    if (strcmp (format, "gcb") == 0) {
+      step->type = QOOB_BINARY_TYPE_GCB;
+    } else if (strcmp (format, "elf") == 0) {
+      step->type = QOOB_BINARY_TYPE_ELF;
+    } else if (strcmp (format, "dol") == 0) {
+      step->type = QOOB_BINARY_TYPE_DOL;
+    } else {
+      return 1;
+    }
+  }
+
+  /* Pipes are not files */
+  if (*line == '\0' || strcmp (line, "-") == 0) {
+    return 1;
+  }
+  step->file = strdup (line);
+
+  return 0;
+}
+
+void
+qoob_flasher_util_print_slots (qoob_slot_t *slots)
+{
+    int i;
+
+    printf ("\n\n");
+    printf ("-------------------\n");
+    printf (" Qoob Flasher %s\n", VERSION);
+    printf ("-------------------\n\n");
+
+    printf ("----------------------------------------------\n");
+    printf (" Slot\tType\tApplication\n");
+    printf ("----------------------------------------------\n");
+      
+    for (i=0; i<QOOB_PRO_SLOTS; i++) {
+      printf (" [%02d]\t",i);
+
+      if (slots[i].type == QOOB_BINARY_TYPE_GCB) {
+        printf ("[GCB]\t");
+      } else if (slots[i].type == QOOB_BINARY_TYPE_ELF) {
+        printf ("[ELF]\t");
+      } else if (slots[i].type == QOOB_BINARY_TYPE_DOL) {
+        printf ("[DOL]\t");
+      } else if (slots[i].type == QOOB_BINARY_TYPE_CONFIG) {
+        printf ("[CFG]\t");
+      } else {
+        printf ("\t");
+      }
+      printf ("%s\n",slots[i].name);
+
+      if ( ((i+1)%8) == 0)
+        printf ("\n");
+    }
+}
+
 void
 qoop_flasher_util_print_help (void) 
 {
@@ -156,11 +488,54 @@ qoop_flasher_util_print_help (void)
   printf ("  -s, --slot-list          prints slot list after write or erase\n");
   printf ("  -w, --write=SLOT         writes given file to flash. Use with -l, -d or -q\n");
   printf ("  -r, --read=SLOT          reads given slot as gcb to given file\n");
+  printf ("                           FILE - is stdin for write and stdout for read\n");
   printf ("  -e, --erase=SLOT         erase application in flash\n");
   printf ("  -f, --force-erase=SLOT   erase one slot\n");
   printf ("  -l, --elf                Set ELF file format to write\n");
   printf ("  -d, --dol                Set DOL file format to write\n");
   printf ("  -q, --qoob               Set GCB or Config file format to write.\n");
+  printf ("  -m, --minimize[=MODE]    minimize ELF or DOL before write. MODE is\n");
+  printf ("                           strip (default) or dol (ELF to DOL)\n");
+  printf ("  -p, --sparse             do not send packets which are same as erased flash\n");
+  printf ("  -i, --index=FILE         image index to use. Gives format for write\n");
+  printf ("  -S, --scan=DIR           add images from directory to index and list them\n");
+  printf ("  -I, --images             list images in index\n");
+  printf ("  -c, --verify=SLOT        check that given file is flashed at SLOT.\n");
+  printf ("                           Use with -l, -d or -q\n");
+  printf ("  -n, --no-daemon          use device directly even if qoob-flasherd runs\n");
+  printf ("  -P, --priority=N         job priority in qoob-flasherd queue. Bigger\n");
+  printf ("                           is run first. Default is 0\n");
+  printf ("  -k, --socket=PATH        qoob-flasherd socket to use\n");
+  printf ("  -t, --timeout=SECONDS    wait at most SECONDS if other program uses\n");
+  printf ("                           the device. Default is to wait until free\n");
+  printf ("  -R, --retries=N          times failed slot or half slot is done again.\n");
+  printf ("                           Default is 3\n");
+  printf ("  -b, --station=LAYOUT     flash every device plugged in to match slot\n");
+  printf ("                           layout file until stopped with Ctrl-C\n");
+  printf ("  -T, --transport=NAME     USB access: auto, usbfs, hidraw or libusb.\n");
+  printf ("                           Default auto tries them in this order\n");
+  printf ("  -D, --device=PATH        use only device at PATH: bus and port like\n");
+  printf ("                           1-1.2, /dev/bus/usb/001/004, /dev/hidraw0\n");
+  printf ("                           or BUS:DEVICE. Running daemon is not used\n");
+  printf ("  -W, --deadline=SECONDS   stop command cleanly if it is not done in\n");
+  printf ("                           SECONDS. Ctrl-C stops it the same way\n");
+  printf ("  -a, --watch              with -w keep device open and write file again\n");
+  printf ("                           when it changes. Only changed slots are written\n");
+  printf ("  -B, --batch=FILE         run commands of script FILE, - is stdin, with\n");
+  printf ("                           one device session. See the man page\n");
+  printf ("  -o, --profile[=TRACE]    print time of every phase and slot. TRACE is\n");
+  printf ("                           Chrome trace event file of the timeline\n");
+  printf ("  -x, --compose=IMAGE      with -b write whole flash image of the layout\n");
+  printf ("                           to IMAGE, - is stdout. No device is used\n");
+  printf ("  -z, --backup[=SLOT]      read every application, or one at SLOT, to\n");
+  printf ("                           compressed archive FILE. - is stdout\n");
+  printf ("  -Z, --restore[=SLOT]     write every application, or one at SLOT, of\n");
+  printf ("                           archive FILE back to flash\n");
+  printf ("  -g, --config-get=KEY     print value of config slot. KEY is\n");
+  printf ("                           OFFSET[:u8|u16|u32], e.g. 0x24:u16\n");
+  printf ("  -G, --config-set=KEY=VALUE\n");
+  printf ("                           change value of config slot. Only config\n");
+  printf ("                           slot is written and only if value changes\n");
   printf ("\n");
 
 
@@ -178,6 +553,43 @@ qoop_flasher_util_print_help (void)
   printf (" Write qoob-bios to flash\n");
   printf ("  qoob-flasher -q -w0 /tmp/qoob-bios.gcb\n\n");
 
+  printf (" Write ELF converted to DOL. Shows how many slots was saved\n");
+  printf ("  qoob-flasher -v -l -mdol -w3 /tmp/app.elf\n\n");
+
+  printf (" Index homebrew images and write one without giving format\n");
+  printf ("  qoob-flasher -i ~/.qoob-index -S ~/homebrew\n");
+  printf ("  qoob-flasher -i ~/.qoob-index -w3 ~/homebrew/app.dol\n\n");
+
+  printf (" Check that qoob-bios is flashed\n");
+  printf ("  qoob-flasher -q -c0 /tmp/qoob-bios.gcb\n\n");
+
+  printf (" Write application from a pipe and checksum bios\n");
+  printf ("  make | qoob-flasher -w3 -\n");
+  printf ("  qoob-flasher -r0 - | sha256sum\n\n");
+
+  printf (" Flash application again every time it is built\n");
+  printf ("  qoob-flasher -l -a -w3 /tmp/app.elf\n\n");
+
+  printf (" Back up bios, replace application and list slots in one session\n");
+  printf ("  printf 'read 0 bios.gcb\\nerase 5\\nwrite 5 elf app.elf\\nlist\\n' |\n");
+  printf ("    qoob-flasher -B -\n\n");
+
+  printf (" Back up whole flash and later restore only the application at slot 3\n");
+  printf ("  qoob-flasher -z flash.qarc\n");
+  printf ("  qoob-flasher -Z3 flash.qarc\n\n");
+
+  printf (" Show a config value and change another one\n");
+  printf ("  qoob-flasher -g 0x10 -G 0x24:u16=0x1f4\n\n");
+
+  printf (" See where time of a write goes in a trace viewer\n");
+  printf ("  qoob-flasher -l -otrace.json -w3 /tmp/app.elf\n\n");
+
+  printf (" Flash bios and application to every device plugged in\n");
+  printf ("  qoob-flasher -v -b /srv/bench/layout\n\n");
+
+  printf (" Make 2 MB image of the same layout for a chip programmer\n");
+  printf ("  qoob-flasher -b /srv/bench/layout -x golden.bin\n\n");
+
   printf ("See also the man page.\n\n");
 }
 
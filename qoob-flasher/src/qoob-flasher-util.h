@@ -28,23 +28,61 @@ typedef enum {
   FLASHER_COMMAND_READ,
   FLASHER_COMMAND_WRITE,
   FLASHER_COMMAND_ERASE,
-  FLASHER_COMMAND_FORCE_ERASE
+  FLASHER_COMMAND_FORCE_ERASE,
+  FLASHER_COMMAND_SCAN,
+  FLASHER_COMMAND_IMAGES,
+  FLASHER_COMMAND_VERIFY,
+  FLASHER_COMMAND_STATION,
+  FLASHER_COMMAND_BATCH,
+  FLASHER_COMMAND_BACKUP,
+  FLASHER_COMMAND_RESTORE,
+  FLASHER_COMMAND_CONFIG
 } flasher_command_t;
 
+/* One command of batch script */
+typedef struct QoobFlasherStep qoob_flasher_step_t;
+struct QoobFlasherStep
+{
+  flasher_command_t command;
+  short int slot_num;
+  binary_type_t type;         /* Format of written or verified file */
+  char *file;
+  int line;                   /* Line in the script */
+};
+
 struct QoobFlasher
 {
   qoob_t qoob;
   qoob_slot_t *slots; //[QOOB_PRO_SLOTS];
 
   char *file;
+  char *index_file;
+  char *scan_dir;
+  char *socket;               /* qoob-flasherd socket */
+  char *layout_file;          /* Station mode slot layout */
+  char *batch_file;           /* Batch script, "-" is stdin */
+  char *image_file;           /* Flash image composed of layout */
+  char *device_path;          /* Device given by user, e.g. "1-1.2" */
+  char *trace_file;           /* Chrome trace of the profile */
+  char **config_args;         /* KEY to get or KEY=VALUE to set, in order */
+  int config_count;
   short int slot_num;
   short int erase_from;
   short int erase_to;
 
   flasher_command_t command;
 
+  qoob_index_t index;
+  qoob_cancel_t cancel;       /* Ctrl-C and deadline stop the command */
+  qoob_profile_t *profile;    /* Phase times, NULL if not asked */
+  struct timespec started;    /* Before library init */
+
   qoob_boolean_t help;
   qoob_boolean_t list;
+  qoob_boolean_t watch;       /* Write file again when it changes */
+  qoob_boolean_t daemon;      /* Use qoob-flasherd if it is running */
+  int daemon_fd;
+  int priority;
 
   unsigned int verbose;
 };
@@ -53,6 +91,8 @@ void qoob_flasher_util_parse_options (qoob_flasher_t *flasher,
                                       int *argc, 
                                       char ***argv);
 int qoob_flasher_util_test_options (qoob_flasher_t *flasher);
+int qoob_flasher_util_parse_step (char *line, qoob_flasher_step_t *step);
+void qoob_flasher_util_print_slots (qoob_slot_t *slots);
 void qoop_flasher_util_print_help_and_exit (int e);
 
 #endif
@@ -0,0 +1,410 @@
+/*
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#ifdef __linux__
+# include <sys/inotify.h>
+#endif
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <qoob.h>
+
+#include "qoob-flasher-util.h"
+#include "qoob-flasher-watch.h"
+
+/* 
+ * Watch mode writes the file again every time it changes. Device is kept
+ * open and image of the previous write in memory, so only slots whose
+ * content changed are erased and written. Header slot changes always as 
+ * it has digest of the payload. Directory is watched instead of the file
+ * because linkers and editors often replace the file.
+ */
+
+/* File has to be unchanged this long before it is written */
+#define WATCH_SETTLE_MS 200
+#define WATCH_EVENT_SIZE 4096
+
+typedef struct Watch watch_t;
+struct Watch
+{
+  qoob_flasher_t *flasher;
+  const char *name;           /* File name without directory */
+  char *image;                /* In flash now or NULL if not known */
+  size_t image_size;
+  qoob_boolean_t open;
+  int flashed;
+  int failed;
+};
+
+static int watch_open (watch_t *watch);
+static qoob_boolean_t watch_changed (watch_t *watch, int fd);
+static qoob_error_t open_device (watch_t *watch);
+static void close_device (watch_t *watch);
+static qoob_boolean_t up_to_date (watch_t *watch,
+                                  const char *image,
+                                  size_t size);
+static qoob_error_t flash_file (watch_t *watch);
+static int count_slots (unsigned long mask);
+static double elapsed (const struct timeval *start);
+
+/*
+ * Runs until Ctrl-C or deadline. Returns exit status of qoob-flasher.
+ */
+int
+qoob_flasher_watch_run (qoob_flasher_t *flasher)
+{
+  watch_t watch;
+  struct pollfd pfd;
+  qoob_boolean_t pending = QOOB_FALSE;
+  qoob_error_t err;
+
+  memset (&watch, 0, sizeof (watch));
+  watch.flasher = flasher;
+  watch.name = strrchr (flasher->file, '/');
+  watch.name = watch.name != NULL ? watch.name+1 : flasher->file;
+
+  pfd.fd = watch_open (&watch);
+  pfd.events = POLLIN;
+  if (pfd.fd < 0) {
+    printf ("Error: %s: cannot watch file: %s\n", 
+            flasher->file, strerror (errno));
+    return 1;
+  }
+
+  err = open_device (&watch);
+  if (err != QOOB_ERROR_OK) {
+    printf ("Error: %s\n", qoob_error_to_string (err));
+    close (pfd.fd);
+    return 1;
+  }
+
+  /* Flash may have the file already */
+  err = flash_file (&watch);
+
+  printf ("Watching %s. Stop with Ctrl-C.\n", flasher->file);
+  fflush (stdout);
+
+  while (err != QOOB_ERROR_CANCELLED && err != QOOB_ERROR_DEADLINE) {
+    int timeout = pending == QOOB_TRUE ? WATCH_SETTLE_MS : -1;
+    int remaining = qoob_cancel_remaining (&flasher->cancel);
+    int r;
+
+    if (remaining >= 0 && (timeout < 0 || remaining < timeout))
+      timeout = remaining;
+
+    r = poll (&pfd, 1, timeout);
+
+    err = qoob_cancel_check (&flasher->cancel);
+    if (err != QOOB_ERROR_OK)
+      break;
+
+    if (r < 0 && errno != EINTR) {
+      printf ("Error: %s: %s\n", flasher->file, strerror (errno));
+      break;
+    }
+
+    if (r > 0) {
+      if (watch_changed (&watch, pfd.fd) == QOOB_TRUE)
+        pending = QOOB_TRUE;
+    } else if (r == 0 && pending == QOOB_TRUE) {
+      pending = QOOB_FALSE;
+      err = flash_file (&watch);
+      fflush (stdout);
+    }
+  }
+
+  close (pfd.fd);
+  close_device (&watch);
+  free (watch.image);
+
+  printf ("\nWatch stopped. %d write(s), %d failed.\n", 
+          watch.flashed, watch.failed);
+
+  return watch.failed > 0 ? 1 : 0;
+}
+
+/* Static functions */
+static int
+watch_open (watch_t *watch)
+{
+#ifdef __linux__
+  const char *file = watch->flasher->file;
+  char *dir;
+  int fd;
+
+  if (watch->name == file) {
+    dir = strdup (".");
+  } else if (watch->name-1 == file) {
+    dir = strdup ("/");
+  } else {
+    dir = strndup (file, (size_t)(watch->name-1-file));
+  }
+  if (dir == NULL) {
+    return -1;
+  }
+
+  fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+  if (fd >= 0 &&
+      inotify_add_watch (fd, dir, 
+                         IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+    int e = errno;
+
+    close (fd);
+    fd = -1;
+    errno = e;
+  }
+  free (dir);
+
+  return fd;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+/* Reads queued events. Tells if any of them is about the file. */
+static qoob_boolean_t
+watch_changed (watch_t *watch, int fd)
+{
+#ifdef __linux__
+  char buf[WATCH_EVENT_SIZE] 
+    __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+  qoob_boolean_t changed = QOOB_FALSE;
+  ssize_t len;
+
+  while ((len = read (fd, buf, sizeof (buf))) > 0) {
+    ssize_t i;
+
+    for (i=0; i<len; ) {
+      struct inotify_event *e = (struct inotify_event *)(buf+i);
+
+      if (e->len > 0 && strcmp (e->name, watch->name) == 0)
+        changed = QOOB_TRUE;
+      i += sizeof (struct inotify_event) + e->len;
+    }
+  }
+
+  return changed;
+#else
+  return QOOB_FALSE;
+#endif
+}
+
+/* Device stays reserved until watch is stopped */
+static qoob_error_t
+open_device (watch_t *watch)
+{
+  qoob_flasher_t *flasher = watch->flasher;
+  qoob_error_t err;
+
+  if (flasher->device_path != NULL) {
+    err = qoob_sync_usb_find_path (&flasher->qoob, flasher->device_path);
+  } else {
+    err = qoob_sync_usb_find (&flasher->qoob);
+  }
+  if (err != QOOB_ERROR_OK) {
+    return err;
+  }
+
+  qoob_sync_slot_free (flasher->slots);
+  flasher->slots = NULL;
+  err = qoob_sync_usb_list (&flasher->qoob, &flasher->slots);
+  if (err != QOOB_ERROR_OK) {
+    qoob_sync_usb_clear (&flasher->qoob);
+    return err;
+  }
+  watch->open = QOOB_TRUE;
+
+  return QOOB_ERROR_OK;
+}
+
+/* After failure flash content is not known. Device may be unplugged. */
+static void
+close_device (watch_t *watch)
+{
+  if (watch->open == QOOB_TRUE) {
+    qoob_sync_usb_clear (&watch->flasher->qoob);
+    qoob_sync_rescan (&watch->flasher->qoob);
+  }
+  watch->open = QOOB_FALSE;
+
+  free (watch->image);
+  watch->image = NULL;
+  watch->image_size = 0;
+}
+
+/* Slot header tells if libqoob wrote the same image there */
+static qoob_boolean_t
+up_to_date (watch_t *watch,
+            const char *image,
+            size_t size)
+{
+  qoob_slot_t *slot = &watch->flasher->slots[watch->flasher->slot_num];
+  unsigned char digest[QOOB_DIGEST_SIZE];
+  unsigned long length;
+
+  if (slot->first != QOOB_TRUE || slot->has_digest != QOOB_TRUE)
+    return QOOB_FALSE;
+
+  if (size < QOOB_GCB_HEADER_SIZE ||
+      qoob_image_gcb_digest (image, &length, digest) != QOOB_TRUE)
+    return QOOB_FALSE;
+
+  return (slot->slots_used == 
+          qoob_file_slots_needed (QOOB_BINARY_TYPE_GCB, size) &&
+          slot->length == length &&
+          memcmp (slot->digest, digest, QOOB_DIGEST_SIZE) == 0) ?
+    QOOB_TRUE : QOOB_FALSE;
+}
+
+/*
+ * Builds image of the file and writes slots which differ from previous 
+ * one. Build time is modification time of the file.
+ */
+static qoob_error_t
+flash_file (watch_t *watch)
+{
+  qoob_flasher_t *flasher = watch->flasher;
+  char *data = NULL;
+  size_t size = 0;
+  char *image = NULL;
+  size_t image_size = 0;
+  struct stat st;
+  struct timeval start;
+  struct timespec now;
+  unsigned long completed = 0;
+  int used_slots;
+  qoob_error_t err;
+
+  if (stat (flasher->file, &st) < 0) {
+    printf ("Error: %s: %s\n", flasher->file, strerror (errno));
+    return QOOB_ERROR_FILE_NOT_VALID;
+  }
+
+  err = qoob_image_load (flasher->file, &data, &size);
+  if (err == QOOB_ERROR_OK) {
+    err = qoob_sync_usb_image (&flasher->qoob, flasher->file, data, size,
+                               &image, &image_size);
+    free (data);
+  }
+  if (err != QOOB_ERROR_OK) {
+    printf ("Error: %s: %s\n", flasher->file, qoob_error_to_string (err));
+    return err;
+  }
+
+  /* Same image again, e.g. file was only touched */
+  if (watch->image != NULL && image_size == watch->image_size &&
+      memcmp (image, watch->image, image_size) == 0) {
+    printf ("%s has not changed.\n", flasher->file);
+    free (image);
+    return QOOB_ERROR_OK;
+  }
+
+  if (watch->open == QOOB_FALSE) {
+    err = open_device (watch);
+    if (err != QOOB_ERROR_OK) {
+      printf ("Error: %s\n", qoob_error_to_string (err));
+      watch->failed++;
+      free (image);
+      return err;
+    }
+  }
+
+  /* First round. Nothing to do if flash has the image already. */
+  if (watch->image == NULL && up_to_date (watch, image, image_size)) {
+    printf ("%s is flashed at slot [%02d].\n", 
+            flasher->file, flasher->slot_num);
+    watch->image = image;
+    watch->image_size = image_size;
+    return QOOB_ERROR_OK;
+  }
+
+  gettimeofday (&start, NULL);
+  err = qoob_sync_usb_write_changed (&flasher->qoob, 
+                                     watch->image, watch->image_size,
+                                     image, image_size,
+                                     flasher->slot_num);
+  qoob_sync_completed_get (&flasher->qoob, &completed);
+  if (err != QOOB_ERROR_OK) {
+    printf ("Error: %s\n", qoob_error_to_string (err));
+    watch->failed++;
+    close_device (watch);
+    free (image);
+    return err;
+  }
+
+  free (watch->image);
+  watch->image = image;
+  watch->image_size = image_size;
+  watch->flashed++;
+
+  used_slots = qoob_file_slots_needed (QOOB_BINARY_TYPE_GCB, image_size);
+  clock_gettime (CLOCK_REALTIME, &now);
+  printf ("Flashed %d of %d slot(s) in %.2f s. %.2f s from build.\n",
+          count_slots (completed),
+          used_slots,
+          elapsed (&start),
+          (now.tv_sec-st.st_mtim.tv_sec) + 
+          (now.tv_nsec-st.st_mtim.tv_nsec)/1e9);
+
+  return QOOB_ERROR_OK;
+}
+
+static int
+count_slots (unsigned long mask)
+{
+  int n = 0;
+
+  for (; mask != 0; mask &= mask-1)
+    n++;
+
+  return n;
+}
+
+static double
+elapsed (const struct timeval *start)
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+
+  return (now.tv_sec-start->tv_sec) + (now.tv_usec-start->tv_usec)/1e6;
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
@@ -18,8 +18,13 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <signal.h>
 
 #ifdef HAVE_CONFIG_H
 # include <config.h>
@@ -28,20 +33,52 @@
 #include <qoob.h>
 
 #include "qoob-flasher-util.h"
+#include "qoob-flasher-client.h"
+#include "qoob-flasher-station.h"
+#include "qoob-flasher-watch.h"
+#include "qoob-flasher-batch.h"
+#include "qoob-flasherd-proto.h"
+
+/* Application name of ELF or DOL written from stdin */
+#define STDIN_NAME "stdin"
 
 static int flasher_init (qoob_flasher_t *flasher);
 static void flasher_deinit (qoob_flasher_t *flasher);
 
-static void print_slots (qoob_slot_t *slots);
+static void print_images (qoob_index_t *index);
+static int compose_image (qoob_flasher_t *flasher);
+static qoob_error_t backup_archive (qoob_flasher_t *flasher, int out);
+static qoob_error_t restore_archive (qoob_flasher_t *flasher);
+static qoob_error_t edit_config (qoob_flasher_t *flasher);
+static qoob_error_t format_from_index (qoob_flasher_t *flasher);
+static qoob_error_t stdin_load (qoob_flasher_t *flasher,
+                                char **data,
+                                size_t *size);
 static void qoob_callback (qoob_sync_callback_t type,
                            int progress,
                            int total,
                            void *user_data);
+static void print_transfer (qoob_flasher_t *flasher, struct timeval *start);
+static void print_open (qoob_flasher_t *flasher);
+static void print_completed (qoob_flasher_t *flasher);
+static void print_profile (qoob_flasher_t *flasher);
+static void catch_signals (qoob_flasher_t *flasher);
+static void on_signal (int sig);
+
+/* Cancelled by Ctrl-C */
+static qoob_cancel_t *cancel_token = NULL;
 
 int
 main (int argc, char **argv)
 {
   qoob_flasher_t flasher;
+  qoob_boolean_t daemon = QOOB_FALSE; /* qoob-flasherd runs the command */
+  qoob_boolean_t stream = QOOB_FALSE; /* File is stdin or stdout */
+  char *data = NULL;                  /* Image read from stdin */
+  size_t size = 0;
+  int out = -1;                       /* stdout for read data */
+  struct timeval start;               /* Read or write started */
+  struct timespec initialized;        /* Library init done */
   qoob_error_t ret;
 
   /* Initialize struct */
@@ -56,6 +93,7 @@ main (int argc, char **argv)
     fprintf (stderr, "Error: init qoob library.\n");
     return 1;
   }
+  clock_gettime (CLOCK_MONOTONIC, &initialized);
 
   /* Parse options */
   qoob_flasher_util_parse_options (&flasher, &argc, &argv);
@@ -66,18 +104,149 @@ main (int argc, char **argv)
     qoop_flasher_util_print_help_and_exit (1);
   }
 
-  /* Check is device connected to USB */
-  ret = qoob_sync_usb_find (&flasher.qoob);
-  if (ret != QOOB_ERROR_OK) {
-    goto error;
+  /* Profile starts before library init. Daemon would hide the phases. */
+  if (flasher.profile != NULL) {
+    flasher.profile->origin = flasher.started;
+    qoob_profile_add_span (flasher.profile, QOOB_PHASE_INIT, -1,
+                           &flasher.started, &initialized);
+    qoob_sync_profile_set (&flasher.qoob, flasher.profile);
+    flasher.daemon = QOOB_FALSE;
   }
 
-  qoob_sync_set_callback (&(flasher.qoob), qoob_callback, &flasher);
+  /* "-" is stdin for write and stdout for read and backup */
+  if (flasher.file != NULL && strcmp (flasher.file, "-") == 0 &&
+      (flasher.command == FLASHER_COMMAND_READ ||
+       flasher.command == FLASHER_COMMAND_WRITE ||
+       flasher.command == FLASHER_COMMAND_BACKUP)) {
+    stream = QOOB_TRUE;
 
-  /* Every command needs to list of slots */
-  ret = qoob_sync_usb_list (&flasher.qoob, &flasher.slots);
-  if (ret != QOOB_ERROR_OK) {
-    goto error;
+    /* Daemon uses files only */
+    flasher.daemon = QOOB_FALSE;
+
+    if (flasher.command != FLASHER_COMMAND_WRITE) {
+      /* Messages go to stderr so they do not mix with data */
+      out = dup (STDOUT_FILENO);
+      if (out == -1 || dup2 (STDERR_FILENO, STDOUT_FILENO) == -1) {
+        ret = QOOB_ERROR_FD_OPEN;
+        goto error;
+      }
+    } else {
+      /* Whole image is read before device is reserved */
+      ret = stdin_load (&flasher, &data, &size);
+      if (ret != QOOB_ERROR_OK) {
+        goto error;
+      }
+    }
+  }
+
+  /* Image index */
+  if (flasher.index_file != NULL) {
+    ret = qoob_index_open (&flasher.index, flasher.index_file);
+    if (ret != QOOB_ERROR_OK) {
+      goto error;
+    }
+
+    if (flasher.command == FLASHER_COMMAND_SCAN) {
+      ret = qoob_index_scan (&flasher.index, flasher.scan_dir, 0);
+      if (ret != QOOB_ERROR_OK) {
+        goto error;
+      }
+    }
+
+    /* No need for device */
+    if (flasher.command == FLASHER_COMMAND_SCAN ||
+        flasher.command == FLASHER_COMMAND_IMAGES) {
+      print_images (&flasher.index);
+      flasher_deinit (&flasher);
+      return 0;
+    }
+
+    if ((flasher.command == FLASHER_COMMAND_WRITE ||
+         flasher.command == FLASHER_COMMAND_VERIFY) &&
+        stream == QOOB_FALSE) {
+      ret = format_from_index (&flasher);
+      if (ret != QOOB_ERROR_OK) {
+        goto error;
+      }
+    }
+  }
+
+  /* Layout is put to an image file instead of devices */
+  if (flasher.command == FLASHER_COMMAND_STATION &&
+      flasher.image_file != NULL) {
+    int status;
+
+    status = compose_image (&flasher);
+    flasher_deinit (&flasher);
+    return status;
+  }
+
+  /* Flashes every device plugged in until stopped */
+  if (flasher.command == FLASHER_COMMAND_STATION) {
+    int status;
+
+    status = qoob_flasher_station_run (&flasher);
+    flasher_deinit (&flasher);
+    return status;
+  }
+
+  /* Commands of the script share one device session */
+  if (flasher.command == FLASHER_COMMAND_BATCH) {
+    int status;
+
+    catch_signals (&flasher);
+    status = qoob_flasher_batch_run (&flasher);
+    flasher_deinit (&flasher);
+    return status;
+  }
+
+  /* Writes file again every time it changes until stopped */
+  if (flasher.command == FLASHER_COMMAND_WRITE && 
+      flasher.watch == QOOB_TRUE) {
+    int status;
+
+    catch_signals (&flasher);
+    status = qoob_flasher_watch_run (&flasher);
+    flasher_deinit (&flasher);
+    return status;
+  }
+
+  /* Daemon has its own device and knows no archives or config */
+  if (flasher.device_path != NULL ||
+      flasher.command == FLASHER_COMMAND_BACKUP ||
+      flasher.command == FLASHER_COMMAND_RESTORE ||
+      flasher.command == FLASHER_COMMAND_CONFIG) {
+    flasher.daemon = QOOB_FALSE;
+  }
+
+  /* Running qoob-flasherd owns the device. Command is given to it. */
+  if (flasher.daemon == QOOB_TRUE) {
+    flasher.daemon_fd = qoob_flasher_client_connect (flasher.socket);
+    daemon = flasher.daemon_fd >= 0 ? QOOB_TRUE : QOOB_FALSE;
+  }
+
+  if (daemon == QOOB_FALSE) {
+    catch_signals (&flasher);
+
+    /* Check is device connected to USB */
+    if (flasher.device_path != NULL) {
+      ret = qoob_sync_usb_find_path (&flasher.qoob, flasher.device_path);
+    } else {
+      ret = qoob_sync_usb_find (&flasher.qoob);
+    }
+    if (ret != QOOB_ERROR_OK) {
+      goto error;
+    }
+
+    if (flasher.verbose > 0) {
+      print_open (&flasher);
+    }
+
+    /* Every command needs to list of slots */
+    ret = qoob_sync_usb_list (&flasher.qoob, &flasher.slots);
+    if (ret != QOOB_ERROR_OK) {
+      goto error;
+    }
   }
 
   /* Actual command executing */
@@ -85,7 +254,13 @@ main (int argc, char **argv)
 
   /* List all slots */
   case FLASHER_COMMAND_LIST: {
-    print_slots (flasher.slots);
+    if (daemon == QOOB_TRUE) {
+      ret = qoob_flasher_client_run (&flasher, qoob_callback);
+      if (ret != QOOB_ERROR_OK) {
+        goto error;
+      }
+    }
+    qoob_flasher_util_print_slots (flasher.slots);
   }
     break;
 
@@ -98,13 +273,22 @@ main (int argc, char **argv)
               flasher.slot_num);
     }
 
-    ret = qoob_sync_usb_read (&flasher.qoob, flasher.file, flasher.slot_num);
+    gettimeofday (&start, NULL);
+    if (daemon == QOOB_TRUE) {
+      ret = qoob_flasher_client_run (&flasher, qoob_callback);
+    } else if (stream == QOOB_TRUE) {
+      ret = qoob_sync_usb_read_fd (&flasher.qoob, out, flasher.slot_num);
+    } else {
+      ret = qoob_sync_usb_read (&flasher.qoob, flasher.file, flasher.slot_num);
+    }
     if (ret != QOOB_ERROR_OK) {
       goto error;
     }
 
     if (flasher.verbose > 0) {
       printf ("\nGCB file saved succesfully.\n");
+      if (daemon == QOOB_FALSE)
+        print_transfer (&flasher, &start);
     }
   }
     break;
@@ -118,25 +302,40 @@ main (int argc, char **argv)
               flasher.slot_num);
     }
 
-    ret = qoob_sync_usb_write (&flasher.qoob, flasher.file, flasher.slot_num);
+    gettimeofday (&start, NULL);
+    if (daemon == QOOB_TRUE) {
+      ret = qoob_flasher_client_run (&flasher, qoob_callback);
+    } else if (stream == QOOB_TRUE) {
+      ret = qoob_sync_usb_write_buffer (&flasher.qoob, 
+                                        STDIN_NAME, 
+                                        data, 
+                                        size, 
+                                        flasher.slot_num);
+    } else {
+      ret = qoob_sync_usb_write (&flasher.qoob, flasher.file, flasher.slot_num);
+    }
     if (ret != QOOB_ERROR_OK) {
       goto error;
     }
 
-    if (flasher.list == QOOB_TRUE) {
-
-      /* modified -> list */
+    /* Daemon sends slots after every command */
+    if (flasher.list == QOOB_TRUE && daemon == QOOB_FALSE) {
       ret = qoob_sync_usb_list (&flasher.qoob, &flasher.slots);
       if (ret != QOOB_ERROR_OK) {
         goto error;
       }
+    }
+
+    if (flasher.list == QOOB_TRUE) {
 
       /* modified -> print list */
-      print_slots (flasher.slots);
+      qoob_flasher_util_print_slots (flasher.slots);
     }
 
     if (flasher.verbose > 0) {
       printf ("\nFile %s flashed succesfully.\n", flasher.file);
+      if (daemon == QOOB_FALSE)
+        print_transfer (&flasher, &start);
     }
   }
     break;
@@ -147,19 +346,26 @@ main (int argc, char **argv)
       printf ("Erasing flash starting at slot [%02d].\n", flasher.slot_num);
     }
 
-    ret = qoob_sync_usb_erase (&flasher.qoob, flasher.slot_num);
+    if (daemon == QOOB_TRUE) {
+      ret = qoob_flasher_client_run (&flasher, qoob_callback);
+    } else {
+      ret = qoob_sync_usb_erase (&flasher.qoob, flasher.slot_num);
+    }
     if (ret != QOOB_ERROR_OK) {
       goto error;
     }
     
-    if (flasher.list == QOOB_TRUE) {
+    if (flasher.list == QOOB_TRUE && daemon == QOOB_FALSE) {
       ret = qoob_sync_usb_list (&flasher.qoob, &flasher.slots);
       if (ret != QOOB_ERROR_OK) {
         goto error;
       }
+    }
+
+    if (flasher.list == QOOB_TRUE) {
 
       /* modified -> print list */
-      print_slots (flasher.slots);
+      qoob_flasher_util_print_slots (flasher.slots);
     }
 
     if (flasher.verbose > 0) {
@@ -170,21 +376,114 @@ main (int argc, char **argv)
 
   /* Erasing slots from flash (not safe)*/
   case FLASHER_COMMAND_FORCE_ERASE: {
-    ret = qoob_sync_usb_erase_forced (&flasher.qoob, 
-                                 flasher.erase_from, 
-                                 flasher.erase_to);
+    if (daemon == QOOB_TRUE) {
+      ret = qoob_flasher_client_run (&flasher, qoob_callback);
+    } else {
+      ret = qoob_sync_usb_erase_forced (&flasher.qoob, 
+                                   flasher.erase_from, 
+                                   flasher.erase_to);
+    }
     if (ret != QOOB_ERROR_OK) {
       goto error;
     }
 
     /* Update slots */
+    if (daemon == QOOB_FALSE) {
+      ret = qoob_sync_usb_list (&flasher.qoob, &flasher.slots);
+      if (ret != QOOB_ERROR_OK) {
+        goto error;
+      }
+    }
+
+    /* modified -> print list */
+    qoob_flasher_util_print_slots (flasher.slots);
+  }
+    break;
+
+  /* Compare file to flash */
+  case FLASHER_COMMAND_VERIFY: {
+    if (flasher.verbose > 0) {
+      printf ("\nVerifying file %s. Starting at slot [%02d].\n", 
+              flasher.file,
+              flasher.slot_num);
+    }
+
+    if (daemon == QOOB_TRUE) {
+      ret = qoob_flasher_client_run (&flasher, qoob_callback);
+    } else {
+      /* Digest in the header tells it without reading the slots */
+      ret = qoob_sync_usb_verify_header (&flasher.qoob, 
+                                         flasher.file, 
+                                         flasher.slot_num);
+      if (ret == QOOB_ERROR_DIGEST_MISSING) {
+        if (flasher.verbose > 0) {
+          printf ("Header can not tell. Comparing flash content.\n");
+        }
+        ret = qoob_sync_usb_verify (&flasher.qoob, 
+                                    flasher.file, 
+                                    flasher.slot_num);
+      }
+    }
+    if (ret != QOOB_ERROR_OK) {
+      goto error;
+    }
+
+    if (flasher.verbose > 0) {
+      printf ("\nFile %s is flashed at slot [%02d].\n", 
+              flasher.file,
+              flasher.slot_num);
+    }
+  }
+    break;
+
+  /* Applications to compressed archive */
+  case FLASHER_COMMAND_BACKUP: {
+    gettimeofday (&start, NULL);
+    ret = backup_archive (&flasher, stream == QOOB_TRUE ? out : -1);
+    if (ret != QOOB_ERROR_OK) {
+      goto error;
+    }
+
+    if (flasher.verbose > 0) {
+      print_transfer (&flasher, &start);
+    }
+  }
+    break;
+
+  /* Applications of archive back to flash */
+  case FLASHER_COMMAND_RESTORE: {
+    gettimeofday (&start, NULL);
+    ret = restore_archive (&flasher);
+    if (ret != QOOB_ERROR_OK) {
+      goto error;
+    }
+
     ret = qoob_sync_usb_list (&flasher.qoob, &flasher.slots);
     if (ret != QOOB_ERROR_OK) {
       goto error;
     }
 
-    /* modified -> print list */
-    print_slots (flasher.slots);
+    if (flasher.list == QOOB_TRUE) {
+      qoob_flasher_util_print_slots (flasher.slots);
+    }
+
+    if (flasher.verbose > 0) {
+      print_transfer (&flasher, &start);
+    }
+  }
+    break;
+
+  /* Values of config slot */
+  case FLASHER_COMMAND_CONFIG: {
+    gettimeofday (&start, NULL);
+    ret = edit_config (&flasher);
+    if (ret != QOOB_ERROR_OK) {
+      goto error;
+    }
+
+    if (flasher.verbose > 0) {
+      print_transfer (&flasher, &start);
+    }
   }
     break;
 
@@ -195,48 +494,517 @@ main (int argc, char **argv)
   }
 
   flasher_deinit (&flasher);
+  free (data);
+  if (out >= 0 && close (out) == -1) {
+    printf ("Error: %s\n", qoob_error_to_string (QOOB_ERROR_FD_WRITE));
+    return 1;
+  }
 
   return 0;
 
  error:
   printf ("Error: %s\n", qoob_error_to_string (ret));
+  if (ret == QOOB_ERROR_CANCELLED || ret == QOOB_ERROR_DEADLINE) {
+    print_completed (&flasher);
+  }
+  if (ret == QOOB_ERROR_LOCK_TIMEOUT) {
+    qoob_lock_holder_t holder;
+
+    if (qoob_sync_usb_holder (&flasher.qoob, &holder) == QOOB_ERROR_OK) {
+      printf ("Device is held by %s (pid %d).\n", 
+              holder.name, 
+              (int)holder.pid);
+    }
+  }
   flasher_deinit (&flasher);
+  free (data);
+  if (out >= 0)
+    close (out);
   return 1;
 }
 
 static void
-print_slots (qoob_slot_t *slots)
+print_images (qoob_index_t *index)
 {
-    int i;
+  int i;
+
+  printf ("----------------------------------------------\n");
+  printf (" Slots\tType\tApplication\tFile\n");
+  printf ("----------------------------------------------\n");
 
-    printf ("\n\n");
-    printf ("-------------------\n");
-    printf (" Qoob Flasher %s\n", VERSION);
-    printf ("-------------------\n\n");
+  for (i=0; i<index->count; i++) {
+    qoob_index_entry_t *e = &index->entries[i];
 
-    printf ("----------------------------------------------\n");
-    printf (" Slot\tType\tApplication\n");
-    printf ("----------------------------------------------\n");
-      
+    if (e->type == QOOB_BINARY_TYPE_VOID)
+      continue;
+
+    printf (" %2d\t[%s]\t%s\t%s\n", 
+            e->slots_used,
+            qoob_file_format_to_string (e->type),
+            e->name,
+            e->path);
+  }
+}
+
+/*
+ * Whole flash image of the station layout. Messages go to stderr when 
+ * image goes to stdout.
+ */
+static int
+compose_image (qoob_flasher_t *flasher)
+{
+  qoob_layout_t layout;
+  qoob_compose_t compose;
+  FILE *msg = stdout;
+  int line;
+  int entry;
+  int slots = 0;
+  int fd;
+  int i;
+  qoob_error_t err;
+
+  if (strcmp (flasher->image_file, "-") == 0)
+    msg = stderr;
+
+  err = qoob_layout_load (&layout, flasher->layout_file, &line);
+  if (err != QOOB_ERROR_OK) {
+    if (line > 0) {
+      fprintf (msg, "Error: %s:%d: %s\n", 
+               flasher->layout_file, line, qoob_error_to_string (err));
+    } else {
+      fprintf (msg, "Error: %s: %s\n", 
+               flasher->layout_file, qoob_error_to_string (err));
+    }
+    return 1;
+  }
+
+  err = qoob_compose_init (&compose);
+  if (err != QOOB_ERROR_OK) {
+    fprintf (msg, "Error: %s\n", qoob_error_to_string (err));
+    qoob_layout_free (&layout);
+    return 1;
+  }
+
+  err = qoob_compose_layout (&compose, &flasher->qoob, &layout, &entry);
+  if (err != QOOB_ERROR_OK) {
+    if (entry >= 0) {
+      fprintf (msg, "Error: [%02d] %s: %s\n", 
+               layout.entries[entry].slot,
+               layout.entries[entry].file,
+               qoob_error_to_string (err));
+    } else {
+      fprintf (msg, "Error: %s\n", qoob_error_to_string (err));
+    }
+    qoob_compose_free (&compose);
+    qoob_layout_free (&layout);
+    return 1;
+  }
+
+  if (msg == stderr) {
+    fd = STDOUT_FILENO;
+  } else {
+    fd = open (flasher->image_file, 
+               (O_WRONLY|O_CREAT|O_TRUNC), 
+               (S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH));
+  }
+  if (fd < 0) {
+    err = QOOB_ERROR_FD_OPEN;
+  } else {
+    err = qoob_compose_save_fd (&compose, fd);
+    if (fd != STDOUT_FILENO && close (fd) == -1 && err == QOOB_ERROR_OK)
+      err = QOOB_ERROR_FD_WRITE;
+  }
+  if (err != QOOB_ERROR_OK) {
+    fprintf (msg, "Error: %s: %s\n", 
+             flasher->image_file, qoob_error_to_string (err));
+    qoob_compose_free (&compose);
+    qoob_layout_free (&layout);
+    return 1;
+  }
+
+  if (flasher->verbose > 0) {
     for (i=0; i<QOOB_PRO_SLOTS; i++) {
-      printf (" [%02d]\t",i);
-
-      if (slots[i].type == QOOB_BINARY_TYPE_GCB) {
-        printf ("[GCB]\t");
-      } else if (slots[i].type == QOOB_BINARY_TYPE_ELF) {
-        printf ("[ELF]\t");
-      } else if (slots[i].type == QOOB_BINARY_TYPE_DOL) {
-        printf ("[DOL]\t");
-      } else if (slots[i].type == QOOB_BINARY_TYPE_CONFIG) {
-        printf ("[CFG]\t");
-      } else {
-        printf ("\t");
-      }
-      printf ("%s\n",slots[i].name);
+      if (compose.used & (1UL << i))
+        slots++;
+    }
+    fprintf (msg, "%d application(s) in %d slot(s) of %d put to %s.\n",
+             layout.count, slots, QOOB_PRO_SLOTS, flasher->image_file);
+  }
+
+  qoob_compose_free (&compose);
+  qoob_layout_free (&layout);
+
+  return 0;
+}
+
+/*
+ * Every application, or the one at slot_num, is read to archive file. 
+ * Archive goes to out if it is given.
+ */
+static qoob_error_t
+backup_archive (qoob_flasher_t *flasher, int out)
+{
+  qoob_archive_t archive;
+  short int from = 0;
+  short int to = QOOB_PRO_SLOTS-1;
+  int fd = out;
+  int slots = 0;
+  int i;
+  qoob_error_t ret;
+
+  if (flasher->slot_num >= 0) {
+    if (flasher->slots[flasher->slot_num].first != QOOB_TRUE ||
+        flasher->slots[flasher->slot_num].slots_used == 0) {
+      return QOOB_ERROR_SLOT_NOT_FIRST;
+    }
+    from = to = flasher->slot_num;
+  }
+
+  if (fd < 0) {
+    fd = open (flasher->file, 
+               (O_WRONLY|O_CREAT|O_TRUNC), 
+               (S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH));
+    if (fd < 0) {
+      return QOOB_ERROR_FD_OPEN;
+    }
+  }
+
+  ret = qoob_archive_create (&archive, fd);
+  if (ret == QOOB_ERROR_OK)
+    ret = qoob_sync_usb_backup (&flasher->qoob, &archive, from, to);
+  if (ret == QOOB_ERROR_OK)
+    ret = qoob_archive_finish (&archive);
+
+  if (fd != out && close (fd) == -1 && ret == QOOB_ERROR_OK)
+    ret = QOOB_ERROR_FD_WRITE;
+  if (ret != QOOB_ERROR_OK) {
+    return ret;
+  }
+
+  if (flasher->verbose > 0) {
+    for (i=0; i<QOOB_PRO_SLOTS; i++) {
+      if (archive.slot[i].present == QOOB_TRUE)
+        slots++;
+    }
+    printf ("%d slot(s) saved to %s in %lu bytes.\n", 
+            slots, 
+            flasher->file, 
+            archive.offset);
+  }
+
+  return QOOB_ERROR_OK;
+}
+
+/* Every application of the archive, or the one at slot_num, is written */
+static qoob_error_t
+restore_archive (qoob_flasher_t *flasher)
+{
+  qoob_archive_t archive;
+  int fd;
+  int i;
+  qoob_error_t ret;
+
+  fd = open (flasher->file, O_RDONLY);
+  if (fd < 0) {
+    return QOOB_ERROR_FD_OPEN;
+  }
+
+  ret = qoob_archive_open (&archive, fd);
+  for (i=0; i<QOOB_PRO_SLOTS && ret == QOOB_ERROR_OK; i++) {
+    if (flasher->slot_num >= 0 && i != flasher->slot_num)
+      continue;
+    if (flasher->slot_num < 0 && 
+        (archive.slot[i].present != QOOB_TRUE || archive.slot[i].app != i))
+      continue;
+
+    if (flasher->verbose > 0) {
+      printf ("Restoring [%02d] from %s.\n", i, flasher->file);
+      fflush (stdout);
+    }
+    ret = qoob_sync_usb_restore (&flasher->qoob, &archive, (short int)i);
+  }
+  close (fd);
+
+  return ret;
+}
+
+/*
+ * Config slot is read once. Gets are printed and sets applied in order
+ * and slot is written once at the end if some value changed.
+ */
+static qoob_error_t
+edit_config (qoob_flasher_t *flasher)
+{
+  qoob_config_t *config;
+  int i;
+  qoob_error_t ret;
+
+  config = (qoob_config_t *)malloc (sizeof (qoob_config_t));
+  if (config == NULL) {
+    return QOOB_ERROR_NO_MEMORY;
+  }
+
+  ret = qoob_sync_usb_config_read (&flasher->qoob, config);
+  for (i=0; i<flasher->config_count && ret == QOOB_ERROR_OK; i++) {
+    qoob_config_key_t key;
+    char *arg = flasher->config_args[i];
+    char *eq = strchr (arg, '=');
+    unsigned long value;
+
+    if (eq != NULL)
+      *eq = '\0';
+    ret = qoob_config_key_parse (arg, &key);
+    if (ret == QOOB_ERROR_OK && eq == NULL) {
+      ret = qoob_config_get (config, &key, &value);
+      if (ret == QOOB_ERROR_OK)
+        printf ("%s=0x%0*lx\n", arg, key.width*2, value);
+    } else if (ret == QOOB_ERROR_OK) {
+      char *end;
+
+      value = strtoul (eq+1, &end, 0);
+      if (*(eq+1) == '\0' || *end != '\0')
+        ret = QOOB_ERROR_INPUT_NOT_VALID;
+      else
+        ret = qoob_config_set (config, &key, value);
+    }
+    if (eq != NULL)
+      *eq = '=';
+  }
 
-      if ( ((i+1)%8) == 0)
-        printf ("\n");
+  if (ret == QOOB_ERROR_OK && config->changed == QOOB_TRUE) {
+    if (flasher->verbose > 0) {
+      printf ("Writing config at slot [%02d].\n", config->slot);
+      fflush (stdout);
     }
+    ret = qoob_sync_usb_config_write (&flasher->qoob, config);
+  } else if (ret == QOOB_ERROR_OK && flasher->verbose > 0) {
+    printf ("Config at slot [%02d] is not changed.\n", config->slot);
+  }
+  free (config);
+
+  return ret;
+}
+
+/* Slots which stopped command finished */
+static void
+print_completed (qoob_flasher_t *flasher)
+{
+  unsigned long completed;
+  int i;
+
+  if (qoob_sync_completed_get (&flasher->qoob, &completed) != QOOB_ERROR_OK)
+    return;
+
+  printf ("Completed slots:");
+  for (i=0; i<QOOB_PRO_SLOTS; i++) {
+    if (completed & (1UL << i))
+      printf (" [%02d]", i);
+  }
+  printf (completed == 0 ? " none\n" : "\n");
+}
+
+/*
+ * Time of every phase with its share of profiled time. Other is time
+ * between phases, e.g. session commands and work of qoob-flasher.
+ */
+static void
+print_profile (qoob_flasher_t *flasher)
+{
+  qoob_profile_t *profile = flasher->profile;
+  long total[QOOB_PHASE_COUNT];
+  int count[QOOB_PHASE_COUNT];
+  long slot_total[QOOB_PRO_SLOTS][QOOB_PHASE_COUNT];
+  long wall = 0;
+  long phases = 0;
+  int i;
+  int p;
+
+  memset (total, 0, sizeof (total));
+  memset (count, 0, sizeof (count));
+  memset (slot_total, 0, sizeof (slot_total));
+
+  for (i=0; i<profile->count; i++) {
+    qoob_profile_event_t *e = &profile->events[i];
+
+    total[e->phase] += e->duration;
+    count[e->phase]++;
+    if (e->slot >= 0 && e->slot < QOOB_PRO_SLOTS)
+      slot_total[e->slot][e->phase] += e->duration;
+    if (e->start + e->duration > wall)
+      wall = e->start + e->duration;
+  }
+
+  printf ("\nProfile in ms:\n");
+  printf (" Phase\t  Count\t     Total\t      Mean\t Share\n");
+  for (p=0; p<QOOB_PHASE_COUNT; p++) {
+    if (count[p] == 0)
+      continue;
+    phases += total[p];
+    printf (" %s\t%7d\t%10.2f\t%10.2f\t%5.1f%%\n",
+            qoob_profile_phase_to_string ((qoob_phase_t)p),
+            count[p],
+            total[p] / 1000.0,
+            total[p] / 1000.0 / count[p],
+            wall > 0 ? total[p] * 100.0 / wall : 0.0);
+  }
+  printf (" other\t       \t%10.2f\t          \t%5.1f%%\n",
+          (wall - phases) / 1000.0,
+          wall > 0 ? (wall - phases) * 100.0 / wall : 0.0);
+  printf (" total\t       \t%10.2f\n", wall / 1000.0);
+
+  /* Slot rows only for slot phases which were done */
+  printf ("\n Slot");
+  for (p=QOOB_PHASE_LIST; p<QOOB_PHASE_COUNT; p++) {
+    if (p != QOOB_PHASE_LOAD && p != QOOB_PHASE_HEADER && count[p] > 0)
+      printf ("\t%10s", qoob_profile_phase_to_string ((qoob_phase_t)p));
+  }
+  printf ("\n");
+  for (i=0; i<QOOB_PRO_SLOTS; i++) {
+    qoob_boolean_t used = QOOB_FALSE;
+
+    for (p=0; p<QOOB_PHASE_COUNT; p++) {
+      if (slot_total[i][p] > 0)
+        used = QOOB_TRUE;
+    }
+    if (used == QOOB_FALSE)
+      continue;
+
+    printf (" [%02d]", i);
+    for (p=QOOB_PHASE_LIST; p<QOOB_PHASE_COUNT; p++) {
+      if (p != QOOB_PHASE_LOAD && p != QOOB_PHASE_HEADER && count[p] > 0)
+        printf ("\t%10.2f", slot_total[i][p] / 1000.0);
+    }
+    printf ("\n");
+  }
+
+  if (profile->dropped > 0) {
+    printf ("%d event(s) did not fit to profile.\n", profile->dropped);
+  }
+
+  if (flasher->trace_file != NULL) {
+    qoob_error_t err;
+
+    err = qoob_profile_trace_save (profile, flasher->trace_file);
+    if (err != QOOB_ERROR_OK) {
+      printf ("Warning: %s: %s\n", 
+              flasher->trace_file, qoob_error_to_string (err));
+    } else {
+      printf ("Trace saved to %s.\n", flasher->trace_file);
+    }
+  }
+}
+
+/*
+ * Waiting for other program is told via callback. Ctrl-C ends device 
+ * session cleanly, second one kills.
+ */
+static void
+catch_signals (qoob_flasher_t *flasher)
+{
+  struct sigaction sa;
+
+  qoob_sync_set_callback (&flasher->qoob, qoob_callback, flasher);
+
+  cancel_token = &flasher->cancel;
+  qoob_sync_cancel_set (&flasher->qoob, &flasher->cancel);
+  memset (&sa, 0, sizeof (sa));
+  sa.sa_handler = on_signal;
+  sa.sa_flags = SA_RESTART | SA_RESETHAND;
+  sigemptyset (&sa.sa_mask);
+  sigaction (SIGINT, &sa, NULL);
+  sigaction (SIGTERM, &sa, NULL);
+}
+
+static void
+on_signal (int sig)
+{
+  qoob_cancel_request (cancel_token);
+}
+
+/* Startup time before any transfer is done */
+static void
+print_open (qoob_flasher_t *flasher)
+{
+  qoob_transfer_t transfer;
+  const qoob_transport_t *transport;
+
+  if (qoob_sync_transfer_get (&flasher->qoob, &transfer) != QOOB_ERROR_OK)
+    return;
+  transport = qoob_transport_get (transfer.transport);
+
+  printf ("Device found in %.1f ms and opened in %.1f ms using %s "
+          "transport.\n",
+          transfer.discover_time / 1000.0,
+          transfer.open_time / 1000.0,
+          transport != NULL ? transport->name : "unknown");
+}
+
+/* Time used and transport helps to compare usbfs and libusb */
+static void
+print_transfer (qoob_flasher_t *flasher, struct timeval *start)
+{
+  struct timeval now;
+  qoob_transfer_t transfer;
+  const qoob_transport_t *transport;
+  double seconds;
+
+  gettimeofday (&now, NULL);
+  seconds = (now.tv_sec - start->tv_sec) + 
+    (now.tv_usec - start->tv_usec) / 1000000.0;
+
+  if (qoob_sync_transfer_get (&flasher->qoob, &transfer) != QOOB_ERROR_OK)
+    return;
+  transport = qoob_transport_get (transfer.transport);
+
+  printf ("Transfer took %.2f seconds using %s transport. "
+          "Latency %d us, %d retries.\n",
+          seconds,
+          transport != NULL ? transport->name : "unknown",
+          transfer.srtt,
+          transfer.retried);
+}
+
+static qoob_error_t
+format_from_index (qoob_flasher_t *flasher)
+{
+  const qoob_index_entry_t *e;
+  binary_type_t type;
+  qoob_error_t ret;
+
+  ret = qoob_index_lookup (&flasher->index, flasher->file, &e);
+  if (ret != QOOB_ERROR_OK) {
+    return ret;
+  }
+
+  if (flasher->verbose > 0) {
+    char digest[QOOB_DIGEST_STRING_SIZE];
+
+    qoob_digest_to_string (e->digest, digest);
+    printf ("Index: %s [%s] '%s' %d slot(s) sha256 %s\n",
+            e->path,
+            qoob_file_format_to_string (e->type),
+            e->name,
+            e->slots_used,
+            digest);
+  }
+
+  /* Format given by user wins */
+  qoob_sync_file_format_get (&flasher->qoob, &type);
+  if (type == QOOB_BINARY_TYPE_VOID) {
+    type = e->type;
+    if (type == QOOB_BINARY_TYPE_CONFIG)
+      type = QOOB_BINARY_TYPE_GCB;
+    qoob_sync_file_format_set (&flasher->qoob, type);
+  }
+  if (type == QOOB_BINARY_TYPE_VOID) {
+    return QOOB_ERROR_NOT_SUPPORTED_FILE_FORMAT;
+  }
+
+  if (flasher->slot_num + e->slots_used > QOOB_PRO_SLOTS) {
+    return QOOB_ERROR_TOO_BIG_DATA;
+  }
+
+  return QOOB_ERROR_OK;
 }
 
 static int total_slots = -1;
@@ -250,6 +1018,50 @@ qoob_callback (qoob_sync_callback_t type,
 {
   qoob_flasher_t *flasher = (qoob_flasher_t *)user_data;
 
+  /* Slot savings are shown with -v */
+  if (type == QOOB_SYNC_CALLBACK_MINIMIZE) {
+    if (flasher->verbose > 0) {
+      printf ("Minimized: %d slot(s) instead of %d. %d slot(s) saved.\n",
+              progress, total, total-progress);
+    }
+    return;
+  }
+
+  if (type == QOOB_SYNC_CALLBACK_LOCK_WAIT) {
+    if (flasher->verbose > 0) {
+      qoob_lock_holder_t holder;
+
+      if (qoob_sync_usb_holder (&flasher->qoob, &holder) == QOOB_ERROR_OK) {
+        printf ("Device is used by %s (pid %d). Waiting",
+                holder.name, progress);
+      } else if (progress == 0) {
+        /* Held by other user, see qoob-lock.h */
+        printf ("Device is used by another user. Waiting");
+      } else {
+        printf ("Device is used by pid %d. Waiting", progress);
+      }
+      printf (". %d before this one.\n", total);
+      fflush (stdout);
+    }
+    return;
+  }
+
+  if (type == QOOB_SYNC_CALLBACK_RETRY) {
+    if (flasher->verbose > 0) {
+      printf ("\nTransfer failed. Retrying slot [%02d]. %d retries so far.\n",
+              progress, total);
+      fflush (stdout);
+    }
+    return;
+  }
+
+  if (type == QOOB_SYNC_CALLBACK_SPARSE) {
+    if (flasher->verbose > 0) {
+      printf ("\nSparse write: %d of %d packets skipped.\n", progress, total);
+    }
+    return;
+  }
+
   if (flasher->verbose < 2) {
     return;
   }
@@ -335,6 +1147,43 @@ qoob_callback (qoob_sync_callback_t type,
   fflush (stdout);
 }
 
+/*
+ * Reads image from stdin. Format is detected from content if it is not
+ * given.
+ */
+static qoob_error_t
+stdin_load (qoob_flasher_t *flasher,
+            char **data,
+            size_t *size)
+{
+  binary_type_t type;
+  qoob_error_t ret;
+
+  ret = qoob_image_load_fd (STDIN_FILENO, data, size);
+  if (ret != QOOB_ERROR_OK) {
+    return ret;
+  }
+
+  qoob_sync_file_format_get (&flasher->qoob, &type);
+  if (type == QOOB_BINARY_TYPE_VOID) {
+    qoob_file_format_parse_buffer (*data, *size, *size, &type);
+    if (type == QOOB_BINARY_TYPE_CONFIG)
+      type = QOOB_BINARY_TYPE_GCB;
+    if (type == QOOB_BINARY_TYPE_VOID) {
+      return QOOB_ERROR_NOT_SUPPORTED_FILE_FORMAT;
+    }
+    qoob_sync_file_format_set (&flasher->qoob, type);
+  }
+
+  if (flasher->verbose > 0) {
+    fprintf (stderr, "Read %lu bytes of %s from stdin.\n", 
+             (unsigned long)*size,
+             qoob_file_format_to_string (type));
+  }
+
+  return QOOB_ERROR_OK;
+}
+
 static int
 flasher_init (qoob_flasher_t *flasher)
 {
@@ -345,7 +1194,22 @@ flasher_init (qoob_flasher_t *flasher)
   flasher->command = FLASHER_COMMAND_LIST;
   flasher->slot_num = -1;
   flasher->file = NULL;
+  flasher->index_file = NULL;
+  flasher->scan_dir = NULL;
+  flasher->socket = flasherd_proto_socket ();
+  flasher->layout_file = NULL;
+  flasher->batch_file = NULL;
+  flasher->image_file = NULL;
+  flasher->device_path = NULL;
+  flasher->trace_file = NULL;
+  flasher->config_args = NULL;
+  flasher->config_count = 0;
   flasher->slots = NULL;
+  flasher->profile = NULL;
+  clock_gettime (CLOCK_MONOTONIC, &flasher->started);
+
+  memset (&flasher->index, 0, sizeof (flasher->index));
+  qoob_cancel_init (&flasher->cancel);
 
   /* Impossible situatioons */
   flasher->erase_from = 32;
@@ -353,6 +1217,10 @@ flasher_init (qoob_flasher_t *flasher)
 
   flasher->help = QOOB_FALSE;
   flasher->list = QOOB_FALSE;
+  flasher->watch = QOOB_FALSE;
+  flasher->daemon = QOOB_TRUE;
+  flasher->daemon_fd = -1;
+  flasher->priority = 0;
   flasher->verbose = 0;
   
   return 0;
@@ -361,13 +1229,54 @@ flasher_init (qoob_flasher_t *flasher)
 static void
 flasher_deinit (qoob_flasher_t *flasher)
 {
+  if (flasher->profile != NULL) {
+    print_profile (flasher);
+    free (flasher->profile);
+    flasher->profile = NULL;
+  }
+
   qoob_sync_slot_free (flasher->slots);
+  flasher->slots = NULL;
   qoob_sync_deinit (&flasher->qoob);
 
+  if (flasher->daemon_fd >= 0) {
+    close (flasher->daemon_fd);
+  }
+  flasher->daemon_fd = -1;
+
   if (flasher->file != NULL) {
     free (flasher->file);
   }
   flasher->file = NULL;
+
+  if (flasher->index.file != NULL) {
+    if (qoob_index_save (&flasher->index) != QOOB_ERROR_OK) {
+      fprintf (stderr, "Warning: could not save image index.\n");
+    }
+    qoob_index_close (&flasher->index);
+  }
+  free (flasher->index_file);
+  free (flasher->scan_dir);
+  free (flasher->socket);
+  free (flasher->layout_file);
+  free (flasher->batch_file);
+  free (flasher->image_file);
+  free (flasher->device_path);
+  free (flasher->trace_file);
+  flasher->index_file = NULL;
+  flasher->scan_dir = NULL;
+  flasher->socket = NULL;
+  flasher->layout_file = NULL;
+  flasher->batch_file = NULL;
+  flasher->image_file = NULL;
+  flasher->device_path = NULL;
+  flasher->trace_file = NULL;
+
+  while (flasher->config_count > 0) {
+    free (flasher->config_args[--flasher->config_count]);
+  }
+  free (flasher->config_args);
+  flasher->config_args = NULL;
 }
 
 /* Emacs indentatation information
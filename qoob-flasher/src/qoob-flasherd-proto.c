@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+/*
+ * Socket path and peer check shared by qoob-flasherd and its clients.
+ */
+
+/* struct ucred */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <qoob.h>
+
+#include "qoob-flasherd-proto.h"
+
+/*
+ * FLASHERD_SOCKET_NAME in runtime dir of the user. NULL if user has no
+ * private runtime directory.
+ */
+char *
+flasherd_proto_socket (void)
+{
+  char dir[QOOB_LOCK_PATH_SIZE];
+  char path[QOOB_LOCK_PATH_SIZE + sizeof (FLASHERD_SOCKET_NAME) + 1];
+
+  if (qoob_lock_runtime_dir (dir, sizeof (dir)) != QOOB_ERROR_OK) {
+    return NULL;
+  }
+  snprintf (path, sizeof (path), "%s%c%s", 
+            dir, QOOB_DIRECTORY_SEPARATOR, FLASHERD_SOCKET_NAME);
+
+  return strdup (path);
+}
+
+/* Other end of connected socket is run by the same user */
+qoob_boolean_t
+flasherd_proto_peer_is_user (int fd)
+{
+#ifdef SO_PEERCRED
+  struct ucred cred;
+  socklen_t len = sizeof (cred);
+
+  if (getsockopt (fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+    return QOOB_FALSE;
+  }
+
+  return cred.uid == geteuid () ? QOOB_TRUE : QOOB_FALSE;
+#else
+  uid_t uid;
+  gid_t gid;
+
+  if (getpeereid (fd, &uid, &gid) != 0) {
+    return QOOB_FALSE;
+  }
+
+  return uid == geteuid () ? QOOB_TRUE : QOOB_FALSE;
+#endif
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
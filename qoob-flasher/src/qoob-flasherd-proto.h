@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+/*
+ * Protocol between qoob-flasherd and its clients. 
+ *
+ * Socket is FLASHERD_SOCKET_NAME in qoob_lock_runtime_dir () of the user,
+ * so other users can not reach it. Both ends check with peer credentials
+ * that the other one is run by the same user. Client connects to the 
+ * socket and sends one request line:
+ *
+ *   COMMAND PRIORITY SLOT SLOT_TO TYPE MINIMIZE SPARSE FILE
+ *
+ * Numbers are decimal. TYPE, MINIMIZE and SPARSE are values of
+ * binary_type_t, qoob_minimize_t and qoob_boolean_t. FILE is the rest of 
+ * the line and it is absolute path or '-' if command has no file. Jobs with
+ * bigger PRIORITY are run first, same priority in arrival order.
+ *
+ * Daemon answers with lines:
+ *
+ *   QUEUED POSITION                 jobs before this one
+ *   PROGRESS TYPE PROGRESS TOTAL    libqoob callback
+ *   SLOT NUM TYPE SLOTS_USED FIRST LENGTH DIGEST NAME
+ *   OK
+ *   ERROR QOOB_ERROR
+ *
+ * LENGTH and DIGEST are payload length and hex digest from the slot 
+ * header, or 0 and '-' if header has no digest. Slot table is sent after
+ * every job. Connection is closed after OK or 
+ * ERROR. PROGRESS lines which do not fit in the socket are dropped, and 
+ * client which does not read other lines in time is disconnected. Job of
+ * a client which disconnects before the job starts is not run.
+ */
+
+#ifndef _QOOB_FLASHERD_PROTO_H_
+#define _QOOB_FLASHERD_PROTO_H_
+
+#include <qoob.h>
+
+#define FLASHERD_SOCKET_NAME "qoob-flasherd.socket"
+#define FLASHERD_LINE_MAX 4096
+#define FLASHERD_NO_FILE "-"
+
+#define FLASHERD_REQ_LIST "LIST"
+#define FLASHERD_REQ_READ "READ"
+#define FLASHERD_REQ_WRITE "WRITE"
+#define FLASHERD_REQ_ERASE "ERASE"
+#define FLASHERD_REQ_FORCE_ERASE "FORCE_ERASE"
+#define FLASHERD_REQ_VERIFY "VERIFY"
+
+#define FLASHERD_REP_QUEUED "QUEUED"
+#define FLASHERD_REP_PROGRESS "PROGRESS"
+#define FLASHERD_REP_SLOT "SLOT"
+#define FLASHERD_REP_OK "OK"
+#define FLASHERD_REP_ERROR "ERROR"
+
+char *flasherd_proto_socket (void);
+qoob_boolean_t flasherd_proto_peer_is_user (int fd);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
@@ -0,0 +1,902 @@
+/*
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+/*
+ * qoob-flasherd keeps Qoob Pro claimed and slot table in memory. Jobs come
+ * from clients over UNIX socket (see qoob-flasherd-proto.h) and are run
+ * one at a time in priority order. New clients are accepted also while job
+ * is running so they get their place in the queue.
+ */
+
+/* POLLRDHUP */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <getopt.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <qoob.h>
+
+#include "qoob-flasherd-proto.h"
+
+#define FLASHERD_MAX_CLIENTS 64
+#define FLASHERD_WRITE_TIMEOUT 1000 /* ms, client has to read in time */
+
+typedef enum {
+  FLASHERD_COMMAND_LIST,
+  FLASHERD_COMMAND_READ,
+  FLASHERD_COMMAND_WRITE,
+  FLASHERD_COMMAND_ERASE,
+  FLASHERD_COMMAND_FORCE_ERASE,
+  FLASHERD_COMMAND_VERIFY
+} flasherd_command_t;
+
+typedef struct FlasherdClient flasherd_client_t;
+struct FlasherdClient
+{
+  int fd;
+  char line[FLASHERD_LINE_MAX];
+  size_t len;
+  flasherd_client_t *next;
+};
+
+typedef struct FlasherdJob flasherd_job_t;
+struct FlasherdJob
+{
+  int fd;
+  flasherd_command_t command;
+  int priority;
+  unsigned long serial;       /* Arrival order inside same priority */
+  short int slot;
+  short int slot_to;
+  binary_type_t type;
+  qoob_minimize_t minimize;
+  qoob_boolean_t sparse;
+  char *file;
+  flasherd_job_t *next;
+};
+
+typedef struct Flasherd flasherd_t;
+struct Flasherd
+{
+  qoob_t qoob;
+  qoob_slot_t *slots;
+  qoob_boolean_t connected;
+  qoob_boolean_t lost;        /* Device was closed after error */
+
+  char *socket_path;
+  int listen_fd;
+  int clients_count;
+  flasherd_client_t *clients; /* Request line not yet read */
+  flasherd_job_t *queue;      /* Sorted, first one is run next */
+  flasherd_job_t *current;
+  unsigned long serial;
+
+  qoob_boolean_t foreground;
+  unsigned int verbose;
+};
+
+static volatile sig_atomic_t quit = 0;
+
+static void print_help_and_exit (int e);
+static void signal_handler (int sig);
+static int listen_socket (flasherd_t *d);
+static void service (flasherd_t *d, int timeout);
+static void accept_client (flasherd_t *d);
+static void read_client (flasherd_t *d, flasherd_client_t *client);
+static void remove_client (flasherd_t *d, flasherd_client_t *client);
+static flasherd_job_t *parse_request (const char *line);
+static void enqueue (flasherd_t *d, flasherd_job_t *job);
+static void job_free (flasherd_job_t *job);
+static qoob_boolean_t client_gone (int fd);
+static qoob_error_t device_open (flasherd_t *d);
+static void device_close (flasherd_t *d);
+static qoob_error_t run_job (flasherd_t *d, flasherd_job_t *job);
+static void send_slots (flasherd_t *d, int *fd);
+static void reply (int *fd, qoob_boolean_t droppable, const char *fmt, ...)
+  __attribute__ ((format (printf, 3, 4)));
+static void callback (qoob_sync_callback_t type,
+                      int progress,
+                      int total,
+                      void *user_data);
+
+int
+main (int argc, char **argv)
+{
+  flasherd_t d;
+  struct sigaction sa;
+  qoob_error_t ret;
+
+  memset (&d, 0, sizeof (d));
+  d.listen_fd = -1;
+  d.socket_path = flasherd_proto_socket ();
+
+  while (1) {
+    static struct option long_options[] = {
+      {"help", no_argument, 0, 'h'},
+      {"verbose", no_argument, 0, 'v'},
+      {"foreground", no_argument, 0, 'F'},
+      {"socket", required_argument, 0, 'k'},
+      {0, 0, 0, 0}
+    };
+    int index = 0;
+    int c = getopt_long (argc, argv, "hvFk:", long_options, &index);
+
+    if (c == -1)
+      break;
+
+    switch (c) {
+    case 'h':
+      print_help_and_exit (0);
+      break;
+    case 'v':
+      d.verbose++;
+      break;
+    case 'F':
+      d.foreground = QOOB_TRUE;
+      break;
+    case 'k':
+      free (d.socket_path);
+      d.socket_path = strdup (optarg);
+      break;
+    default:
+      print_help_and_exit (1);
+      break;
+    }
+  }
+
+  if (d.socket_path == NULL) {
+    fprintf (stderr, "Error: no private runtime directory, use -k.\n");
+    return 1;
+  }
+
+  if (qoob_sync_init (&d.qoob) != QOOB_ERROR_OK) {
+    fprintf (stderr, "Error: init qoob library.\n");
+    free (d.socket_path);
+    return 1;
+  }
+
+  /* Device has to be there at start. Later it is opened again if lost. */
+  ret = device_open (&d);
+  if (ret != QOOB_ERROR_OK) {
+    fprintf (stderr, "Error: %s\n", qoob_error_to_string (ret));
+    qoob_sync_deinit (&d.qoob);
+    return 1;
+  }
+
+  if (listen_socket (&d) != 0) {
+    device_close (&d);
+    qoob_sync_deinit (&d.qoob);
+    return 1;
+  }
+
+  memset (&sa, 0, sizeof (sa));
+  sa.sa_handler = signal_handler;
+  sigaction (SIGINT, &sa, NULL);
+  sigaction (SIGTERM, &sa, NULL);
+  sa.sa_handler = SIG_IGN;
+  sigaction (SIGPIPE, &sa, NULL);
+
+  if (d.foreground == QOOB_FALSE && daemon (0, 0) != 0) {
+    fprintf (stderr, "Error: could not start daemon.\n");
+    quit = 1;
+  }
+
+  while (!quit) {
+    flasherd_job_t *job;
+
+    /* Wait only if there is nothing to do */
+    service (&d, d.queue != NULL ? 0 : -1);
+
+    job = d.queue;
+    if (job == NULL) {
+      continue;
+    }
+    d.queue = job->next;
+
+    /* Client stopped while waiting, e.g. with Ctrl-C. Started job is 
+       finished anyway. */
+    if (client_gone (job->fd) == QOOB_TRUE) {
+      if (d.verbose > 0 && d.foreground == QOOB_TRUE) {
+        printf ("Job %lu: client has gone, dropped\n", job->serial);
+        fflush (stdout);
+      }
+      job_free (job);
+      continue;
+    }
+
+    d.current = job;
+    ret = run_job (&d, job);
+    d.current = NULL;
+
+    if (d.verbose > 0 && d.foreground == QOOB_TRUE) {
+      printf ("Job %lu: %s\n", job->serial, qoob_error_to_string (ret));
+      fflush (stdout);
+    }
+
+    send_slots (&d, &job->fd);
+    if (ret == QOOB_ERROR_OK) {
+      reply (&job->fd, QOOB_FALSE, FLASHERD_REP_OK "\n");
+    } else {
+      reply (&job->fd, QOOB_FALSE, FLASHERD_REP_ERROR " %d\n", (int)ret);
+    }
+    job_free (job);
+  }
+
+  while (d.clients != NULL) {
+    remove_client (&d, d.clients);
+  }
+  while (d.queue != NULL) {
+    flasherd_job_t *job = d.queue;
+    d.queue = job->next;
+    job_free (job);
+  }
+
+  close (d.listen_fd);
+  unlink (d.socket_path);
+  free (d.socket_path);
+
+  device_close (&d);
+  qoob_sync_deinit (&d.qoob);
+
+  return 0;
+}
+
+static void
+print_help_and_exit (int e)
+{
+  printf ("Usage: qoob-flasherd [OPTION]...\n");
+  printf ("Keeps Qoob Pro open and runs qoob-flasher jobs from a queue.\n\n");
+
+  printf ("  -h, --help               display this help and exits\n");
+  printf ("  -v, --verbose            print finished jobs in foreground\n");
+  printf ("  -F, --foreground         do not detach from terminal\n");
+  printf ("  -k, --socket=PATH        listen PATH instead of %s in\n"
+          "                           $XDG_RUNTIME_DIR or /tmp/qoob-UID\n",
+          FLASHERD_SOCKET_NAME);
+  printf ("\n");
+  printf ("See also the man page.\n\n");
+
+  exit (e);
+}
+
+static void
+signal_handler (int sig)
+{
+  quit = 1;
+}
+
+static int
+listen_socket (flasherd_t *d)
+{
+  struct sockaddr_un addr;
+  mode_t mask;
+  int fd;
+
+  if (strlen (d->socket_path) >= sizeof (addr.sun_path)) {
+    fprintf (stderr, "Error: socket path is too long.\n");
+    return 1;
+  }
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, d->socket_path);
+
+  fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror ("socket");
+    return 1;
+  }
+
+  /* Socket is stale only if nobody answers */
+  if (connect (fd, (struct sockaddr *)&addr, sizeof (addr)) == 0) {
+    fprintf (stderr, "Error: qoob-flasherd is already running at %s.\n",
+             d->socket_path);
+    close (fd);
+    return 1;
+  }
+  close (fd);
+  unlink (d->socket_path);
+
+  fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror ("socket");
+    return 1;
+  }
+
+  /* Only owner may flash */
+  mask = umask (077);
+  if (bind (fd, (struct sockaddr *)&addr, sizeof (addr)) != 0) {
+    umask (mask);
+    perror ("bind");
+    close (fd);
+    return 1;
+  }
+  umask (mask);
+
+  if (listen (fd, 8) != 0) {
+    perror ("listen");
+    close (fd);
+    unlink (d->socket_path);
+    return 1;
+  }
+
+  d->listen_fd = fd;
+
+  return 0;
+}
+
+/*
+ * Accepts new clients and reads their requests. Timeout is milliseconds
+ * as in poll (). 
+ */
+static void
+service (flasherd_t *d, int timeout)
+{
+  struct pollfd fds[FLASHERD_MAX_CLIENTS+1];
+  flasherd_client_t *client;
+  flasherd_client_t *next;
+  int n = 0;
+  int i;
+
+  fds[n].fd = d->listen_fd;
+  fds[n].events = POLLIN;
+  n++;
+
+  for (client = d->clients; client != NULL; client = client->next) {
+    fds[n].fd = client->fd;
+    fds[n].events = POLLIN;
+    n++;
+  }
+
+  if (poll (fds, n, timeout) <= 0) {
+    return;
+  }
+
+  /* Same order as in fds. New clients are added to the head of the list
+     so they are handled only after accept. */
+  i = 1;
+  for (client = d->clients; client != NULL; client = next) {
+    next = client->next;
+    if (fds[i++].revents != 0) {
+      read_client (d, client);
+    }
+  }
+
+  if (fds[0].revents & POLLIN) {
+    accept_client (d);
+  }
+}
+
+static void
+accept_client (flasherd_t *d)
+{
+  flasherd_client_t *client;
+  int fd;
+
+  fd = accept (d->listen_fd, NULL, NULL);
+  if (fd < 0) {
+    return;
+  }
+
+  if (flasherd_proto_peer_is_user (fd) == QOOB_FALSE) {
+    if (d->verbose > 0 && d->foreground == QOOB_TRUE) {
+      printf ("Client of other user refused\n");
+      fflush (stdout);
+    }
+    close (fd);
+    return;
+  }
+
+  /* Slow client must not stop the daemon, see reply () */
+  if (fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK) != 0) {
+    close (fd);
+    return;
+  }
+
+  if (d->clients_count >= FLASHERD_MAX_CLIENTS) {
+    reply (&fd, QOOB_FALSE, FLASHERD_REP_ERROR " %d\n", 
+           (int)QOOB_ERROR_NO_MEMORY);
+    if (fd >= 0) {
+      close (fd);
+    }
+    return;
+  }
+
+  client = calloc (1, sizeof (flasherd_client_t));
+  if (client == NULL) {
+    close (fd);
+    return;
+  }
+
+  client->fd = fd;
+  client->next = d->clients;
+  d->clients = client;
+  d->clients_count++;
+}
+
+static void
+read_client (flasherd_t *d, flasherd_client_t *client)
+{
+  flasherd_job_t *job;
+  flasherd_job_t *j;
+  char *nl;
+  ssize_t r;
+  int position;
+
+  r = read (client->fd, 
+            client->line + client->len, 
+            sizeof (client->line) - client->len - 1);
+  if (r < 0 && (errno == EAGAIN || errno == EINTR)) {
+    return;
+  }
+  if (r <= 0) {
+    remove_client (d, client);
+    return;
+  }
+  client->len += (size_t)r;
+  client->line[client->len] = '\0';
+
+  nl = strchr (client->line, '\n');
+  if (nl == NULL) {
+    if (client->len == sizeof (client->line) - 1) {
+      reply (&client->fd, QOOB_FALSE, FLASHERD_REP_ERROR " %d\n", 
+             (int)QOOB_ERROR_INPUT_NOT_VALID);
+      remove_client (d, client);
+    }
+    return;
+  }
+  *nl = '\0';
+
+  job = parse_request (client->line);
+  if (job == NULL) {
+    reply (&client->fd, QOOB_FALSE, FLASHERD_REP_ERROR " %d\n", 
+           (int)QOOB_ERROR_INPUT_NOT_VALID);
+    remove_client (d, client);
+    return;
+  }
+
+  /* Connection belongs to the job now */
+  job->fd = client->fd;
+  job->serial = ++d->serial;
+  client->fd = -1;
+  remove_client (d, client);
+
+  enqueue (d, job);
+
+  position = d->current != NULL ? 1 : 0;
+  for (j = d->queue; j != job; j = j->next) {
+    position++;
+  }
+  reply (&job->fd, QOOB_FALSE, FLASHERD_REP_QUEUED " %d\n", position);
+}
+
+static void
+remove_client (flasherd_t *d, flasherd_client_t *client)
+{
+  flasherd_client_t **p;
+
+  for (p = &d->clients; *p != NULL; p = &(*p)->next) {
+    if (*p == client) {
+      *p = client->next;
+      break;
+    }
+  }
+
+  if (client->fd >= 0) {
+    close (client->fd);
+  }
+  free (client);
+  d->clients_count--;
+}
+
+static flasherd_job_t *
+parse_request (const char *line)
+{
+  static const struct {
+    const char *name;
+    flasherd_command_t command;
+  } commands[] = {
+    {FLASHERD_REQ_LIST, FLASHERD_COMMAND_LIST},
+    {FLASHERD_REQ_READ, FLASHERD_COMMAND_READ},
+    {FLASHERD_REQ_WRITE, FLASHERD_COMMAND_WRITE},
+    {FLASHERD_REQ_ERASE, FLASHERD_COMMAND_ERASE},
+    {FLASHERD_REQ_FORCE_ERASE, FLASHERD_COMMAND_FORCE_ERASE},
+    {FLASHERD_REQ_VERIFY, FLASHERD_COMMAND_VERIFY},
+  };
+  flasherd_job_t *job;
+  char name[16];
+  int type, minimize, sparse;
+  int n = 0;
+  int i;
+
+  job = calloc (1, sizeof (flasherd_job_t));
+  if (job == NULL) {
+    return NULL;
+  }
+
+  if (sscanf (line, "%15s %d %hd %hd %d %d %d %n",
+              name,
+              &job->priority,
+              &job->slot,
+              &job->slot_to,
+              &type,
+              &minimize,
+              &sparse,
+              &n) != 7 || n == 0 || line[n] == '\0') {
+    free (job);
+    return NULL;
+  }
+
+  for (i=0; i<sizeof (commands)/sizeof (commands[0]); i++) {
+    if (strcmp (name, commands[i].name) == 0)
+      break;
+  }
+  if (i == sizeof (commands)/sizeof (commands[0])) {
+    free (job);
+    return NULL;
+  }
+
+  job->command = commands[i].command;
+  job->type = (binary_type_t)type;
+  job->minimize = (qoob_minimize_t)minimize;
+  job->sparse = sparse ? QOOB_TRUE : QOOB_FALSE;
+
+  if (strcmp (line+n, FLASHERD_NO_FILE) != 0) {
+    /* Daemon does not know working directory of the client */
+    if (line[n] != QOOB_DIRECTORY_SEPARATOR) {
+      free (job);
+      return NULL;
+    }
+    job->file = strdup (line+n);
+  }
+
+  return job;
+}
+
+/* Bigger priority first. Same priority in arrival order. */
+static void
+enqueue (flasherd_t *d, flasherd_job_t *job)
+{
+  flasherd_job_t **p;
+
+  for (p = &d->queue; *p != NULL; p = &(*p)->next) {
+    if ((*p)->priority < job->priority)
+      break;
+  }
+
+  job->next = *p;
+  *p = job;
+}
+
+static void
+job_free (flasherd_job_t *job)
+{
+  if (job->fd >= 0) {
+    close (job->fd);
+  }
+  free (job->file);
+  free (job);
+}
+
+/* Client has closed the connection. Nothing is read from it. */
+static qoob_boolean_t
+client_gone (int fd)
+{
+  struct pollfd pfd;
+  char c;
+
+  if (fd < 0) {
+    return QOOB_TRUE;
+  }
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+#ifdef POLLRDHUP
+  pfd.events |= POLLRDHUP;
+#endif
+  pfd.revents = 0;
+
+  if (poll (&pfd, 1, 0) <= 0) {
+    return QOOB_FALSE;
+  }
+
+#ifdef POLLRDHUP
+  if (pfd.revents & POLLRDHUP) {
+    return QOOB_TRUE;
+  }
+#endif
+  if (pfd.revents & (POLLHUP | POLLERR)) {
+    return QOOB_TRUE;
+  }
+
+  /* End of file is readable too */
+  if ((pfd.revents & POLLIN) && recv (fd, &c, 1, MSG_PEEK) == 0) {
+    return QOOB_TRUE;
+  }
+
+  return QOOB_FALSE;
+}
+
+static qoob_error_t
+device_open (flasherd_t *d)
+{
+  qoob_error_t ret;
+
+  /* Bus list is read again in case device was plugged in again */
+  if (d->lost == QOOB_TRUE) {
+    qoob_sync_deinit (&d->qoob);
+    if (qoob_sync_init (&d->qoob) != QOOB_ERROR_OK) {
+      return QOOB_ERROR_NOT_FOUND;
+    }
+  }
+
+  qoob_sync_set_callback (&d->qoob, callback, d);
+
+  ret = qoob_sync_usb_find (&d->qoob);
+  if (ret != QOOB_ERROR_OK) {
+    return ret;
+  }
+
+  qoob_sync_slot_free (d->slots);
+  d->slots = NULL;
+
+  ret = qoob_sync_usb_list (&d->qoob, &d->slots);
+  if (ret != QOOB_ERROR_OK) {
+    qoob_sync_usb_clear (&d->qoob);
+    return ret;
+  }
+
+  d->connected = QOOB_TRUE;
+
+  return QOOB_ERROR_OK;
+}
+
+static void
+device_close (flasherd_t *d)
+{
+  qoob_sync_usb_clear (&d->qoob);
+  d->connected = QOOB_FALSE;
+  d->lost = QOOB_TRUE;
+}
+
+static qoob_error_t
+run_job (flasherd_t *d, flasherd_job_t *job)
+{
+  qoob_boolean_t modifies = QOOB_FALSE;
+  qoob_error_t ret;
+
+  if (d->connected == QOOB_FALSE) {
+    ret = device_open (d);
+    if (ret != QOOB_ERROR_OK) {
+      return ret;
+    }
+  }
+
+  qoob_sync_file_format_set (&d->qoob, job->type);
+  qoob_sync_minimize_set (&d->qoob, job->minimize);
+  qoob_sync_sparse_set (&d->qoob, job->sparse);
+
+  switch (job->command) {
+  case FLASHERD_COMMAND_LIST:
+    /* Slot table is kept up to date */
+    ret = QOOB_ERROR_OK;
+    break;
+  case FLASHERD_COMMAND_READ:
+    ret = qoob_sync_usb_read (&d->qoob, job->file, job->slot);
+    break;
+  case FLASHERD_COMMAND_WRITE:
+    ret = qoob_sync_usb_write (&d->qoob, job->file, job->slot);
+    modifies = QOOB_TRUE;
+    break;
+  case FLASHERD_COMMAND_ERASE:
+    ret = qoob_sync_usb_erase (&d->qoob, job->slot);
+    modifies = QOOB_TRUE;
+    break;
+  case FLASHERD_COMMAND_FORCE_ERASE:
+    ret = qoob_sync_usb_erase_forced (&d->qoob, job->slot, job->slot_to);
+    modifies = QOOB_TRUE;
+    break;
+  case FLASHERD_COMMAND_VERIFY:
+    ret = qoob_sync_usb_verify_header (&d->qoob, job->file, job->slot);
+    if (ret == QOOB_ERROR_DIGEST_MISSING) {
+      ret = qoob_sync_usb_verify (&d->qoob, job->file, job->slot);
+    }
+    break;
+  default:
+    ret = QOOB_ERROR_INPUT_NOT_VALID;
+    break;
+  }
+
+  /* Device is opened again for the next job */
+  if (ret == QOOB_ERROR_DEVICE_UNKNOWN1 ||
+      ret == QOOB_ERROR_SEND_DATA ||
+      ret == QOOB_ERROR_RECEIVE_DATA ||
+      ret == QOOB_ERROR_DEVICE_HANDLE_NOT_VALID) {
+    device_close (d);
+    return ret;
+  }
+
+  if (modifies == QOOB_TRUE) {
+    qoob_error_t lret;
+
+    qoob_sync_slot_free (d->slots);
+    d->slots = NULL;
+
+    lret = qoob_sync_usb_list (&d->qoob, &d->slots);
+    if (lret != QOOB_ERROR_OK) {
+      device_close (d);
+      if (ret == QOOB_ERROR_OK) {
+        ret = lret;
+      }
+    }
+  }
+
+  return ret;
+}
+
+static void
+send_slots (flasherd_t *d, int *fd)
+{
+  int i;
+
+  if (d->slots == NULL) {
+    return;
+  }
+
+  for (i=0; i<QOOB_PRO_SLOTS; i++) {
+    char name[sizeof (d->slots[i].name)];
+    char *p;
+    char digest[QOOB_DIGEST_STRING_SIZE] = FLASHERD_NO_FILE;
+
+    memcpy (name, d->slots[i].name, sizeof (name));
+    name[sizeof (name)-1] = '\0';
+
+    /* Name ends the line */
+    for (p = name; *p != '\0'; p++) {
+      if (*p == '\n' || *p == '\r')
+        *p = ' ';
+    }
+
+    if (d->slots[i].has_digest == QOOB_TRUE) {
+      qoob_digest_to_string (d->slots[i].digest, digest);
+    }
+
+    reply (fd, QOOB_FALSE, FLASHERD_REP_SLOT " %d %d %d %d %lu %s %s\n",
+           i,
+           (int)d->slots[i].type,
+           (int)d->slots[i].slots_used,
+           (int)d->slots[i].first,
+           d->slots[i].has_digest == QOOB_TRUE ? d->slots[i].length : 0,
+           digest,
+           name);
+  }
+}
+
+/*
+ * Client may have gone while job ran. Sockets do not block: 
+ * droppable line is left out if none of it fits, others wait at most 
+ * FLASHERD_WRITE_TIMEOUT. Client which does not read in time is 
+ * disconnected and fd is set to -1, so lines are always whole.
+ */
+static void
+reply (int *fd, qoob_boolean_t droppable, const char *fmt, ...)
+{
+  char line[FLASHERD_LINE_MAX];
+  va_list ap;
+  size_t sent = 0;
+  int n;
+
+  if (*fd < 0) {
+    return;
+  }
+
+  va_start (ap, fmt);
+  n = vsnprintf (line, sizeof (line), fmt, ap);
+  va_end (ap);
+
+  if (n < 0) {
+    return;
+  }
+  if (n >= sizeof (line)) {
+    n = sizeof (line) - 1;
+  }
+
+  while (sent < (size_t)n) {
+    struct pollfd pfd;
+    ssize_t w;
+
+    w = write (*fd, line + sent, (size_t)n - sent);
+    if (w > 0) {
+      sent += (size_t)w;
+      continue;
+    }
+    if (w < 0 && errno == EINTR) {
+      continue;
+    }
+    if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      if (sent == 0 && droppable == QOOB_TRUE) {
+        return;
+      }
+
+      pfd.fd = *fd;
+      pfd.events = POLLOUT;
+      if (poll (&pfd, 1, FLASHERD_WRITE_TIMEOUT) > 0) {
+        continue;
+      }
+    }
+
+    /* Gone or fallen behind */
+    close (*fd);
+    *fd = -1;
+    return;
+  }
+}
+
+static void
+callback (qoob_sync_callback_t type,
+          int progress,
+          int total,
+          void *user_data)
+{
+  flasherd_t *d = (flasherd_t *)user_data;
+
+  /* Progress is not worth waiting */
+  if (d->current != NULL) {
+    reply (&d->current->fd, QOOB_TRUE, FLASHERD_REP_PROGRESS " %d %d %d\n",
+           (int)type, progress, total);
+  }
+
+  /* Queue keeps growing while long job runs */
+  switch (type) {
+  case QOOB_SYNC_CALLBACK_READ_SLOT:
+  case QOOB_SYNC_CALLBACK_WRITE_SLOT:
+  case QOOB_SYNC_CALLBACK_ERASE:
+  case QOOB_SYNC_CALLBACK_LIST:
+    service (d, 0);
+    break;
+  default:
+    break;
+  }
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
@@ -0,0 +1,736 @@
+/*
+ * Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#define FUSE_USE_VERSION 26
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <fuse.h>
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <qoob.h>
+
+/* 
+ * Mounts Qoob Pro flash as a directory. Each application is a file 
+ * "SLOT-NAME.gcb" with content of its slots, same as qoob-flasher -r
+ * gives. Reads transfer only half slots they touch and those are cached
+ * by libqoob. New files are kept in memory and flashed to free slots when
+ * closed. Removing file erases the application.
+ */
+
+#define FILE_NAME_SIZE (QOOB_GCB_NAME_SIZE+16)
+
+/* Slot 0 has bios. It is used only when asked with "00-" name. */
+#define FIRST_FREE_SLOT 1
+
+/* New file which is flashed when it is closed */
+typedef struct QoobFuseFile qoob_fuse_file_t;
+struct QoobFuseFile
+{
+  char *name;                 /* Without leading slash */
+  char *data;
+  size_t size;
+  qoob_fuse_file_t *next;
+};
+
+typedef struct QoobFuse qoob_fuse_t;
+struct QoobFuse
+{
+  qoob_t qoob;
+  qoob_fuse_file_t *files;
+  time_t mounted;
+};
+
+static qoob_fuse_t fs;
+
+static void slot_file_name (int slot, 
+                            char *name, 
+                            size_t size);
+static int slot_from_path (const char *path);
+static qoob_fuse_file_t *file_find (const char *path);
+static void file_remove (qoob_fuse_file_t *file);
+static int file_resize (qoob_fuse_file_t *file, 
+                        size_t size);
+static int file_flash (qoob_fuse_file_t *file);
+static int free_slot (const char *name, 
+                      int needed);
+static qoob_boolean_t slot_used (int slot);
+static const qoob_app_t *app_at (int slot);
+static int list_slots (void);
+static int error_to_errno (qoob_error_t err);
+
+static int
+qoob_fuse_getattr (const char *path, 
+                   struct stat *st)
+{
+  qoob_fuse_file_t *file;
+  int slot;
+
+  memset (st, 0, sizeof (*st));
+  st->st_uid = getuid ();
+  st->st_gid = getgid ();
+  st->st_atime = st->st_mtime = st->st_ctime = fs.mounted;
+
+  if (strcmp (path, "/") == 0) {
+    st->st_mode = S_IFDIR | 0755;
+    st->st_nlink = 2;
+    return 0;
+  }
+
+  slot = slot_from_path (path);
+  if (slot >= 0) {
+    st->st_mode = S_IFREG | 0644;
+    st->st_nlink = 1;
+    st->st_size = (off_t)app_at (slot)->slots_used*QOOB_PRO_SLOT_SIZE;
+    st->st_blksize = QOOB_PRO_SLOT_SIZE/2;    /* Half slot is read at once */
+    st->st_blocks = st->st_size/512;
+    return 0;
+  }
+
+  file = file_find (path);
+  if (file != NULL) {
+    st->st_mode = S_IFREG | 0644;
+    st->st_nlink = 1;
+    st->st_size = (off_t)file->size;
+    return 0;
+  }
+
+  return -ENOENT;
+}
+
+static int
+qoob_fuse_readdir (const char *path, 
+                   void *buf, 
+                   fuse_fill_dir_t filler,
+                   off_t offset, 
+                   struct fuse_file_info *fi)
+{
+  char name[FILE_NAME_SIZE];
+  qoob_fuse_file_t *file;
+  const qoob_table_t *table = qoob_sync_table_get (&fs.qoob);
+  const qoob_app_t *app;
+
+  if (strcmp (path, "/") != 0) {
+    return -ENOENT;
+  }
+
+  filler (buf, ".", NULL, 0);
+  filler (buf, "..", NULL, 0);
+
+  for (app = qoob_table_next (table, NULL); 
+       app != NULL; 
+       app = qoob_table_next (table, app)) {
+    if (app->type == QOOB_BINARY_TYPE_VOID)
+      continue;
+
+    slot_file_name (app->slot, name, sizeof (name));
+    filler (buf, name, NULL, 0);
+  }
+
+  for (file = fs.files; file != NULL; file = file->next) {
+    filler (buf, file->name, NULL, 0);
+  }
+
+  return 0;
+}
+
+static int
+qoob_fuse_open (const char *path, 
+                struct fuse_file_info *fi)
+{
+  if (slot_from_path (path) >= 0) {
+    /* Flashed applications are replaced by removing and copying */
+    if ((fi->flags & O_ACCMODE) != O_RDONLY) {
+      return -EACCES;
+    }
+    return 0;
+  }
+
+  if (file_find (path) != NULL) {
+    return 0;
+  }
+
+  return -ENOENT;
+}
+
+static int
+qoob_fuse_read (const char *path, 
+                char *buf, 
+                size_t size, 
+                off_t offset,
+                struct fuse_file_info *fi)
+{
+  qoob_fuse_file_t *file;
+  qoob_error_t err;
+  size_t total;
+  int slot;
+
+  slot = slot_from_path (path);
+  if (slot < 0) {
+    file = file_find (path);
+    if (file == NULL) {
+      return -ENOENT;
+    }
+    if ((size_t)offset >= file->size) {
+      return 0;
+    }
+    if (size > file->size - (size_t)offset)
+      size = file->size - (size_t)offset;
+    memcpy (buf, file->data+offset, size);
+    return (int)size;
+  }
+
+  total = (size_t)app_at (slot)->slots_used*QOOB_PRO_SLOT_SIZE;
+  if ((size_t)offset >= total) {
+    return 0;
+  }
+  if (size > total - (size_t)offset)
+    size = total - (size_t)offset;
+
+  err = qoob_sync_usb_read_range (&fs.qoob, 
+                                  (unsigned long)slot*QOOB_PRO_SLOT_SIZE + 
+                                    (unsigned long)offset,
+                                  buf, 
+                                  size);
+  if (err != QOOB_ERROR_OK) {
+    return error_to_errno (err);
+  }
+
+  return (int)size;
+}
+
+static int
+qoob_fuse_create (const char *path, 
+                  mode_t mode, 
+                  struct fuse_file_info *fi)
+{
+  qoob_fuse_file_t *file;
+
+  if (slot_from_path (path) >= 0 || file_find (path) != NULL) {
+    return -EEXIST;
+  }
+
+  /* No directories */
+  if (strchr (path+1, '/') != NULL || 
+      strlen (path+1) >= FILE_NAME_SIZE) {
+    return -EACCES;
+  }
+
+  file = (qoob_fuse_file_t *)calloc (1, sizeof (qoob_fuse_file_t));
+  if (file == NULL) {
+    return -ENOMEM;
+  }
+  file->name = strdup (path+1);
+  if (file->name == NULL) {
+    free (file);
+    return -ENOMEM;
+  }
+
+  file->next = fs.files;
+  fs.files = file;
+
+  return 0;
+}
+
+static int
+qoob_fuse_write (const char *path, 
+                 const char *buf, 
+                 size_t size,
+                 off_t offset, 
+                 struct fuse_file_info *fi)
+{
+  qoob_fuse_file_t *file;
+  int ret;
+
+  file = file_find (path);
+  if (file == NULL) {
+    return slot_from_path (path) >= 0 ? -EACCES : -ENOENT;
+  }
+
+  if ((size_t)offset + size > file->size) {
+    ret = file_resize (file, (size_t)offset + size);
+    if (ret != 0) {
+      return ret;
+    }
+  }
+  memcpy (file->data+offset, buf, size);
+
+  return (int)size;
+}
+
+static int
+qoob_fuse_truncate (const char *path, 
+                    off_t size)
+{
+  qoob_fuse_file_t *file;
+
+  file = file_find (path);
+  if (file == NULL) {
+    return slot_from_path (path) >= 0 ? -EACCES : -ENOENT;
+  }
+
+  return file_resize (file, (size_t)size);
+}
+
+static int
+qoob_fuse_ftruncate (const char *path, 
+                     off_t size,
+                     struct fuse_file_info *fi)
+{
+  return qoob_fuse_truncate (path, size);
+}
+
+/* Closing new file flashes it. Error is returned to close (). */
+static int
+qoob_fuse_flush (const char *path, 
+                 struct fuse_file_info *fi)
+{
+  qoob_fuse_file_t *file;
+  int ret;
+
+  file = file_find (path);
+  if (file == NULL || file->size == 0) {
+    return 0;
+  }
+
+  ret = file_flash (file);
+  file_remove (file);
+
+  return ret;
+}
+
+static int
+qoob_fuse_unlink (const char *path)
+{
+  qoob_fuse_file_t *file;
+  qoob_error_t err;
+  int slot;
+
+  file = file_find (path);
+  if (file != NULL) {
+    file_remove (file);
+    return 0;
+  }
+
+  slot = slot_from_path (path);
+  if (slot < 0) {
+    return -ENOENT;
+  }
+
+  err = qoob_sync_usb_erase (&fs.qoob, (short int)slot);
+  if (err != QOOB_ERROR_OK) {
+    list_slots ();
+    return error_to_errno (err);
+  }
+
+  return list_slots ();
+}
+
+static int
+qoob_fuse_utimens (const char *path, 
+                   const struct timespec tv[2])
+{
+  if (strcmp (path, "/") == 0 ||
+      slot_from_path (path) >= 0 || 
+      file_find (path) != NULL) {
+    return 0;
+  }
+
+  return -ENOENT;
+}
+
+/* Block is a slot */
+static int
+qoob_fuse_statfs (const char *path, 
+                  struct statvfs *st)
+{
+  int i;
+
+  memset (st, 0, sizeof (*st));
+  st->f_bsize = QOOB_PRO_SLOT_SIZE;
+  st->f_frsize = QOOB_PRO_SLOT_SIZE;
+  st->f_blocks = QOOB_PRO_SLOTS;
+  st->f_namemax = FILE_NAME_SIZE-1;
+
+  for (i=0; i<QOOB_PRO_SLOTS; i++) {
+    if (slot_used (i) == QOOB_FALSE) {
+      st->f_bfree++;
+      st->f_bavail++;
+    }
+  }
+
+  return 0;
+}
+
+static void
+qoob_fuse_destroy (void *data)
+{
+  while (fs.files != NULL) {
+    fprintf (stderr, "Warning: %s was not flashed.\n", fs.files->name);
+    file_remove (fs.files);
+  }
+}
+
+static struct fuse_operations qoob_fuse_operations;
+
+int
+main (int argc, char **argv)
+{
+  char **args;
+  qoob_error_t err;
+  int ret;
+  int i;
+
+  for (i=1; i<argc; i++) {
+    if (strcmp (argv[i], "-h") == 0 || strcmp (argv[i], "--help") == 0) {
+      printf ("Usage: qoob-fuse MOUNTPOINT [FUSE OPTIONS]...\n");
+      printf ("Mounts Qoob Pro flash. Unmount with fusermount -u.\n\n");
+      return fuse_main (argc, argv, &qoob_fuse_operations, NULL);
+    }
+  }
+
+  qoob_fuse_operations.getattr = qoob_fuse_getattr;
+  qoob_fuse_operations.readdir = qoob_fuse_readdir;
+  qoob_fuse_operations.open = qoob_fuse_open;
+  qoob_fuse_operations.read = qoob_fuse_read;
+  qoob_fuse_operations.create = qoob_fuse_create;
+  qoob_fuse_operations.write = qoob_fuse_write;
+  qoob_fuse_operations.truncate = qoob_fuse_truncate;
+  qoob_fuse_operations.ftruncate = qoob_fuse_ftruncate;
+  qoob_fuse_operations.flush = qoob_fuse_flush;
+  qoob_fuse_operations.unlink = qoob_fuse_unlink;
+  qoob_fuse_operations.utimens = qoob_fuse_utimens;
+  qoob_fuse_operations.statfs = qoob_fuse_statfs;
+  qoob_fuse_operations.destroy = qoob_fuse_destroy;
+
+  if (qoob_sync_init (&fs.qoob) != QOOB_ERROR_OK) {
+    fprintf (stderr, "Error: init qoob library.\n");
+    return 1;
+  }
+  fs.files = NULL;
+  fs.mounted = time (NULL);
+
+  /* Mount fails at once if other program uses the device */
+  qoob_sync_lock_timeout_set (&fs.qoob, 0);
+
+  err = qoob_sync_usb_find (&fs.qoob);
+  if (err != QOOB_ERROR_OK) {
+    qoob_lock_holder_t holder;
+
+    printf ("Error: %s\n", qoob_error_to_string (err));
+    if (err == QOOB_ERROR_LOCK_TIMEOUT &&
+        qoob_sync_usb_holder (&fs.qoob, &holder) == QOOB_ERROR_OK) {
+      printf ("Device is held by %s (pid %d).\n", 
+              holder.name, 
+              (int)holder.pid);
+    }
+    qoob_sync_deinit (&fs.qoob);
+    return 1;
+  }
+
+  if (list_slots () != 0) {
+    printf ("Error: listing slots.\n");
+    qoob_sync_deinit (&fs.qoob);
+    return 1;
+  }
+
+  /* libusb-0.1 is not thread safe. Run single threaded. */
+  args = (char **)malloc (sizeof (char *) * (argc+2));
+  if (args == NULL) {
+    qoob_sync_deinit (&fs.qoob);
+    return 1;
+  }
+  memcpy (args, argv, sizeof (char *) * argc);
+  args[argc] = "-s";
+  args[argc+1] = NULL;
+
+  ret = fuse_main (argc+1, args, &qoob_fuse_operations, NULL);
+
+  free (args);
+  qoob_sync_deinit (&fs.qoob);
+
+  return ret;
+}
+
+/* Static functions */
+
+/* "03-Name.gcb". Characters which are hard to use in shell are replaced. */
+static void
+slot_file_name (int slot, 
+                char *name, 
+                size_t size)
+{
+  const char *app = qoob_table_app_name (qoob_sync_table_get (&fs.qoob),
+                                         app_at (slot));
+  size_t len;
+  size_t i;
+
+  while (*app == ' ')
+    app++;
+  len = strlen (app);
+  while (len > 0 && isspace ((unsigned char)app[len-1]))
+    len--;
+  if (len > QOOB_GCB_NAME_SIZE)
+    len = QOOB_GCB_NAME_SIZE;
+
+  snprintf (name, size, "%02d-%.*s.gcb", slot, (int)len, app);
+
+  for (i=3; name[i] != '\0'; i++) {
+    unsigned char c = (unsigned char)name[i];
+
+    if (!isalnum (c) && c != '.' && c != '-' && c != '_')
+      name[i] = '_';
+  }
+}
+
+/* Slot of the flashed application or -1 */
+static int
+slot_from_path (const char *path)
+{
+  char name[FILE_NAME_SIZE];
+  const qoob_app_t *app;
+  int slot;
+
+  if (path[0] != '/' ||
+      !isdigit ((unsigned char)path[1]) || 
+      !isdigit ((unsigned char)path[2]) ||
+      path[3] != '-') {
+    return -1;
+  }
+
+  slot = (path[1]-'0')*10 + (path[2]-'0');
+  app = app_at (slot);
+  if (app == NULL ||
+      app->slot != slot ||
+      app->type == QOOB_BINARY_TYPE_VOID) {
+    return -1;
+  }
+
+  slot_file_name (slot, name, sizeof (name));
+  if (strcmp (name, path+1) != 0) {
+    return -1;
+  }
+
+  return slot;
+}
+
+static qoob_fuse_file_t *
+file_find (const char *path)
+{
+  qoob_fuse_file_t *file;
+
+  for (file = fs.files; file != NULL; file = file->next) {
+    if (strcmp (file->name, path+1) == 0)
+      return file;
+  }
+
+  return NULL;
+}
+
+static void
+file_remove (qoob_fuse_file_t *file)
+{
+  qoob_fuse_file_t **p;
+
+  for (p = &fs.files; *p != NULL; p = &(*p)->next) {
+    if (*p == file) {
+      *p = file->next;
+      break;
+    }
+  }
+
+  free (file->name);
+  free (file->data);
+  free (file);
+}
+
+/* Flash is the limit. Gaps are zero. */
+static int
+file_resize (qoob_fuse_file_t *file, 
+             size_t size)
+{
+  char *data;
+
+  if (size > QOOB_PRO_TOTAL_SIZE) {
+    return -EFBIG;
+  }
+
+  data = (char *)realloc (file->data, size > 0 ? size : 1);
+  if (data == NULL) {
+    return -ENOMEM;
+  }
+  if (size > file->size) {
+    memset (data+file->size, 0, size - file->size);
+  }
+  file->data = data;
+  file->size = size;
+
+  return 0;
+}
+
+static int
+file_flash (qoob_fuse_file_t *file)
+{
+  binary_type_t type;
+  const char *name = file->name;
+  qoob_error_t err;
+  int slot;
+
+  qoob_file_format_parse_buffer (file->data, file->size, file->size, &type);
+  if (type == QOOB_BINARY_TYPE_CONFIG)
+    type = QOOB_BINARY_TYPE_GCB;
+  if (type == QOOB_BINARY_TYPE_VOID) {
+    return -EINVAL;
+  }
+
+  slot = free_slot (name, qoob_file_slots_needed (type, file->size));
+  if (slot < 0) {
+    return -ENOSPC;
+  }
+
+  /* Application name is not prefixed with slot */
+  if (isdigit ((unsigned char)name[0]) && 
+      isdigit ((unsigned char)name[1]) && 
+      name[2] == '-') {
+    name += 3;
+  }
+
+  qoob_sync_file_format_set (&fs.qoob, type);
+  err = qoob_sync_usb_write_buffer (&fs.qoob, 
+                                    name, 
+                                    file->data, 
+                                    file->size, 
+                                    (short int)slot);
+  list_slots ();
+  if (err != QOOB_ERROR_OK) {
+    fprintf (stderr, "Error: %s: %s\n", 
+             file->name, 
+             qoob_error_to_string (err));
+    return error_to_errno (err);
+  }
+
+  return 0;
+}
+
+/* 
+ * Name starting with "NN-" asks slot NN. Otherwise first free slots after
+ * bios are used.
+ */
+static int
+free_slot (const char *name, 
+           int needed)
+{
+  int first = FIRST_FREE_SLOT;
+  int last = QOOB_PRO_SLOTS - needed;
+  int slot;
+  int i;
+
+  if (isdigit ((unsigned char)name[0]) && 
+      isdigit ((unsigned char)name[1]) && 
+      name[2] == '-') {
+    first = (name[0]-'0')*10 + (name[1]-'0');
+    last = first;
+  }
+
+  for (slot = first; slot <= last; slot++) {
+    for (i=slot; i<slot+needed; i++) {
+      if (slot_used (i) == QOOB_TRUE)
+        break;
+    }
+    if (i == slot+needed) {
+      return slot;
+    }
+  }
+
+  return -1;
+}
+
+/* Application with unknown header can be written over from its first 
+   slot */
+static qoob_boolean_t
+slot_used (int slot)
+{
+  const qoob_app_t *app = app_at (slot);
+
+  if (app != NULL &&
+      (app->slot != slot || app->type != QOOB_BINARY_TYPE_VOID)) {
+    return QOOB_TRUE;
+  }
+  return QOOB_FALSE;
+}
+
+static const qoob_app_t *
+app_at (int slot)
+{
+  return qoob_table_app_at (qoob_sync_table_get (&fs.qoob), 
+                            (short int)slot);
+}
+
+static int
+list_slots (void)
+{
+  qoob_slot_t *slots = NULL;
+  qoob_error_t err;
+
+  err = qoob_sync_usb_list (&fs.qoob, &slots);
+  qoob_sync_slot_free (slots);
+
+  return err == QOOB_ERROR_OK ? 0 : error_to_errno (err);
+}
+
+static int
+error_to_errno (qoob_error_t err)
+{
+  switch (err) {
+  case QOOB_ERROR_OK:
+    return 0;
+  case QOOB_ERROR_NO_MEMORY:
+    return -ENOMEM;
+  case QOOB_ERROR_TOO_BIG_DATA:
+  case QOOB_ERROR_TRYING_TO_OVERWRITE:
+    return -ENOSPC;
+  case QOOB_ERROR_NOT_SUPPORTED_FILE_FORMAT:
+    return -EINVAL;
+  default:
+    break;
+  }
+  return -EIO;
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:2
+   c-set-offset:2
+   c-basic-offset:2
+   End:
+*/
+// vim: filetype=c:expandtab:shiftwidth=2:tabstop=2:softtabstop=2
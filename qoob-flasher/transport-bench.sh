@@ -0,0 +1,99 @@
+#!/bin/sh
+#
+# Copyright (C) 2018 Joni Valtanen <jvaltane@kapsi.fi>
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+# USA.
+#
+# Read and write throughput of transports:
+#
+#   transport-bench.sh SLOT FILE [ROUNDS [TRANSPORT]...]
+#
+# GCB FILE is written to SLOT and read back ROUNDS times (default 5) with
+# every TRANSPORT (default usbfs and libusb). Application at SLOT is erased
+# first and it is lost. Median of "Transfer took" times of qoob-flasher -v
+# is printed, so finding and opening the device are not counted.
+# QOOB_FLASHER gives the program, default is qoob-flasher in PATH.
+
+FLASHER=${QOOB_FLASHER:-qoob-flasher}
+
+if [ $# -lt 2 ]; then
+  echo "Usage: $0 SLOT FILE [ROUNDS [TRANSPORT]...]" >&2
+  exit 1
+fi
+
+slot=$1
+file=$2
+rounds=5
+shift 2
+if [ $# -gt 0 ]; then
+  rounds=$1
+  shift
+fi
+transports=${*:-usbfs libusb}
+
+out=$(mktemp) || exit 1
+trap 'rm -f "$out"' EXIT
+
+# Seconds of one command, nothing if it failed
+took () {
+  "$FLASHER" -n -v -T "$@" 2>/dev/null |
+    sed -n 's/^Transfer took \([0-9.]*\) seconds.*/\1/p'
+}
+
+# Median of numbers given one per line
+median () {
+  sort -n | awk '{ v[NR] = $1 }
+                 END { if (NR % 2) print v[(NR+1)/2];
+                       else print (v[NR/2] + v[NR/2+1]) / 2 }'
+}
+
+line () {
+  awk -v t="$1" -v op="$2" -v s="$3" -v b="$4" 'BEGIN {
+    printf "%-10s %-6s %8.2f %10.1f\n", t, op, s, (s > 0 ? b/1024/s : 0) }'
+}
+
+printf "%-10s %-6s %8s %10s\n" transport op seconds KB/s
+
+for t in $transports; do
+  writes=""
+  reads=""
+  i=0
+
+  while [ $i -lt "$rounds" ]; do
+    "$FLASHER" -n -T "$t" -e "$slot" >/dev/null 2>&1
+
+    s=$(took "$t" -q -w "$slot" "$file")
+    if [ -z "$s" ]; then
+      echo "Error: write with $t failed." >&2
+      exit 1
+    fi
+    writes="$writes $s"
+
+    s=$(took "$t" -r "$slot" "$out")
+    if [ -z "$s" ]; then
+      echo "Error: read with $t failed." >&2
+      exit 1
+    fi
+    reads="$reads $s"
+
+    i=$((i+1))
+  done
+
+  line "$t" write \
+    "$(echo $writes | tr ' ' '\n' | median)" "$(wc -c < "$file")"
+  line "$t" read \
+    "$(echo $reads | tr ' ' '\n' | median)" "$(wc -c < "$out")"
+done